@@ -86,6 +86,10 @@ namespace antlr4 {
     /// </summary>
     Token *_lastTokenBufferStart;
 
+    /// Keeps the token _lastToken/_lastTokenBufferStart point to alive once
+    /// it has been flushed from <seealso cref="#tokens"/>.
+    std::unique_ptr<Token> _lastTokenOwner;
+
     /// <summary>
     /// Absolute token index. It's the index of the token about to be read via
     /// {@code LT(1)}. Goes from 0 to the number of tokens in the entire stream,
@@ -14,6 +14,7 @@
 #include "atn/ActionTransition.h"
 #include "atn/TokensStartState.h"
 #include "misc/Interval.h"
+#include "misc/IntervalSet.h"
 #include "dfa/DFA.h"
 #include "Lexer.h"
 #include "internal/Synchronization.h"
@@ -174,7 +175,17 @@ size_t LexerATNSimulator::execATN(CharStream *input, dfa::DFAState *ds0) {
 dfa::DFAState *LexerATNSimulator::getExistingTargetState(dfa::DFAState *s, size_t t) {
   dfa::DFAState* retval = nullptr;
   SharedLock<SharedMutex> edgeLock(atn._edgeMutex);
-  if (t <= MAX_DFA_EDGE) {
+  if (t > MAX_DFA_EDGE) {
+    if (t > Lexer::MAX_CHAR_VALUE) { // EOF
+      return nullptr;
+    }
+    // Binary search the range edges for the one containing t.
+    auto iterator = std::upper_bound(s->rangeEdges.begin(), s->rangeEdges.end(), t,
+      [](size_t symbol, const dfa::DFAState::RangeEdge &edge) { return symbol < edge.from; });
+    if (iterator != s->rangeEdges.begin() && t <= std::prev(iterator)->to) {
+      retval = std::prev(iterator)->target;
+    }
+  } else {
     auto iterator = s->edges.find(t - MIN_DFA_EDGE);
 #if LEXER_DEBUG_ATN == 1
     if (iterator != s->edges.end()) {
@@ -515,7 +526,10 @@ dfa::DFAState *LexerATNSimulator::addDFAEdge(dfa::DFAState *from, size_t t, ATNC
 
 void LexerATNSimulator::addDFAEdge(dfa::DFAState *p, size_t t, dfa::DFAState *q) {
   if (/*t < MIN_DFA_EDGE ||*/ t > MAX_DFA_EDGE) { // MIN_DFA_EDGE is 0
-    // Only track edges within the DFA bounds
+    if (t > Lexer::MAX_CHAR_VALUE) { // EOF
+      return;
+    }
+    addDFARangeEdge(p, t, q);
     return;
   }
 
@@ -523,6 +537,43 @@ void LexerATNSimulator::addDFAEdge(dfa::DFAState *p, size_t t, dfa::DFAState *q)
   p->edges[t - MIN_DFA_EDGE] = q; // connect
 }
 
+void LexerATNSimulator::addDFARangeEdge(dfa::DFAState *p, size_t t, dfa::DFAState *q) {
+  // The reach set on t only depends on which transitions out of p's configs
+  // match t. Find the largest range around t where that doesn't change: it is
+  // bounded by the nearest interval endpoints of all transition labels.
+  size_t from = MAX_DFA_EDGE + 1;
+  size_t to = Lexer::MAX_CHAR_VALUE;
+  for (const auto &c : p->configs->configs) {
+    for (const auto &trans : c->state->transitions) {
+      if (trans->isEpsilon()) {
+        continue;
+      }
+      // label() returns by value; keep it alive while walking its intervals.
+      const misc::IntervalSet label = trans->label();
+      for (const misc::Interval &interval : label.getIntervals()) {
+        size_t a = static_cast<size_t>(interval.a);
+        size_t b = static_cast<size_t>(interval.b);
+        if (a <= t && t <= b) {
+          from = std::max(from, a);
+          to = std::min(to, b);
+        } else if (b < t) {
+          from = std::max(from, b + 1);
+        } else { // a > t
+          to = std::min(to, a - 1);
+        }
+      }
+    }
+  }
+
+  UniqueLock<SharedMutex> edgeLock(atn._edgeMutex);
+  auto iterator = std::upper_bound(p->rangeEdges.begin(), p->rangeEdges.end(), from,
+    [](size_t symbol, const dfa::DFAState::RangeEdge &edge) { return symbol < edge.from; });
+  if (iterator != p->rangeEdges.begin() && std::prev(iterator)->to >= from) {
+    return; // Another thread added this range already.
+  }
+  p->rangeEdges.insert(iterator, { from, to, q }); // connect
+}
+
 dfa::DFAState *LexerATNSimulator::addDFAState(ATNConfigSet *configs) {
   return addDFAState(configs, true);
 }
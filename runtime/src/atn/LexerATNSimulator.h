@@ -28,7 +28,7 @@ namespace atn {
 
   public:
     static constexpr size_t MIN_DFA_EDGE = 0;
-    static constexpr size_t MAX_DFA_EDGE = 127; // forces unicode to stay in ATN
+    static constexpr size_t MAX_DFA_EDGE = 127; // above this, edges are code point ranges
 
   protected:
     /// <summary>
@@ -169,6 +169,10 @@ namespace atn {
     virtual dfa::DFAState* addDFAEdge(dfa::DFAState *from, size_t t, ATNConfigSet *q);
     virtual void addDFAEdge(dfa::DFAState *p, size_t t, dfa::DFAState *q);
 
+    /// Adds an edge for a symbol above MAX_DFA_EDGE, covering the whole code point
+    /// range that behaves like {@code t} in state {@code p}.
+    void addDFARangeEdge(dfa::DFAState *p, size_t t, dfa::DFAState *q);
+
     /// <summary>
     /// Add a new DFA state if there isn't one with this set of
     /// configurations already. This method also detects the first
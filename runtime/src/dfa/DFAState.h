@@ -66,6 +66,17 @@ namespace dfa {
     //     Watch out: we no longer have the -1 offset, as it isn't needed anymore.
     FlatHashMap<size_t, DFAState*> edges;
 
+    /// Lexer edges for symbols above LexerATNSimulator::MAX_DFA_EDGE. Each entry
+    /// covers a code point range [from, to] over which every outgoing ATN
+    /// transition of this state matches uniformly, so one edge serves e.g. all
+    /// CJK characters inside a comment. Disjoint and sorted by {@code from}.
+    struct RangeEdge {
+      size_t from;
+      size_t to;
+      DFAState *target;
+    };
+    std::vector<RangeEdge> rangeEdges;
+
     /// if accept state, what ttype do we match or alt do we predict?
     /// This is set to <seealso cref="ATN#INVALID_ALT_NUMBER"/> when <seealso cref="#predicates"/>{@code !=null} or
     /// <seealso cref="#requiresFullContext"/>.
@@ -10,9 +10,80 @@
 
 #include "misc/IntervalSet.h"
 
+#include <bit>
+#include <mutex>
+
 using namespace antlr4;
 using namespace antlr4::misc;
 
+namespace {
+
+  using Bits = std::array<uint64_t, IntervalSet::SMALL_WORDS>;
+
+  // Sets bits for [a..b], clipped to the small window.
+  void setRange(Bits &bits, ssize_t a, ssize_t b) {
+    a = std::max(a, IntervalSet::SMALL_MIN);
+    b = std::min(b, IntervalSet::SMALL_MAX);
+    for (size_t w = 0; w < bits.size() && a <= b; ++w) {
+      ssize_t base = IntervalSet::SMALL_MIN + static_cast<ssize_t>(w * 64);
+      ssize_t lo = std::max(a, base);
+      ssize_t hi = std::min(b, base + 63);
+      if (lo > hi) {
+        continue;
+      }
+      bits[w] |= (~uint64_t(0) >> (63 - (hi - lo))) << (lo - base);
+    }
+  }
+
+  // Calls f(a, b) for every maximal run of set bits, in ascending order.
+  template <typename F>
+  void forEachRun(const Bits &bits, F &&f) {
+    ssize_t start = 0;
+    bool inRun = false;
+    for (size_t w = 0; w < bits.size(); ++w) {
+      uint64_t word = bits[w];
+      size_t i = 0;
+      while (i < 64) {
+        // Skip to the next bit that differs from the current run state.
+        uint64_t rest = (inRun ? ~word : word) >> i;
+        if (rest == 0) {
+          break;
+        }
+        i += static_cast<size_t>(std::countr_zero(rest));
+        ssize_t value = IntervalSet::SMALL_MIN + static_cast<ssize_t>(w * 64 + i);
+        if (inRun) {
+          f(start, value - 1);
+        } else {
+          start = value;
+        }
+        inRun = !inRun;
+      }
+    }
+    if (inRun) {
+      f(start, IntervalSet::SMALL_MAX);
+    }
+  }
+
+  Bits maskOf(const std::vector<Interval> &intervals) {
+    Bits mask {};
+    for (const auto &interval : intervals) {
+      if (interval.a > IntervalSet::SMALL_MAX) {
+        break;
+      }
+      setRange(mask, interval.a, interval.b);
+    }
+    return mask;
+  }
+
+  // Guards the lazy interval mirror of small sets. Contention is rare: the
+  // mirror is only needed by getIntervals() and the string conversions.
+  std::mutex& mirrorMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+}
+
 IntervalSet const IntervalSet::COMPLETE_CHAR_SET =
     IntervalSet::of(Lexer::MIN_CHAR_VALUE, Lexer::MAX_CHAR_VALUE);
 
@@ -22,35 +93,79 @@ IntervalSet::IntervalSet() : _intervals() {
 }
 
 IntervalSet::IntervalSet(const IntervalSet &set) : IntervalSet() {
-  _intervals = set._intervals;
+  *this = set;
 }
 
-IntervalSet::IntervalSet(IntervalSet&& set) : IntervalSet(std::move(set._intervals)) {
+IntervalSet::IntervalSet(IntervalSet&& set) : IntervalSet() {
+  *this = std::move(set);
 }
 
-IntervalSet::IntervalSet(std::vector<Interval>&& intervals) : _intervals(std::move(intervals)) {
+IntervalSet::IntervalSet(std::vector<Interval>&& intervals) : _intervals() {
+  if (intervals.empty() || fitsSmall(intervals.front().a, intervals.back().b)) {
+    for (const auto &interval : intervals) {
+      setRange(_bits, interval.a, interval.b);
+    }
+  } else {
+    _small = false;
+    _intervals = std::move(intervals);
+  }
 }
 
 IntervalSet& IntervalSet::operator=(const IntervalSet& other) {
-  _intervals = other._intervals;
+  if (this == &other) {
+    return *this;
+  }
+
+  _small = other._small;
+  _bits = other._bits;
+  invalidateMirror();
+  if (_small) {
+    _intervals.clear(); // The mirror is rebuilt on demand, no need to copy it.
+  } else {
+    _intervals = other._intervals;
+  }
   return *this;
 }
 
 IntervalSet& IntervalSet::operator=(IntervalSet&& other) {
+  if (this == &other) {
+    return *this;
+  }
+
+  _small = other._small;
+  _bits = other._bits;
+  _mirrorValid.store(other._mirrorValid.load(std::memory_order_relaxed), std::memory_order_relaxed);
   _intervals = std::move(other._intervals);
+  other.clear();
   return *this;
 }
 
 IntervalSet IntervalSet::of(ssize_t a) {
-  return IntervalSet({ Interval(a, a) });
+  return of(a, a);
 }
 
 IntervalSet IntervalSet::of(ssize_t a, ssize_t b) {
-  return IntervalSet({ Interval(a, b) });
+  IntervalSet result;
+  result.add(a, b);
+  return result;
 }
 
 void IntervalSet::clear() {
+  _small = true;
+  _bits = {};
+  invalidateMirror();
+  _intervals.clear();
+}
+
+void IntervalSet::toLarge() {
+  if (!_small) {
+    return;
+  }
+
   _intervals.clear();
+  forEachRun(_bits, [this](ssize_t a, ssize_t b) { _intervals.push_back(Interval(a, b)); });
+  _small = false;
+  invalidateMirror();
 }
 
 void IntervalSet::add(ssize_t el) {
@@ -66,6 +181,15 @@ void IntervalSet::add(const Interval &addition) {
     return;
   }
 
+  if (_small) {
+    if (fitsSmall(addition.a, addition.b)) {
+      setRange(_bits, addition.a, addition.b);
+      invalidateMirror();
+      return;
+    }
+    toLarge();
+  }
+
   // find position in list
   for (auto iterator = _intervals.begin(); iterator != _intervals.end(); ++iterator) {
     Interval r = *iterator;
@@ -119,6 +243,18 @@ IntervalSet IntervalSet::Or(const std::vector<IntervalSet> &sets) {
 }
 
 IntervalSet& IntervalSet::addAll(const IntervalSet &set) {
+  if (set._small) {
+    if (_small) {
+      for (size_t i = 0; i < SMALL_WORDS; ++i) {
+        _bits[i] |= set._bits[i];
+      }
+      invalidateMirror();
+    } else {
+      forEachRun(set._bits, [this](ssize_t a, ssize_t b) { add(Interval(a, b)); });
+    }
+    return *this;
+  }
+
   // walk set and add each interval
   for (auto const& interval : set._intervals) {
     add(interval);
@@ -149,11 +285,25 @@ IntervalSet IntervalSet::subtract(const IntervalSet &left, const IntervalSet &ri
   }
 
   IntervalSet result(left);
+  if (result._small) {
+    Bits mask = right._small ? right._bits : maskOf(right._intervals);
+    for (size_t i = 0; i < SMALL_WORDS; ++i) {
+      result._bits[i] &= ~mask[i];
+    }
+    return result;
+  }
+
+  std::vector<Interval> rightRuns;
+  if (right._small) {
+    forEachRun(right._bits, [&rightRuns](ssize_t a, ssize_t b) { rightRuns.push_back(Interval(a, b)); });
+  }
+  const std::vector<Interval> &rightIntervals = right._small ? rightRuns : right._intervals;
+
   size_t resultI = 0;
   size_t rightI = 0;
-  while (resultI < result._intervals.size() && rightI < right._intervals.size()) {
+  while (resultI < result._intervals.size() && rightI < rightIntervals.size()) {
     Interval &resultInterval = result._intervals[resultI];
-    const Interval &rightInterval = right._intervals[rightI];
+    const Interval &rightInterval = rightIntervals[rightI];
 
     // operation: (resultInterval - rightInterval) and update indexes
 
@@ -208,14 +358,23 @@ IntervalSet IntervalSet::subtract(const IntervalSet &left, const IntervalSet &ri
 }
 
 IntervalSet IntervalSet::Or(const IntervalSet &a) const {
-  IntervalSet result;
-  result.addAll(*this);
+  IntervalSet result(*this);
   result.addAll(a);
   return result;
 }
 
 IntervalSet IntervalSet::And(const IntervalSet &other) const {
   IntervalSet intersection;
+  if (_small || other._small) {
+    // The intersection is a subset of the small operand, so it is small too.
+    Bits mine = _small ? _bits : maskOf(_intervals);
+    Bits theirs = other._small ? other._bits : maskOf(other._intervals);
+    for (size_t i = 0; i < SMALL_WORDS; ++i) {
+      intersection._bits[i] = mine[i] & theirs[i];
+    }
+    return intersection;
+  }
+
   size_t i = 0;
   size_t j = 0;
 
@@ -265,6 +424,14 @@ bool IntervalSet::contains(size_t el) const {
 }
 
 bool IntervalSet::contains(ssize_t el) const {
+  if (_small) {
+    if (el < SMALL_MIN || el > SMALL_MAX) {
+      return false;
+    }
+    size_t bit = static_cast<size_t>(el - SMALL_MIN);
+    return (_bits[bit / 64] >> (bit % 64)) & 1;
+  }
+
   if (_intervals.empty() || el < _intervals.front().a || el > _intervals.back().b) {
     return false;
   }
@@ -275,10 +442,23 @@ bool IntervalSet::contains(ssize_t el) const {
 }
 
 bool IntervalSet::isEmpty() const {
+  if (_small) {
+    for (uint64_t word : _bits) {
+      if (word != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   return _intervals.empty();
 }
 
 ssize_t IntervalSet::getSingleElement() const {
+  if (_small) {
+    return size() == 1 ? getMinElement() : Token::INVALID_TYPE;
+  }
+
   if (_intervals.size() == 1) {
     if (_intervals[0].a == _intervals[0].b) {
       return _intervals[0].a;
@@ -289,6 +469,15 @@ ssize_t IntervalSet::getSingleElement() const {
 }
 
 ssize_t IntervalSet::getMaxElement() const {
+  if (_small) {
+    for (size_t w = SMALL_WORDS; w-- > 0;) {
+      if (_bits[w] != 0) {
+        return SMALL_MIN + static_cast<ssize_t>(w * 64 + 63 - static_cast<size_t>(std::countl_zero(_bits[w])));
+      }
+    }
+    return Token::INVALID_TYPE;
+  }
+
   if (_intervals.empty()) {
     return Token::INVALID_TYPE;
   }
@@ -297,6 +486,15 @@ ssize_t IntervalSet::getMaxElement() const {
 }
 
 ssize_t IntervalSet::getMinElement() const {
+  if (_small) {
+    for (size_t w = 0; w < SMALL_WORDS; ++w) {
+      if (_bits[w] != 0) {
+        return SMALL_MIN + static_cast<ssize_t>(w * 64 + static_cast<size_t>(std::countr_zero(_bits[w])));
+      }
+    }
+    return Token::INVALID_TYPE;
+  }
+
   if (_intervals.empty()) {
     return Token::INVALID_TYPE;
   }
@@ -305,27 +503,51 @@ ssize_t IntervalSet::getMinElement() const {
 }
 
 std::vector<Interval> const& IntervalSet::getIntervals() const {
+  if (_small && !_mirrorValid.load(std::memory_order_acquire)) {
+    // Small sets may be shared read-only between threads (e.g. cached follow sets).
+    std::lock_guard<std::mutex> lock(mirrorMutex());
+    if (!_mirrorValid.load(std::memory_order_relaxed)) {
+      _intervals.clear();
+      forEachRun(_bits, [this](ssize_t a, ssize_t b) { _intervals.push_back(Interval(a, b)); });
+      _mirrorValid.store(true, std::memory_order_release);
+    }
+  }
   return _intervals;
 }
 
 size_t IntervalSet::hashCode() const {
   size_t hash = MurmurHash::initialize();
-  for (const auto &interval : _intervals) {
-    hash = MurmurHash::update(hash, interval.a);
-    hash = MurmurHash::update(hash, interval.b);
+  size_t count = 0;
+  auto update = [&](ssize_t a, ssize_t b) {
+    hash = MurmurHash::update(hash, a);
+    hash = MurmurHash::update(hash, b);
+    ++count;
+  };
+
+  if (_small) {
+    forEachRun(_bits, update);
+  } else {
+    for (const auto &interval : _intervals) {
+      update(interval.a, interval.b);
+    }
   }
 
-  return MurmurHash::finish(hash, _intervals.size() * 2);
+  return MurmurHash::finish(hash, count * 2);
 }
 
 bool IntervalSet::operator == (const IntervalSet &other) const {
-  if (_intervals.empty() && other._intervals.empty())
+  if (_small && other._small)
+    return _bits == other._bits;
+
+  if (isEmpty() && other.isEmpty())
     return true;
 
-  if (_intervals.size() != other._intervals.size())
+  const std::vector<Interval> &mine = getIntervals();
+  const std::vector<Interval> &theirs = other.getIntervals();
+  if (mine.size() != theirs.size())
     return false;
 
-  return std::equal(_intervals.begin(), _intervals.end(), other._intervals.begin());
+  return std::equal(mine.begin(), mine.end(), theirs.begin());
 }
 
 std::string IntervalSet::toString() const {
@@ -333,7 +555,7 @@ std::string IntervalSet::toString() const {
 }
 
 std::string IntervalSet::toString(bool elemAreChar) const {
-  if (_intervals.empty()) {
+  if (isEmpty()) {
     return "{}";
   }
 
@@ -344,7 +566,7 @@ std::string IntervalSet::toString(bool elemAreChar) const {
   }
 
   bool firstEntry = true;
-  for (const auto &interval : _intervals) {
+  for (const auto &interval : getIntervals()) {
     if (!firstEntry)
       ss << ", ";
     firstEntry = false;
@@ -375,7 +597,7 @@ std::string IntervalSet::toString(bool elemAreChar) const {
 }
 
 std::string IntervalSet::toString(const dfa::Vocabulary &vocabulary) const {
-  if (_intervals.empty()) {
+  if (isEmpty()) {
     return "{}";
   }
 
@@ -386,7 +608,7 @@ std::string IntervalSet::toString(const dfa::Vocabulary &vocabulary) const {
   }
 
   bool firstEntry = true;
-  for (const auto &interval : _intervals) {
+  for (const auto &interval : getIntervals()) {
     if (!firstEntry)
       ss << ", ";
     firstEntry = false;
@@ -422,6 +644,14 @@ std::string IntervalSet::elementName(const dfa::Vocabulary &vocabulary, ssize_t
 }
 
 size_t IntervalSet::size() const {
+  if (_small) {
+    size_t result = 0;
+    for (uint64_t word : _bits) {
+      result += static_cast<size_t>(std::popcount(word));
+    }
+    return result;
+  }
+
   size_t result = 0;
   for (const auto &interval : _intervals) {
     result += size_t(interval.b - interval.a + 1);
@@ -431,7 +661,7 @@ size_t IntervalSet::size() const {
 
 std::vector<ssize_t> IntervalSet::toList() const {
   std::vector<ssize_t> result;
-  for (const auto &interval : _intervals) {
+  for (const auto &interval : getIntervals()) {
     ssize_t a = interval.a;
     ssize_t b = interval.b;
     for (ssize_t v = a; v <= b; v++) {
@@ -443,7 +673,7 @@ std::vector<ssize_t> IntervalSet::toList() const {
 
 std::set<ssize_t> IntervalSet::toSet() const {
   std::set<ssize_t> result;
-  for (const auto &interval : _intervals) {
+  for (const auto &interval : getIntervals()) {
     ssize_t a = interval.a;
     ssize_t b = interval.b;
     for (ssize_t v = a; v <= b; v++) {
@@ -455,7 +685,7 @@ std::set<ssize_t> IntervalSet::toSet() const {
 
 ssize_t IntervalSet::get(size_t i) const {
   size_t index = 0;
-  for (const auto &interval : _intervals) {
+  for (const auto &interval : getIntervals()) {
     ssize_t a = interval.a;
     ssize_t b = interval.b;
     for (ssize_t v = a; v <= b; v++) {
@@ -473,6 +703,15 @@ void IntervalSet::remove(size_t el) {
 }
 
 void IntervalSet::remove(ssize_t el) {
+  if (_small) {
+    if (el >= SMALL_MIN && el <= SMALL_MAX) {
+      size_t bit = static_cast<size_t>(el - SMALL_MIN);
+      _bits[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+      invalidateMirror();
+    }
+    return;
+  }
+
   for (size_t i = 0; i < _intervals.size(); ++i) {
     Interval &interval = _intervals[i];
     ssize_t a = interval.a;
@@ -8,6 +8,8 @@
 #include "misc/Interval.h"
 #include "Exceptions.h"
 
+#include <array>
+
 namespace antlr4 {
 namespace misc {
 
@@ -22,15 +24,37 @@ namespace misc {
    * This class is able to represent sets containing any combination of values in
    * the range {@link Integer#MIN_VALUE} to {@link Integer#MAX_VALUE}
    * (inclusive).</p>
+   *
+   * <p>
+   * Sets whose elements all lie in [{@link #SMALL_MIN}, {@link #SMALL_MAX}]
+   * (token types of vocabularies with fewer than 126 types, EOF and EPSILON)
+   * are stored in a fixed-width bitset instead, so constructing, copying,
+   * combining and testing them does not allocate. A set switches to the
+   * interval list as soon as an element outside that window is added.</p>
    */
   class ANTLR4CPP_PUBLIC IntervalSet final {
   public:
     static IntervalSet const COMPLETE_CHAR_SET;
     static IntervalSet const EMPTY_SET;
 
+    /// Smallest and largest element of the bitset representation.
+    static constexpr ssize_t SMALL_MIN = -2;
+    static constexpr size_t SMALL_WORDS = 2;
+    static constexpr ssize_t SMALL_MAX = SMALL_MIN + static_cast<ssize_t>(SMALL_WORDS * 64) - 1;
+
   private:
-    /// The list of sorted, disjoint intervals.
-    std::vector<Interval> _intervals;
+    using Bits = std::array<uint64_t, SMALL_WORDS>;
+
+    /// Element v is bit (v - SMALL_MIN). Only meaningful while _small is set.
+    Bits _bits {};
+    bool _small = true;
+
+    /// Set once _intervals mirrors _bits for a small set (see getIntervals()).
+    mutable std::atomic<bool> _mirrorValid { false };
+
+    /// The list of sorted, disjoint intervals. For a small set this is only a
+    /// lazily built copy of _bits.
+    mutable std::vector<Interval> _intervals;
 
     explicit IntervalSet(std::vector<Interval>&& intervals);
 
@@ -170,6 +194,13 @@ namespace misc {
 
   private:
     void addItems() { /* No-op */ }
+
+    static bool fitsSmall(ssize_t a, ssize_t b) { return a >= SMALL_MIN && b <= SMALL_MAX; }
+
+    /// Switches a small set to the interval list representation.
+    void toLarge();
+
+    void invalidateMirror() { _mirrorValid.store(false, std::memory_order_relaxed); }
   };
 
 } // namespace atn
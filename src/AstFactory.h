@@ -18,10 +18,12 @@
 #pragma once
 
 #include "AstNodes.h"
+#include <array>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
 #include <new>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -242,6 +244,16 @@ public:
     return InternedString{id};
   }
 
+  /**
+   * @brief ID of an already interned string, without interning it
+   */
+  [[nodiscard]] std::optional<InternedString> lookup(std::string_view str) const {
+    auto it = index_.find(std::string(str));
+    if (it == index_.end())
+      return std::nullopt;
+    return InternedString{it->second};
+  }
+
   /**
    * @brief Get string by ID
    */
@@ -262,6 +274,85 @@ private:
   std::unordered_map<std::string, uint32_t> index_;
 };
 
+// ============================================================================
+// Per-Kind Node Index
+// ============================================================================
+
+/**
+ * @brief Every node a factory created, bucketed by AstKind
+ *
+ * Filled as nodes are created, so "all CallExprs of this file" is a list
+ * lookup instead of a tree walk. Buckets are in creation order, which for
+ * the tree builder is bottom-up source order. Error recovery can leave a few
+ * nodes that were created but never attached to the tree.
+ *
+ * Usage:
+ *   for (auto *call : factory.index().ofType<CallExprNode>()) { ... }
+ *   factory.index().forEach<ImportStmtNode>([](ImportStmtNode *imp) { ... });
+ */
+class NodeIndex {
+public:
+  void add(AstNode *node) {
+    buckets_[slotOf(node->kind)].push_back(node);
+    ++size_;
+  }
+
+  void clear() {
+    for (auto &bucket : buckets_)
+      bucket.clear();
+    size_ = 0;
+  }
+
+  /**
+   * @brief All nodes of one kind
+   */
+  [[nodiscard]] const std::vector<AstNode *> &nodesOf(AstKind kind) const noexcept {
+    return buckets_[slotOf(kind)];
+  }
+
+  [[nodiscard]] size_t count(AstKind kind) const noexcept { return nodesOf(kind).size(); }
+
+  template <typename T, typename Func> void forEach(Func &&func) const {
+    for (auto *node : nodesOf(T::Kind))
+      func(static_cast<T *>(node));
+  }
+
+  template <typename T> [[nodiscard]] std::vector<T *> ofType() const {
+    const auto &nodes = nodesOf(T::Kind);
+    std::vector<T *> result;
+    result.reserve(nodes.size());
+    for (auto *node : nodes)
+      result.push_back(static_cast<T *>(node));
+    return result;
+  }
+
+  /**
+   * @brief Total number of indexed nodes
+   */
+  [[nodiscard]] size_t size() const noexcept { return size_; }
+
+private:
+  /// AstKind categories are numbered in steps of 100; each gets this many slots
+  static constexpr size_t SlotsPerCategory = 32;
+
+  static_assert(static_cast<size_t>(AstKind::ExprEnd) - static_cast<size_t>(AstKind::ExprBegin) <=
+                SlotsPerCategory);
+  static_assert(static_cast<size_t>(AstKind::StmtEnd) - static_cast<size_t>(AstKind::StmtBegin) <=
+                SlotsPerCategory);
+  static_assert(static_cast<size_t>(AstKind::DeclEnd) - static_cast<size_t>(AstKind::DeclBegin) <=
+                SlotsPerCategory);
+  static_assert(static_cast<size_t>(AstKind::TypeEnd) - static_cast<size_t>(AstKind::TypeBegin) <=
+                SlotsPerCategory);
+
+  [[nodiscard]] static size_t slotOf(AstKind kind) noexcept {
+    size_t k = static_cast<size_t>(kind);
+    return (k / 100) * SlotsPerCategory + (k % 100) % SlotsPerCategory;
+  }
+
+  std::array<std::vector<AstNode *>, 4 * SlotsPerCategory> buckets_;
+  size_t size_ = 0;
+};
+
 // ============================================================================
 // AST Factory
 // ============================================================================
@@ -287,13 +378,28 @@ public:
 
   [[nodiscard]] const StringTable &strings() const noexcept { return strings_; }
 
+  /**
+   * @brief Keep node memory not allocated from the arena (e.g. a mapped AST
+   *        image) alive as long as this factory
+   */
+  void retainStorage(std::shared_ptr<void> storage) { external_.push_back(std::move(storage)); }
+
+  /**
+   * @brief Nodes created by this factory, by kind
+   */
+  [[nodiscard]] const NodeIndex &index() const noexcept { return index_; }
+
+  /**
+   * @brief Index a node that was not created here (e.g. mapped from an AST image)
+   */
+  void indexNode(AstNode *node) { index_.add(node); }
+
   // ========================================================================
   // Error/Placeholder Node Creation
   // ========================================================================
 
   [[nodiscard]] ErrorExprNode *makeErrorExpr(SourceRange range, std::string_view message = "") {
-    auto *node = arena_.make<ErrorExprNode>();
-    node->kind = AstKind::ErrorExpr;
+    auto *node = create<ErrorExprNode>();
     node->flags = NodeFlags::HasError;
     node->range = range;
     node->errorMessage = strings_.intern(message);
@@ -301,16 +407,14 @@ public:
   }
 
   [[nodiscard]] MissingExprNode *makeMissingExpr(SourceRange range) {
-    auto *node = arena_.make<MissingExprNode>();
-    node->kind = AstKind::MissingExpr;
+    auto *node = create<MissingExprNode>();
     node->flags = NodeFlags::HasError;
     node->range = range;
     return node;
   }
 
   [[nodiscard]] ErrorStmtNode *makeErrorStmt(SourceRange range, std::string_view message = "") {
-    auto *node = arena_.make<ErrorStmtNode>();
-    node->kind = AstKind::ErrorStmt;
+    auto *node = create<ErrorStmtNode>();
     node->flags = NodeFlags::HasError;
     node->range = range;
     node->errorMessage = strings_.intern(message);
@@ -318,8 +422,7 @@ public:
   }
 
   [[nodiscard]] ErrorDeclNode *makeErrorDecl(SourceRange range, std::string_view message = "") {
-    auto *node = arena_.make<ErrorDeclNode>();
-    node->kind = AstKind::ErrorDecl;
+    auto *node = create<ErrorDeclNode>();
     node->flags = NodeFlags::HasError;
     node->range = range;
     node->errorMessage = strings_.intern(message);
@@ -327,8 +430,7 @@ public:
   }
 
   [[nodiscard]] ErrorTypeNode *makeErrorType(SourceRange range, std::string_view message = "") {
-    auto *node = arena_.make<ErrorTypeNode>();
-    node->kind = AstKind::ErrorType;
+    auto *node = create<ErrorTypeNode>();
     node->flags = NodeFlags::HasError;
     node->range = range;
     node->errorMessage = strings_.intern(message);
@@ -340,15 +442,13 @@ public:
   // ========================================================================
 
   [[nodiscard]] NullLiteralNode *makeNullLiteral(SourceRange range) {
-    auto *node = arena_.make<NullLiteralNode>();
-    node->kind = AstKind::NullLiteral;
+    auto *node = create<NullLiteralNode>();
     node->range = range;
     return node;
   }
 
   [[nodiscard]] BoolLiteralNode *makeBoolLiteral(SourceRange range, bool value) {
-    auto *node = arena_.make<BoolLiteralNode>();
-    node->kind = AstKind::BoolLiteral;
+    auto *node = create<BoolLiteralNode>();
     node->range = range;
     node->value = value;
     return node;
@@ -356,8 +456,7 @@ public:
 
   [[nodiscard]] IntLiteralNode *makeIntLiteral(SourceRange range, int64_t value,
                                                bool isHex = false) {
-    auto *node = arena_.make<IntLiteralNode>();
-    node->kind = AstKind::IntLiteral;
+    auto *node = create<IntLiteralNode>();
     node->range = range;
     node->value = value;
     node->isHex = isHex;
@@ -365,8 +464,7 @@ public:
   }
 
   [[nodiscard]] FloatLiteralNode *makeFloatLiteral(SourceRange range, double value) {
-    auto *node = arena_.make<FloatLiteralNode>();
-    node->kind = AstKind::FloatLiteral;
+    auto *node = create<FloatLiteralNode>();
     node->range = range;
     node->value = value;
     return node;
@@ -374,8 +472,7 @@ public:
 
   [[nodiscard]] StringLiteralNode *makeStringLiteral(SourceRange range, std::string_view value,
                                                      std::string_view rawValue = "") {
-    auto *node = arena_.make<StringLiteralNode>();
-    node->kind = AstKind::StringLiteral;
+    auto *node = create<StringLiteralNode>();
     node->range = range;
     node->value = strings_.intern(value);
     node->rawValue = strings_.intern(rawValue.empty() ? value : rawValue);
@@ -387,8 +484,7 @@ public:
   // ========================================================================
 
   [[nodiscard]] IdentifierNode *makeIdentifier(SourceRange range, std::string_view name) {
-    auto *node = arena_.make<IdentifierNode>();
-    node->kind = AstKind::Identifier;
+    auto *node = create<IdentifierNode>();
     node->range = range;
     node->name = strings_.intern(name);
     return node;
@@ -396,8 +492,7 @@ public:
 
   [[nodiscard]] QualifiedIdentifierNode *
   makeQualifiedIdentifier(SourceRange range, const std::vector<std::string_view> &parts) {
-    auto *node = arena_.make<QualifiedIdentifierNode>();
-    node->kind = AstKind::QualifiedIdentifier;
+    auto *node = create<QualifiedIdentifierNode>();
     node->range = range;
 
     std::vector<InternedString> internedParts;
@@ -422,8 +517,7 @@ public:
                                                            bool isIncomplete = false) {
     assert(base && "base must not be null - use ErrorExpr");
 
-    auto *node = arena_.make<MemberAccessExprNode>();
-    node->kind = AstKind::MemberAccessExpr;
+    auto *node = create<MemberAccessExprNode>();
     node->range = range;
     node->base = base;
     node->member = strings_.intern(member);
@@ -439,8 +533,7 @@ public:
   [[nodiscard]] IndexExprNode *makeIndexExpr(SourceRange range, Expr *base, Expr *index) {
     assert(base && index && "base and index must not be null");
 
-    auto *node = arena_.make<IndexExprNode>();
-    node->kind = AstKind::IndexExpr;
+    auto *node = create<IndexExprNode>();
     node->range = range;
     node->base = base;
     node->index = index;
@@ -454,8 +547,7 @@ public:
                                                          std::string_view member) {
     assert(base && "base must not be null");
 
-    auto *node = arena_.make<ColonLookupExprNode>();
-    node->kind = AstKind::ColonLookupExpr;
+    auto *node = create<ColonLookupExprNode>();
     node->range = range;
     node->base = base;
     node->member = strings_.intern(member);
@@ -473,8 +565,7 @@ public:
                                                Expr *right, SourceLoc opLoc = {}) {
     assert(left && right && "operands must not be null");
 
-    auto *node = arena_.make<BinaryExprNode>();
-    node->kind = AstKind::BinaryExpr;
+    auto *node = create<BinaryExprNode>();
     node->range = range;
     node->op = op;
     node->left = left;
@@ -490,8 +581,7 @@ public:
                                              bool isPrefix = true) {
     assert(operand && "operand must not be null");
 
-    auto *node = arena_.make<UnaryExprNode>();
-    node->kind = AstKind::UnaryExpr;
+    auto *node = create<UnaryExprNode>();
     node->range = range;
     node->op = op;
     node->operand = operand;
@@ -511,8 +601,7 @@ public:
                                            SourceRange parenRange = {}) {
     assert(callee && "callee must not be null");
 
-    auto *node = arena_.make<CallExprNode>();
-    node->kind = AstKind::CallExpr;
+    auto *node = create<CallExprNode>();
     node->range = range;
     node->callee = callee;
     node->arguments = arena_.makeArrayView(args);
@@ -532,8 +621,7 @@ public:
 
   [[nodiscard]] NewExprNode *makeNewExpr(SourceRange range, QualifiedIdentifierNode *typeName,
                                          const std::vector<Expr *> &args) {
-    auto *node = arena_.make<NewExprNode>();
-    node->kind = AstKind::NewExpr;
+    auto *node = create<NewExprNode>();
     node->range = range;
     node->typeName = typeName;
     node->arguments = arena_.makeArrayView(args);
@@ -545,8 +633,7 @@ public:
   // ========================================================================
 
   [[nodiscard]] ListExprNode *makeListExpr(SourceRange range, const std::vector<Expr *> &elements) {
-    auto *node = arena_.make<ListExprNode>();
-    node->kind = AstKind::ListExpr;
+    auto *node = create<ListExprNode>();
     node->range = range;
     node->elements = arena_.makeArrayView(elements);
     return node;
@@ -557,8 +644,7 @@ public:
                                            bool isBracketedKey = false) {
     assert(key && value && "key and value must not be null");
 
-    auto *node = arena_.make<MapEntryNode>();
-    node->kind = AstKind::MapEntryExpr;
+    auto *node = create<MapEntryNode>();
     node->range = range;
     node->key = key;
     node->value = value;
@@ -569,8 +655,7 @@ public:
 
   [[nodiscard]] MapExprNode *makeMapExpr(SourceRange range,
                                          const std::vector<MapEntryNode *> &entries) {
-    auto *node = arena_.make<MapExprNode>();
-    node->kind = AstKind::MapExpr;
+    auto *node = create<MapExprNode>();
     node->range = range;
     node->entries = arena_.makeArrayView(entries);
     return node;
@@ -581,8 +666,7 @@ public:
                                                BlockStmtNode *body, bool isMultiReturn = false) {
     assert(returnType && body && "returnType and body must not be null");
 
-    auto *node = arena_.make<LambdaExprNode>();
-    node->kind = AstKind::LambdaExpr;
+    auto *node = create<LambdaExprNode>();
     node->range = range;
     node->returnType = returnType;
     node->params = arena_.makeArrayView(params);
@@ -594,8 +678,7 @@ public:
   [[nodiscard]] ParenExprNode *makeParenExpr(SourceRange range, Expr *inner) {
     assert(inner && "inner must not be null");
 
-    auto *node = arena_.make<ParenExprNode>();
-    node->kind = AstKind::ParenExpr;
+    auto *node = create<ParenExprNode>();
     node->range = range;
     node->inner = inner;
     if (inner->hasError()) {
@@ -605,8 +688,7 @@ public:
   }
 
   [[nodiscard]] VarArgsExprNode *makeVarArgsExpr(SourceRange range) {
-    auto *node = arena_.make<VarArgsExprNode>();
-    node->kind = AstKind::VarArgsExpr;
+    auto *node = create<VarArgsExprNode>();
     node->range = range;
     return node;
   }
@@ -616,8 +698,7 @@ public:
   // ========================================================================
 
   [[nodiscard]] EmptyStmtNode *makeEmptyStmt(SourceRange range) {
-    auto *node = arena_.make<EmptyStmtNode>();
-    node->kind = AstKind::EmptyStmt;
+    auto *node = create<EmptyStmtNode>();
     node->range = range;
     return node;
   }
@@ -625,8 +706,7 @@ public:
   [[nodiscard]] ExprStmtNode *makeExprStmt(SourceRange range, Expr *expr) {
     assert(expr && "expr must not be null");
 
-    auto *node = arena_.make<ExprStmtNode>();
-    node->kind = AstKind::ExprStmt;
+    auto *node = create<ExprStmtNode>();
     node->range = range;
     node->expr = expr;
     if (expr->hasError()) {
@@ -637,8 +717,7 @@ public:
 
   [[nodiscard]] BlockStmtNode *makeBlockStmt(SourceRange range,
                                              const std::vector<Stmt *> &statements) {
-    auto *node = arena_.make<BlockStmtNode>();
-    node->kind = AstKind::BlockStmt;
+    auto *node = create<BlockStmtNode>();
     node->range = range;
     node->statements = arena_.makeArrayView(statements);
     return node;
@@ -647,8 +726,7 @@ public:
   [[nodiscard]] AssignStmtNode *makeAssignStmt(SourceRange range, Expr *target, Expr *value) {
     assert(target && value && "target and value must not be null");
 
-    auto *node = arena_.make<AssignStmtNode>();
-    node->kind = AstKind::AssignStmt;
+    auto *node = create<AssignStmtNode>();
     node->range = range;
     node->target.expr = target;
     node->value = value;
@@ -658,8 +736,7 @@ public:
   [[nodiscard]] MultiAssignStmtNode *makeMultiAssignStmt(SourceRange range,
                                                          const std::vector<Expr *> &targets,
                                                          const std::vector<Expr *> &values) {
-    auto *node = arena_.make<MultiAssignStmtNode>();
-    node->kind = AstKind::MultiAssignStmt;
+    auto *node = create<MultiAssignStmtNode>();
     node->range = range;
 
     std::vector<LValue> lvalues;
@@ -677,8 +754,7 @@ public:
                                                            Expr *target, Expr *value) {
     assert(target && value && "target and value must not be null");
 
-    auto *node = arena_.make<UpdateAssignStmtNode>();
-    node->kind = AstKind::UpdateAssignStmt;
+    auto *node = create<UpdateAssignStmtNode>();
     node->range = range;
     node->op = op;
     node->target.expr = target;
@@ -689,8 +765,7 @@ public:
   [[nodiscard]] IfStmtNode *makeIfStmt(SourceRange range,
                                        const std::vector<IfStmtNode::Branch> &branches,
                                        BlockStmtNode *elseBody = nullptr) {
-    auto *node = arena_.make<IfStmtNode>();
-    node->kind = AstKind::IfStmt;
+    auto *node = create<IfStmtNode>();
     node->range = range;
     node->branches = arena_.makeArrayView(branches);
     node->elseBody = elseBody;
@@ -701,8 +776,7 @@ public:
                                              BlockStmtNode *body) {
     assert(condition && body && "condition and body must not be null");
 
-    auto *node = arena_.make<WhileStmtNode>();
-    node->kind = AstKind::WhileStmt;
+    auto *node = create<WhileStmtNode>();
     node->range = range;
     node->condition = condition;
     node->body = body;
@@ -714,8 +788,7 @@ public:
                                                BlockStmtNode *body) {
     assert(body && "body must not be null");
 
-    auto *node = arena_.make<ForStmtNode>();
-    node->kind = AstKind::ForStmt;
+    auto *node = create<ForStmtNode>();
     node->range = range;
     node->style = ForStmtNode::Style::CStyle;
     node->init = init;
@@ -730,8 +803,7 @@ public:
                                                 Expr *collection, BlockStmtNode *body) {
     assert(collection && body && "collection and body must not be null");
 
-    auto *node = arena_.make<ForStmtNode>();
-    node->kind = AstKind::ForStmt;
+    auto *node = create<ForStmtNode>();
     node->range = range;
     node->style = ForStmtNode::Style::ForEach;
     node->iterVars = arena_.makeArrayView(iterVars);
@@ -741,23 +813,20 @@ public:
   }
 
   [[nodiscard]] BreakStmtNode *makeBreakStmt(SourceRange range) {
-    auto *node = arena_.make<BreakStmtNode>();
-    node->kind = AstKind::BreakStmt;
+    auto *node = create<BreakStmtNode>();
     node->range = range;
     return node;
   }
 
   [[nodiscard]] ContinueStmtNode *makeContinueStmt(SourceRange range) {
-    auto *node = arena_.make<ContinueStmtNode>();
-    node->kind = AstKind::ContinueStmt;
+    auto *node = create<ContinueStmtNode>();
     node->range = range;
     return node;
   }
 
   [[nodiscard]] ReturnStmtNode *makeReturnStmt(SourceRange range,
                                                const std::vector<Expr *> &values = {}) {
-    auto *node = arena_.make<ReturnStmtNode>();
-    node->kind = AstKind::ReturnStmt;
+    auto *node = create<ReturnStmtNode>();
     node->range = range;
     node->values = arena_.makeArrayView(values);
     return node;
@@ -766,8 +835,7 @@ public:
   [[nodiscard]] DeferStmtNode *makeDeferStmt(SourceRange range, BlockStmtNode *body) {
     assert(body && "body must not be null");
 
-    auto *node = arena_.make<DeferStmtNode>();
-    node->kind = AstKind::DeferStmt;
+    auto *node = create<DeferStmtNode>();
     node->range = range;
     node->body = body;
     return node;
@@ -776,8 +844,7 @@ public:
   [[nodiscard]] ImportStmtNode *makeImportStmtNamespace(SourceRange range,
                                                         std::string_view modulePath,
                                                         std::string_view namespaceAlias) {
-    auto *node = arena_.make<ImportStmtNode>();
-    node->kind = AstKind::ImportStmt;
+    auto *node = create<ImportStmtNode>();
     node->range = range;
     node->style = ImportStmtNode::Style::Namespace;
     node->modulePath = strings_.intern(modulePath);
@@ -788,8 +855,7 @@ public:
   [[nodiscard]] ImportStmtNode *
   makeImportStmtNamed(SourceRange range, std::string_view modulePath,
                       const std::vector<ImportSpecifier> &specifiers) {
-    auto *node = arena_.make<ImportStmtNode>();
-    node->kind = AstKind::ImportStmt;
+    auto *node = create<ImportStmtNode>();
     node->range = range;
     node->style = ImportStmtNode::Style::Named;
     node->modulePath = strings_.intern(modulePath);
@@ -800,8 +866,7 @@ public:
   [[nodiscard]] DeclStmtNode *makeDeclStmt(SourceRange range, Decl *decl) {
     assert(decl && "decl must not be null");
 
-    auto *node = arena_.make<DeclStmtNode>();
-    node->kind = AstKind::DeclStmt;
+    auto *node = create<DeclStmtNode>();
     node->range = range;
     node->decl = decl;
     return node;
@@ -816,8 +881,7 @@ public:
                                          NodeFlags modifiers = NodeFlags::None) {
     assert(type && "type must not be null - use ErrorType or InferredType");
 
-    auto *node = arena_.make<VarDeclNode>();
-    node->kind = AstKind::VarDecl;
+    auto *node = create<VarDeclNode>();
     node->range = range;
     node->name = strings_.intern(name);
     node->type = type;
@@ -830,8 +894,7 @@ public:
                                                    const std::vector<std::string_view> &names,
                                                    Expr *initializer,
                                                    NodeFlags modifiers = NodeFlags::None) {
-    auto *node = arena_.make<MultiVarDeclNode>();
-    node->kind = AstKind::MultiVarDecl;
+    auto *node = create<MultiVarDeclNode>();
     node->range = range;
 
     std::vector<InternedString> internedNames;
@@ -849,8 +912,7 @@ public:
                                                      TypeNode *type, bool isVariadic = false) {
     assert(type && "type must not be null");
 
-    auto *node = arena_.make<ParameterDeclNode>();
-    node->kind = AstKind::ParameterDecl;
+    auto *node = create<ParameterDeclNode>();
     node->range = range;
     node->name = strings_.intern(name);
     node->type = type;
@@ -866,8 +928,7 @@ public:
                    bool hasVarArgs = false) {
     assert(returnType && body && "returnType and body must not be null");
 
-    auto *node = arena_.make<FunctionDeclNode>();
-    node->kind = AstKind::FunctionDecl;
+    auto *node = create<FunctionDeclNode>();
     node->range = range;
     node->name = strings_.intern(name);
     node->returnType = returnType;
@@ -885,8 +946,7 @@ public:
                                              NodeFlags modifiers = NodeFlags::None) {
     assert(type && "type must not be null");
 
-    auto *node = arena_.make<FieldDeclNode>();
-    node->kind = AstKind::FieldDecl;
+    auto *node = create<FieldDeclNode>();
     node->range = range;
     node->name = strings_.intern(name);
     node->type = type;
@@ -901,8 +961,7 @@ public:
                  NodeFlags modifiers = NodeFlags::None, bool isMultiReturn = false) {
     assert(returnType && body && "returnType and body must not be null");
 
-    auto *node = arena_.make<MethodDeclNode>();
-    node->kind = AstKind::MethodDecl;
+    auto *node = create<MethodDeclNode>();
     node->range = range;
     node->name = strings_.intern(name);
     node->returnType = returnType;
@@ -917,8 +976,7 @@ public:
                                              const std::vector<FieldDeclNode *> &fields,
                                              const std::vector<MethodDeclNode *> &methods,
                                              NodeFlags modifiers = NodeFlags::None) {
-    auto *node = arena_.make<ClassDeclNode>();
-    node->kind = AstKind::ClassDecl;
+    auto *node = create<ClassDeclNode>();
     node->range = range;
     node->name = strings_.intern(name);
     node->fields = arena_.makeArrayView(fields);
@@ -931,8 +989,7 @@ public:
   makeCompilationUnit(SourceRange range, std::string_view filename,
                       const std::vector<Stmt *> &statements,
                       const std::vector<ImportStmtNode *> &imports = {}) {
-    auto *node = arena_.make<CompilationUnitNode>();
-    node->kind = AstKind::CompilationUnit;
+    auto *node = create<CompilationUnitNode>();
     node->range = range;
     node->filename = strings_.intern(filename);
     node->statements = arena_.makeArrayView(statements);
@@ -945,31 +1002,27 @@ public:
   // ========================================================================
 
   [[nodiscard]] InferredTypeNode *makeInferredType(SourceRange range) {
-    auto *node = arena_.make<InferredTypeNode>();
-    node->kind = AstKind::InferredType;
+    auto *node = create<InferredTypeNode>();
     node->range = range;
     return node;
   }
 
   [[nodiscard]] PrimitiveTypeNode *makePrimitiveType(SourceRange range,
                                                      PrimitiveKind primitiveKind) {
-    auto *node = arena_.make<PrimitiveTypeNode>();
-    node->kind = AstKind::PrimitiveType;
+    auto *node = create<PrimitiveTypeNode>();
     node->range = range;
     node->primitiveKind = primitiveKind;
     return node;
   }
 
   [[nodiscard]] AnyTypeNode *makeAnyType(SourceRange range) {
-    auto *node = arena_.make<AnyTypeNode>();
-    node->kind = AstKind::AnyType;
+    auto *node = create<AnyTypeNode>();
     node->range = range;
     return node;
   }
 
   [[nodiscard]] ListTypeNode *makeListType(SourceRange range, TypeNode *elementType = nullptr) {
-    auto *node = arena_.make<ListTypeNode>();
-    node->kind = AstKind::ListType;
+    auto *node = create<ListTypeNode>();
     node->range = range;
     node->elementType = elementType;
     return node;
@@ -977,8 +1030,7 @@ public:
 
   [[nodiscard]] MapTypeNode *makeMapType(SourceRange range, TypeNode *keyType = nullptr,
                                          TypeNode *valueType = nullptr) {
-    auto *node = arena_.make<MapTypeNode>();
-    node->kind = AstKind::MapType;
+    auto *node = create<MapTypeNode>();
     node->range = range;
     node->keyType = keyType;
     node->valueType = valueType;
@@ -987,16 +1039,14 @@ public:
 
   [[nodiscard]] QualifiedTypeNode *makeQualifiedType(SourceRange range,
                                                      QualifiedIdentifierNode *name) {
-    auto *node = arena_.make<QualifiedTypeNode>();
-    node->kind = AstKind::QualifiedType;
+    auto *node = create<QualifiedTypeNode>();
     node->range = range;
     node->name = name;
     return node;
   }
 
   [[nodiscard]] MultiReturnTypeNode *makeMultiReturnType(SourceRange range) {
-    auto *node = arena_.make<MultiReturnTypeNode>();
-    node->kind = AstKind::MultiReturnType;
+    auto *node = create<MultiReturnTypeNode>();
     node->range = range;
     return node;
   }
@@ -1016,8 +1066,20 @@ public:
   }
 
 private:
+  /**
+   * @brief Allocate a node of type T, set its kind and index it
+   */
+  template <typename T> [[nodiscard]] T *create() {
+    auto *node = arena_.make<T>();
+    node->kind = T::Kind;
+    index_.add(node);
+    return node;
+  }
+
   Arena arena_;
   StringTable strings_;
+  NodeIndex index_;
+  std::vector<std::shared_ptr<void>> external_; ///< Node memory owned elsewhere
 
 public:
   // ========================================================================
@@ -0,0 +1,959 @@
+/**
+ * @file AstImage.h
+ * @brief Relocatable On-Disk AST Images for Instant File Reopen
+ *
+ * Reopening a large file that has not changed since the last session still
+ * pays for a full ANTLR lex + parse + AST build. An AST image is the arena
+ * contents of a finished parse written out with every pointer replaced by an
+ * offset, plus a relocation table listing those pointer slots. Loading maps
+ * the file copy-on-write, adds the mapping's base address to each listed
+ * slot, and the nodes are usable in place - no parsing, no per-node
+ * allocation.
+ *
+ * Key Features:
+ * - Keyed by a hash of the document content, so any edit misses
+ * - Header carries a layout fingerprint (sizeof/alignof of every node type),
+ *   the executable's build id and a grammar fingerprint (the serialized
+ *   lexer/parser ATNs); images from another build or grammar are rejected and
+ *   the file is parsed normally
+ * - A checksum of the image body is verified before any slot is relocated, so
+ *   a truncated or corrupted file is never used as nodes
+ * - Interned strings and syntax errors travel with the nodes
+ * - Bounded cache directory: least recently used images are pruned
+ *
+ * Images are a cache, never a source of truth: every failure falls back to a
+ * regular parse.
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "AstFactory.h"
+#include "AstNodes.h"
+#include "LangLexer.h"
+#include "LangParser.h"
+#include "LspLogger.h"
+#include "StructuralHash.h"
+#include "Utf8CharStream.h"
+#include "antlr4-runtime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <elf.h>
+#include <link.h>
+#endif
+
+namespace lang {
+namespace ast {
+
+// ============================================================================
+// Fingerprints
+// ============================================================================
+
+namespace image_detail {
+
+constexpr uint64_t mix(uint64_t seed, uint64_t value) noexcept {
+  return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+template <typename... T> constexpr uint64_t layoutOf() noexcept {
+  uint64_t h = 0;
+  ((h = mix(mix(h, sizeof(T)), alignof(T))), ...);
+  return h;
+}
+
+} // namespace image_detail
+
+/// Bumped whenever the image encoding itself changes
+inline constexpr uint32_t AstImageFormatVersion = 3;
+
+/// Changes whenever a node struct, an AstKind range or the pointer width changes
+inline constexpr uint64_t AstLayoutFingerprint = image_detail::mix(
+    image_detail::layoutOf<
+        void *, SourceRange, InternedString, ArrayView<AstNode *>, LValue, IfStmtNode::Branch,
+        ImportSpecifier, ErrorExprNode, MissingExprNode, NullLiteralNode, BoolLiteralNode,
+        IntLiteralNode, FloatLiteralNode, StringLiteralNode, IdentifierNode,
+        QualifiedIdentifierNode, MemberAccessExprNode, IndexExprNode, ColonLookupExprNode,
+        BinaryExprNode, UnaryExprNode, CallExprNode, NewExprNode, ListExprNode, MapEntryNode,
+        MapExprNode, LambdaExprNode, ParenExprNode, VarArgsExprNode, ErrorStmtNode, EmptyStmtNode,
+        ExprStmtNode, BlockStmtNode, AssignStmtNode, MultiAssignStmtNode, UpdateAssignStmtNode,
+        IfStmtNode, WhileStmtNode, ForStmtNode, BreakStmtNode, ContinueStmtNode, ReturnStmtNode,
+        DeferStmtNode, ImportStmtNode, DeclStmtNode, ErrorDeclNode, VarDeclNode,
+        MultiVarDeclNode, ParameterDeclNode, FunctionDeclNode, FieldDeclNode, MethodDeclNode,
+        ClassDeclNode, CompilationUnitNode, ErrorTypeNode, InferredTypeNode, PrimitiveTypeNode,
+        AnyTypeNode, ListTypeNode, MapTypeNode, QualifiedTypeNode, MultiReturnTypeNode>(),
+    (static_cast<uint64_t>(AstKind::ExprEnd) << 48) | (static_cast<uint64_t>(AstKind::StmtEnd) << 32) |
+        (static_cast<uint64_t>(AstKind::DeclEnd) << 16) | static_cast<uint64_t>(AstKind::TypeEnd));
+
+/**
+ * @brief Identifies the executable, so images never outlive the build that wrote them
+ *
+ * sizeof/alignof cannot see reordered fields, or a pointer swapped for an
+ * integer of the same size; any rebuild can. Uses the GNU build-id note, else
+ * a hash of /proc/self/exe. 0 where neither is available: images are then
+ * guarded by the layout fingerprint and the body checksum alone.
+ */
+[[nodiscard]] inline uint64_t buildFingerprint() {
+  static const uint64_t fingerprint = [] {
+    uint64_t id = 0;
+#if defined(__linux__)
+    dl_iterate_phdr(
+        [](dl_phdr_info *info, size_t, void *data) {
+          // First entry: the executable
+          for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+            const ElfW(Phdr) &segment = info->dlpi_phdr[i];
+            if (segment.p_type != PT_NOTE)
+              continue;
+            const char *note = reinterpret_cast<const char *>(info->dlpi_addr + segment.p_vaddr);
+            const char *end = note + segment.p_memsz;
+            while (end - note >= static_cast<ptrdiff_t>(sizeof(ElfW(Nhdr)))) {
+              ElfW(Nhdr) header;
+              std::memcpy(&header, note, sizeof header);
+              const char *name = note + sizeof header;
+              const char *desc = name + ((header.n_namesz + 3) & ~3u);
+              note = desc + ((header.n_descsz + 3) & ~3u);
+              if (note > end)
+                break;
+              if (header.n_type == NT_GNU_BUILD_ID && header.n_namesz == 4 &&
+                  std::memcmp(name, "GNU", 4) == 0) {
+                *static_cast<uint64_t *>(data) =
+                    StructuralHasher::hashBytes(std::string_view(desc, header.n_descsz));
+                return 1;
+              }
+            }
+          }
+          return 1;
+        },
+        &id);
+    if (id == 0) {
+      std::ifstream exe("/proc/self/exe", std::ios::binary);
+      std::string bytes((std::istreambuf_iterator<char>(exe)), std::istreambuf_iterator<char>());
+      if (!bytes.empty())
+        id = StructuralHasher::hashBytes(bytes);
+    }
+#endif
+    return id;
+  }();
+  return fingerprint;
+}
+
+/**
+ * @brief Hash of the generated lexer and parser ATNs
+ *
+ * A grammar change alters the trees the builder produces even when no node
+ * struct changes, so images record the grammar they were built with.
+ */
+[[nodiscard]] inline uint64_t grammarFingerprint() {
+  static const uint64_t fingerprint = [] {
+    lsp::Utf8CharStream input(std::string_view(), "<fingerprint>");
+    LangLexer lexer(&input);
+    antlr4::CommonTokenStream tokens(&lexer);
+    LangParser parser(&tokens);
+
+    auto hashAtn = [](antlr4::atn::SerializedATNView atn) {
+      return StructuralHasher::hashBytes(
+          std::string_view(reinterpret_cast<const char *>(atn.data()), atn.size_bytes()));
+    };
+    return image_detail::mix(hashAtn(lexer.getSerializedATN()),
+                             hashAtn(parser.getSerializedATN()));
+  }();
+  return fingerprint;
+}
+
+// ============================================================================
+// Image Format
+// ============================================================================
+
+/**
+ * @brief Syntax error stored alongside the tree
+ */
+struct ImageDiagnostic {
+  uint32_t beginLine = 0;
+  uint32_t beginColumn = 0;
+  uint32_t endLine = 0;
+  uint32_t endColumn = 0;
+  std::string message;
+};
+
+/**
+ * @brief Fixed header at offset 0 of every image
+ *
+ * Sections follow the header in this order: nodes (16-byte aligned), the
+ * relocation table (uint64 offsets into the node section), the node table
+ * (offset of every node, to rebuild the factory's NodeIndex), the string table
+ * (ids 1..n-1 as length + bytes) and the syntax errors.
+ */
+struct AstImageHeader {
+  static constexpr uint64_t Magic = 0x31474d4954534141ull; // "AASTIMG1"
+
+  uint64_t magic = Magic;
+  uint32_t formatVersion = AstImageFormatVersion;
+  uint32_t pointerSize = sizeof(void *);
+  uint64_t layout = AstLayoutFingerprint;
+  uint64_t build = 0;
+  uint64_t grammar = 0;
+  uint64_t contentHash = 0;
+  uint64_t contentSize = 0;
+
+  uint64_t nodesOffset = 0;
+  uint64_t nodesSize = 0;
+  uint64_t relocsOffset = 0;
+  uint64_t relocCount = 0;
+  uint64_t nodeTableOffset = 0;
+  uint64_t nodeCount = 0;
+  uint64_t stringsOffset = 0;
+  uint64_t stringCount = 0;
+  uint64_t diagnosticsOffset = 0;
+  uint64_t diagnosticCount = 0;
+  uint64_t rootOffset = 0; ///< CompilationUnitNode, relative to the node section
+  uint64_t imageSize = 0;  ///< Header included
+  uint64_t bodyHash = 0;   ///< Of every byte after the header
+};
+
+static_assert(std::is_trivially_copyable_v<AstImageHeader>);
+
+// ============================================================================
+// Writer
+// ============================================================================
+
+/**
+ * @brief Serializes a finished tree into a relocatable image
+ *
+ * Nodes are laid out in post-order with their child arrays; pointer slots hold
+ * offsets into the node section (0 is reserved for null). Shared nodes - the
+ * CompilationUnit's import list points at nodes that also appear in its
+ * statements - are written once.
+ *
+ * Usage:
+ *   std::vector<char> bytes = AstImageWriter::write(root, strings, content, syntaxErrors);
+ */
+class AstImageWriter {
+public:
+  [[nodiscard]] static std::vector<char> write(const CompilationUnitNode *root,
+                                               const StringTable &strings,
+                                               std::string_view content,
+                                               const std::vector<ImageDiagnostic> &diagnostics) {
+    AstImageWriter writer;
+    writer.nodes_.resize(16); // offset 0 means null
+    uint64_t rootOffset = writer.place(root);
+
+    AstImageHeader header;
+    header.build = buildFingerprint();
+    header.grammar = grammarFingerprint();
+    header.contentHash = StructuralHasher::hashBytes(content);
+    header.contentSize = content.size();
+    header.rootOffset = rootOffset;
+
+    std::vector<char> out(sizeof(AstImageHeader));
+    auto pad = [&out](size_t align) { out.resize((out.size() + align - 1) & ~(align - 1)); };
+    auto put = [&out](const void *data, size_t size) {
+      const char *p = static_cast<const char *>(data);
+      out.insert(out.end(), p, p + size);
+    };
+    auto putString = [&](std::string_view s) {
+      uint32_t len = static_cast<uint32_t>(s.size());
+      put(&len, sizeof len);
+      put(s.data(), s.size());
+    };
+
+    pad(16);
+    header.nodesOffset = out.size();
+    header.nodesSize = writer.nodes_.size();
+    put(writer.nodes_.data(), writer.nodes_.size());
+
+    pad(8);
+    header.relocsOffset = out.size();
+    header.relocCount = writer.relocs_.size();
+    put(writer.relocs_.data(), writer.relocs_.size() * sizeof(uint64_t));
+
+    header.nodeTableOffset = out.size();
+    header.nodeCount = writer.nodeOffsets_.size();
+    put(writer.nodeOffsets_.data(), writer.nodeOffsets_.size() * sizeof(uint64_t));
+
+    header.stringsOffset = out.size();
+    header.stringCount = strings.size();
+    for (uint32_t id = 1; id < strings.size(); ++id)
+      putString(strings.get(InternedString{id}));
+
+    header.diagnosticsOffset = out.size();
+    header.diagnosticCount = diagnostics.size();
+    for (const auto &d : diagnostics) {
+      uint32_t pos[4] = {d.beginLine, d.beginColumn, d.endLine, d.endColumn};
+      put(pos, sizeof pos);
+      putString(d.message);
+    }
+
+    header.imageSize = out.size();
+    header.bodyHash = StructuralHasher::hashBytes(
+        std::string_view(out.data() + sizeof header, out.size() - sizeof header));
+    std::memcpy(out.data(), &header, sizeof header);
+    return out;
+  }
+
+private:
+  AstImageWriter() = default;
+
+  /// (offset of a pointer slot within the object being emitted, target offset or 0 for null)
+  using Slots = std::vector<std::pair<uint64_t, uint64_t>>;
+
+  template <typename T> static uint64_t slotIn(const T &object, const void *field) {
+    return static_cast<uint64_t>(static_cast<const char *>(field) -
+                                 reinterpret_cast<const char *>(&object));
+  }
+
+  uint64_t append(const void *data, size_t size, size_t align) {
+    align = std::max<size_t>(align, 8);
+    size_t offset = (nodes_.size() + align - 1) & ~(align - 1);
+    nodes_.resize(offset + size);
+    std::memcpy(nodes_.data() + offset, data, size);
+    return offset;
+  }
+
+  void patch(uint64_t at, uint64_t target) {
+    std::memcpy(nodes_.data() + at, &target, sizeof target);
+    relocs_.push_back(at);
+  }
+
+  template <typename T> uint64_t emitObjects(const T *objects, size_t count, const std::vector<Slots> &slots) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint64_t offset = append(objects, sizeof(T) * count, alignof(T));
+    for (size_t i = 0; i < count; ++i)
+      for (auto [slot, target] : slots[i]) {
+        if (target)
+          patch(offset + i * sizeof(T) + slot, target);
+        else
+          std::memset(nodes_.data() + offset + i * sizeof(T) + slot, 0, sizeof(void *));
+      }
+    return offset;
+  }
+
+  // ---- Field helpers: record where each pointer of `object` must point ----
+
+  template <typename Obj, typename P> void pointer(Slots &slots, const Obj &object, P *const &field) {
+    slots.emplace_back(slotIn(object, &field), place(field));
+  }
+
+  template <typename Obj, typename E>
+  void nodeArray(Slots &slots, const Obj &object, const ArrayView<E *> &view) {
+    if (view.empty()) {
+      slots.emplace_back(slotIn(object, &view.data_), 0);
+      return;
+    }
+    std::vector<uint64_t> targets;
+    targets.reserve(view.size());
+    for (E *e : view)
+      targets.push_back(place(e));
+    uint64_t offset = append(targets.data(), targets.size() * sizeof(uint64_t), alignof(E *));
+    for (size_t i = 0; i < targets.size(); ++i)
+      if (targets[i])
+        patch(offset + i * sizeof(uint64_t), targets[i]);
+    slots.emplace_back(slotIn(object, &view.data_), offset);
+  }
+
+  template <typename Obj, typename E>
+  void podArray(Slots &slots, const Obj &object, const ArrayView<E> &view) {
+    static_assert(std::is_trivially_copyable_v<E>);
+    if (view.empty()) {
+      slots.emplace_back(slotIn(object, &view.data_), 0);
+      return;
+    }
+    slots.emplace_back(slotIn(object, &view.data_),
+                       append(view.data(), view.size() * sizeof(E), alignof(E)));
+  }
+
+  /// Array of structs that themselves hold node pointers
+  template <typename Obj, typename E, typename Fix>
+  void structArray(Slots &slots, const Obj &object, const ArrayView<E> &view, Fix &&fix) {
+    if (view.empty()) {
+      slots.emplace_back(slotIn(object, &view.data_), 0);
+      return;
+    }
+    std::vector<E> elems(view.begin(), view.end());
+    std::vector<Slots> elemSlots(elems.size());
+    for (size_t i = 0; i < elems.size(); ++i)
+      fix(elemSlots[i], elems[i]);
+    slots.emplace_back(slotIn(object, &view.data_),
+                       emitObjects(elems.data(), elems.size(), elemSlots));
+  }
+
+  template <typename T, typename Fix> uint64_t emit(const AstNode *node, Fix &&fix) {
+    T copy = *static_cast<const T *>(node);
+    std::vector<Slots> slots(1);
+    fix(slots[0], copy);
+    return emitObjects(&copy, 1, slots);
+  }
+
+  template <typename T> uint64_t plain(const AstNode *node) {
+    return emit<T>(node, [](Slots &, const T &) {});
+  }
+
+  /**
+   * @brief Write `node` (and everything it points to) once, return its offset
+   */
+  uint64_t place(const AstNode *node) {
+    if (!node)
+      return 0;
+    if (auto it = placed_.find(node); it != placed_.end())
+      return it->second;
+    uint64_t offset = placeNode(node);
+    placed_.emplace(node, offset);
+    if (offset)
+      nodeOffsets_.push_back(offset);
+    return offset;
+  }
+
+  uint64_t placeNode(const AstNode *node) {
+    switch (node->kind) {
+    // ---- Expressions ----
+    case AstKind::ErrorExpr:
+      return plain<ErrorExprNode>(node);
+    case AstKind::MissingExpr:
+      return plain<MissingExprNode>(node);
+    case AstKind::NullLiteral:
+      return plain<NullLiteralNode>(node);
+    case AstKind::BoolLiteral:
+      return plain<BoolLiteralNode>(node);
+    case AstKind::IntLiteral:
+      return plain<IntLiteralNode>(node);
+    case AstKind::FloatLiteral:
+      return plain<FloatLiteralNode>(node);
+    case AstKind::StringLiteral:
+      return plain<StringLiteralNode>(node);
+    case AstKind::Identifier:
+      return plain<IdentifierNode>(node);
+    case AstKind::QualifiedIdentifier:
+      return emit<QualifiedIdentifierNode>(
+          node, [&](Slots &s, const auto &n) { podArray(s, n, n.parts); });
+    case AstKind::MemberAccessExpr:
+      return emit<MemberAccessExprNode>(node,
+                                        [&](Slots &s, const auto &n) { pointer(s, n, n.base); });
+    case AstKind::IndexExpr:
+      return emit<IndexExprNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.base);
+        pointer(s, n, n.index);
+      });
+    case AstKind::ColonLookupExpr:
+      return emit<ColonLookupExprNode>(node,
+                                       [&](Slots &s, const auto &n) { pointer(s, n, n.base); });
+    case AstKind::BinaryExpr:
+      return emit<BinaryExprNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.left);
+        pointer(s, n, n.right);
+      });
+    case AstKind::UnaryExpr:
+      return emit<UnaryExprNode>(node, [&](Slots &s, const auto &n) { pointer(s, n, n.operand); });
+    case AstKind::CallExpr:
+      return emit<CallExprNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.callee);
+        nodeArray(s, n, n.arguments);
+      });
+    case AstKind::NewExpr:
+      return emit<NewExprNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.typeName);
+        nodeArray(s, n, n.arguments);
+      });
+    case AstKind::ListExpr:
+      return emit<ListExprNode>(node, [&](Slots &s, const auto &n) { nodeArray(s, n, n.elements); });
+    case AstKind::MapExpr:
+      return emit<MapExprNode>(node, [&](Slots &s, const auto &n) { nodeArray(s, n, n.entries); });
+    case AstKind::MapEntryExpr:
+      return emit<MapEntryNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.key);
+        pointer(s, n, n.value);
+      });
+    case AstKind::LambdaExpr:
+      return emit<LambdaExprNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.returnType);
+        nodeArray(s, n, n.params);
+        pointer(s, n, n.body);
+      });
+    case AstKind::ParenExpr:
+      return emit<ParenExprNode>(node, [&](Slots &s, const auto &n) { pointer(s, n, n.inner); });
+    case AstKind::VarArgsExpr:
+      return plain<VarArgsExprNode>(node);
+
+    // ---- Statements ----
+    case AstKind::ErrorStmt:
+      return plain<ErrorStmtNode>(node);
+    case AstKind::EmptyStmt:
+      return plain<EmptyStmtNode>(node);
+    case AstKind::ExprStmt:
+      return emit<ExprStmtNode>(node, [&](Slots &s, const auto &n) { pointer(s, n, n.expr); });
+    case AstKind::BlockStmt:
+      return emit<BlockStmtNode>(node,
+                                 [&](Slots &s, const auto &n) { nodeArray(s, n, n.statements); });
+    case AstKind::AssignStmt:
+      return emit<AssignStmtNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.target.expr);
+        pointer(s, n, n.value);
+      });
+    case AstKind::MultiAssignStmt:
+      return emit<MultiAssignStmtNode>(node, [&](Slots &s, const auto &n) {
+        structArray(s, n, n.targets,
+                    [&](Slots &es, const LValue &lv) { pointer(es, lv, lv.expr); });
+        nodeArray(s, n, n.values);
+      });
+    case AstKind::UpdateAssignStmt:
+      return emit<UpdateAssignStmtNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.target.expr);
+        pointer(s, n, n.value);
+      });
+    case AstKind::IfStmt:
+      return emit<IfStmtNode>(node, [&](Slots &s, const auto &n) {
+        structArray(s, n, n.branches, [&](Slots &es, const IfStmtNode::Branch &b) {
+          pointer(es, b, b.condition);
+          pointer(es, b, b.body);
+        });
+        pointer(s, n, n.elseBody);
+      });
+    case AstKind::WhileStmt:
+      return emit<WhileStmtNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.condition);
+        pointer(s, n, n.body);
+      });
+    case AstKind::ForStmt:
+      return emit<ForStmtNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.init);
+        pointer(s, n, n.condition);
+        nodeArray(s, n, n.updates);
+        nodeArray(s, n, n.iterVars);
+        pointer(s, n, n.collection);
+        pointer(s, n, n.body);
+      });
+    case AstKind::BreakStmt:
+      return plain<BreakStmtNode>(node);
+    case AstKind::ContinueStmt:
+      return plain<ContinueStmtNode>(node);
+    case AstKind::ReturnStmt:
+      return emit<ReturnStmtNode>(node, [&](Slots &s, const auto &n) { nodeArray(s, n, n.values); });
+    case AstKind::DeferStmt:
+      return emit<DeferStmtNode>(node, [&](Slots &s, const auto &n) { pointer(s, n, n.body); });
+    case AstKind::ImportStmt:
+      return emit<ImportStmtNode>(node,
+                                  [&](Slots &s, const auto &n) { podArray(s, n, n.specifiers); });
+    case AstKind::DeclStmt:
+      return emit<DeclStmtNode>(node, [&](Slots &s, const auto &n) { pointer(s, n, n.decl); });
+
+    // ---- Declarations ----
+    case AstKind::ErrorDecl:
+      return plain<ErrorDeclNode>(node);
+    case AstKind::VarDecl:
+      return emit<VarDeclNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.type);
+        pointer(s, n, n.initializer);
+      });
+    case AstKind::MultiVarDecl:
+      return emit<MultiVarDeclNode>(node, [&](Slots &s, const auto &n) {
+        podArray(s, n, n.names);
+        pointer(s, n, n.initializer);
+      });
+    case AstKind::ParameterDecl:
+      return emit<ParameterDeclNode>(node, [&](Slots &s, const auto &n) { pointer(s, n, n.type); });
+    case AstKind::FunctionDecl:
+      return emit<FunctionDeclNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.returnType);
+        nodeArray(s, n, n.parameters);
+        pointer(s, n, n.body);
+        pointer(s, n, n.qualifiedName);
+      });
+    case AstKind::FieldDecl:
+      return emit<FieldDeclNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.type);
+        pointer(s, n, n.initializer);
+      });
+    case AstKind::MethodDecl:
+      return emit<MethodDeclNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.returnType);
+        nodeArray(s, n, n.parameters);
+        pointer(s, n, n.body);
+      });
+    case AstKind::ClassDecl:
+      return emit<ClassDeclNode>(node, [&](Slots &s, const auto &n) {
+        nodeArray(s, n, n.fields);
+        nodeArray(s, n, n.methods);
+      });
+    case AstKind::CompilationUnit:
+      return emit<CompilationUnitNode>(node, [&](Slots &s, const auto &n) {
+        nodeArray(s, n, n.statements);
+        nodeArray(s, n, n.imports);
+      });
+
+    // ---- Types ----
+    case AstKind::ErrorType:
+      return plain<ErrorTypeNode>(node);
+    case AstKind::InferredType:
+      return plain<InferredTypeNode>(node);
+    case AstKind::PrimitiveType:
+      return plain<PrimitiveTypeNode>(node);
+    case AstKind::AnyType:
+      return plain<AnyTypeNode>(node);
+    case AstKind::ListType:
+      return emit<ListTypeNode>(node,
+                                [&](Slots &s, const auto &n) { pointer(s, n, n.elementType); });
+    case AstKind::MapType:
+      return emit<MapTypeNode>(node, [&](Slots &s, const auto &n) {
+        pointer(s, n, n.keyType);
+        pointer(s, n, n.valueType);
+      });
+    case AstKind::QualifiedType:
+      return emit<QualifiedTypeNode>(node, [&](Slots &s, const auto &n) { pointer(s, n, n.name); });
+    case AstKind::MultiReturnType:
+      return plain<MultiReturnTypeNode>(node);
+
+    default:
+      // Unknown kind: keep the slot null rather than writing garbage
+      return 0;
+    }
+  }
+
+  std::vector<char> nodes_;
+  std::vector<uint64_t> relocs_;
+  std::vector<uint64_t> nodeOffsets_;
+  std::unordered_map<const AstNode *, uint64_t> placed_;
+};
+
+// ============================================================================
+// Reader
+// ============================================================================
+
+/**
+ * @brief Validates and relocates an image in writable memory
+ */
+class AstImageReader {
+public:
+  /**
+   * @brief Turn the image at `data` into a live tree
+   *
+   * Interns the image's strings into `factory`, which must be fresh so that
+   * the ids stored in the nodes stay valid, and adds the nodes to its index.
+   *
+   * @return The root, or nullptr if the image is stale, corrupt or from
+   *         another build (`factory` may then hold partial state)
+   */
+  [[nodiscard]] static CompilationUnitNode *relocate(char *data, size_t size,
+                                                     std::string_view content,
+                                                     AstFactory &factory,
+                                                     std::vector<ImageDiagnostic> &diagnostics) {
+    StringTable &strings = factory.strings();
+    if (size < sizeof(AstImageHeader) || strings.size() != 1 || factory.index().size() != 0)
+      return nullptr;
+
+    AstImageHeader h;
+    std::memcpy(&h, data, sizeof h);
+    if (h.magic != AstImageHeader::Magic || h.formatVersion != AstImageFormatVersion ||
+        h.pointerSize != sizeof(void *) || h.layout != AstLayoutFingerprint ||
+        h.build != buildFingerprint() || h.grammar != grammarFingerprint() ||
+        h.contentSize != content.size() || h.imageSize != size)
+      return nullptr;
+
+    auto within = [size](uint64_t offset, uint64_t length) {
+      return offset <= size && length <= size - offset;
+    };
+    if (h.nodesOffset % 16 != 0 || !within(h.nodesOffset, h.nodesSize) ||
+        h.relocsOffset % 8 != 0 || h.relocCount > size / sizeof(uint64_t) ||
+        !within(h.relocsOffset, h.relocCount * sizeof(uint64_t)) ||
+        h.nodeTableOffset % 8 != 0 || h.nodeCount > size / sizeof(uint64_t) ||
+        !within(h.nodeTableOffset, h.nodeCount * sizeof(uint64_t)) ||
+        !within(h.stringsOffset, 0) || !within(h.diagnosticsOffset, 0) ||
+        h.rootOffset == 0 || !within(h.rootOffset, sizeof(CompilationUnitNode)) ||
+        h.rootOffset + sizeof(CompilationUnitNode) > h.nodesSize)
+      return nullptr;
+
+    // Hashing is the expensive check; do it after the cheap ones, and before any byte of the
+    // body is trusted
+    if (h.contentHash != StructuralHasher::hashBytes(content) ||
+        h.bodyHash != StructuralHasher::hashBytes(
+                          std::string_view(data + sizeof h, size - sizeof h)))
+      return nullptr;
+
+    char *nodes = data + h.nodesOffset;
+    const char *relocs = data + h.relocsOffset;
+    uintptr_t base = reinterpret_cast<uintptr_t>(nodes);
+    for (uint64_t i = 0; i < h.relocCount; ++i) {
+      uint64_t slot;
+      std::memcpy(&slot, relocs + i * sizeof(uint64_t), sizeof slot);
+      if (slot % 8 != 0 || slot + sizeof(uint64_t) > h.nodesSize)
+        return nullptr;
+      uint64_t target;
+      std::memcpy(&target, nodes + slot, sizeof target);
+      if (target == 0 || target >= h.nodesSize)
+        return nullptr;
+      uintptr_t address = base + static_cast<uintptr_t>(target);
+      std::memcpy(nodes + slot, &address, sizeof address);
+    }
+
+    std::vector<AstNode *> indexed;
+    indexed.reserve(h.nodeCount);
+    const char *table = data + h.nodeTableOffset;
+    for (uint64_t i = 0; i < h.nodeCount; ++i) {
+      uint64_t offset;
+      std::memcpy(&offset, table + i * sizeof(uint64_t), sizeof offset);
+      if (offset == 0 || offset % 8 != 0 || offset + sizeof(AstNode) > h.nodesSize)
+        return nullptr;
+      auto *node = reinterpret_cast<AstNode *>(nodes + offset);
+      if (!isExpr(node->kind) && !isStmt(node->kind) && !isDecl(node->kind) &&
+          !isType(node->kind))
+        return nullptr;
+      indexed.push_back(node);
+    }
+
+    const char *cursor = data + h.stringsOffset;
+    const char *end = data + size;
+    auto readString = [&cursor, end](std::string_view &out) {
+      uint32_t len;
+      if (end - cursor < static_cast<ptrdiff_t>(sizeof len))
+        return false;
+      std::memcpy(&len, cursor, sizeof len);
+      cursor += sizeof len;
+      if (static_cast<uint64_t>(end - cursor) < len)
+        return false;
+      out = std::string_view(cursor, len);
+      cursor += len;
+      return true;
+    };
+
+    // 按原顺序重新 intern，id 必须一一对上
+    for (uint64_t id = 1; id < h.stringCount; ++id) {
+      std::string_view s;
+      if (!readString(s) || strings.intern(s).id != id)
+        return nullptr;
+    }
+
+    cursor = data + h.diagnosticsOffset;
+    for (uint64_t i = 0; i < h.diagnosticCount; ++i) {
+      ImageDiagnostic d;
+      uint32_t pos[4];
+      if (end - cursor < static_cast<ptrdiff_t>(sizeof pos))
+        return nullptr;
+      std::memcpy(pos, cursor, sizeof pos);
+      cursor += sizeof pos;
+      std::string_view message;
+      if (!readString(message))
+        return nullptr;
+      d.beginLine = pos[0];
+      d.beginColumn = pos[1];
+      d.endLine = pos[2];
+      d.endColumn = pos[3];
+      d.message = std::string(message);
+      diagnostics.push_back(std::move(d));
+    }
+
+    auto *root = reinterpret_cast<CompilationUnitNode *>(nodes + h.rootOffset);
+    if (root->kind != AstKind::CompilationUnit)
+      return nullptr;
+    for (auto *node : indexed)
+      factory.indexNode(node);
+    return root;
+  }
+};
+
+// ============================================================================
+// Cache Directory
+// ============================================================================
+
+/**
+ * @brief Directory of AST images keyed by document content
+ *
+ * Images are keyed by document content and source name (the tree records its
+ * filename). Thread-safe: images are written to a temporary file and renamed
+ * into place, and each load maps its own private copy.
+ *
+ * Usage:
+ *   AstImageCache cache("/tmp/lang-ast");
+ *   if (auto *cu = cache.load(content, path, factory, syntaxErrors)) { ... }
+ *   else { parse; cache.store(content, path, cu, factory.strings(), syntaxErrors); }
+ */
+class AstImageCache {
+public:
+  /// Below this size a parse is about as fast as opening a file
+  static constexpr size_t DefaultMinContentBytes = 16 * 1024;
+  static constexpr size_t DefaultMaxImages = 512;
+
+  explicit AstImageCache(std::string directory, size_t minContentBytes = DefaultMinContentBytes,
+                         size_t maxImages = DefaultMaxImages)
+      : directory_(std::move(directory)), minContentBytes_(minContentBytes),
+        maxImages_(maxImages) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+  }
+
+  [[nodiscard]] const std::string &directory() const noexcept { return directory_; }
+  [[nodiscard]] size_t minContentBytes() const noexcept { return minContentBytes_; }
+
+  /**
+   * @brief Map the image for `content` into `factory`
+   *
+   * `factory` must be fresh. On success it keeps the mapping alive and owns
+   * the strings; on failure it may hold a partial string table and should be
+   * reset before parsing.
+   */
+  [[nodiscard]] CompilationUnitNode *load(std::string_view content, std::string_view sourceName,
+                                          AstFactory &factory,
+                                          std::vector<ImageDiagnostic> &diagnostics) {
+    std::string path = pathFor(content, sourceName);
+    auto image = mapFile(path);
+    if (!image.data) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    auto *root = AstImageReader::relocate(static_cast<char *>(image.data.get()), image.size,
+                                          content, factory, diagnostics);
+    if (!root) {
+      LSP_LOG("AstImageCache: rejected stale image " << path);
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+      diagnostics.clear();
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    factory.retainStorage(std::move(image.data));
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return root;
+  }
+
+  /**
+   * @brief Write the image for a tree parsed from `content`
+   */
+  bool store(std::string_view content, std::string_view sourceName,
+             const CompilationUnitNode *root, const StringTable &strings,
+             const std::vector<ImageDiagnostic> &diagnostics) {
+    if (!root || content.size() < minContentBytes_)
+      return false;
+
+    std::vector<char> bytes = AstImageWriter::write(root, strings, content, diagnostics);
+    std::string path = pathFor(content, sourceName);
+    std::string temp =
+        path + ".tmp" + std::to_string(tempCounter_.fetch_add(1, std::memory_order_relaxed));
+    {
+      std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+      if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::filesystem::remove(temp, ec);
+      return false;
+    }
+
+    stores_.fetch_add(1, std::memory_order_relaxed);
+    prune();
+    return true;
+  }
+
+  [[nodiscard]] uint64_t hits() const noexcept { return hits_.load(std::memory_order_relaxed); }
+  [[nodiscard]] uint64_t misses() const noexcept { return misses_.load(std::memory_order_relaxed); }
+  [[nodiscard]] uint64_t stores() const noexcept { return stores_.load(std::memory_order_relaxed); }
+
+private:
+  struct MappedFile {
+    std::shared_ptr<void> data;
+    size_t size = 0;
+  };
+
+  [[nodiscard]] std::string pathFor(std::string_view content, std::string_view sourceName) const {
+    uint64_t source = image_detail::mix(StructuralHasher::hashBytes(sourceName), content.size());
+    char name[48];
+    std::snprintf(name, sizeof name, "%016llx-%016llx.astimg",
+                  static_cast<unsigned long long>(StructuralHasher::hashBytes(content)),
+                  static_cast<unsigned long long>(source));
+    return (std::filesystem::path(directory_) / name).string();
+  }
+
+  /**
+   * @brief Map `path` copy-on-write; relocation writes never reach the file
+   */
+  static MappedFile mapFile(const std::string &path) {
+    MappedFile result;
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return result;
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(AstImageHeader))) {
+      ::close(fd);
+      return result;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void *addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+      return result;
+    result.data = std::shared_ptr<void>(addr, [size](void *p) { ::munmap(p, size); });
+    result.size = size;
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+      return result;
+    size_t size = static_cast<size_t>(in.tellg());
+    if (size < sizeof(AstImageHeader))
+      return result;
+    // operator new alignment is enough for the 16-byte aligned node section
+    std::shared_ptr<void> buffer(::operator new(size), [](void *p) { ::operator delete(p); });
+    in.seekg(0);
+    if (!in.read(static_cast<char *>(buffer.get()), static_cast<std::streamsize>(size)))
+      return result;
+    result.data = std::move(buffer);
+    result.size = size;
+#endif
+    return result;
+  }
+
+  /**
+   * @brief Remove the least recently used images beyond the cap
+   */
+  void prune() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, fs::path>> images;
+    for (const auto &entry : fs::directory_iterator(directory_, ec)) {
+      if (entry.path().extension() == ".astimg")
+        images.emplace_back(entry.last_write_time(ec), entry.path());
+    }
+    if (images.size() <= maxImages_)
+      return;
+
+    std::sort(images.begin(), images.end());
+    size_t excess = images.size() - maxImages_;
+    for (size_t i = 0; i < excess; ++i)
+      fs::remove(images[i].second, ec);
+  }
+
+  std::string directory_;
+  size_t minContentBytes_;
+  size_t maxImages_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> stores_{0};
+  std::atomic<uint64_t> tempCounter_{0};
+};
+
+} // namespace ast
+} // namespace lang
@@ -717,7 +717,10 @@ struct VarArgsExprNode : Expr {
 /**
  * @brief Base for all statement nodes
  */
-struct Stmt : AstNode {};
+struct Stmt : AstNode {
+  /// Position-independent hash of this subtree (see StructuralHash.h), 0 = not computed
+  uint64_t structuralHash = 0;
+};
 
 // --------------------------------------------------------------------------
 // Error & Basic Statements
@@ -953,6 +956,9 @@ struct DeclStmtNode : Stmt {
 struct Decl : AstNode {
   InternedString name; ///< Declared name (may be empty for error)
 
+  /// Position-independent hash of this subtree (see StructuralHash.h), 0 = not computed
+  uint64_t structuralHash = 0;
+
   [[nodiscard]] bool isGlobal() const noexcept { return hasFlag(flags, NodeFlags::IsGlobal); }
 
   [[nodiscard]] bool isConst() const noexcept { return hasFlag(flags, NodeFlags::IsConst); }
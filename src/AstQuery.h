@@ -0,0 +1,255 @@
+/**
+ * @file AstQuery.h
+ * @brief Structural Queries over the Arena AST
+ *
+ * NodeFinder::findAllOfType walks the whole tree for every question of the
+ * form "all calls to print" or "all imports". NodeQuery answers them from the
+ * factory's per-kind NodeIndex instead: candidates come straight from the
+ * kind buckets, then cheap structural filters are applied, so the cost is
+ * proportional to the nodes of the requested kinds rather than the tree.
+ *
+ * Key Features:
+ * - Kind filters (one or several kinds, or a whole category)
+ * - Name filters compared by InternedString id; a name the file never
+ *   interned matches nothing without touching a node
+ * - Callee, source range and arbitrary predicate filters
+ * - Error-recovery nodes (error kinds, placeholders without a position) never match
+ * - Lazy: forEach()/first()/count() never materialize a result vector
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "AstFactory.h"
+#include "AstNodes.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace lang {
+namespace ast {
+
+/**
+ * @brief The name a node declares or refers to
+ *
+ * Identifier and declaration names, accessed members, the last part of a
+ * qualified name, a qualified type's name and an import's module path.
+ */
+[[nodiscard]] inline InternedString nodeName(const AstNode *node) noexcept {
+  if (!node)
+    return {};
+  if (isDecl(node->kind))
+    return static_cast<const Decl *>(node)->name;
+
+  switch (node->kind) {
+  case AstKind::Identifier:
+    return static_cast<const IdentifierNode *>(node)->name;
+  case AstKind::MemberAccessExpr:
+    return static_cast<const MemberAccessExprNode *>(node)->member;
+  case AstKind::ColonLookupExpr:
+    return static_cast<const ColonLookupExprNode *>(node)->member;
+  case AstKind::QualifiedIdentifier: {
+    const auto &parts = static_cast<const QualifiedIdentifierNode *>(node)->parts;
+    return parts.empty() ? InternedString{} : parts[parts.size() - 1];
+  }
+  case AstKind::QualifiedType:
+    return nodeName(static_cast<const QualifiedTypeNode *>(node)->name);
+  case AstKind::ImportStmt:
+    return static_cast<const ImportStmtNode *>(node)->modulePath;
+  default:
+    return {};
+  }
+}
+
+/**
+ * @brief Kind-indexed query over the nodes of one factory
+ *
+ * Usage:
+ *   NodeQuery q(file.factory());
+ *   q.ofType<CallExprNode>().callee("print");
+ *   q.forEach([](AstNode* call) { ... });
+ *
+ *   auto classes = NodeQuery(factory).ofType<ClassDeclNode>().named("Vec").collect();
+ */
+class NodeQuery {
+public:
+  using Predicate = std::function<bool(const AstNode *)>;
+
+  explicit NodeQuery(const AstFactory &factory) : factory_(&factory) {}
+
+  // ========================================================================
+  // Filters
+  // ========================================================================
+
+  /**
+   * @brief Add a kind to match (kinds are OR-ed; no kind = every kind)
+   */
+  NodeQuery &ofKind(AstKind kind) {
+    if (std::find(kinds_.begin(), kinds_.end(), kind) == kinds_.end())
+      kinds_.push_back(kind);
+    return *this;
+  }
+
+  template <typename T> NodeQuery &ofType() { return ofKind(T::Kind); }
+
+  /**
+   * @brief Match every kind of a category, e.g. all statements
+   */
+  NodeQuery &ofCategory(AstKind begin, AstKind end) {
+    for (auto k = static_cast<uint16_t>(begin); k < static_cast<uint16_t>(end); ++k)
+      ofKind(static_cast<AstKind>(k));
+    return *this;
+  }
+
+  /**
+   * @brief Only nodes whose nodeName() is `name`
+   */
+  NodeQuery &named(std::string_view name) {
+    name_ = internedOrNone(name);
+    return *this;
+  }
+
+  /**
+   * @brief Only CallExprs whose callee's nodeName() is `name`
+   *
+   * Matches `print(x)`, `obj.print(x)` and `mod:print(x)` alike.
+   */
+  NodeQuery &callee(std::string_view name) {
+    ofType<CallExprNode>();
+    callee_ = internedOrNone(name);
+    return *this;
+  }
+
+  /**
+   * @brief Only nodes lying inside `range`
+   *
+   * Compares AST offsets, which count code points. Take the range from a node,
+   * or convert byte offsets (SourceFile::getOffset) with
+   * SourceFile::codePointOffsetOf first.
+   */
+  NodeQuery &within(SourceRange range) {
+    within_ = range;
+    return *this;
+  }
+
+  /**
+   * @brief Only nodes satisfying `predicate` (applied last)
+   */
+  NodeQuery &where(Predicate predicate) {
+    predicates_.push_back(std::move(predicate));
+    return *this;
+  }
+
+  // ========================================================================
+  // Execution
+  // ========================================================================
+
+  /**
+   * @brief Call `func(AstNode*)` for every match; stop early if it returns false
+   */
+  template <typename Func> void forEach(Func &&func) const {
+    if (empty_)
+      return;
+
+    auto visit = [&](const std::vector<AstNode *> &bucket) {
+      for (auto *node : bucket) {
+        if (!matches(node))
+          continue;
+        if constexpr (std::is_same_v<std::invoke_result_t<Func &, AstNode *>, bool>) {
+          if (!func(node))
+            return false;
+        } else {
+          func(node);
+        }
+      }
+      return true;
+    };
+
+    const NodeIndex &index = factory_->index();
+    if (!kinds_.empty()) {
+      for (AstKind kind : kinds_)
+        if (!visit(index.nodesOf(kind)))
+          return;
+      return;
+    }
+    for (AstKind begin : {AstKind::ExprBegin, AstKind::StmtBegin, AstKind::DeclBegin,
+                          AstKind::TypeBegin}) {
+      AstKind end = begin == AstKind::ExprBegin   ? AstKind::ExprEnd
+                    : begin == AstKind::StmtBegin ? AstKind::StmtEnd
+                    : begin == AstKind::DeclBegin ? AstKind::DeclEnd
+                                                  : AstKind::TypeEnd;
+      for (auto k = static_cast<uint16_t>(begin); k < static_cast<uint16_t>(end); ++k)
+        if (!visit(index.nodesOf(static_cast<AstKind>(k))))
+          return;
+    }
+  }
+
+  [[nodiscard]] std::vector<AstNode *> collect() const {
+    std::vector<AstNode *> result;
+    forEach([&](AstNode *node) { result.push_back(node); });
+    return result;
+  }
+
+  [[nodiscard]] AstNode *first() const {
+    AstNode *found = nullptr;
+    forEach([&](AstNode *node) {
+      found = node;
+      return false;
+    });
+    return found;
+  }
+
+  [[nodiscard]] size_t count() const {
+    size_t n = 0;
+    forEach([&](AstNode *) { ++n; });
+    return n;
+  }
+
+private:
+  /// Names are compared by id; a string the file never interned cannot match
+  std::optional<InternedString> internedOrNone(std::string_view name) {
+    auto id = factory_->strings().lookup(name);
+    if (!id)
+      empty_ = true;
+    return id;
+  }
+
+  [[nodiscard]] bool matches(const AstNode *node) const {
+    // Stand-ins the tolerant builder made up for missing source are not results
+    if (isError(node->kind) || node->isFromRecovery() || node->isSynthetic() ||
+        !node->range.begin.isValid())
+      return false;
+    if (name_ && nodeName(node) != *name_)
+      return false;
+    if (callee_) {
+      if (node->kind != AstKind::CallExpr)
+        return false;
+      if (nodeName(static_cast<const CallExprNode *>(node)->callee) != *callee_)
+        return false;
+    }
+    if (within_ && (node->range.begin.offset < within_->begin.offset ||
+                    node->range.end.offset > within_->end.offset))
+      return false;
+    for (const auto &predicate : predicates_)
+      if (!predicate(node))
+        return false;
+    return true;
+  }
+
+  const AstFactory *factory_;
+  std::vector<AstKind> kinds_;
+  std::optional<InternedString> name_;
+  std::optional<InternedString> callee_;
+  std::optional<SourceRange> within_;
+  std::vector<Predicate> predicates_;
+  bool empty_ = false; ///< A filter can never match
+};
+
+} // namespace ast
+} // namespace lang
@@ -0,0 +1,512 @@
+/**
+ * @file CompressedTextStore.h
+ * @brief Compressed Resident Text for Indexed-but-Unopened Files
+ *
+ * Keeps the text of files that are known to the workspace but not open in the
+ * editor, compressed in memory. Features that occasionally need such text
+ * (rename edits, hover snippets, cross-file edits) decode only the block that
+ * holds the requested line instead of keeping the whole file resident.
+ *
+ * Key Features:
+ * - Built-in LZ4-style block compressor (no external dependency)
+ * - Blocks split at line boundaries for block-wise random access
+ * - One-block decode cache for consecutive lookups in the same file
+ * - Memory and decode-latency statistics
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "LineOffsetTable.h"
+#include "StructuralHash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lang {
+namespace lsp {
+
+// ============================================================================
+// LZ Block Codec
+// ============================================================================
+
+namespace lz {
+
+constexpr size_t MinMatch = 4;
+constexpr size_t LastLiterals = 5; ///< Trailing bytes always emitted as literals
+constexpr size_t MaxOffset = 65535;
+constexpr int HashBits = 12;
+
+namespace detail {
+
+[[nodiscard]] inline uint32_t read32(const uint8_t *p) noexcept {
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+[[nodiscard]] inline uint32_t hash(uint32_t sequence) noexcept {
+  return (sequence * 2654435761u) >> (32 - HashBits);
+}
+
+inline void writeLength(std::string &out, size_t length) {
+  while (length >= 255) {
+    out.push_back(static_cast<char>(255));
+    length -= 255;
+  }
+  out.push_back(static_cast<char>(length));
+}
+
+inline void emitSequence(std::string &out, const uint8_t *literals, size_t literalLength,
+                         size_t offset, size_t matchLength) {
+  size_t matchCode = matchLength - MinMatch;
+  uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) |
+                                       std::min<size_t>(matchCode, 15));
+  out.push_back(static_cast<char>(token));
+  if (literalLength >= 15) {
+    writeLength(out, literalLength - 15);
+  }
+  out.append(reinterpret_cast<const char *>(literals), literalLength);
+  out.push_back(static_cast<char>(offset & 0xFF));
+  out.push_back(static_cast<char>((offset >> 8) & 0xFF));
+  if (matchCode >= 15) {
+    writeLength(out, matchCode - 15);
+  }
+}
+
+inline void emitLastLiterals(std::string &out, const uint8_t *literals, size_t literalLength) {
+  uint8_t token = static_cast<uint8_t>(std::min<size_t>(literalLength, 15) << 4);
+  out.push_back(static_cast<char>(token));
+  if (literalLength >= 15) {
+    writeLength(out, literalLength - 15);
+  }
+  out.append(reinterpret_cast<const char *>(literals), literalLength);
+}
+
+} // namespace detail
+
+/**
+ * @brief Compress a block (LZ4 block format)
+ */
+[[nodiscard]] inline std::string compress(std::string_view input) {
+  std::string out;
+  out.reserve(input.size() / 2 + 16);
+
+  const auto *src = reinterpret_cast<const uint8_t *>(input.data());
+  const size_t size = input.size();
+  size_t anchor = 0;
+
+  if (size >= MinMatch + LastLiterals) {
+    std::vector<int32_t> table(size_t{1} << HashBits, -1);
+    const size_t matchLimit = size - LastLiterals;
+    size_t i = 0;
+
+    while (i + MinMatch <= matchLimit) {
+      uint32_t sequence = detail::read32(src + i);
+      uint32_t h = detail::hash(sequence);
+      int32_t candidate = table[h];
+      table[h] = static_cast<int32_t>(i);
+
+      if (candidate >= 0 && i - static_cast<size_t>(candidate) <= MaxOffset &&
+          detail::read32(src + candidate) == sequence) {
+        size_t length = MinMatch;
+        while (i + length < matchLimit && src[candidate + length] == src[i + length]) {
+          ++length;
+        }
+        detail::emitSequence(out, src + anchor, i - anchor, i - static_cast<size_t>(candidate),
+                             length);
+        i += length;
+        anchor = i;
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  detail::emitLastLiterals(out, src + anchor, size - anchor);
+  return out;
+}
+
+/**
+ * @brief Decompress a block produced by compress()
+ * @param input Compressed bytes
+ * @param output Destination, must be exactly the original size
+ * @return false if the input is malformed
+ */
+[[nodiscard]] inline bool decompress(std::string_view input, char *output,
+                                     size_t outputSize) noexcept {
+  const auto *src = reinterpret_cast<const uint8_t *>(input.data());
+  const auto *srcEnd = src + input.size();
+  char *dst = output;
+  char *dstEnd = output + outputSize;
+
+  auto readLength = [&](size_t &length) -> bool {
+    uint8_t b;
+    do {
+      if (src >= srcEnd)
+        return false;
+      b = *src++;
+      length += b;
+    } while (b == 255);
+    return true;
+  };
+
+  while (src < srcEnd) {
+    uint8_t token = *src++;
+
+    size_t literalLength = token >> 4;
+    if (literalLength == 15 && !readLength(literalLength))
+      return false;
+    if (literalLength > static_cast<size_t>(srcEnd - src) ||
+        literalLength > static_cast<size_t>(dstEnd - dst))
+      return false;
+    std::memcpy(dst, src, literalLength);
+    src += literalLength;
+    dst += literalLength;
+
+    if (src >= srcEnd)
+      break; // Last sequence carries literals only
+
+    if (srcEnd - src < 2)
+      return false;
+    size_t offset = static_cast<size_t>(src[0]) | (static_cast<size_t>(src[1]) << 8);
+    src += 2;
+
+    size_t matchLength = token & 0x0F;
+    if (matchLength == 15 && !readLength(matchLength))
+      return false;
+    matchLength += MinMatch;
+
+    if (offset == 0 || offset > static_cast<size_t>(dst - output) ||
+        matchLength > static_cast<size_t>(dstEnd - dst))
+      return false;
+
+    // 重叠拷贝：offset 小于长度时必须逐字节复制
+    const char *match = dst - offset;
+    for (size_t k = 0; k < matchLength; ++k) {
+      dst[k] = match[k];
+    }
+    dst += matchLength;
+  }
+
+  return dst == dstEnd;
+}
+
+} // namespace lz
+
+// ============================================================================
+// Compressed Text Store
+// ============================================================================
+
+/**
+ * @brief In-memory compressed text for files that are not open in the editor
+ *
+ * Usage:
+ *   CompressedTextStore store;
+ *   store.put(uri, text);
+ *
+ *   auto line = store.getLine(uri, 42);            // decodes one block
+ *   auto slice = store.getSlice(uri, 100, 180);    // decodes covering blocks
+ *   auto stats = store.stats();                    // memory vs decode latency
+ *
+ * Thread-safe: all operations take an internal lock.
+ */
+class CompressedTextStore {
+public:
+  static constexpr size_t DefaultBlockSize = 16 * 1024;
+
+  /**
+   * @brief Memory and latency figures
+   */
+  struct Stats {
+    size_t documents = 0;
+    size_t blocks = 0;
+    size_t rawBytes = 0;        ///< Uncompressed size of all stored text
+    size_t compressedBytes = 0; ///< Resident compressed size
+    uint64_t blockDecodes = 0;  ///< Blocks decompressed on demand
+    uint64_t cacheHits = 0;     ///< Lookups served by the decoded-block cache
+    uint64_t decodeNanos = 0;   ///< Total time spent decompressing
+
+    [[nodiscard]] double compressionRatio() const noexcept {
+      return compressedBytes ? static_cast<double>(rawBytes) / compressedBytes : 0.0;
+    }
+
+    [[nodiscard]] double averageDecodeMicros() const noexcept {
+      return blockDecodes ? static_cast<double>(decodeNanos) / blockDecodes / 1000.0 : 0.0;
+    }
+  };
+
+  explicit CompressedTextStore(size_t blockSize = DefaultBlockSize) : blockSize_(blockSize) {}
+
+  // Non-copyable
+  CompressedTextStore(const CompressedTextStore &) = delete;
+  CompressedTextStore &operator=(const CompressedTextStore &) = delete;
+
+  // ========================================================================
+  // Storage
+  // ========================================================================
+
+  /**
+   * @brief Store (or replace) the text of a document
+   */
+  void put(const std::string &uri, std::string_view text) {
+    Document doc = encode(text);
+    std::lock_guard<std::mutex> lock(mutex_);
+    dropCache(uri);
+    documents_[uri] = std::move(doc);
+  }
+
+  /**
+   * @brief Remove a document
+   */
+  void erase(const std::string &uri) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dropCache(uri);
+    documents_.erase(uri);
+  }
+
+  [[nodiscard]] bool contains(const std::string &uri) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return documents_.find(uri) != documents_.end();
+  }
+
+  /**
+   * @brief URIs of the stored documents, in no particular order
+   */
+  [[nodiscard]] std::vector<std::string> uris() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> result;
+    result.reserve(documents_.size());
+    for (const auto &[uri, _] : documents_)
+      result.push_back(uri);
+    return result;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    documents_.clear();
+    cachedUri_.clear();
+    cachedText_.clear();
+  }
+
+  // ========================================================================
+  // Random Access
+  // ========================================================================
+
+  /**
+   * @brief Get a single line (without terminator)
+   * @param line 1-based line number
+   */
+  [[nodiscard]] std::optional<std::string> getLine(const std::string &uri, uint32_t line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = documents_.find(uri);
+    if (it == documents_.end() || line == 0 || line > it->second.lineCount)
+      return std::nullopt;
+
+    const Document &doc = it->second;
+    auto blockIt =
+        std::upper_bound(doc.blocks.begin(), doc.blocks.end(), line,
+                         [](uint32_t l, const Block &block) { return l < block.firstLine; });
+    size_t blockIndex = static_cast<size_t>(blockIt - doc.blocks.begin()) - 1;
+    const Block &block = doc.blocks[blockIndex];
+
+    const std::string *text = decodeBlock(uri, doc, blockIndex);
+    if (!text)
+      return std::nullopt;
+
+    // 块总是从行首开始，在块内顺序定位目标行
+    LineOffsetTable table(*text);
+    return std::string(table.getLineText(*text, line - block.firstLine + 1));
+  }
+
+  /**
+   * @brief Get the text between two byte offsets
+   */
+  [[nodiscard]] std::optional<std::string> getSlice(const std::string &uri, uint32_t begin,
+                                                    uint32_t end) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = documents_.find(uri);
+    if (it == documents_.end())
+      return std::nullopt;
+
+    const Document &doc = it->second;
+    end = std::min(end, doc.rawSize);
+    if (begin >= end)
+      return std::string();
+
+    std::string result;
+    result.reserve(end - begin);
+    for (size_t i = 0; i < doc.blocks.size(); ++i) {
+      const Block &block = doc.blocks[i];
+      uint32_t blockEnd = block.rawOffset + block.rawSize;
+      if (blockEnd <= begin)
+        continue;
+      if (block.rawOffset >= end)
+        break;
+
+      const std::string *text = decodeBlock(uri, doc, i);
+      if (!text)
+        return std::nullopt;
+      uint32_t from = std::max(begin, block.rawOffset) - block.rawOffset;
+      uint32_t to = std::min(end, blockEnd) - block.rawOffset;
+      result.append(*text, from, to - from);
+    }
+    return result;
+  }
+
+  /**
+   * @brief Decode the whole document
+   */
+  [[nodiscard]] std::optional<std::string> getText(const std::string &uri) {
+    return getSlice(uri, 0, UINT32_MAX);
+  }
+
+  /**
+   * @brief Hash of a stored document's text (StructuralHasher::hashBytes), without decoding
+   */
+  [[nodiscard]] std::optional<uint64_t> contentHash(const std::string &uri) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = documents_.find(uri);
+    if (it == documents_.end())
+      return std::nullopt;
+    return it->second.contentHash;
+  }
+
+  /**
+   * @brief Get the line count of a stored document
+   */
+  [[nodiscard]] std::optional<uint32_t> lineCount(const std::string &uri) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = documents_.find(uri);
+    if (it == documents_.end())
+      return std::nullopt;
+    return it->second.lineCount;
+  }
+
+  // ========================================================================
+  // Statistics
+  // ========================================================================
+
+  [[nodiscard]] Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats s = counters_;
+    s.documents = documents_.size();
+    for (const auto &[_, doc] : documents_) {
+      s.blocks += doc.blocks.size();
+      s.rawBytes += doc.rawSize;
+      for (const auto &block : doc.blocks) {
+        s.compressedBytes += block.data.size();
+      }
+    }
+    return s;
+  }
+
+private:
+  struct Block {
+    uint32_t rawOffset = 0; ///< Byte offset of the block in the original text
+    uint32_t rawSize = 0;
+    uint32_t firstLine = 1; ///< 1-based line number of the block's first line
+    std::string data;       ///< Compressed bytes
+  };
+
+  struct Document {
+    std::vector<Block> blocks;
+    uint32_t rawSize = 0;
+    uint32_t lineCount = 1;
+    uint64_t contentHash = 0;
+  };
+
+  /**
+   * @brief Split text into line-aligned blocks and compress each one
+   */
+  [[nodiscard]] Document encode(std::string_view text) const {
+    LineOffsetTable table(text);
+
+    Document doc;
+    doc.rawSize = static_cast<uint32_t>(text.size());
+    doc.lineCount = table.lineCount();
+    doc.contentHash = ast::StructuralHasher::hashBytes(text);
+
+    uint32_t line = 1;
+    while (line <= doc.lineCount) {
+      Block block;
+      block.firstLine = line;
+      block.rawOffset = table.getLineStartOffset(line);
+
+      // 至少包含一整行，之后按行累积到块大小
+      uint32_t next = line + 1;
+      while (next <= doc.lineCount &&
+             table.getLineStartOffset(next) - block.rawOffset < blockSize_) {
+        ++next;
+      }
+      uint32_t blockEnd =
+          next <= doc.lineCount ? table.getLineStartOffset(next) : doc.rawSize;
+      block.rawSize = blockEnd - block.rawOffset;
+      block.data = lz::compress(text.substr(block.rawOffset, block.rawSize));
+      doc.blocks.push_back(std::move(block));
+      line = next;
+    }
+
+    return doc;
+  }
+
+  /**
+   * @brief Decode a block, reusing the last decoded block when possible
+   * @note Caller holds mutex_
+   */
+  const std::string *decodeBlock(const std::string &uri, const Document &doc, size_t index) {
+    if (cachedIndex_ == index && cachedUri_ == uri) {
+      ++counters_.cacheHits;
+      return &cachedText_;
+    }
+
+    // Decode beside the cached block: on failure it must still match its key
+    const Block &block = doc.blocks[index];
+    auto start = std::chrono::steady_clock::now();
+    decodeBuffer_.resize(block.rawSize);
+    bool ok = lz::decompress(block.data, decodeBuffer_.data(), block.rawSize);
+    counters_.decodeNanos += static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                             start)
+            .count());
+    ++counters_.blockDecodes;
+
+    if (!ok)
+      return nullptr;
+    cachedText_.swap(decodeBuffer_);
+    cachedUri_ = uri;
+    cachedIndex_ = index;
+    return &cachedText_;
+  }
+
+  void dropCache(const std::string &uri) {
+    if (cachedUri_ == uri) {
+      cachedUri_.clear();
+      cachedIndex_ = SIZE_MAX;
+    }
+  }
+
+  size_t blockSize_;
+  std::unordered_map<std::string, Document> documents_;
+  mutable std::mutex mutex_;
+
+  // Decoded-block cache (one entry)
+  std::string cachedUri_;
+  size_t cachedIndex_ = SIZE_MAX;
+  std::string cachedText_;
+  std::string decodeBuffer_; ///< Swapped with cachedText_ after a successful decode
+
+  Stats counters_;
+};
+
+} // namespace lsp
+} // namespace lang
@@ -0,0 +1,653 @@
+/**
+ * @file ControlFlow.h
+ * @brief Compact Per-Function Control-Flow Graphs
+ *
+ * A Cfg describes one function, method or lambda body as basic blocks of
+ * "elements" (simple statements and branch conditions) connected by edges.
+ * Alongside the elements, every block records the reads and writes of the
+ * function's local variables in evaluation order, resolved once while
+ * building, so dataflow analyses (see Dataflow.h) never look at names again.
+ *
+ * Key Features:
+ * - Flat storage: blocks, elements, accesses and edges each live in one
+ *   contiguous array owned by the Cfg (edges in CSR form), no per-block
+ *   allocation and no pointers between blocks
+ * - if/else-if chains, while, C-style and foreach for, break, continue,
+ *   return; `while (true)` and condition-less `for` have no exit edge
+ * - defer bodies run on every way out of the function, in reverse order
+ *   of registration; each one is optional because its registration may
+ *   not have been reached
+ * - Reverse post-order and reachability computed once at build time
+ * - Variables captured by nested lambdas/functions count as read where the
+ *   closure is created
+ *
+ * Usage:
+ *   Cfg cfg = CfgBuilder::build(functionDecl);
+ *   for (uint32_t b : cfg.reversePostOrder())
+ *     for (const CfgAccess& a : cfg.accesses(b)) ...
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "AstNodes.h"
+#include "NameBinder.h"
+#include "NodeFinder.h"
+
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace lang {
+namespace semantic {
+
+// ============================================================================
+// Graph
+// ============================================================================
+
+/**
+ * @brief A local variable or parameter of the analyzed function
+ */
+struct CfgVariable {
+  ast::InternedString name;
+  ast::Decl *decl = nullptr; ///< VarDecl, MultiVarDecl or ParameterDecl
+};
+
+/**
+ * @brief One read or write of a local variable
+ */
+struct CfgAccess {
+  uint32_t variable = 0; ///< Index into Cfg::variables()
+  bool isDef = false;
+  bool hasValue = true; ///< False for a declaration without initializer
+  /// Identifier for reads and assignments, the declaration for declarations
+  ast::AstNode *node = nullptr;
+};
+
+/**
+ * @brief A basic block: ranges into the Cfg's flat arrays
+ */
+struct CfgBlock {
+  uint32_t firstElement = 0;
+  uint32_t elementCount = 0;
+  uint32_t firstAccess = 0;
+  uint32_t accessCount = 0;
+  uint32_t firstSucc = 0;
+  uint32_t succCount = 0;
+  uint32_t firstPred = 0;
+  uint32_t predCount = 0;
+};
+
+/**
+ * @brief Control-flow graph of one function body
+ */
+class Cfg {
+public:
+  static constexpr uint32_t Entry = 0; ///< Parameters are defined here
+  static constexpr uint32_t Exit = 1;  ///< Reached by every return and by falling off the end
+  static constexpr uint32_t Unreachable = std::numeric_limits<uint32_t>::max();
+
+  [[nodiscard]] uint32_t blockCount() const noexcept {
+    return static_cast<uint32_t>(blocks_.size());
+  }
+
+  [[nodiscard]] const CfgBlock &block(uint32_t b) const noexcept { return blocks_[b]; }
+
+  /// Statements, conditions and declarations executed by the block, in order
+  [[nodiscard]] ast::ArrayView<ast::AstNode *> elements(uint32_t b) const noexcept {
+    return {elements_.data() + blocks_[b].firstElement, blocks_[b].elementCount};
+  }
+
+  /// Variable accesses of the block, in evaluation order
+  [[nodiscard]] ast::ArrayView<CfgAccess> accesses(uint32_t b) const noexcept {
+    return {accesses_.data() + blocks_[b].firstAccess, blocks_[b].accessCount};
+  }
+
+  [[nodiscard]] ast::ArrayView<uint32_t> successors(uint32_t b) const noexcept {
+    return {succs_.data() + blocks_[b].firstSucc, blocks_[b].succCount};
+  }
+
+  [[nodiscard]] ast::ArrayView<uint32_t> predecessors(uint32_t b) const noexcept {
+    return {preds_.data() + blocks_[b].firstPred, blocks_[b].predCount};
+  }
+
+  /// All accesses of the function; block b owns [firstAccess, firstAccess + accessCount)
+  [[nodiscard]] const std::vector<CfgAccess> &allAccesses() const noexcept { return accesses_; }
+
+  [[nodiscard]] const std::vector<CfgVariable> &variables() const noexcept { return variables_; }
+
+  /// Blocks reachable from Entry, in reverse post-order
+  [[nodiscard]] const std::vector<uint32_t> &reversePostOrder() const noexcept { return rpo_; }
+
+  /// Position of a block in reversePostOrder(), or Unreachable
+  [[nodiscard]] uint32_t rpoIndex(uint32_t b) const noexcept { return rpoIndex_[b]; }
+
+  [[nodiscard]] bool isReachable(uint32_t b) const noexcept { return rpoIndex_[b] != Unreachable; }
+
+  /// Control can reach the closing brace of the body (an implicit return)
+  [[nodiscard]] bool fallsOffEnd() const noexcept { return fallsOffEnd_; }
+
+private:
+  friend class CfgBuilder;
+
+  std::vector<CfgBlock> blocks_;
+  std::vector<ast::AstNode *> elements_;
+  std::vector<CfgAccess> accesses_;
+  std::vector<uint32_t> succs_;
+  std::vector<uint32_t> preds_;
+  std::vector<CfgVariable> variables_;
+  std::vector<uint32_t> rpo_;
+  std::vector<uint32_t> rpoIndex_;
+  bool fallsOffEnd_ = false;
+};
+
+// ============================================================================
+// Builder
+// ============================================================================
+
+/**
+ * @brief Builds the Cfg of a FunctionDecl, MethodDecl or LambdaExpr
+ */
+class CfgBuilder {
+public:
+  [[nodiscard]] static Cfg build(ast::AstNode *function) {
+    CfgBuilder builder;
+    builder.run(function);
+    return builder.finish();
+  }
+
+  /// Parameters and body of a function-like node (body is null for anything else)
+  static std::pair<ast::ArrayView<ast::ParameterDeclNode *>, ast::BlockStmtNode *>
+  signatureOf(ast::AstNode *function) noexcept {
+    switch (function ? function->kind : ast::AstKind::ErrorExpr) {
+    case ast::AstKind::FunctionDecl: {
+      auto *fn = static_cast<ast::FunctionDeclNode *>(function);
+      return {fn->parameters, fn->body};
+    }
+    case ast::AstKind::MethodDecl: {
+      auto *fn = static_cast<ast::MethodDeclNode *>(function);
+      return {fn->parameters, fn->body};
+    }
+    case ast::AstKind::LambdaExpr: {
+      auto *fn = static_cast<ast::LambdaExprNode *>(function);
+      return {fn->params, fn->body};
+    }
+    default:
+      return {{}, nullptr};
+    }
+  }
+
+private:
+  static constexpr uint32_t NoVariable = std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t ReturnTarget = 2; ///< Where returns go before defers run
+
+  /// What a name is bound to while building; NoVariable for names of nested functions
+  struct Binding {
+    uint32_t variable = NoVariable;
+  };
+
+  struct Loop {
+    uint32_t breakTarget;
+    uint32_t continueTarget;
+  };
+
+  struct Deferred {
+    uint32_t first;
+    uint32_t last;
+  };
+
+  void run(ast::AstNode *function) {
+    auto [params, body] = signatureOf(function);
+    newBlock(); // Entry
+    newBlock(); // Exit
+    newBlock(); // ReturnTarget
+    cur_ = Cfg::Entry;
+
+    binder_.enterScope();
+    for (auto *param : params) {
+      append(param);
+      define(param->name, param, param);
+    }
+    uint32_t start = newBlock();
+    edge(cur_, start);
+    cur_ = start;
+    if (body)
+      stmt(body);
+    binder_.exitScope();
+
+    fallOff_ = cur_;
+    edge(cur_, ReturnTarget);
+
+    // Defers run last-registered first, each only if its registration was reached
+    uint32_t at = ReturnTarget;
+    for (auto it = defers_.rbegin(); it != defers_.rend(); ++it) {
+      uint32_t next = newBlock();
+      edge(at, it->first);
+      edge(it->last, next);
+      edge(at, next);
+      at = next;
+    }
+    edge(at, Cfg::Exit);
+  }
+
+  // --------------------------------------------------------------------------
+  // Statements
+  // --------------------------------------------------------------------------
+
+  void stmt(ast::Stmt *s) {
+    if (!s)
+      return;
+    switch (s->kind) {
+    case ast::AstKind::BlockStmt:
+      binder_.enterScope();
+      for (auto *child : static_cast<ast::BlockStmtNode *>(s)->statements)
+        stmt(child);
+      binder_.exitScope();
+      break;
+
+    case ast::AstKind::EmptyStmt:
+      break;
+
+    case ast::AstKind::ExprStmt:
+      append(s);
+      expr(static_cast<ast::ExprStmtNode *>(s)->expr);
+      break;
+
+    case ast::AstKind::AssignStmt: {
+      auto *assign = static_cast<ast::AssignStmtNode *>(s);
+      append(s);
+      expr(assign->value);
+      assignTo(assign->target.expr, false);
+      break;
+    }
+
+    case ast::AstKind::MultiAssignStmt: {
+      auto *assign = static_cast<ast::MultiAssignStmtNode *>(s);
+      append(s);
+      for (auto *value : assign->values)
+        expr(value);
+      for (const auto &target : assign->targets)
+        assignTo(target.expr, false);
+      break;
+    }
+
+    case ast::AstKind::UpdateAssignStmt: {
+      auto *assign = static_cast<ast::UpdateAssignStmtNode *>(s);
+      append(s);
+      expr(assign->value);
+      assignTo(assign->target.expr, true);
+      break;
+    }
+
+    case ast::AstKind::DeclStmt:
+      append(s);
+      decl(static_cast<ast::DeclStmtNode *>(s)->decl);
+      break;
+
+    case ast::AstKind::IfStmt:
+      ifStmt(static_cast<ast::IfStmtNode *>(s));
+      break;
+
+    case ast::AstKind::WhileStmt:
+      whileStmt(static_cast<ast::WhileStmtNode *>(s));
+      break;
+
+    case ast::AstKind::ForStmt:
+      forStmt(static_cast<ast::ForStmtNode *>(s));
+      break;
+
+    case ast::AstKind::BreakStmt:
+    case ast::AstKind::ContinueStmt:
+      append(s);
+      if (!loops_.empty()) {
+        const Loop &loop = loops_.back();
+        edge(cur_, s->kind == ast::AstKind::BreakStmt ? loop.breakTarget : loop.continueTarget);
+      }
+      cur_ = newBlock();
+      break;
+
+    case ast::AstKind::ReturnStmt:
+      append(s);
+      for (auto *value : static_cast<ast::ReturnStmtNode *>(s)->values)
+        expr(value);
+      edge(cur_, ReturnTarget);
+      cur_ = newBlock();
+      break;
+
+    case ast::AstKind::DeferStmt: {
+      // Built now, where its names resolve; linked to the exit path in run()
+      uint32_t resume = cur_;
+      std::vector<Loop> outerLoops;
+      outerLoops.swap(loops_);
+      uint32_t first = newBlock();
+      cur_ = first;
+      stmt(static_cast<ast::DeferStmtNode *>(s)->body);
+      defers_.push_back({first, cur_});
+      loops_.swap(outerLoops);
+      cur_ = resume;
+      break;
+    }
+
+    default:
+      append(s);
+      expr(s);
+      break;
+    }
+  }
+
+  void ifStmt(ast::IfStmtNode *s) {
+    uint32_t join = newBlock();
+    for (const auto &branch : s->branches) {
+      append(branch.condition);
+      expr(branch.condition);
+      uint32_t then = newBlock();
+      uint32_t otherwise = newBlock();
+      edge(cur_, then);
+      edge(cur_, otherwise);
+
+      cur_ = then;
+      stmt(branch.body);
+      edge(cur_, join);
+      cur_ = otherwise;
+    }
+    stmt(s->elseBody);
+    edge(cur_, join);
+    cur_ = join;
+  }
+
+  void whileStmt(ast::WhileStmtNode *s) {
+    uint32_t head = newBlock();
+    edge(cur_, head);
+    cur_ = head;
+    append(s->condition);
+    expr(s->condition);
+
+    uint32_t body = newBlock();
+    uint32_t after = newBlock();
+    edge(head, body);
+    if (!isAlwaysTrue(s->condition))
+      edge(head, after);
+
+    loops_.push_back({after, head});
+    cur_ = body;
+    stmt(s->body);
+    edge(cur_, head);
+    loops_.pop_back();
+    cur_ = after;
+  }
+
+  void forStmt(ast::ForStmtNode *s) {
+    binder_.enterScope();
+    uint32_t body = 0;
+    uint32_t after = 0;
+
+    if (s->style == ast::ForStmtNode::Style::ForEach) {
+      append(s->collection);
+      expr(s->collection);
+      uint32_t head = newBlock();
+      edge(cur_, head);
+      body = newBlock();
+      after = newBlock();
+      edge(head, body);
+      edge(head, after);
+
+      cur_ = body;
+      for (auto *var : s->iterVars) {
+        append(var);
+        define(var->name, var, var);
+      }
+      loops_.push_back({after, head});
+      stmt(s->body);
+      edge(cur_, head);
+    } else {
+      stmt(s->init);
+      uint32_t head = newBlock();
+      edge(cur_, head);
+      cur_ = head;
+      if (s->condition) {
+        append(s->condition);
+        expr(s->condition);
+      }
+      body = newBlock();
+      after = newBlock();
+      uint32_t update = newBlock();
+      edge(head, body);
+      if (s->condition && !isAlwaysTrue(s->condition))
+        edge(head, after);
+
+      loops_.push_back({after, update});
+      cur_ = body;
+      stmt(s->body);
+      edge(cur_, update);
+      cur_ = update;
+      for (auto *step : s->updates)
+        stmt(step);
+      edge(cur_, head);
+    }
+
+    loops_.pop_back();
+    binder_.exitScope();
+    cur_ = after;
+  }
+
+  static bool isAlwaysTrue(ast::Expr *condition) noexcept {
+    while (condition && condition->kind == ast::AstKind::ParenExpr)
+      condition = static_cast<ast::ParenExprNode *>(condition)->inner;
+    return condition && condition->kind == ast::AstKind::BoolLiteral &&
+           static_cast<ast::BoolLiteralNode *>(condition)->value;
+  }
+
+  // --------------------------------------------------------------------------
+  // Declarations and Expressions
+  // --------------------------------------------------------------------------
+
+  void decl(ast::Decl *d) {
+    if (!d)
+      return;
+    switch (d->kind) {
+    case ast::AstKind::VarDecl: {
+      auto *var = static_cast<ast::VarDeclNode *>(d);
+      expr(var->initializer);
+      define(var->name, var, var, var->initializer != nullptr);
+      break;
+    }
+    case ast::AstKind::MultiVarDecl: {
+      auto *multi = static_cast<ast::MultiVarDeclNode *>(d);
+      expr(multi->initializer);
+      for (auto name : multi->names)
+        define(name, multi, multi, multi->initializer != nullptr);
+      break;
+    }
+    default:
+      // Nested functions and classes: only their captures matter here
+      expr(d);
+      break;
+    }
+  }
+
+  /// Assignment target: an identifier is a def (preceded by a read for op=)
+  void assignTo(ast::Expr *target, bool alsoRead) {
+    if (target && target->kind == ast::AstKind::Identifier) {
+      auto *id = static_cast<ast::IdentifierNode *>(target);
+      if (const Binding *b = binder_.lookup(id->name); b && b->variable != NoVariable) {
+        if (alsoRead)
+          access(b->variable, false, id);
+        access(b->variable, true, id);
+      }
+      return;
+    }
+    expr(target);
+  }
+
+  /**
+   * @brief Record the reads below `node`
+   *
+   * Inside nested lambdas and functions, declarations shadow outer names
+   * without becoming variables of this graph, and every remaining reference
+   * to an outer variable counts as a read at this point.
+   */
+  void expr(ast::AstNode *node) {
+    if (!node)
+      return;
+    switch (node->kind) {
+    case ast::AstKind::Identifier: {
+      auto *id = static_cast<ast::IdentifierNode *>(node);
+      if (const Binding *b = binder_.lookup(id->name); b && b->variable != NoVariable)
+        access(b->variable, false, id);
+      return;
+    }
+    case ast::AstKind::LambdaExpr:
+    case ast::AstKind::FunctionDecl:
+    case ast::AstKind::MethodDecl:
+    case ast::AstKind::ClassDecl:
+    case ast::AstKind::BlockStmt:
+    case ast::AstKind::ForStmt:
+      ++nested_;
+      binder_.enterScope();
+      lsp::NodeFinder::forEachChild(node, [this](ast::AstNode *child) { expr(child); });
+      binder_.exitScope();
+      --nested_;
+      return;
+    case ast::AstKind::VarDecl:
+    case ast::AstKind::ParameterDecl:
+      lsp::NodeFinder::forEachChild(node, [this](ast::AstNode *child) { expr(child); });
+      shadow(static_cast<ast::Decl *>(node)->name);
+      return;
+    case ast::AstKind::MultiVarDecl:
+      lsp::NodeFinder::forEachChild(node, [this](ast::AstNode *child) { expr(child); });
+      for (auto name : static_cast<ast::MultiVarDeclNode *>(node)->names)
+        shadow(name);
+      return;
+    default:
+      lsp::NodeFinder::forEachChild(node, [this](ast::AstNode *child) { expr(child); });
+      return;
+    }
+  }
+
+  void define(ast::InternedString name, ast::Decl *decl, ast::AstNode *node,
+              bool hasValue = true) {
+    if (name.isEmpty())
+      return;
+    uint32_t variable = static_cast<uint32_t>(variables_.size());
+    variables_.push_back({name, decl});
+    bindings_.push_back({variable});
+    binder_.bind(name, &bindings_.back());
+    accesses_[cur_].push_back({variable, true, hasValue, node});
+  }
+
+  /// A name declared inside a nested function hides outer variables there
+  void shadow(ast::InternedString name) {
+    if (name.isEmpty() || nested_ == 0)
+      return;
+    bindings_.push_back({NoVariable});
+    binder_.bind(name, &bindings_.back());
+  }
+
+  // --------------------------------------------------------------------------
+  // Storage
+  // --------------------------------------------------------------------------
+
+  uint32_t newBlock() {
+    elements_.emplace_back();
+    accesses_.emplace_back();
+    return static_cast<uint32_t>(elements_.size() - 1);
+  }
+
+  void edge(uint32_t from, uint32_t to) { edges_.emplace_back(from, to); }
+
+  void append(ast::AstNode *node) {
+    if (node)
+      elements_[cur_].push_back(node);
+  }
+
+  void access(uint32_t variable, bool isDef, ast::AstNode *node) {
+    accesses_[cur_].push_back({variable, isDef, true, node});
+  }
+
+  /// Flatten per-block lists into the Cfg's arrays and order the blocks
+  Cfg finish() {
+    Cfg cfg;
+    const uint32_t n = static_cast<uint32_t>(elements_.size());
+    cfg.blocks_.resize(n);
+    cfg.variables_ = std::move(variables_);
+
+    for (uint32_t b = 0; b < n; ++b) {
+      CfgBlock &block = cfg.blocks_[b];
+      block.firstElement = static_cast<uint32_t>(cfg.elements_.size());
+      block.elementCount = static_cast<uint32_t>(elements_[b].size());
+      cfg.elements_.insert(cfg.elements_.end(), elements_[b].begin(), elements_[b].end());
+      block.firstAccess = static_cast<uint32_t>(cfg.accesses_.size());
+      block.accessCount = static_cast<uint32_t>(accesses_[b].size());
+      cfg.accesses_.insert(cfg.accesses_.end(), accesses_[b].begin(), accesses_[b].end());
+    }
+
+    // Edges in CSR form, both directions
+    for (const auto &[from, to] : edges_) {
+      ++cfg.blocks_[from].succCount;
+      ++cfg.blocks_[to].predCount;
+    }
+    uint32_t succAt = 0;
+    uint32_t predAt = 0;
+    for (auto &block : cfg.blocks_) {
+      block.firstSucc = succAt;
+      block.firstPred = predAt;
+      succAt += block.succCount;
+      predAt += block.predCount;
+      block.succCount = block.predCount = 0;
+    }
+    cfg.succs_.resize(succAt);
+    cfg.preds_.resize(predAt);
+    for (const auto &[from, to] : edges_) {
+      CfgBlock &src = cfg.blocks_[from];
+      CfgBlock &dst = cfg.blocks_[to];
+      cfg.succs_[src.firstSucc + src.succCount++] = to;
+      cfg.preds_[dst.firstPred + dst.predCount++] = from;
+    }
+
+    // Reverse post-order of the blocks reachable from Entry (iterative DFS)
+    std::vector<uint32_t> postOrder;
+    std::vector<uint8_t> seen(n, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{Cfg::Entry, 0}};
+    seen[Cfg::Entry] = 1;
+    while (!stack.empty()) {
+      auto &[b, next] = stack.back();
+      if (next < cfg.blocks_[b].succCount) {
+        uint32_t s = cfg.succs_[cfg.blocks_[b].firstSucc + next++];
+        if (!seen[s]) {
+          seen[s] = 1;
+          stack.emplace_back(s, 0);
+        }
+        continue;
+      }
+      postOrder.push_back(b);
+      stack.pop_back();
+    }
+    cfg.rpo_.assign(postOrder.rbegin(), postOrder.rend());
+    cfg.rpoIndex_.assign(n, Cfg::Unreachable);
+    for (uint32_t i = 0; i < cfg.rpo_.size(); ++i)
+      cfg.rpoIndex_[cfg.rpo_[i]] = i;
+
+    cfg.fallsOffEnd_ = cfg.isReachable(fallOff_);
+    return cfg;
+  }
+
+  std::vector<std::vector<ast::AstNode *>> elements_; ///< Per block, flattened in finish()
+  std::vector<std::vector<CfgAccess>> accesses_;
+  std::vector<std::pair<uint32_t, uint32_t>> edges_;
+  std::vector<CfgVariable> variables_;
+
+  uint32_t cur_ = Cfg::Entry;
+  uint32_t fallOff_ = Cfg::Entry;
+  std::vector<Loop> loops_;
+  std::vector<Deferred> defers_;
+
+  BasicNameBinder<Binding> binder_;
+  std::deque<Binding> bindings_; ///< Stable storage behind binder_
+  int nested_ = 0;               ///< Depth of nested functions being scanned for captures
+};
+
+} // namespace semantic
+} // namespace lang
@@ -0,0 +1,421 @@
+/**
+ * @file Dataflow.h
+ * @brief Bit-Vector Dataflow over Control-Flow Graphs
+ *
+ * Classic gen/kill analyses solved on a Cfg (ControlFlow.h). Sets are rows of
+ * 64-bit words in one flat matrix per solution, so meet and transfer are
+ * word-parallel OR/AND/ANDNOT loops. The solver is a worklist ordered by
+ * reverse post-order (post-order for backward problems): the lowest pending
+ * position is always taken next, so acyclic regions settle in one pass and
+ * loops converge in a few.
+ *
+ * Key Features:
+ * - BitVectorProblem: forward/backward, union/intersection meet
+ * - ReachingDefinitions built on it
+ * - FunctionFlow: per-function CFG and analyses, each built on first use
+ * - FlowSummary: position-independent findings cached by structural hash
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "ControlFlow.h"
+#include "StructuralHash.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace lang {
+namespace semantic {
+
+// ============================================================================
+// Bit Matrix
+// ============================================================================
+
+/**
+ * @brief rows x bits, each row a run of 64-bit words in one allocation
+ */
+class BitMatrix {
+public:
+  BitMatrix() = default;
+
+  BitMatrix(uint32_t rows, uint32_t bits)
+      : bits_(bits), words_((bits + 63) / 64), data_(static_cast<size_t>(rows) * words_, 0) {}
+
+  [[nodiscard]] uint32_t bits() const noexcept { return bits_; }
+  [[nodiscard]] uint32_t wordsPerRow() const noexcept { return words_; }
+
+  [[nodiscard]] uint64_t *row(uint32_t r) noexcept {
+    return data_.data() + static_cast<size_t>(r) * words_;
+  }
+  [[nodiscard]] const uint64_t *row(uint32_t r) const noexcept {
+    return data_.data() + static_cast<size_t>(r) * words_;
+  }
+
+  [[nodiscard]] bool test(uint32_t r, uint32_t bit) const noexcept {
+    return (row(r)[bit / 64] >> (bit % 64)) & 1;
+  }
+  void set(uint32_t r, uint32_t bit) noexcept { row(r)[bit / 64] |= uint64_t(1) << (bit % 64); }
+  void reset(uint32_t r, uint32_t bit) noexcept {
+    row(r)[bit / 64] &= ~(uint64_t(1) << (bit % 64));
+  }
+
+  /// Set every bit of a row (the padding bits of the last word stay clear)
+  void fill(uint32_t r) noexcept {
+    uint64_t *words = row(r);
+    for (uint32_t w = 0; w < words_; ++w)
+      words[w] = ~uint64_t(0);
+    if (bits_ % 64)
+      words[words_ - 1] = (uint64_t(1) << (bits_ % 64)) - 1;
+  }
+
+  /// Call f(bit) for every set bit of a row
+  template <typename Func> void forEachSet(uint32_t r, Func &&f) const {
+    const uint64_t *words = row(r);
+    for (uint32_t w = 0; w < words_; ++w)
+      for (uint64_t word = words[w]; word; word &= word - 1)
+        f(w * 64 + static_cast<uint32_t>(std::countr_zero(word)));
+  }
+
+private:
+  uint32_t bits_ = 0;
+  uint32_t words_ = 0;
+  std::vector<uint64_t> data_;
+};
+
+// ============================================================================
+// Generic Solver
+// ============================================================================
+
+/**
+ * @brief A gen/kill problem: after = gen | (before & ~kill)
+ *
+ * "before" is the block entry for forward problems and the block exit for
+ * backward ones. The boundary block (Entry / Exit) starts from the empty set.
+ */
+struct BitVectorProblem {
+  enum class Direction : uint8_t { Forward, Backward };
+  enum class Meet : uint8_t { Union, Intersection };
+
+  Direction direction = Direction::Forward;
+  Meet meet = Meet::Union;
+  BitMatrix gen;  ///< One row per block
+  BitMatrix kill; ///< One row per block
+};
+
+/**
+ * @brief Sets at the entry (in) and exit (out) of every block
+ *
+ * Rows of unreachable blocks are meaningless.
+ */
+struct DataflowSolution {
+  BitMatrix in;
+  BitMatrix out;
+  uint32_t visits = 0; ///< Blocks processed until the fixpoint
+};
+
+[[nodiscard]] inline DataflowSolution solve(const Cfg &cfg, const BitVectorProblem &problem) {
+  const bool forward = problem.direction == BitVectorProblem::Direction::Forward;
+  const bool intersect = problem.meet == BitVectorProblem::Meet::Intersection;
+  const uint32_t blocks = cfg.blockCount();
+  const uint32_t words = problem.gen.wordsPerRow();
+  const auto &rpo = cfg.reversePostOrder();
+  const uint32_t order = static_cast<uint32_t>(rpo.size());
+  const uint32_t boundary = forward ? Cfg::Entry : Cfg::Exit;
+
+  DataflowSolution solution{BitMatrix(blocks, problem.gen.bits()),
+                            BitMatrix(blocks, problem.gen.bits()), 0};
+  BitMatrix &before = forward ? solution.in : solution.out;
+  BitMatrix &after = forward ? solution.out : solution.in;
+  if (intersect)
+    for (uint32_t b = 0; b < blocks; ++b)
+      after.fill(b);
+
+  // Worklist as a bit per position; position p is rpo[p] forward, rpo[order-1-p] backward
+  auto blockAt = [&](uint32_t p) { return forward ? rpo[p] : rpo[order - 1 - p]; };
+  auto positionOf = [&](uint32_t b) {
+    uint32_t i = cfg.rpoIndex(b);
+    return forward ? i : order - 1 - i;
+  };
+  std::vector<uint64_t> pending((order + 63) / 64, 0);
+  for (uint32_t p = 0; p < order; ++p)
+    pending[p / 64] |= uint64_t(1) << (p % 64);
+
+  std::vector<uint64_t> next(words);
+  for (uint32_t scan = 0; scan < pending.size();) {
+    if (!pending[scan]) {
+      ++scan;
+      continue;
+    }
+    uint32_t p = scan * 64 + static_cast<uint32_t>(std::countr_zero(pending[scan]));
+    pending[scan] &= pending[scan] - 1;
+    uint32_t b = blockAt(p);
+    ++solution.visits;
+
+    // Meet over reachable neighbours
+    uint64_t *in = before.row(b);
+    if (b != boundary) {
+      bool first = true;
+      for (uint32_t n : forward ? cfg.predecessors(b) : cfg.successors(b)) {
+        if (!cfg.isReachable(n))
+          continue;
+        const uint64_t *src = after.row(n);
+        for (uint32_t w = 0; w < words; ++w)
+          in[w] = first ? src[w] : intersect ? (in[w] & src[w]) : (in[w] | src[w]);
+        first = false;
+      }
+      if (first)
+        std::fill(in, in + words, 0);
+    }
+
+    // Transfer
+    const uint64_t *gen = problem.gen.row(b);
+    const uint64_t *kill = problem.kill.row(b);
+    uint64_t *out = after.row(b);
+    bool changed = false;
+    for (uint32_t w = 0; w < words; ++w) {
+      next[w] = gen[w] | (in[w] & ~kill[w]);
+      changed |= next[w] != out[w];
+      out[w] = next[w];
+    }
+    if (!changed)
+      continue;
+
+    for (uint32_t n : forward ? cfg.successors(b) : cfg.predecessors(b)) {
+      if (!cfg.isReachable(n))
+        continue;
+      uint32_t q = positionOf(n);
+      pending[q / 64] |= uint64_t(1) << (q % 64);
+      scan = std::min(scan, q / 64);
+    }
+  }
+  return solution;
+}
+
+// ============================================================================
+// Reaching Definitions
+// ============================================================================
+
+/**
+ * @brief Which variable definitions may reach each point
+ *
+ * Definitions are the CfgAccesses with isDef set, numbered in access order.
+ */
+class ReachingDefinitions {
+public:
+  explicit ReachingDefinitions(const Cfg &cfg) : cfg_(cfg) {
+    const auto &accesses = cfg.allAccesses();
+    defOfAccess_.assign(accesses.size(), NoDef);
+    for (uint32_t a = 0; a < accesses.size(); ++a) {
+      if (accesses[a].isDef) {
+        defOfAccess_[a] = static_cast<uint32_t>(defAccess_.size());
+        defAccess_.push_back(a);
+      }
+    }
+
+    const uint32_t defs = definitionCount();
+    defsOfVariable_ = BitMatrix(static_cast<uint32_t>(cfg.variables().size()), defs);
+    for (uint32_t d = 0; d < defs; ++d)
+      defsOfVariable_.set(accesses[defAccess_[d]].variable, d);
+
+    BitVectorProblem problem;
+    problem.gen = BitMatrix(cfg.blockCount(), defs);
+    problem.kill = BitMatrix(cfg.blockCount(), defs);
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+      const CfgBlock &block = cfg.block(b);
+      for (uint32_t a = block.firstAccess; a < block.firstAccess + block.accessCount; ++a) {
+        if (!accesses[a].isDef)
+          continue;
+        // A def kills every def of its variable, including earlier ones in this block
+        const uint64_t *same = defsOfVariable_.row(accesses[a].variable);
+        uint64_t *gen = problem.gen.row(b);
+        uint64_t *kill = problem.kill.row(b);
+        for (uint32_t w = 0; w < problem.gen.wordsPerRow(); ++w) {
+          gen[w] &= ~same[w];
+          kill[w] |= same[w];
+        }
+        problem.gen.set(b, defOfAccess_[a]);
+      }
+    }
+    solution_ = solve(cfg, problem);
+  }
+
+  [[nodiscard]] uint32_t definitionCount() const noexcept {
+    return static_cast<uint32_t>(defAccess_.size());
+  }
+
+  [[nodiscard]] const CfgAccess &definition(uint32_t d) const noexcept {
+    return cfg_.allAccesses()[defAccess_[d]];
+  }
+
+  /**
+   * @brief Call f(definition) for each def of the variable accessed by
+   *        `access` (an index into allAccesses() within `block`) that may
+   *        reach that access
+   */
+  template <typename Func> void forEachReaching(uint32_t block, uint32_t access, Func &&f) const {
+    const auto &accesses = cfg_.allAccesses();
+    const uint32_t variable = accesses[access].variable;
+    for (uint32_t a = access; a-- > cfg_.block(block).firstAccess;) {
+      if (accesses[a].isDef && accesses[a].variable == variable) {
+        f(defOfAccess_[a]);
+        return;
+      }
+    }
+    const uint64_t *in = solution_.in.row(block);
+    const uint64_t *same = defsOfVariable_.row(variable);
+    for (uint32_t w = 0; w < solution_.in.wordsPerRow(); ++w)
+      for (uint64_t word = in[w] & same[w]; word; word &= word - 1)
+        f(w * 64 + static_cast<uint32_t>(std::countr_zero(word)));
+  }
+
+  [[nodiscard]] const DataflowSolution &solution() const noexcept { return solution_; }
+
+private:
+  static constexpr uint32_t NoDef = std::numeric_limits<uint32_t>::max();
+
+  const Cfg &cfg_;
+  std::vector<uint32_t> defAccess_;   ///< Definition -> access index
+  std::vector<uint32_t> defOfAccess_; ///< Access index -> definition (NoDef for reads)
+  BitMatrix defsOfVariable_;          ///< Variable -> its definitions
+  DataflowSolution solution_;
+};
+
+// ============================================================================
+// Per-Function Flow
+// ============================================================================
+
+/**
+ * @brief CFG and analyses of one function, each built on first request
+ *
+ * Holds pointers into the AST; does not outlive the tree.
+ */
+class FunctionFlow {
+public:
+  explicit FunctionFlow(ast::AstNode *function) : function_(function) {}
+
+  FunctionFlow(const FunctionFlow &) = delete;
+  FunctionFlow &operator=(const FunctionFlow &) = delete;
+
+  [[nodiscard]] ast::AstNode *function() const noexcept { return function_; }
+
+  [[nodiscard]] const Cfg &cfg() {
+    if (!cfg_)
+      cfg_ = std::make_unique<Cfg>(CfgBuilder::build(function_));
+    return *cfg_;
+  }
+
+  [[nodiscard]] const ReachingDefinitions &reachingDefinitions() {
+    if (!reaching_)
+      reaching_ = std::make_unique<ReachingDefinitions>(cfg());
+    return *reaching_;
+  }
+
+private:
+  ast::AstNode *function_;
+  std::unique_ptr<Cfg> cfg_;
+  std::unique_ptr<ReachingDefinitions> reaching_;
+};
+
+// ============================================================================
+// Cached Summaries
+// ============================================================================
+
+/**
+ * @brief What the lint rules need from a function's flow, without positions
+ *
+ * Reads are identified by their ordinal among the Identifier nodes of the
+ * body in NodeFinder::forEachChild pre-order, which is the same for any two
+ * bodies with the same structural hash.
+ */
+struct FlowSummary {
+  bool fallsOffEnd = false;
+  std::vector<uint32_t> unassignedReads; ///< Reads a declaration without initializer may reach
+};
+
+/**
+ * @brief Cache key of a function's flow: 0 when the tree carries no hashes
+ *
+ * Function and method hashes already cover parameters and body; lambdas
+ * combine their body hash with the parameter names.
+ */
+[[nodiscard]] inline uint64_t flowKey(ast::AstNode *function, const ast::StringTable &strings) {
+  if (!function)
+    return 0;
+  if (function->kind == ast::AstKind::FunctionDecl || function->kind == ast::AstKind::MethodDecl)
+    return static_cast<ast::Decl *>(function)->structuralHash;
+
+  auto [params, body] = CfgBuilder::signatureOf(function);
+  if (!body || !body->structuralHash)
+    return 0;
+  uint64_t key = body->structuralHash;
+  for (auto *param : params)
+    key = (key ^ ast::StructuralHasher::hashBytes(strings.get(param->name))) * 0x100000001b3ull;
+  return key ? key : 1;
+}
+
+/**
+ * @brief Identifier nodes of a body in pre-order
+ */
+[[nodiscard]] inline std::vector<ast::IdentifierNode *> identifiersOf(ast::AstNode *body) {
+  std::vector<ast::IdentifierNode *> result;
+  auto walk = [&](auto &self, ast::AstNode *node) -> void {
+    if (!node)
+      return;
+    if (node->kind == ast::AstKind::Identifier)
+      result.push_back(static_cast<ast::IdentifierNode *>(node));
+    lsp::NodeFinder::forEachChild(node, [&](ast::AstNode *child) { self(self, child); });
+  };
+  walk(walk, body);
+  return result;
+}
+
+[[nodiscard]] inline FlowSummary summarizeFlow(FunctionFlow &flow) {
+  FlowSummary summary;
+  const Cfg &cfg = flow.cfg();
+  summary.fallsOffEnd = cfg.fallsOffEnd();
+
+  const auto &accesses = cfg.allAccesses();
+  std::vector<const ast::AstNode *> unassigned;
+  const ReachingDefinitions *reaching = nullptr;
+  for (uint32_t b : cfg.reversePostOrder()) {
+    const CfgBlock &block = cfg.block(b);
+    for (uint32_t a = block.firstAccess; a < block.firstAccess + block.accessCount; ++a) {
+      if (accesses[a].isDef)
+        continue;
+      if (!reaching)
+        reaching = &flow.reachingDefinitions();
+      bool uninitialized = false;
+      reaching->forEachReaching(
+          b, a, [&](uint32_t d) { uninitialized |= !reaching->definition(d).hasValue; });
+      if (uninitialized)
+        unassigned.push_back(accesses[a].node);
+    }
+  }
+
+  if (!unassigned.empty()) {
+    auto ids = identifiersOf(CfgBuilder::signatureOf(flow.function()).second);
+    std::unordered_map<const ast::AstNode *, uint32_t> ordinal;
+    for (uint32_t i = 0; i < ids.size(); ++i)
+      ordinal.emplace(ids[i], i);
+    for (const auto *node : unassigned) {
+      auto it = ordinal.find(node);
+      if (it != ordinal.end())
+        summary.unassignedReads.push_back(it->second);
+    }
+    std::sort(summary.unassignedReads.begin(), summary.unassignedReads.end());
+    summary.unassignedReads.erase(
+        std::unique(summary.unassignedReads.begin(), summary.unassignedReads.end()),
+        summary.unassignedReads.end());
+  }
+  return summary;
+}
+
+} // namespace semantic
+} // namespace lang
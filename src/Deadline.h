@@ -0,0 +1,60 @@
+/**
+ * @file Deadline.h
+ * @brief Per-Request Time Budget
+ *
+ * Interactive requests that aggregate several sources (completion, workspace
+ * queries) run cheap sources first and poll a Deadline between units of
+ * expensive work; when it expires they return what they have and mark the
+ * result incomplete.
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include <chrono>
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief A point in time after which work should stop
+ *
+ * Usage:
+ *   Deadline deadline(std::chrono::milliseconds(30));
+ *   for (auto& unit : work) {
+ *     if (deadline.expired()) { result.isIncomplete = true; break; }
+ *     process(unit);
+ *   }
+ */
+class Deadline {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Never expires
+  Deadline() = default;
+
+  /// Expires after budget; a zero budget never expires
+  explicit Deadline(std::chrono::milliseconds budget)
+      : start_(Clock::now()), end_(budget.count() > 0 ? start_ + budget : Clock::time_point::max()) {}
+
+  [[nodiscard]] static Deadline unlimited() noexcept { return {}; }
+
+  [[nodiscard]] bool expired() const noexcept {
+    return end_ != Clock::time_point::max() && Clock::now() >= end_;
+  }
+
+  [[nodiscard]] bool isUnlimited() const noexcept { return end_ == Clock::time_point::max(); }
+
+  /// Time spent since construction
+  [[nodiscard]] std::chrono::microseconds elapsed() const noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_);
+  }
+
+private:
+  Clock::time_point start_ = Clock::now();
+  Clock::time_point end_ = Clock::time_point::max();
+};
+
+} // namespace lsp
+} // namespace lang
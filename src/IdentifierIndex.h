@@ -0,0 +1,394 @@
+/**
+ * @file IdentifierIndex.h
+ * @brief Per-File Identifier Bloom Filters for Pruning Cross-File Searches
+ *
+ * A workspace-wide search for a name (references to an export, rename) would
+ * otherwise parse and analyze every file. Each file gets a small Bloom filter
+ * over the identifier tokens it contains; a search consults the filters first
+ * and analyzes only files that may mention the name. False positives cost one
+ * wasted analysis, false negatives cannot happen.
+ *
+ * Key Features:
+ * - Built by a lightweight identifier scan (comments and string literals
+ *   skipped), about 10 bits per distinct identifier, ~1% false positives
+ * - On-disk files are keyed by path + mtime + size; open documents by version
+ * - Persisted in one index file in the cache directory, so a cold start
+ *   prunes without reading any source file
+ *
+ * The index is a cache, never a source of truth: an unreadable or mismatched
+ * index file is ignored and filters are rebuilt on demand.
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "LspLogger.h"
+#include "StructuralHash.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lang {
+namespace lsp {
+
+// ============================================================================
+// Identifier Filter
+// ============================================================================
+
+/**
+ * @brief Bloom filter over the identifier tokens of one source text
+ *
+ * Usage:
+ *   auto filter = IdentifierFilter::build(text);
+ *   if (filter.mayContain("Rectangle")) analyze(file);
+ */
+class IdentifierFilter {
+public:
+  static constexpr unsigned HashCount = 7;
+  static constexpr size_t BitsPerIdentifier = 10;
+
+  IdentifierFilter() = default;
+
+  /**
+   * @brief Build from source text
+   */
+  [[nodiscard]] static IdentifierFilter build(std::string_view text) {
+    std::vector<uint64_t> hashes;
+    forEachIdentifier(text, [&](std::string_view id) { hashes.push_back(hashOf(id)); });
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    IdentifierFilter filter;
+    size_t bits = std::max<size_t>(64, hashes.size() * BitsPerIdentifier);
+    filter.words_.assign((bits + 63) / 64, 0);
+    for (uint64_t h : hashes)
+      filter.insert(h);
+    return filter;
+  }
+
+  /**
+   * @brief Restore from words written by words()
+   */
+  [[nodiscard]] static IdentifierFilter fromWords(std::vector<uint64_t> words) {
+    IdentifierFilter filter;
+    filter.words_ = std::move(words);
+    return filter;
+  }
+
+  /**
+   * @brief False means the text certainly has no such identifier token
+   */
+  [[nodiscard]] bool mayContain(std::string_view name) const noexcept {
+    if (words_.empty())
+      return true;
+    uint64_t h = hashOf(name);
+    uint64_t bits = words_.size() * 64;
+    uint64_t h1 = h, h2 = (h >> 32) | 1;
+    for (unsigned i = 0; i < HashCount; ++i) {
+      uint64_t bit = (h1 + i * h2) % bits;
+      if (!(words_[bit / 64] & (uint64_t{1} << (bit % 64))))
+        return false;
+    }
+    return true;
+  }
+
+  [[nodiscard]] const std::vector<uint64_t> &words() const noexcept { return words_; }
+
+  [[nodiscard]] size_t byteSize() const noexcept { return words_.size() * sizeof(uint64_t); }
+
+  /**
+   * @brief Call func(std::string_view) for each identifier token outside comments and strings
+   */
+  template <typename Func> static void forEachIdentifier(std::string_view text, Func &&func) {
+    auto isStart = [](unsigned char c) { return std::isalpha(c) || c == '_' || c >= 0x80; };
+    auto isPart = [](unsigned char c) {
+      return std::isalnum(c) || c == '_' || c >= 0x80;
+    };
+
+    size_t i = 0, n = text.size();
+    while (i < n) {
+      unsigned char c = static_cast<unsigned char>(text[i]);
+      if (c == '/' && i + 1 < n && text[i + 1] == '/') {
+        i = text.find('\n', i);
+        if (i == std::string_view::npos)
+          return;
+      } else if (c == '/' && i + 1 < n && text[i + 1] == '*') {
+        i = text.find("*/", i + 2);
+        if (i == std::string_view::npos)
+          return;
+        i += 2;
+      } else if (c == '"' || c == '\'') {
+        for (++i; i < n && text[i] != static_cast<char>(c); ++i) {
+          if (text[i] == '\\')
+            ++i;
+        }
+        ++i;
+      } else if (isStart(c)) {
+        size_t start = i;
+        while (i < n && isPart(static_cast<unsigned char>(text[i])))
+          ++i;
+        func(text.substr(start, i - start));
+      } else if (std::isdigit(c)) {
+        // 数字字面量（含 0x1F、1e10 之类）整体跳过，不当作标识符
+        while (i < n && isPart(static_cast<unsigned char>(text[i])))
+          ++i;
+      } else {
+        ++i;
+      }
+    }
+  }
+
+private:
+  [[nodiscard]] static uint64_t hashOf(std::string_view id) noexcept {
+    return ast::StructuralHasher::hashBytes(id);
+  }
+
+  void insert(uint64_t h) noexcept {
+    uint64_t bits = words_.size() * 64;
+    uint64_t h1 = h, h2 = (h >> 32) | 1;
+    for (unsigned i = 0; i < HashCount; ++i) {
+      uint64_t bit = (h1 + i * h2) % bits;
+      words_[bit / 64] |= uint64_t{1} << (bit % 64);
+    }
+  }
+
+  std::vector<uint64_t> words_;
+};
+
+// ============================================================================
+// Identifier Index
+// ============================================================================
+
+/**
+ * @brief Identifier filters of the workspace's source files
+ *
+ * Usage:
+ *   IdentifierIndex index;
+ *   index.setCacheDirectory(dir);           // optional persistence
+ *   if (index.forFile(path)->mayContain(name)) ...
+ *   if (index.forText(path, version, text)->mayContain(name)) ...  // open documents
+ *   index.save();
+ */
+class IdentifierIndex {
+public:
+  using FilterPtr = std::shared_ptr<const IdentifierFilter>;
+
+  struct Stats {
+    uint64_t built = 0;    ///< Filters computed from source text
+    uint64_t reused = 0;   ///< Lookups answered by a current filter
+    uint64_t restored = 0; ///< Filters loaded from the index file
+  };
+
+  IdentifierIndex() = default;
+
+  IdentifierIndex(const IdentifierIndex &) = delete;
+  IdentifierIndex &operator=(const IdentifierIndex &) = delete;
+
+  /**
+   * @brief Persist filters of on-disk files in dir (empty = memory only)
+   */
+  void setCacheDirectory(std::string dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (dir == directory_)
+      return;
+    directory_ = std::move(dir);
+    loaded_ = false;
+  }
+
+  /**
+   * @brief Filter of a file's on-disk content; rebuilt when mtime or size changed
+   * @return Null if the file cannot be read
+   */
+  [[nodiscard]] FilterPtr forFile(const std::string &path) {
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec)
+      return nullptr;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec)
+      return nullptr;
+    int64_t stamp = static_cast<int64_t>(mtime.time_since_epoch().count());
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      loadLocked();
+      auto it = disk_.find(path);
+      if (it != disk_.end() && it->second.mtime == stamp && it->second.size == size) {
+        ++stats_.reused;
+        return it->second.filter;
+      }
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      return nullptr;
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    auto filter = std::make_shared<const IdentifierFilter>(IdentifierFilter::build(text));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    disk_[path] = DiskEntry{stamp, size, filter};
+    dirty_ = true;
+    ++stats_.built;
+    return filter;
+  }
+
+  /**
+   * @brief Filter of an open document's text, cached per version
+   */
+  [[nodiscard]] FilterPtr forText(const std::string &path, int64_t version, std::string_view text) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = open_.find(path);
+      if (it != open_.end() && it->second.first == version) {
+        ++stats_.reused;
+        return it->second.second;
+      }
+    }
+    auto filter = std::make_shared<const IdentifierFilter>(IdentifierFilter::build(text));
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_[path] = {version, filter};
+    ++stats_.built;
+    return filter;
+  }
+
+  /**
+   * @brief Forget the in-memory filter of a closed document
+   */
+  void closeDocument(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    open_.erase(path);
+  }
+
+  /**
+   * @brief Write on-disk filters to the index file if any changed
+   */
+  void save() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_ || directory_.empty())
+      return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+    std::string path = indexPath();
+    std::string temp = path + ".tmp";
+    {
+      std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+      if (!out)
+        return;
+      out.write(Magic, sizeof(Magic));
+      writePod(out, FormatVersion);
+      writePod(out, static_cast<uint32_t>(disk_.size()));
+      for (const auto &[file, entry] : disk_) {
+        writePod(out, static_cast<uint32_t>(file.size()));
+        out.write(file.data(), static_cast<std::streamsize>(file.size()));
+        writePod(out, entry.mtime);
+        writePod(out, entry.size);
+        const auto &words = entry.filter->words();
+        writePod(out, static_cast<uint32_t>(words.size()));
+        out.write(reinterpret_cast<const char *>(words.data()),
+                  static_cast<std::streamsize>(words.size() * sizeof(uint64_t)));
+      }
+      if (!out)
+        return;
+    }
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+    dirty_ = false;
+    LSP_LOG("identifier index: saved " << disk_.size() << " filters to " << path);
+  }
+
+  [[nodiscard]] Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+private:
+  static constexpr char Magic[8] = {'S', 'P', 'T', 'I', 'D', 'X', '\0', '\0'};
+  static constexpr uint32_t FormatVersion = 1;
+
+  struct DiskEntry {
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    FilterPtr filter;
+  };
+
+  [[nodiscard]] std::string indexPath() const {
+    return (std::filesystem::path(directory_) / "identifiers.idx").string();
+  }
+
+  template <typename T> static void writePod(std::ofstream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  template <typename T> static bool readPod(std::ifstream &in, T &value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+  }
+
+  /// Read the index file once per cache directory (caller holds mutex_)
+  void loadLocked() {
+    if (loaded_)
+      return;
+    loaded_ = true;
+    if (directory_.empty())
+      return;
+
+    std::ifstream in(indexPath(), std::ios::binary);
+    if (!in)
+      return;
+    char magic[sizeof(Magic)];
+    uint32_t version = 0, count = 0;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, Magic, sizeof(Magic)) != 0 ||
+        !readPod(in, version) || version != FormatVersion || !readPod(in, count))
+      return;
+
+    size_t restored = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t pathSize = 0, wordCount = 0;
+      DiskEntry entry;
+      if (!readPod(in, pathSize) || pathSize > 4096)
+        break;
+      std::string file(pathSize, '\0');
+      if (!in.read(file.data(), pathSize) || !readPod(in, entry.mtime) ||
+          !readPod(in, entry.size) || !readPod(in, wordCount) || wordCount > (1u << 24))
+        break;
+      std::vector<uint64_t> words(wordCount);
+      if (!in.read(reinterpret_cast<char *>(words.data()),
+                   static_cast<std::streamsize>(wordCount * sizeof(uint64_t))))
+        break;
+      entry.filter = std::make_shared<const IdentifierFilter>(
+          IdentifierFilter::fromWords(std::move(words)));
+      // 内存中已有的条目更新，保留它
+      disk_.emplace(std::move(file), std::move(entry));
+      ++restored;
+    }
+    stats_.restored += restored;
+    LSP_LOG("identifier index: restored " << restored << " filters from " << indexPath());
+  }
+
+  mutable std::mutex mutex_;
+  std::string directory_;
+  bool loaded_ = false;
+  bool dirty_ = false;
+  std::unordered_map<std::string, DiskEntry> disk_;
+  std::unordered_map<std::string, std::pair<int64_t, FilterPtr>> open_;
+  Stats stats_;
+};
+
+} // namespace lsp
+} // namespace lang
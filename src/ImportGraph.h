@@ -0,0 +1,236 @@
+/**
+ * @file ImportGraph.h
+ * @brief Workspace Import Graph for File Renames and Moves
+ *
+ * Renaming or moving a module breaks every `import ... from "path"` naming
+ * it. ImportGraph records the imports each workspace file makes and the file
+ * each one resolves to, with a reverse index from target to importers, so a
+ * rename edits the importers directly instead of searching workspace text.
+ *
+ * Key Features:
+ * - One edge per import: the module path as written, the file it resolves
+ *   to, the directory it was resolved against, and where its literal is
+ * - Files keyed by a stamp (editor version when open, mtime + size on disk);
+ *   a refresh rescans only files whose stamp changed
+ * - Ordered by path, so a directory move finds everything under it, and
+ *   everything importing from under it, with one range scan each
+ * - specifierFor(): the module path an import should use after a move,
+ *   keeping its style (base directory, "./" prefix, implied extension)
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "LineOffsetTable.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief One `import ... from "path"` of a file
+ */
+struct ImportEdge {
+  /// Directory the module path was resolved against
+  enum class Base : uint8_t {
+    Importer, ///< The importing file's directory
+    Fixed,    ///< Workspace root or an include path (baseDir)
+  };
+
+  std::string specifier; ///< Module path as written
+  std::string target;    ///< Normalized path of the imported file
+  Base base = Base::Importer;
+  std::string baseDir; ///< For Base::Fixed
+  Range literal;       ///< Text between the quotes
+  char quote = '"';
+};
+
+/**
+ * @brief Imports of every workspace file, and who imports each file
+ *
+ * Usage:
+ *   if (!graph.isCurrent(path, stamp))
+ *     graph.update(path, uri, stamp, scanImports(file));
+ *   graph.retain(presentPaths);
+ *   std::set<std::string> affected;
+ *   graph.collectImportersOf(movedDir, affected);
+ *   graph.collectFilesIn(movedDir, affected);
+ */
+class ImportGraph {
+public:
+  using Moves = std::vector<std::pair<std::string, std::string>>; ///< (old path, new path)
+
+  struct File {
+    std::string uri;
+    std::string stamp;
+    std::vector<ImportEdge> imports;
+  };
+
+  [[nodiscard]] bool isCurrent(const std::string &path, const std::string &stamp) const {
+    auto it = files_.find(path);
+    return it != files_.end() && it->second.stamp == stamp;
+  }
+
+  void update(const std::string &path, std::string uri, std::string stamp,
+              std::vector<ImportEdge> imports) {
+    unlink(path);
+    for (const auto &edge : imports)
+      importersOf_[edge.target].insert(path);
+    files_[path] = File{std::move(uri), std::move(stamp), std::move(imports)};
+  }
+
+  /**
+   * @brief Forget files that are no longer in the workspace
+   */
+  void retain(const std::unordered_set<std::string> &present) {
+    std::vector<std::string> gone;
+    for (const auto &[path, file] : files_) {
+      if (!present.count(path))
+        gone.push_back(path);
+    }
+    for (const auto &path : gone) {
+      unlink(path);
+      files_.erase(path);
+    }
+  }
+
+  [[nodiscard]] const File *file(const std::string &path) const {
+    auto it = files_.find(path);
+    return it == files_.end() ? nullptr : &it->second;
+  }
+
+  [[nodiscard]] size_t size() const noexcept { return files_.size(); }
+
+  /**
+   * @brief Files importing `path`, or anything under it when it is a directory
+   */
+  void collectImportersOf(const std::string &path, std::set<std::string> &out) const {
+    forEachWithin(importersOf_, path,
+                  [&](const auto &entry) { out.insert(entry.second.begin(), entry.second.end()); });
+  }
+
+  /**
+   * @brief Files at `path` or under it
+   */
+  void collectFilesIn(const std::string &path, std::set<std::string> &out) const {
+    forEachWithin(files_, path, [&](const auto &entry) { out.insert(entry.first); });
+  }
+
+  // ========================================================================
+  // Path Arithmetic
+  // ========================================================================
+
+  /**
+   * @brief Whether path is dir itself or lies under it
+   */
+  [[nodiscard]] static bool within(const std::string &path, const std::string &dir) {
+    if (path.compare(0, dir.size(), dir) != 0)
+      return false;
+    return path.size() == dir.size() || isSeparator(path[dir.size()]) ||
+           (!dir.empty() && isSeparator(dir.back()));
+  }
+
+  /**
+   * @brief Where path ends up after the moves (itself if none applies)
+   */
+  [[nodiscard]] static std::string movedPath(const std::string &path, const Moves &moves) {
+    for (const auto &[from, to] : moves) {
+      if (within(path, from))
+        return to + path.substr(from.size());
+    }
+    return path;
+  }
+
+  /**
+   * @brief Module path the edge should use once importer and target are at their new paths
+   *
+   * A path resolved against a fixed directory stays relative to it while the
+   * target remains inside; otherwise the path becomes relative to the
+   * importer. A "./" prefix and an implied ".lang" extension are kept.
+   */
+  [[nodiscard]] static std::string specifierFor(const ImportEdge &edge, const std::string &importer,
+                                                const std::string &target) {
+    namespace fs = std::filesystem;
+    fs::path to(target);
+    fs::path relative;
+    bool fromImporter = edge.base == ImportEdge::Base::Importer;
+    if (!fromImporter) {
+      relative = to.lexically_relative(edge.baseDir);
+      if (relative.empty() || *relative.begin() == "..")
+        fromImporter = true;
+    }
+    if (fromImporter)
+      relative = to.lexically_relative(fs::path(importer).parent_path());
+    if (relative.empty())
+      return to.generic_string();
+
+    if (!fs::path(edge.specifier).has_extension() && relative.extension() == ".lang")
+      relative.replace_extension();
+    std::string specifier = relative.generic_string();
+    if (fromImporter && edge.specifier.rfind("./", 0) == 0 && specifier.rfind("../", 0) != 0)
+      specifier = "./" + specifier;
+    return specifier;
+  }
+
+  /**
+   * @brief Text to put between the quotes of a string literal
+   */
+  [[nodiscard]] static std::string escape(const std::string &specifier, char quote) {
+    std::string text;
+    text.reserve(specifier.size());
+    for (char c : specifier) {
+      if (c == '\\' || c == quote)
+        text += '\\';
+      text += c;
+    }
+    return text;
+  }
+
+private:
+  [[nodiscard]] static bool isSeparator(char c) noexcept {
+    return c == '/' || c == static_cast<char>(std::filesystem::path::preferred_separator);
+  }
+
+  /// Entry for path itself, then the contiguous key range "path/..."
+  template <typename Map, typename Func>
+  static void forEachWithin(const Map &map, const std::string &path, Func &&func) {
+    auto exact = map.find(path);
+    if (exact != map.end())
+      func(*exact);
+    std::string dir = path;
+    if (dir.empty() || !isSeparator(dir.back()))
+      dir += static_cast<char>(std::filesystem::path::preferred_separator);
+    for (auto it = map.lower_bound(dir); it != map.end() && it->first.compare(0, dir.size(), dir) == 0;
+         ++it)
+      func(*it);
+  }
+
+  void unlink(const std::string &path) {
+    auto it = files_.find(path);
+    if (it == files_.end())
+      return;
+    for (const auto &edge : it->second.imports) {
+      auto importers = importersOf_.find(edge.target);
+      if (importers == importersOf_.end())
+        continue;
+      importers->second.erase(path);
+      if (importers->second.empty())
+        importersOf_.erase(importers);
+    }
+  }
+
+  std::map<std::string, File> files_;                        ///< By normalized path
+  std::map<std::string, std::set<std::string>> importersOf_; ///< Target -> importing files
+};
+
+} // namespace lsp
+} // namespace lang
@@ -115,19 +115,22 @@ public:
   void build(std::string_view source) {
     lineOffsets_.clear();
     lineOffsets_.push_back(0); // Line 1 starts at offset 0
+    terminatorLengths_.clear();
 
-    // 存储源文本用于后续查询
-    source_ = std::string(source);
-
+    // 只记录换行符长度，不保存源文本副本
     for (size_t i = 0; i < source.size(); ++i) {
       if (source[i] == '\n') {
         lineOffsets_.push_back(static_cast<uint32_t>(i + 1));
+        terminatorLengths_.push_back(1);
       } else if (source[i] == '\r') {
         // Handle \r\n (Windows) and lone \r (old Mac)
+        uint8_t length = 1;
         if (i + 1 < source.size() && source[i + 1] == '\n') {
           ++i; // Skip the \n in \r\n
+          length = 2;
         }
         lineOffsets_.push_back(static_cast<uint32_t>(i + 1));
+        terminatorLengths_.push_back(length);
       }
     }
 
@@ -211,19 +214,8 @@ public:
         return 0;
       }
 
-      uint32_t end = nextLineStart;
-
-      // 回退跳过换行符
-      // 检查 \n
-      if (end > 0 && source_[end - 1] == '\n') {
-        --end;
-      }
-      // 检查 \r (处理 \r\n 和单独的 \r)
-      if (end > 0 && source_[end - 1] == '\r') {
-        --end;
-      }
-
-      return end;
+      // 回退跳过换行符 (\n, \r\n 或单独的 \r)
+      return nextLineStart - terminatorLengths_[line - 1];
     }
     return sourceLength_;
   }
@@ -301,15 +293,10 @@ public:
     return source.substr(start, end - start);
   }
 
-  /**
-   * @brief Get stored source text
-   */
-  [[nodiscard]] const std::string &source() const noexcept { return source_; }
-
 private:
-  std::vector<uint32_t> lineOffsets_; ///< Offset of each line's first character
-  uint32_t sourceLength_ = 0;         ///< Total length of source
-  std::string source_;                ///< Stored source text for line end calculation
+  std::vector<uint32_t> lineOffsets_;      ///< Offset of each line's first character
+  std::vector<uint8_t> terminatorLengths_; ///< Terminator length of each non-last line
+  uint32_t sourceLength_ = 0;              ///< Total length of source
 };
 
 // ============================================================================
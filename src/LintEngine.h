@@ -0,0 +1,899 @@
+/**
+ * @file LintEngine.h
+ * @brief Fused Single-Pass Lint Rules
+ *
+ * Every lint check written as its own visitor would walk the tree once more.
+ * LintEngine walks it once: rules declare the AstKinds they care about (and
+ * whether they want scope enter/exit events), and the engine dispatches each
+ * node only to the rules interested in its kind.
+ *
+ * Key Features:
+ * - One traversal for all enabled rules, kind-indexed dispatch
+ * - Shared lexical bindings (BasicNameBinder over declarations), so rules
+ *   resolve names without building their own scope tables
+ * - Per-rule timing, call and report counters
+ * - Rule sets configurable by rule name or code, with severity overrides
+ * - Control-flow summaries (Dataflow.h) built only for functions a rule
+ *   asks about, and reused across runs for unchanged function bodies
+ * - Findings may carry a machine-applicable fix (L001, L002), used by the
+ *   source.fixAll code action and workspace fix-all
+ *
+ * Built-in rules:
+ *   L001 unused-variable        Local variable never referenced
+ *   L002 unreachable-code       Statements after return/break/continue
+ *   L003 shadowing              Local declaration hides an outer local/parameter
+ *   L004 defer-misuse           Control flow escaping a defer block, nested defer
+ *   L005 suspicious-any         'any' variable always initialized with one type
+ *   L006 missing-return         Typed function can reach its end without a return
+ *   L007 use-before-assignment  Read reachable from a declaration without initializer
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "AstNodes.h"
+#include "Dataflow.h"
+#include "NameBinder.h"
+#include "NodeFinder.h"
+#include "Scope.h"
+#include "SemanticAnalyzer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace lang {
+namespace semantic {
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+/**
+ * @brief Which rules run, and how loudly
+ *
+ * Rules are referred to by name ("unused-variable") or code ("L001").
+ */
+struct LintConfig {
+  bool enabled = true;
+  std::vector<std::string> disabledRules; ///< Never run these
+  std::vector<std::string> onlyRules;     ///< When non-empty, run only these
+  std::unordered_map<std::string, DiagnosticSeverity> severities; ///< Per-rule override
+  bool collectTimings = true; ///< Time every rule callback
+};
+
+/**
+ * @brief Cost of one rule, for the last run or accumulated
+ */
+struct LintRuleTiming {
+  std::string_view rule;
+  std::string_view code;
+  uint64_t nanos = 0;   ///< Time spent in the rule's callbacks
+  uint64_t calls = 0;   ///< Callbacks dispatched to the rule
+  uint64_t reports = 0; ///< Diagnostics it produced
+};
+
+// ============================================================================
+// Rule Interface
+// ============================================================================
+
+/**
+ * @brief A declaration visible at the current point of the traversal
+ */
+struct LintBinding {
+  ast::Decl *decl = nullptr;
+  ScopeKind scope = ScopeKind::Global; ///< Kind of scope that declared it
+};
+
+/**
+ * @brief A lexical scope opened by the traversal
+ */
+struct LintScope {
+  ScopeKind kind = ScopeKind::Global;
+  ast::AstNode *owner = nullptr; ///< CompilationUnit, function, class, loop or block
+};
+
+class LintContext;
+
+/**
+ * @brief One lint check
+ *
+ * visit() runs before a node's children, leave() after them. Names declared
+ * by a node are bound after leave() for variables, fields and parameters and
+ * before visit() of the children for functions, methods and classes, so a
+ * rule inspecting a declaration in visit() still sees what it would shadow.
+ */
+class LintRule {
+public:
+  virtual ~LintRule() = default;
+
+  [[nodiscard]] virtual std::string_view name() const noexcept = 0;
+  [[nodiscard]] virtual std::string_view code() const noexcept = 0;
+  [[nodiscard]] virtual DiagnosticSeverity defaultSeverity() const noexcept {
+    return DiagnosticSeverity::Warning;
+  }
+
+  /// Kinds passed to visit()/leave()
+  [[nodiscard]] virtual std::vector<ast::AstKind> interests() const = 0;
+  /// Whether enterScope()/exitScope() are wanted
+  [[nodiscard]] virtual bool wantsScopeEvents() const noexcept { return false; }
+
+  virtual void beginFile(LintContext & /*ctx*/) {}
+  virtual void visit(ast::AstNode * /*node*/, LintContext & /*ctx*/) {}
+  virtual void leave(ast::AstNode * /*node*/, LintContext & /*ctx*/) {}
+  virtual void enterScope(const LintScope & /*scope*/, LintContext & /*ctx*/) {}
+  virtual void exitScope(const LintScope & /*scope*/, LintContext & /*ctx*/) {}
+};
+
+/**
+ * @brief What a rule can see and do during the traversal
+ */
+class LintContext {
+public:
+  [[nodiscard]] const ast::StringTable &strings() const noexcept { return *strings_; }
+  [[nodiscard]] std::string_view text(ast::InternedString s) const { return strings_->get(s); }
+
+  /// Semantic model of the file (may be null)
+  [[nodiscard]] SemanticModel *model() const noexcept { return model_; }
+
+  /// Ancestors of the current node, outermost first
+  [[nodiscard]] const std::vector<ast::AstNode *> &ancestors() const noexcept {
+    return ancestors_;
+  }
+
+  [[nodiscard]] ast::AstNode *parent() const noexcept {
+    return ancestors_.empty() ? nullptr : ancestors_.back();
+  }
+
+  /// Innermost open scope
+  [[nodiscard]] const LintScope &scope() const noexcept { return scopes_.back(); }
+
+  [[nodiscard]] size_t scopeDepth() const noexcept { return scopes_.size(); }
+
+  /// Declaration a reference to `name` sees here, or nullptr
+  [[nodiscard]] const LintBinding *resolve(ast::InternedString name) const noexcept {
+    return binder_.lookup(name);
+  }
+
+  /// Declaration of `name` in the innermost scope, or nullptr
+  [[nodiscard]] const LintBinding *resolveLocal(ast::InternedString name) const noexcept {
+    return binder_.lookupLocal(name);
+  }
+
+  /**
+   * @brief Control-flow summary of a function, method or lambda
+   *
+   * Computed on first request in a run; bodies whose structural hash was
+   * seen before reuse the earlier summary without building a CFG.
+   */
+  const FlowSummary &flow(ast::AstNode *function) {
+    auto it = flows_.find(function);
+    if (it != flows_.end())
+      return it->second;
+
+    uint64_t key = flowCache_ ? flowKey(function, *strings_) : 0;
+    std::optional<FlowSummary> summary;
+    if (key)
+      summary = flowCache_->find(key);
+    if (!summary) {
+      FunctionFlow flow(function);
+      summary = summarizeFlow(flow);
+      if (key)
+        flowCache_->store(key, *summary);
+    }
+    return flows_.emplace(function, std::move(*summary)).first->second;
+  }
+
+  /**
+   * @brief Report a finding of the rule currently running
+   * @param fixes Edits that resolve it, only when applying them blindly is safe
+   */
+  void report(ast::SourceRange range, std::string message, std::vector<FixEdit> fixes = {}) {
+    diagnostics_.push_back(
+        {severity_, std::move(message), range, std::string(code_), std::move(fixes)});
+    ++reports_;
+  }
+
+private:
+  friend class LintEngine;
+
+  const ast::StringTable *strings_ = nullptr;
+  SemanticModel *model_ = nullptr;
+  std::vector<ast::AstNode *> ancestors_;
+  std::vector<LintScope> scopes_;
+  BasicNameBinder<LintBinding> binder_;
+  std::vector<Diagnostic> diagnostics_;
+  std::unordered_map<const ast::AstNode *, FlowSummary> flows_;
+  ast::SubtreeCache<FlowSummary> *flowCache_ = nullptr;
+
+  // Set by the engine around each callback
+  std::string_view code_;
+  DiagnosticSeverity severity_ = DiagnosticSeverity::Warning;
+  uint64_t reports_ = 0;
+};
+
+// ============================================================================
+// Built-in Rules
+// ============================================================================
+
+namespace lint {
+
+[[nodiscard]] inline bool isFunctionBoundary(ast::AstKind kind) noexcept {
+  return kind == ast::AstKind::FunctionDecl || kind == ast::AstKind::MethodDecl ||
+         kind == ast::AstKind::LambdaExpr;
+}
+
+[[nodiscard]] inline bool isLocalScope(ScopeKind kind) noexcept {
+  return kind != ScopeKind::Global && kind != ScopeKind::Class;
+}
+
+/// Whether evaluating the expression can have no effect besides its value
+[[nodiscard]] inline bool isEffectFree(const ast::Expr *expr) noexcept {
+  if (!expr)
+    return true;
+  switch (expr->kind) {
+  case ast::AstKind::NullLiteral:
+  case ast::AstKind::BoolLiteral:
+  case ast::AstKind::IntLiteral:
+  case ast::AstKind::FloatLiteral:
+  case ast::AstKind::StringLiteral:
+  case ast::AstKind::Identifier:
+  case ast::AstKind::LambdaExpr:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief L001: local variables that are never referenced
+ *
+ * Any reference counts as a use, including assignment. Names starting with
+ * '_' and loop iterator variables are exempt. The fix deletes the declaration
+ * statement when its initializer has no side effects.
+ */
+class UnusedVariableRule : public LintRule {
+public:
+  [[nodiscard]] std::string_view name() const noexcept override { return "unused-variable"; }
+  [[nodiscard]] std::string_view code() const noexcept override { return "L001"; }
+
+  [[nodiscard]] std::vector<ast::AstKind> interests() const override {
+    return {ast::AstKind::VarDecl, ast::AstKind::MultiVarDecl, ast::AstKind::Identifier};
+  }
+  [[nodiscard]] bool wantsScopeEvents() const noexcept override { return true; }
+
+  void beginFile(LintContext &) override {
+    declared_.clear();
+    used_.clear();
+  }
+
+  void visit(ast::AstNode *node, LintContext &ctx) override {
+    if (node->kind != ast::AstKind::Identifier)
+      return;
+    if (const auto *binding = ctx.resolve(static_cast<ast::IdentifierNode *>(node)->name))
+      used_.insert(binding->decl);
+  }
+
+  void leave(ast::AstNode *node, LintContext &ctx) override {
+    if (node->kind == ast::AstKind::Identifier || declared_.empty() ||
+        !isLocalScope(ctx.scope().kind))
+      return;
+    // Loop iterator variables are often required by syntax, not by need
+    ast::AstNode *parent = ctx.parent();
+    if (parent && parent->kind == ast::AstKind::ForStmt)
+      return;
+    bool statement = parent && parent->kind == ast::AstKind::DeclStmt;
+    declared_.back().push_back(
+        {static_cast<ast::Decl *>(node), statement ? parent->range : ast::SourceRange::invalid()});
+  }
+
+  void enterScope(const LintScope &, LintContext &) override { declared_.emplace_back(); }
+
+  void exitScope(const LintScope &, LintContext &ctx) override {
+    if (declared_.empty())
+      return;
+    for (const auto &[decl, statement] : declared_.back()) {
+      if (used_.count(decl))
+        continue;
+      std::string_view name = displayName(decl, ctx);
+      if (name.empty() || name.front() == '_')
+        continue;
+      std::vector<FixEdit> fixes;
+      if (statement.isValid() && isEffectFree(initializer(decl)))
+        fixes.push_back({statement, {}});
+      ctx.report(decl->range, "Variable '" + std::string(name) + "' is declared but never used",
+                 std::move(fixes));
+    }
+    declared_.pop_back();
+  }
+
+private:
+  struct Declared {
+    ast::Decl *decl;
+    ast::SourceRange statement; ///< Enclosing declaration statement, if the decl is one
+  };
+
+  static const ast::Expr *initializer(ast::Decl *decl) {
+    if (decl->kind == ast::AstKind::MultiVarDecl)
+      return static_cast<ast::MultiVarDeclNode *>(decl)->initializer;
+    return static_cast<ast::VarDeclNode *>(decl)->initializer;
+  }
+
+  static std::string_view displayName(ast::Decl *decl, LintContext &ctx) {
+    if (decl->kind == ast::AstKind::MultiVarDecl) {
+      const auto &names = static_cast<ast::MultiVarDeclNode *>(decl)->names;
+      return names.empty() ? std::string_view() : ctx.text(names[0]);
+    }
+    return ctx.text(decl->name);
+  }
+
+  std::vector<std::vector<Declared>> declared_;
+  std::unordered_set<const ast::Decl *> used_;
+};
+
+/**
+ * @brief L002: statements following return/break/continue in the same block
+ *
+ * The fix deletes them.
+ */
+class UnreachableCodeRule : public LintRule {
+public:
+  [[nodiscard]] std::string_view name() const noexcept override { return "unreachable-code"; }
+  [[nodiscard]] std::string_view code() const noexcept override { return "L002"; }
+
+  [[nodiscard]] std::vector<ast::AstKind> interests() const override {
+    return {ast::AstKind::BlockStmt};
+  }
+
+  void visit(ast::AstNode *node, LintContext &ctx) override {
+    const auto &stmts = static_cast<ast::BlockStmtNode *>(node)->statements;
+    for (uint32_t i = 0; i < stmts.size(); ++i) {
+      const char *jump = jumpName(stmts[i]->kind);
+      if (!jump)
+        continue;
+      for (uint32_t j = i + 1; j < stmts.size(); ++j) {
+        if (stmts[j]->kind == ast::AstKind::EmptyStmt)
+          continue;
+        ast::SourceRange range{stmts[j]->range.begin, stmts[stmts.size() - 1]->range.end};
+        ctx.report(range, std::string("Unreachable code after '") + jump + "'", {{range, {}}});
+        break;
+      }
+      return;
+    }
+  }
+
+private:
+  static const char *jumpName(ast::AstKind kind) noexcept {
+    switch (kind) {
+    case ast::AstKind::ReturnStmt:
+      return "return";
+    case ast::AstKind::BreakStmt:
+      return "break";
+    case ast::AstKind::ContinueStmt:
+      return "continue";
+    default:
+      return nullptr;
+    }
+  }
+};
+
+/**
+ * @brief L003: local declarations hiding an outer local or parameter
+ *
+ * Redeclaring a name in the same scope is the analyzer's error, not a lint;
+ * shadowing globals and fields is common and not reported.
+ */
+class ShadowingRule : public LintRule {
+public:
+  [[nodiscard]] std::string_view name() const noexcept override { return "shadowing"; }
+  [[nodiscard]] std::string_view code() const noexcept override { return "L003"; }
+
+  [[nodiscard]] std::vector<ast::AstKind> interests() const override {
+    return {ast::AstKind::VarDecl, ast::AstKind::ParameterDecl, ast::AstKind::MultiVarDecl};
+  }
+
+  void visit(ast::AstNode *node, LintContext &ctx) override {
+    if (!isLocalScope(ctx.scope().kind))
+      return;
+    if (node->kind == ast::AstKind::MultiVarDecl) {
+      for (auto name : static_cast<ast::MultiVarDeclNode *>(node)->names)
+        check(node, name, ctx);
+    } else {
+      check(node, static_cast<ast::Decl *>(node)->name, ctx);
+    }
+  }
+
+private:
+  static void check(ast::AstNode *node, ast::InternedString name, LintContext &ctx) {
+    if (name.isEmpty() || ctx.resolveLocal(name))
+      return;
+    const auto *outer = ctx.resolve(name);
+    if (!outer || !isLocalScope(outer->scope))
+      return;
+    const char *what = outer->decl->kind == ast::AstKind::ParameterDecl ? "parameter" : "variable";
+    ctx.report(node->range, "'" + std::string(ctx.text(name)) + "' shadows a " + what +
+                                " declared on line " +
+                                std::to_string(outer->decl->range.begin.line));
+  }
+};
+
+/**
+ * @brief L004: return/break/continue leaving a defer block, nested defers
+ */
+class DeferMisuseRule : public LintRule {
+public:
+  [[nodiscard]] std::string_view name() const noexcept override { return "defer-misuse"; }
+  [[nodiscard]] std::string_view code() const noexcept override { return "L004"; }
+
+  [[nodiscard]] std::vector<ast::AstKind> interests() const override {
+    return {ast::AstKind::ReturnStmt, ast::AstKind::BreakStmt, ast::AstKind::ContinueStmt,
+            ast::AstKind::DeferStmt};
+  }
+
+  void visit(ast::AstNode *node, LintContext &ctx) override {
+    bool isLoopJump =
+        node->kind == ast::AstKind::BreakStmt || node->kind == ast::AstKind::ContinueStmt;
+    const auto &ancestors = ctx.ancestors();
+    for (auto it = ancestors.rbegin(); it != ancestors.rend(); ++it) {
+      ast::AstKind kind = (*it)->kind;
+      if (isFunctionBoundary(kind))
+        return;
+      if (isLoopJump && (kind == ast::AstKind::WhileStmt || kind == ast::AstKind::ForStmt))
+        return;
+      if (kind != ast::AstKind::DeferStmt)
+        continue;
+
+      switch (node->kind) {
+      case ast::AstKind::DeferStmt:
+        ctx.report(node->range, "Nested 'defer' runs when the outer deferred block exits, "
+                                "not the function");
+        break;
+      case ast::AstKind::ReturnStmt:
+        ctx.report(node->range, "'return' inside a 'defer' block");
+        break;
+      default:
+        ctx.report(node->range,
+                   std::string("'") + (node->kind == ast::AstKind::BreakStmt ? "break" : "continue") +
+                       "' jumps out of a 'defer' block");
+        break;
+      }
+      return;
+    }
+  }
+};
+
+/**
+ * @brief L005: 'any' variables initialized with a value of one obvious type
+ */
+class SuspiciousAnyRule : public LintRule {
+public:
+  [[nodiscard]] std::string_view name() const noexcept override { return "suspicious-any"; }
+  [[nodiscard]] std::string_view code() const noexcept override { return "L005"; }
+  [[nodiscard]] DiagnosticSeverity defaultSeverity() const noexcept override {
+    return DiagnosticSeverity::Info;
+  }
+
+  [[nodiscard]] std::vector<ast::AstKind> interests() const override {
+    return {ast::AstKind::VarDecl, ast::AstKind::FieldDecl};
+  }
+
+  void visit(ast::AstNode *node, LintContext &ctx) override {
+    ast::TypeNode *type = nullptr;
+    ast::Expr *init = nullptr;
+    if (node->kind == ast::AstKind::VarDecl) {
+      type = static_cast<ast::VarDeclNode *>(node)->type;
+      init = static_cast<ast::VarDeclNode *>(node)->initializer;
+    } else {
+      type = static_cast<ast::FieldDeclNode *>(node)->type;
+      init = static_cast<ast::FieldDeclNode *>(node)->initializer;
+    }
+    if (!type || type->kind != ast::AstKind::AnyType || !init)
+      return;
+
+    std::string concrete = typeOf(init, ctx);
+    if (concrete.empty())
+      return;
+    std::string name(ctx.text(static_cast<ast::Decl *>(node)->name));
+    ctx.report(node->range, "'" + name + "' is declared 'any' but its initializer is '" +
+                                concrete + "'; consider declaring it '" + concrete + "'");
+  }
+
+private:
+  static std::string typeOf(ast::Expr *init, LintContext &ctx) {
+    switch (init->kind) {
+    case ast::AstKind::IntLiteral:
+      return "int";
+    case ast::AstKind::FloatLiteral:
+      return "float";
+    case ast::AstKind::StringLiteral:
+      return "string";
+    case ast::AstKind::BoolLiteral:
+      return "bool";
+    case ast::AstKind::NewExpr: {
+      auto *typeName = static_cast<ast::NewExprNode *>(init)->typeName;
+      if (!typeName || typeName->parts.empty())
+        return {};
+      return std::string(ctx.text(typeName->parts[typeName->parts.size() - 1]));
+    }
+    default:
+      return {};
+    }
+  }
+};
+
+/// Functions whose declared return type promises a value
+[[nodiscard]] inline bool returnsValue(ast::AstNode *function) noexcept {
+  ast::TypeNode *type = nullptr;
+  bool multi = false;
+  switch (function->kind) {
+  case ast::AstKind::FunctionDecl:
+    type = static_cast<ast::FunctionDeclNode *>(function)->returnType;
+    multi = static_cast<ast::FunctionDeclNode *>(function)->isMultiReturn;
+    break;
+  case ast::AstKind::MethodDecl:
+    type = static_cast<ast::MethodDeclNode *>(function)->returnType;
+    multi = static_cast<ast::MethodDeclNode *>(function)->isMultiReturn;
+    break;
+  case ast::AstKind::LambdaExpr:
+    type = static_cast<ast::LambdaExprNode *>(function)->returnType;
+    multi = static_cast<ast::LambdaExprNode *>(function)->isMultiReturn;
+    break;
+  default:
+    return false;
+  }
+  if (!type || multi)
+    return false;
+
+  switch (type->kind) {
+  case ast::AstKind::PrimitiveType: {
+    auto primitive = static_cast<ast::PrimitiveTypeNode *>(type)->primitiveKind;
+    return primitive != ast::PrimitiveKind::Void && primitive != ast::PrimitiveKind::Null &&
+           primitive != ast::PrimitiveKind::Invalid;
+  }
+  case ast::AstKind::ListType:
+  case ast::AstKind::MapType:
+  case ast::AstKind::QualifiedType:
+    return true;
+  default:
+    return false; // void-like, any, inferred, error
+  }
+}
+
+/**
+ * @brief L006: typed functions whose end is reachable
+ */
+class MissingReturnRule : public LintRule {
+public:
+  [[nodiscard]] std::string_view name() const noexcept override { return "missing-return"; }
+  [[nodiscard]] std::string_view code() const noexcept override { return "L006"; }
+
+  [[nodiscard]] std::vector<ast::AstKind> interests() const override {
+    return {ast::AstKind::FunctionDecl, ast::AstKind::MethodDecl, ast::AstKind::LambdaExpr};
+  }
+
+  void visit(ast::AstNode *node, LintContext &ctx) override {
+    auto *body = CfgBuilder::signatureOf(node).second;
+    // Bodies lost to error recovery have no position and are not worth a guess
+    if (!body || !body->range.end.isValid() || !returnsValue(node) ||
+        !ctx.flow(node).fallsOffEnd)
+      return;
+
+    std::string what = node->kind == ast::AstKind::LambdaExpr
+                           ? std::string("Lambda")
+                           : "Function '" + std::string(ctx.text(static_cast<ast::Decl *>(node)->name)) + "'";
+    ctx.report({body->range.end, body->range.end},
+               what + " does not return a value on every path");
+  }
+};
+
+/**
+ * @brief L007: reads that a declaration without initializer may reach
+ */
+class UseBeforeAssignmentRule : public LintRule {
+public:
+  [[nodiscard]] std::string_view name() const noexcept override {
+    return "use-before-assignment";
+  }
+  [[nodiscard]] std::string_view code() const noexcept override { return "L007"; }
+
+  [[nodiscard]] std::vector<ast::AstKind> interests() const override {
+    return {ast::AstKind::FunctionDecl, ast::AstKind::MethodDecl, ast::AstKind::LambdaExpr};
+  }
+
+  void visit(ast::AstNode *node, LintContext &ctx) override {
+    const FlowSummary &flow = ctx.flow(node);
+    if (flow.unassignedReads.empty())
+      return;
+
+    auto ids = identifiersOf(CfgBuilder::signatureOf(node).second);
+    for (uint32_t ordinal : flow.unassignedReads) {
+      if (ordinal >= ids.size())
+        continue;
+      ctx.report(ids[ordinal]->range, "'" + std::string(ctx.text(ids[ordinal]->name)) +
+                                          "' may be used before it is assigned");
+    }
+  }
+};
+
+} // namespace lint
+
+// ============================================================================
+// Engine
+// ============================================================================
+
+/**
+ * @brief Runs all enabled rules in one traversal
+ *
+ * Not thread-safe: one run at a time per engine.
+ *
+ * Usage:
+ *   LintEngine engine = LintEngine::withBuiltinRules();
+ *   engine.configure(config);
+ *   auto diagnostics = engine.run(ast, factory.strings(), &model);
+ *   for (const auto& t : engine.timings()) ...
+ */
+class LintEngine {
+public:
+  LintEngine() = default;
+
+  LintEngine(LintEngine &&) = default;
+  LintEngine &operator=(LintEngine &&) = default;
+
+  [[nodiscard]] static LintEngine withBuiltinRules() {
+    LintEngine engine;
+    engine.addRule(std::make_unique<lint::UnusedVariableRule>());
+    engine.addRule(std::make_unique<lint::UnreachableCodeRule>());
+    engine.addRule(std::make_unique<lint::ShadowingRule>());
+    engine.addRule(std::make_unique<lint::DeferMisuseRule>());
+    engine.addRule(std::make_unique<lint::SuspiciousAnyRule>());
+    engine.addRule(std::make_unique<lint::MissingReturnRule>());
+    engine.addRule(std::make_unique<lint::UseBeforeAssignmentRule>());
+    engine.configure(LintConfig{});
+    return engine;
+  }
+
+  void addRule(std::unique_ptr<LintRule> rule) {
+    Slot slot;
+    slot.timing.rule = rule->name();
+    slot.timing.code = rule->code();
+    slot.severity = rule->defaultSeverity();
+    slot.rule = std::move(rule);
+    slots_.push_back(std::move(slot));
+    configure(config_);
+  }
+
+  /**
+   * @brief Select rules and severities; rebuilds the dispatch tables
+   */
+  void configure(const LintConfig &config) {
+    config_ = config;
+    dispatch_.assign(static_cast<size_t>(ast::AstKind::TypeEnd), {});
+    scopeRules_.clear();
+    activeRules_.clear();
+
+    for (uint32_t i = 0; i < slots_.size(); ++i) {
+      Slot &slot = slots_[i];
+      slot.severity = slot.rule->defaultSeverity();
+      slot.enabled = config.enabled && isSelected(*slot.rule);
+      if (auto severity = configuredSeverity(*slot.rule))
+        slot.severity = *severity;
+      if (!slot.enabled)
+        continue;
+
+      activeRules_.push_back(i);
+      for (ast::AstKind kind : slot.rule->interests())
+        dispatch_[static_cast<size_t>(kind)].push_back(i);
+      if (slot.rule->wantsScopeEvents())
+        scopeRules_.push_back(i);
+    }
+  }
+
+  [[nodiscard]] const LintConfig &config() const noexcept { return config_; }
+
+  [[nodiscard]] size_t enabledRuleCount() const noexcept { return activeRules_.size(); }
+
+  /// Control-flow summaries reused across runs
+  [[nodiscard]] const ast::SubtreeCache<FlowSummary> &flowCache() const noexcept {
+    return *flowCache_;
+  }
+
+  /**
+   * @brief Lint one file
+   */
+  [[nodiscard]] std::vector<Diagnostic> run(ast::CompilationUnitNode *root,
+                                            const ast::StringTable &strings,
+                                            SemanticModel *model = nullptr) {
+    ctx_ = LintContext();
+    ctx_.strings_ = &strings;
+    ctx_.model_ = model;
+    ctx_.flowCache_ = flowCache_.get();
+    for (auto &slot : slots_)
+      slot.timing.nanos = slot.timing.calls = slot.timing.reports = 0;
+
+    if (!root || activeRules_.empty())
+      return {};
+
+    for (uint32_t i : activeRules_)
+      call(i, [&](LintRule &rule) { rule.beginFile(ctx_); });
+    walk(root);
+
+    bindings_.clear();
+    return std::move(ctx_.diagnostics_);
+  }
+
+  /**
+   * @brief Per-rule cost of the last run (enabled rules only)
+   */
+  [[nodiscard]] std::vector<LintRuleTiming> timings() const {
+    std::vector<LintRuleTiming> result;
+    for (uint32_t i : activeRules_)
+      result.push_back(slots_[i].timing);
+    return result;
+  }
+
+private:
+  struct Slot {
+    std::unique_ptr<LintRule> rule;
+    bool enabled = true;
+    DiagnosticSeverity severity = DiagnosticSeverity::Warning;
+    LintRuleTiming timing;
+  };
+
+  static bool listed(const std::vector<std::string> &list, const LintRule &rule) {
+    return std::any_of(list.begin(), list.end(), [&](const std::string &entry) {
+      return entry == rule.name() || entry == rule.code();
+    });
+  }
+
+  [[nodiscard]] bool isSelected(const LintRule &rule) const {
+    if (listed(config_.disabledRules, rule))
+      return false;
+    return config_.onlyRules.empty() || listed(config_.onlyRules, rule);
+  }
+
+  [[nodiscard]] std::optional<DiagnosticSeverity> configuredSeverity(const LintRule &rule) const {
+    for (auto key : {rule.name(), rule.code()}) {
+      auto it = config_.severities.find(std::string(key));
+      if (it != config_.severities.end())
+        return it->second;
+    }
+    return std::nullopt;
+  }
+
+  template <typename Callback> void call(uint32_t index, Callback &&callback) {
+    Slot &slot = slots_[index];
+    ctx_.code_ = slot.timing.code;
+    ctx_.severity_ = slot.severity;
+    ctx_.reports_ = 0;
+
+    if (config_.collectTimings) {
+      auto start = std::chrono::steady_clock::now();
+      callback(*slot.rule);
+      slot.timing.nanos += static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                               start)
+              .count());
+    } else {
+      callback(*slot.rule);
+    }
+    ++slot.timing.calls;
+    slot.timing.reports += ctx_.reports_;
+  }
+
+  static std::optional<ScopeKind> scopeOf(ast::AstKind kind) noexcept {
+    switch (kind) {
+    case ast::AstKind::CompilationUnit:
+      return ScopeKind::Global;
+    case ast::AstKind::FunctionDecl:
+    case ast::AstKind::MethodDecl:
+    case ast::AstKind::LambdaExpr:
+      return ScopeKind::Function;
+    case ast::AstKind::ClassDecl:
+      return ScopeKind::Class;
+    case ast::AstKind::ForStmt:
+    case ast::AstKind::WhileStmt:
+      return ScopeKind::Loop;
+    case ast::AstKind::BlockStmt:
+      return ScopeKind::Block;
+    default:
+      return std::nullopt;
+    }
+  }
+
+  void bind(ast::InternedString name, ast::Decl *decl) {
+    if (name.isEmpty() || ctx_.scopes_.empty())
+      return;
+    bindings_.push_back({decl, ctx_.scopes_.back().kind});
+    ctx_.binder_.bind(name, &bindings_.back());
+  }
+
+  /// Functions, methods and classes are visible inside their own bodies
+  void bindBeforeChildren(ast::AstNode *node) {
+    switch (node->kind) {
+    case ast::AstKind::FunctionDecl:
+    case ast::AstKind::MethodDecl:
+    case ast::AstKind::ClassDecl:
+      bind(static_cast<ast::Decl *>(node)->name, static_cast<ast::Decl *>(node));
+      break;
+    default:
+      break;
+    }
+  }
+
+  /// Variables become visible after their initializer
+  void bindAfterChildren(ast::AstNode *node) {
+    switch (node->kind) {
+    case ast::AstKind::VarDecl:
+    case ast::AstKind::ParameterDecl:
+    case ast::AstKind::FieldDecl:
+      bind(static_cast<ast::Decl *>(node)->name, static_cast<ast::Decl *>(node));
+      break;
+    case ast::AstKind::MultiVarDecl:
+      for (auto name : static_cast<ast::MultiVarDeclNode *>(node)->names)
+        bind(name, static_cast<ast::Decl *>(node));
+      break;
+    default:
+      break;
+    }
+  }
+
+  void walk(ast::AstNode *node) {
+    if (!node)
+      return;
+    const auto &interested = dispatch_[slotOf(node->kind)];
+
+    for (uint32_t i : interested)
+      call(i, [&](LintRule &rule) { rule.visit(node, ctx_); });
+    bindBeforeChildren(node);
+
+    auto scopeKind = scopeOf(node->kind);
+    if (scopeKind) {
+      ctx_.scopes_.push_back({*scopeKind, node});
+      ctx_.binder_.enterScope();
+      for (uint32_t i : scopeRules_)
+        call(i, [&](LintRule &rule) { rule.enterScope(ctx_.scopes_.back(), ctx_); });
+    }
+
+    ctx_.ancestors_.push_back(node);
+    lsp::NodeFinder::forEachChild(node, [this](ast::AstNode *child) { walk(child); });
+    ctx_.ancestors_.pop_back();
+
+    if (scopeKind) {
+      for (uint32_t i : scopeRules_)
+        call(i, [&](LintRule &rule) { rule.exitScope(ctx_.scopes_.back(), ctx_); });
+      ctx_.binder_.exitScope();
+      ctx_.scopes_.pop_back();
+    }
+
+    bindAfterChildren(node);
+    for (uint32_t i : interested)
+      call(i, [&](LintRule &rule) { rule.leave(node, ctx_); });
+  }
+
+  [[nodiscard]] static size_t slotOf(ast::AstKind kind) noexcept {
+    return std::min(static_cast<size_t>(kind), static_cast<size_t>(ast::AstKind::TypeEnd) - 1);
+  }
+
+  std::vector<Slot> slots_;
+  LintConfig config_;
+  std::vector<std::vector<uint32_t>> dispatch_; ///< AstKind -> interested enabled rules
+  std::vector<uint32_t> scopeRules_;
+  std::vector<uint32_t> activeRules_;
+
+  LintContext ctx_;
+  std::deque<LintBinding> bindings_; ///< Stable storage behind ctx_.binder_
+  std::unique_ptr<ast::SubtreeCache<FlowSummary>> flowCache_ =
+      std::make_unique<ast::SubtreeCache<FlowSummary>>();
+};
+
+} // namespace semantic
+} // namespace lang
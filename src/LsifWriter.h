@@ -0,0 +1,242 @@
+/**
+ * @file LsifWriter.h
+ * @brief LSIF Dump Writer for Offline Code Intelligence
+ *
+ * Code review and code search tools answer go-to-definition, find-references
+ * and hover from a precomputed dump instead of a running server. LsifWriter
+ * turns the documents produced by LspService::indexWorkspace() into LSIF
+ * (Language Server Index Format) JSON lines, one document at a time.
+ *
+ * Key Features:
+ * - Streaming: each document's vertices and edges are written as soon as it
+ *   arrives; only the ids of exported symbols and of not yet resolvable
+ *   imports are kept until the end
+ * - One result set per symbol with its hover, definition and reference results
+ * - Cross-file: a named import's result set chains (`next`) to the exported
+ *   symbol's, and the import's ranges are added to the export's references,
+ *   so lookups from either side see every file
+ * - Export/import monikers ("lang" scheme, workspace-relative path + name)
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "LspService.h"
+
+#include <nlohmann/json.hpp>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief Writes an LSIF dump as JSON lines
+ *
+ * Usage:
+ *   LsifWriter writer(out, rootUri);
+ *   service.indexWorkspace([&](IndexedDocument&& doc) { writer.document(doc); });
+ *   writer.finish();
+ */
+class LsifWriter {
+public:
+  using json = nlohmann::ordered_json; ///< id, type and label lead each line
+  using Id = uint64_t;
+
+  struct Stats {
+    size_t documents = 0;
+    size_t ranges = 0;
+    size_t imports = 0;    ///< Named imports linked to the exporting file
+    size_t unresolved = 0; ///< Named imports whose export was never seen
+  };
+
+  LsifWriter(std::ostream &out, std::string rootUri, std::string toolVersion = "1.0.0")
+      : out_(out), rootUri_(std::move(rootUri)) {
+    vertex("metaData", {{"version", "0.6.0"},
+                        {"projectRoot", rootUri_},
+                        {"positionEncoding", "utf-16"},
+                        {"toolInfo", {{"name", "lang-lsp"}, {"version", toolVersion}}}});
+    project_ = vertex("project", {{"kind", "lang"}});
+  }
+
+  LsifWriter(const LsifWriter &) = delete;
+  LsifWriter &operator=(const LsifWriter &) = delete;
+
+  /**
+   * @brief Write one document with its ranges and result sets
+   */
+  void document(const IndexedDocument &doc) {
+    Id documentId = vertex("document", {{"uri", doc.uri}, {"languageId", "lang"}});
+    edge("contains", project_, {documentId});
+    ++stats_.documents;
+
+    std::vector<Id> contained;
+    for (const auto &symbol : doc.symbols) {
+      Id resultSet = vertex("resultSet");
+      if (!symbol.hover.empty()) {
+        json contents{{"kind", "markdown"}, {"value", symbol.hover}};
+        Id hover = vertex("hoverResult", {{"result", {{"contents", contents}}}});
+        edge("textDocument/hover", resultSet, hover);
+      }
+
+      Local local{documentId, resultSet, range(symbol.definition, resultSet), {}};
+      contained.push_back(local.definition);
+      for (const auto &ref : symbol.references) {
+        local.references.push_back(range(ref, resultSet));
+        contained.push_back(local.references.back());
+      }
+
+      if (!symbol.importedUri.empty()) {
+        std::string key = exportKey(symbol.importedUri, symbol.importedName);
+        moniker(resultSet, "import", key);
+        auto exported = exports_.find(key);
+        if (exported != exports_.end()) {
+          linkImport(local, exported->second);
+        } else {
+          pending_.push_back({std::move(key), std::move(local)});
+        }
+        continue;
+      }
+
+      Id references = results(local);
+      if (symbol.exported) {
+        std::string key = exportKey(doc.uri, symbol.name);
+        moniker(resultSet, "export", key);
+        exports_.emplace(std::move(key), Export{resultSet, references});
+      }
+    }
+    if (!contained.empty())
+      edge("contains", documentId, contained);
+  }
+
+  /**
+   * @brief Link the imports whose exporting file came later; call once, after the last document
+   */
+  void finish() {
+    for (auto &[key, local] : pending_) {
+      auto exported = exports_.find(key);
+      if (exported != exports_.end()) {
+        linkImport(local, exported->second);
+      } else {
+        ++stats_.unresolved;
+        results(local);
+      }
+    }
+    pending_.clear();
+    out_.flush();
+  }
+
+  [[nodiscard]] const Stats &stats() const noexcept { return stats_; }
+
+private:
+  /// Ids of one symbol's result set and ranges within its document
+  struct Local {
+    Id document = 0;
+    Id resultSet = 0;
+    Id definition = 0;
+    std::vector<Id> references;
+  };
+
+  struct Export {
+    Id resultSet = 0;
+    Id references = 0; ///< referenceResult
+  };
+
+  struct PendingImport {
+    std::string key;
+    Local local;
+  };
+
+  static json position(const Position &p) {
+    Position zero = p.toZeroBased();
+    return {{"line", zero.line}, {"character", zero.column}};
+  }
+
+  Id vertex(const char *label, const json &fields = json::object()) {
+    json line{{"id", ++lastId_}, {"type", "vertex"}, {"label", label}};
+    line.update(fields);
+    write(line);
+    return lastId_;
+  }
+
+  void edge(const char *label, Id from, Id to) {
+    write({{"id", ++lastId_}, {"type", "edge"}, {"label", label}, {"outV", from}, {"inV", to}});
+  }
+
+  void edge(const char *label, Id from, const std::vector<Id> &to) {
+    write({{"id", ++lastId_}, {"type", "edge"}, {"label", label}, {"outV", from}, {"inVs", to}});
+  }
+
+  void item(Id from, const std::vector<Id> &to, Id shard, const char *property = nullptr) {
+    json line{{"id", ++lastId_}, {"type", "edge"}, {"label", "item"},
+              {"outV", from},    {"inVs", to},     {"shard", shard}};
+    if (property)
+      line["property"] = property;
+    write(line);
+  }
+
+  Id range(const Range &r, Id resultSet) {
+    Id id = vertex("range", {{"start", position(r.start)}, {"end", position(r.end)}});
+    edge("next", id, resultSet);
+    ++stats_.ranges;
+    return id;
+  }
+
+  void moniker(Id resultSet, const char *kind, const std::string &identifier) {
+    Id id = vertex("moniker", {{"scheme", "lang"},
+                               {"identifier", identifier},
+                               {"kind", kind},
+                               {"unique", "workspace"}});
+    edge("moniker", resultSet, id);
+  }
+
+  /// Definition and reference results of a symbol local to one document
+  Id results(const Local &local) {
+    Id definitions = vertex("definitionResult");
+    edge("textDocument/definition", local.resultSet, definitions);
+    item(definitions, {local.definition}, local.document);
+
+    Id references = vertex("referenceResult");
+    edge("textDocument/references", local.resultSet, references);
+    item(references, {local.definition}, local.document, "definitions");
+    if (!local.references.empty())
+      item(references, local.references, local.document, "references");
+    return references;
+  }
+
+  /// The import resolves through the export's result set; its ranges count as references there
+  void linkImport(const Local &local, const Export &target) {
+    edge("next", local.resultSet, target.resultSet);
+    std::vector<Id> ranges{local.definition};
+    ranges.insert(ranges.end(), local.references.begin(), local.references.end());
+    item(target.references, ranges, local.document, "references");
+    ++stats_.imports;
+  }
+
+  /// Workspace-relative path of the module and the exported name
+  std::string exportKey(const std::string &uri, const std::string &name) const {
+    std::string key = uri;
+    if (key.size() > rootUri_.size() && key.compare(0, rootUri_.size(), rootUri_) == 0 &&
+        key[rootUri_.size()] == '/')
+      key.erase(0, rootUri_.size() + 1);
+    return key + ":" + name;
+  }
+
+  void write(const json &line) { out_ << line.dump() << '\n'; }
+
+  std::ostream &out_;
+  std::string rootUri_;
+  Id lastId_ = 0;
+  Id project_ = 0;
+  std::unordered_map<std::string, Export> exports_;
+  std::vector<PendingImport> pending_;
+  Stats stats_;
+};
+
+} // namespace lsp
+} // namespace lang
@@ -6,15 +6,31 @@
  */
 
 #include "LspService.h"
+#include "Deadline.h"
+#include "IdentifierIndex.h"
+#include "ImportGraph.h"
+#include "RequestPhase.h"
+#include "StructuralHash.h"
 
 // 启用调试日志 - 调试完成后注释掉这行
 #define LSP_DEBUG_ENABLED
 #include "LspLogger.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
 #include <iomanip>
+#include <map>
+#include <set>
 #include <sstream>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
 
 namespace lang {
 namespace lsp {
@@ -25,7 +41,13 @@ namespace lsp {
 
 class LspService::Impl {
 public:
-  explicit Impl(LspServiceConfig config) : config_(std::move(config)) {}
+  explicit Impl(LspServiceConfig config) : config_(std::move(config)) {
+    lintEngine_.configure(config_.lint);
+    governor_.configure(config_.governor);
+    identifierIndex_.setCacheDirectory(config_.identifierIndexDir);
+  }
+
+  ~Impl() { stopSpeculativeWorker(); }
 
   // Configuration
   LspServiceConfig config_;
@@ -37,23 +59,106 @@ public:
   // Semantic models (cached per file)
   std::unordered_map<std::string, semantic::SemanticModel> semanticModels_;
   mutable std::mutex modelsMutex_;
+  /// Models evicted for stale imports while another thread may hold them; freed by the next edit
+  std::vector<decltype(semanticModels_)::node_type> retiredModels_;
+
+  // Lint rules, run right after analysis (guarded by modelsMutex_)
+  semantic::LintEngine lintEngine_ = semantic::LintEngine::withBuiltinRules();
+  std::vector<semantic::LintRuleTiming> lintTotals_;
+
+  // Exported signatures of imported modules (per module text)
+  semantic::ModuleSignatureCache moduleSignatures_;
+
+  // Content hashes of module files on disk, reused while mtime and size are unchanged
+  struct DiskStamp {
+    std::filesystem::file_time_type mtime;
+    uintmax_t size = 0;
+    uint64_t contentHash = 0;
+  };
+  std::unordered_map<std::string, DiskStamp> diskStamps_;
+  std::mutex diskStampsMutex_;
+
+  // Identifier filters of workspace files, consulted before cross-file searches
+  IdentifierIndex identifierIndex_;
+
+  // Who imports whom, refreshed before computing rename edits
+  ImportGraph importGraph_;
 
   // String table for semantic analysis
   ast::StringTable stringTable_;
 
   // Diagnostics callbacks
-  std::unordered_map<size_t,
-                     std::function<void(const std::string &, const std::vector<Diagnostic> &)>>
+  std::unordered_map<size_t, std::function<void(const std::string &,
+                                                const std::vector<Diagnostic> &, uint64_t)>>
       diagnosticsCallbacks_;
   size_t nextCallbackId_ = 0;
   mutable std::mutex callbacksMutex_;
 
+  // ========================================================================
+  // Speculative Precomputation State
+  // ========================================================================
+
+  /**
+   * @brief Responses precomputed for one document version
+   *
+   * didChange 之后编辑器几乎总会紧接着请求 semantic tokens、outline 和 code actions，
+   * 后台线程在分析完成后提前算好，请求到达时直接返回。
+   */
+  struct SpeculativeResults {
+    int64_t version = 0;
+    SemanticTokensResult semanticTokens;
+    std::vector<DocumentSymbol> documentSymbols;
+    std::vector<TextEdit> fixAllEdits; ///< Edits of the source.fixAll code action
+  };
+
+  struct SpeculativeJob {
+    std::string uri;
+    int64_t version = 0;
+    uint64_t generation = 0; ///< editGeneration_ at scheduling time
+    bool lint = false;       ///< config_.lint.enabled at scheduling time: publish with findings
+    bool precompute = false; ///< config_.enableSpeculativePrecompute at scheduling time
+  };
+
+  std::unordered_map<std::string, SpeculativeResults> speculative_;
+  std::mutex speculativeMutex_; ///< Guards speculative_
+
+  /**
+   * Threading contract for documents (SourceFile) and the models built from them:
+   * - Only the message thread mutates them, and only inside beginDocumentMutation().
+   * - Request handlers run on the message thread and read them without this lock:
+   *   nothing can change them concurrently.
+   * - Any other thread (the speculative worker) reads them only while holding it.
+   *   It never parses lazily: open documents are reparsed by every mutation.
+   * - semanticModels_ is written by both sides under modelsMutex_. Models are
+   *   freed only during a mutation, so a model pointer stays valid until then.
+   */
+  std::mutex documentMutex_;
+  /// Bumped by every edit; in-flight speculative work compares against it to cancel itself
+  std::atomic<uint64_t> editGeneration_{0};
+
+  std::deque<SpeculativeJob> speculativeQueue_;
+  std::mutex queueMutex_;
+  std::condition_variable queueCv_;
+  std::thread speculativeWorker_;
+  bool stopWorker_ = false;
+  /// Worker idle time after which it writes the identifier index if it changed
+  static constexpr std::chrono::seconds IndexSaveDelay{5};
+
+  /// Requests answered from speculative_, and jobs overtaken by an edit; logged at shutdown
+  std::atomic<uint64_t> speculativeHits_{0};
+  std::atomic<uint64_t> speculativeCancelled_{0};
+
+  /// Decides when background work may run; requests enter it via LspService::governor()
+  ResourceGovernor governor_;
+
   // ========================================================================
   // Semantic Analysis
   // ========================================================================
 
   /**
    * @brief Get or create semantic model for a file
+   *
+   * The pointer stays valid until the next document mutation.
    */
   semantic::SemanticModel *getSemanticModel(SourceFile *file) {
     if (!file)
@@ -63,22 +168,235 @@ public:
 
     auto it = semanticModels_.find(file->uri());
     if (it != semanticModels_.end()) {
-      return &it->second;
+      if (importsUpToDate(file->uri(), it->second)) {
+        return &it->second;
+      }
+      // The other of the message thread and the worker may still be reading it
+      retiredModels_.push_back(semanticModels_.extract(it));
     }
 
     // Parse and analyze
+    PhaseScope phase(RequestPhase::Analyze);
     ast::CompilationUnitNode *ast = file->getAst();
     if (!ast)
       return nullptr;
 
     // 使用文件自己的 StringTable，确保 InternedString 一致
     semantic::SemanticAnalyzer analyzer(file->factory().stringTable());
+    std::vector<std::string> visiting{file->uri()};
+    analyzer.setModuleResolver([this, uri = file->uri(), &visiting](std::string_view modulePath) {
+      return loadModuleSignature(uri, modulePath, visiting);
+    });
     auto model = analyzer.analyze(ast);
+    runLint(ast, *file, model);
 
     auto [inserted, _] = semanticModels_.emplace(file->uri(), std::move(model));
     return &inserted->second;
   }
 
+  /**
+   * @brief Run the enabled lint rules over a freshly analyzed file
+   * @note Caller holds modelsMutex_
+   */
+  void runLint(ast::CompilationUnitNode *ast, SourceFile &file, semantic::SemanticModel &model) {
+    if (lintEngine_.enabledRuleCount() == 0)
+      return;
+    // 骨架 AST 没有函数体：每个有返回类型的函数都会"缺少 return"，变量都像没被用过
+    if (file.isSkeletal()) {
+      LSP_LOG("lint " << file.uri() << ": skipped, skeletal AST");
+      return;
+    }
+
+    model.setLintDiagnostics(lintEngine_.run(ast, file.factory().strings(), &model));
+
+    uint64_t nanos = 0;
+    for (const auto &timing : lintEngine_.timings()) {
+      nanos += timing.nanos;
+      auto total = std::find_if(lintTotals_.begin(), lintTotals_.end(),
+                                [&](const auto &t) { return t.code == timing.code; });
+      if (total == lintTotals_.end()) {
+        lintTotals_.push_back(timing);
+        continue;
+      }
+      total->nanos += timing.nanos;
+      total->calls += timing.calls;
+      total->reports += timing.reports;
+    }
+    LSP_LOG("lint " << file.uri() << ": " << model.lintDiagnostics().size() << " findings, "
+                    << nanos / 1000 << " us in rules");
+  }
+
+  /**
+   * @brief Parser diagnostics plus the lint findings of the file's model
+   */
+  std::vector<Diagnostic> withLintDiagnostics(const SourceFile &file,
+                                              const semantic::SemanticModel *model) const {
+    auto diagnostics = file.getDiagnostics();
+    if (!model)
+      return diagnostics;
+
+    for (const auto &finding : model->lintDiagnostics()) {
+      Diagnostic diag;
+      diag.range = file.toRange(finding.range);
+      diag.severity = static_cast<DiagnosticSeverity>(static_cast<int>(finding.severity) + 1);
+      diag.code = finding.code;
+      diag.source = "lang-lint";
+      diag.message = finding.message;
+      diagnostics.push_back(std::move(diag));
+    }
+    return diagnostics;
+  }
+
+  /**
+   * @brief A file that is not open: its resident text if the store holds it, else disk
+   * @return nullptr if it cannot be read
+   */
+  std::unique_ptr<SourceFile> loadClosedFile(const std::string &fileUri,
+                                             const std::string &path) {
+    if (auto text = workspace_.textStore().getText(fileUri))
+      return std::make_unique<SourceFile>(path, std::move(*text));
+    auto file = std::make_unique<SourceFile>(path);
+    if (!file->loadFromDisk())
+      return nullptr;
+    return file;
+  }
+
+  // ========================================================================
+  // Module Signatures
+  // ========================================================================
+
+  /**
+   * @brief Hash of the text a module is analyzed from
+   *
+   * The open document, else the indexed text of a closed one, else the file on
+   * disk. Disk hashes are kept while the file's mtime and size are unchanged,
+   * and dropped on watched-file events.
+   * @return nullopt if the module cannot be read
+   */
+  std::optional<uint64_t> moduleContentHash(const std::string &moduleUri,
+                                            const std::string &path) {
+    if (SourceFile *open = workspace_.getFile(moduleUri)) {
+      if (!open->getAst())
+        return std::nullopt;
+      return open->contentHash();
+    }
+    if (auto hash = workspace_.textStore().contentHash(moduleUri))
+      return hash;
+
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    uintmax_t size = ec ? 0 : std::filesystem::file_size(path, ec);
+    if (ec)
+      return std::nullopt;
+    {
+      std::lock_guard<std::mutex> lock(diskStampsMutex_);
+      auto it = diskStamps_.find(path);
+      if (it != diskStamps_.end() && it->second.mtime == mtime && it->second.size == size)
+        return it->second.contentHash;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      return std::nullopt;
+    std::string text{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    uint64_t hash = ast::StructuralHasher::hashBytes(text);
+    std::lock_guard<std::mutex> lock(diskStampsMutex_);
+    diskStamps_[path] = DiskStamp{mtime, size, hash};
+    return hash;
+  }
+
+  /**
+   * @brief Get the exported signature of an imported module
+   *
+   * Signatures are computed once per module text, keyed by its content hash
+   * (editor versions restart when a document is reopened). Computing one
+   * analyzes only that module; its own imports bind against their cached
+   * signatures in turn.
+   *
+   * @param fromUri Importing document
+   * @param visiting Modules being analyzed on this path (import cycle guard)
+   */
+  std::shared_ptr<const semantic::ModuleSignature>
+  loadModuleSignature(const std::string &fromUri, std::string_view modulePath,
+                      std::vector<std::string> &visiting) {
+    std::string path = workspace_.resolveModulePath(modulePath, fromUri);
+    if (path.empty())
+      return nullptr;
+
+    // Normalized, or every hop of an import chain ("./a" -> "././b") gets a key of its own
+    path = std::filesystem::path(path).lexically_normal().string();
+    std::string moduleUri = uri::pathToUri(path);
+    if (std::find(visiting.begin(), visiting.end(), moduleUri) != visiting.end()) {
+      LSP_LOG("import cycle through " << moduleUri);
+      return nullptr;
+    }
+
+    auto contentHash = moduleContentHash(moduleUri, path);
+    if (!contentHash)
+      return nullptr;
+    if (auto cached = moduleSignatures_.find(moduleUri, *contentHash))
+      return cached;
+
+    SourceFile *open = workspace_.getFile(moduleUri);
+
+    std::unique_ptr<SourceFile> closed;
+    if (!open) {
+      closed = loadClosedFile(moduleUri, path);
+      if (!closed)
+        return nullptr;
+    }
+    SourceFile &module = open ? *open : *closed;
+
+    ast::CompilationUnitNode *ast = module.getAst();
+    if (!ast)
+      return nullptr;
+
+    auto model = analyzeModule(module, ast, moduleUri, visiting);
+
+    auto signature = semantic::ModuleSignature::build(moduleUri, module.contentHash(),
+                                                      model.symbolTable().globalScope());
+    moduleSignatures_.store(signature);
+    return signature;
+  }
+
+  /**
+   * @brief Analyze a module outside the model cache, binding its imports to signatures
+   */
+  semantic::SemanticModel analyzeModule(SourceFile &module, ast::CompilationUnitNode *ast,
+                                        const std::string &moduleUri,
+                                        std::vector<std::string> &visiting) {
+    PhaseScope phase(RequestPhase::Analyze);
+    visiting.push_back(moduleUri);
+    semantic::SemanticAnalyzer analyzer(module.factory().stringTable());
+    analyzer.setModuleResolver([this, &moduleUri, &visiting](std::string_view dependency) {
+      return loadModuleSignature(moduleUri, dependency, visiting);
+    });
+    auto model = analyzer.analyze(ast);
+    visiting.pop_back();
+    return model;
+  }
+
+  /**
+   * @brief Whether every module a cached model imported still exports the same API
+   *
+   * Edits inside a dependency that leave its exports unchanged keep importers'
+   * models valid.
+   */
+  bool importsUpToDate(const std::string &uri, const semantic::SemanticModel &model) {
+    for (const auto &imported : model.importedModules()) {
+      const std::string &moduleUri = imported.signature->uri();
+      auto contentHash = moduleContentHash(moduleUri, uri::uriToPath(moduleUri));
+      if (contentHash == imported.signature->contentHash())
+        continue;
+
+      std::vector<std::string> visiting{uri};
+      auto current = loadModuleSignature(uri, imported.modulePath, visiting);
+      if (!current || current->fingerprint() != imported.signature->fingerprint())
+        return false;
+    }
+    return true;
+  }
+
   /**
    * @brief Invalidate semantic model for a file
    */
@@ -87,6 +405,820 @@ public:
     semanticModels_.erase(uri);
   }
 
+  // ========================================================================
+  // Cross-File Search
+  // ========================================================================
+
+  /**
+   * @brief Source files that may contain an identifier token equal to name
+   *
+   * Consults the identifier filters of open documents (current text) and of
+   * the workspace's files on disk; only the survivors need analysis. Filters
+   * built here reach the index file when the speculative worker idles, or at
+   * shutdown.
+   */
+  std::vector<std::string> filesMentioning(std::string_view name, const std::string &extension) {
+    std::vector<std::string> candidates;
+    size_t scanned = 0;
+    auto consider = [&](const std::string &path, const IdentifierIndex::FilterPtr &filter) {
+      ++scanned;
+      if (!filter || filter->mayContain(name))
+        candidates.push_back(path);
+    };
+
+    std::unordered_set<std::string> openPaths;
+    workspace_.forEachFile([&](const std::string &, const SourceFile &file) {
+      openPaths.insert(file.path());
+      consider(file.path(), identifierIndex_.forText(file.path(), file.version(), file.content()));
+    });
+    if (!extension.empty()) {
+      for (const auto &path : workspace_.findFiles("*" + extension)) {
+        if (!openPaths.count(path))
+          consider(path, identifierIndex_.forFile(path));
+      }
+    }
+    LSP_LOG("identifier index: " << candidates.size() << " of " << scanned
+                               << " files may mention '" << name << "'");
+    return candidates;
+  }
+
+  /**
+   * @brief URI of the module an import path refers to (normalized), or empty
+   */
+  std::string resolveModuleUri(std::string_view modulePath, std::string_view fromUri) const {
+    std::string path = workspace_.resolveModulePath(modulePath, fromUri);
+    if (path.empty())
+      return {};
+    return uri::pathToUri(std::filesystem::path(path).lexically_normal().string());
+  }
+
+  /**
+   * @brief Order candidate files by how likely their hits are to matter
+   *
+   * The defining module first, then open documents, then files on disk by
+   * directory distance from the requesting document.
+   */
+  std::vector<std::string> rankCandidates(std::vector<std::string> paths,
+                                          const std::string &moduleUri,
+                                          const std::string &fromUri) {
+    namespace fs = std::filesystem;
+    fs::path origin = fs::path(uri::uriToPath(fromUri)).parent_path();
+    std::vector<std::pair<std::pair<int, size_t>, std::string>> ranked;
+    ranked.reserve(paths.size());
+    for (auto &path : paths) {
+      std::string fileUri = uri::pathToUri(path);
+      int group = fileUri == moduleUri ? 0 : workspace_.getFile(fileUri) ? 1 : 2;
+      fs::path relative = fs::path(path).parent_path().lexically_relative(origin);
+      size_t distance = static_cast<size_t>(std::distance(relative.begin(), relative.end()));
+      if (relative == ".")
+        distance = 0;
+      ranked.push_back({{group, distance}, std::move(path)});
+    }
+    std::stable_sort(ranked.begin(), ranked.end(),
+                     [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    std::vector<std::string> ordered;
+    ordered.reserve(ranked.size());
+    for (auto &entry : ranked)
+      ordered.push_back(std::move(entry.second));
+    return ordered;
+  }
+
+  /**
+   * @brief References to an exported declaration from the other files of the workspace
+   * @param moduleUri Module that exports the declaration
+   * @param name Exported name
+   * @param skipUri Document whose references were already collected
+   * @param budget Remaining number of references to report; decremented
+   * @param sink Receives the references of one file at a time
+   * @return false if the sink asked to stop
+   */
+  bool addCrossFileReferences(const std::string &moduleUri, const std::string &name,
+                              const std::string &skipUri, bool includeDeclaration, size_t &budget,
+                              const ResultSink<Location> &sink) {
+    std::string extension = std::filesystem::path(uri::uriToPath(moduleUri)).extension().string();
+    for (const auto &path : rankCandidates(filesMentioning(name, extension), moduleUri, skipUri)) {
+      if (budget == 0)
+        return true;
+      std::string fileUri = uri::pathToUri(path);
+      if (fileUri == skipUri)
+        continue;
+
+      SourceFile *open = workspace_.getFile(fileUri);
+      std::unique_ptr<SourceFile> closed;
+      if (!open) {
+        closed = loadClosedFile(fileUri, path);
+        if (!closed)
+          continue;
+      }
+      SourceFile &file = open ? *open : *closed;
+      ast::CompilationUnitNode *ast = file.getAst();
+      if (!ast)
+        continue;
+
+      std::optional<semantic::SemanticModel> detached;
+      semantic::SemanticModel *model = nullptr;
+      if (open) {
+        model = getSemanticModel(open);
+      } else {
+        std::vector<std::string> visiting;
+        detached.emplace(analyzeModule(file, ast, fileUri, visiting));
+        model = &*detached;
+      }
+      if (!model)
+        continue;
+
+      semantic::Scope *global = model->symbolTable().globalScope();
+      std::vector<semantic::Symbol *> targets;
+      std::vector<Location> batch;
+      if (fileUri == moduleUri) {
+        semantic::Symbol *exported = global->resolveLocal(name);
+        if (exported && exported->isExport())
+          targets.push_back(exported);
+      } else {
+        // Named imports of the declaration; the import specifier itself counts as a reference.
+        // Uses of an alias (import { name as other }) name the alias, not the declaration.
+        const auto &strings = file.factory().strings();
+        for (ast::Stmt *stmt : ast->statements) {
+          auto *import = ast::ast_cast<ast::ImportStmtNode>(stmt);
+          if (!import || import->style != ast::ImportStmtNode::Style::Named)
+            continue;
+          if (resolveModuleUri(strings.get(import->modulePath), fileUri) != moduleUri)
+            continue;
+          for (const auto &spec : import->specifiers) {
+            if (strings.get(spec.name) != name)
+              continue;
+            if (spec.alias != spec.name) {
+              if (batch.size() < budget)
+                batch.push_back(Location{fileUri, nameRange(file, spec.range.begin, name)});
+            } else if (auto *imported = global->resolveLocal(strings.get(spec.alias))) {
+              targets.push_back(imported);
+            }
+          }
+        }
+      }
+
+      for (semantic::Symbol *target : targets) {
+        for (const auto &ref : model->findReferences(target)) {
+          if (batch.size() >= budget)
+            break;
+          if (!includeDeclaration && fileUri == moduleUri && ref.begin == target->definitionLoc())
+            continue;
+          batch.push_back(Location{fileUri, nameRange(file, ref.begin, name)});
+        }
+      }
+      budget -= batch.size();
+      if (!sink(std::move(batch)))
+        return false;
+    }
+    return true;
+  }
+
+  // ========================================================================
+  // Import Graph
+  // ========================================================================
+
+  [[nodiscard]] static std::string normalizedPath(const std::string &path) {
+    std::string normal = std::filesystem::path(path).lexically_normal().string();
+    while (normal.size() > 1 &&
+           (normal.back() == '/' ||
+            normal.back() == static_cast<char>(std::filesystem::path::preferred_separator)))
+      normal.pop_back();
+    return normal;
+  }
+
+  /**
+   * @brief The imports a file makes, with the position of each module-path literal
+   */
+  std::vector<ImportEdge> scanImports(SourceFile &file) {
+    namespace fs = std::filesystem;
+    std::vector<ImportEdge> edges;
+    ast::CompilationUnitNode *ast = file.getAst();
+    if (!ast)
+      return edges;
+
+    std::string_view text = file.contentView();
+    const auto &strings = file.factory().strings();
+    fs::path importerDir = fs::path(file.path()).parent_path();
+    for (ast::Stmt *stmt : ast->statements) {
+      auto *import = ast::ast_cast<ast::ImportStmtNode>(stmt);
+      if (!import)
+        continue;
+      ImportEdge edge;
+      edge.specifier = std::string(strings.get(import->modulePath));
+      std::string resolved = workspace_.resolveModulePath(edge.specifier, file.uri());
+      if (edge.specifier.empty() || resolved.empty())
+        continue;
+      edge.target = normalizedPath(resolved);
+
+      // The module path is the statement's last string literal
+      uint32_t begin = file.byteOffsetOf(import->range.begin);
+      uint32_t close = std::max(file.byteOffsetOf(import->range.end), begin);
+      while (close > begin && text[close - 1] != '"' && text[close - 1] != '\'')
+        --close;
+      if (close == begin)
+        continue;
+      edge.quote = text[--close];
+      uint32_t open = close;
+      while (open > begin &&
+             !(text[open - 1] == edge.quote && (open < 2 || text[open - 2] != '\\')))
+        --open;
+      if (open == begin)
+        continue;
+      edge.literal = Range{file.positionOfByte(open), file.positionOfByte(close)};
+
+      // Resolution tries the importer's directory first, then fixed directories
+      fs::path written(edge.specifier);
+      if (!written.has_extension())
+        written.replace_extension(".lang");
+      if (normalizedPath((importerDir / written).string()) != edge.target) {
+        fs::path dir(edge.target);
+        for (auto part = written.begin(); part != written.end(); ++part)
+          dir = dir.parent_path();
+        edge.base = ImportEdge::Base::Fixed;
+        edge.baseDir = dir.string();
+      }
+      edges.push_back(std::move(edge));
+    }
+    return edges;
+  }
+
+  /**
+   * @brief Bring the import graph up to date with the workspace
+   *
+   * Open documents are keyed by version, files on disk by mtime and size;
+   * only files whose key changed are parsed again, and files without the word
+   * "import" are not parsed at all.
+   */
+  void refreshImportGraph() {
+    std::unordered_set<std::string> present;
+    size_t scanned = 0;
+    workspace_.forEachFile([&](const std::string &fileUri, const SourceFile &file) {
+      std::string path = normalizedPath(file.path());
+      std::string stamp = "v" + std::to_string(file.version());
+      present.insert(path);
+      if (importGraph_.isCurrent(path, stamp))
+        return;
+      ++scanned;
+      importGraph_.update(path, fileUri, stamp, scanImports(const_cast<SourceFile &>(file)));
+    });
+
+    for (const auto &extension : config_.sourceExtensions) {
+      for (const auto &found : workspace_.findFiles("*" + extension)) {
+        std::string path = normalizedPath(found);
+        if (!present.insert(path).second)
+          continue;
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        uint64_t size = ec ? 0 : std::filesystem::file_size(path, ec);
+        if (ec)
+          continue;
+        std::string stamp = std::to_string(mtime.time_since_epoch().count()) + ":" +
+                            std::to_string(size);
+        if (importGraph_.isCurrent(path, stamp))
+          continue;
+
+        ++scanned;
+        SourceFile file(path);
+        std::vector<ImportEdge> edges;
+        if (file.loadFromDisk() && file.contentView().find("import") != std::string_view::npos)
+          edges = scanImports(file);
+        importGraph_.update(path, uri::pathToUri(path), std::move(stamp), std::move(edges));
+      }
+    }
+    importGraph_.retain(present);
+    LSP_LOG("import graph: " << importGraph_.size() << " files, " << scanned << " rescanned");
+  }
+
+  // ========================================================================
+  // Fix-All
+  // ========================================================================
+
+  /**
+   * @brief Text edits applying every fix offered by a file's lint findings
+   *
+   * A deletion takes the ';' right after it (statement ranges stop before it)
+   * and, when that leaves only whitespace on its lines, the lines as well. A
+   * fix overlapping one accepted earlier is dropped as a whole; running
+   * fix-all again picks it up against the fixed text.
+   */
+  static std::vector<TextEdit> fixEdits(const SourceFile &file,
+                                        const std::vector<semantic::Diagnostic> &findings) {
+    std::string_view text = file.contentView();
+    auto blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    auto widen = [&](uint32_t begin, uint32_t end) -> std::pair<uint32_t, uint32_t> {
+      uint32_t lineStart = begin;
+      while (lineStart > 0 && blank(text[lineStart - 1]))
+        --lineStart;
+      uint32_t lineEnd = end;
+      while (lineEnd < text.size() && blank(text[lineEnd]))
+        ++lineEnd;
+      if (lineEnd < text.size() && text[lineEnd] == ';') {
+        end = ++lineEnd;
+        while (lineEnd < text.size() && blank(text[lineEnd]))
+          ++lineEnd;
+      }
+      if ((lineStart > 0 && text[lineStart - 1] != '\n') ||
+          (lineEnd < text.size() && text[lineEnd] != '\n'))
+        return {begin, end};
+      return {lineStart, lineEnd < text.size() ? lineEnd + 1 : lineEnd};
+    };
+
+    struct Span {
+      uint32_t begin, end;
+      const std::string *newText;
+    };
+    std::vector<const semantic::Diagnostic *> fixable;
+    for (const auto &finding : findings) {
+      if (!finding.fixes.empty())
+        fixable.push_back(&finding);
+    }
+    std::sort(fixable.begin(), fixable.end(), [](const auto *a, const auto *b) {
+      return a->fixes.front().range.begin.offset < b->fixes.front().range.begin.offset;
+    });
+
+    std::vector<Span> accepted;
+    for (const auto *finding : fixable) {
+      std::vector<Span> spans;
+      for (const auto &fix : finding->fixes) {
+        uint32_t begin = file.byteOffsetOf(fix.range.begin);
+        uint32_t end = std::max(file.byteOffsetOf(fix.range.end), begin);
+        if (fix.newText.empty())
+          std::tie(begin, end) = widen(begin, end);
+        spans.push_back({begin, end, &fix.newText});
+      }
+      bool clash = std::any_of(spans.begin(), spans.end(), [&](const Span &span) {
+        return std::any_of(accepted.begin(), accepted.end(), [&](const Span &other) {
+          return span.begin < other.end && other.begin < span.end;
+        });
+      });
+      if (!clash)
+        accepted.insert(accepted.end(), spans.begin(), spans.end());
+    }
+
+    std::sort(accepted.begin(), accepted.end(),
+              [](const Span &a, const Span &b) { return a.begin < b.begin; });
+    std::vector<TextEdit> edits;
+    edits.reserve(accepted.size());
+    for (const auto &span : accepted)
+      edits.push_back(
+          {Range{file.positionOfByte(span.begin), file.positionOfByte(span.end)}, *span.newText});
+    return edits;
+  }
+
+  /**
+   * @brief Fix one workspace file from its snapshot (open text, or disk when absent)
+   *
+   * Lints without a semantic model: the fixable rules are lexical, and the
+   * file's own parse touches no shared state, so files can be fixed in parallel.
+   */
+  std::vector<TextEdit> fixFile(const std::string &path, std::optional<std::string> text) const {
+    std::unique_ptr<SourceFile> file;
+    if (text) {
+      file = std::make_unique<SourceFile>(path, std::move(*text));
+    } else {
+      file = std::make_unique<SourceFile>(path);
+      if (!file->loadFromDisk())
+        return {};
+    }
+    ast::CompilationUnitNode *ast = file->getAst();
+    // Without bodies every local looks unused; the fix would delete live code
+    if (!ast || file->isSkeletal())
+      return {};
+
+    semantic::LintConfig lint = config_.lint;
+    lint.collectTimings = false;
+    auto engine = semantic::LintEngine::withBuiltinRules();
+    engine.configure(lint);
+    return fixEdits(*file, engine.run(ast, file->factory().strings()));
+  }
+
+  std::optional<WorkspaceEdit>
+  fixAllWorkspace(const std::function<void(const FixAllProgress &)> &progress,
+                  const std::function<bool()> &cancelled) {
+    struct Target {
+      std::string path;
+      std::string uri;
+      std::optional<std::string> text; ///< Open documents only
+      bool open = false;
+      int64_t version = 0;
+      std::vector<TextEdit> edits;
+    };
+
+    // Snapshot: open documents as the editor has them, everything else from disk later
+    std::vector<Target> targets;
+    {
+      std::lock_guard<std::mutex> lock(documentMutex_);
+      workspace_.forEachFile([&](const std::string &fileUri, const SourceFile &file) {
+        targets.push_back(
+            {file.path(), fileUri, std::string(file.contentView()), true, file.version(), {}});
+      });
+    }
+    std::unordered_set<std::string> openPaths;
+    for (const auto &target : targets)
+      openPaths.insert(target.path);
+    for (const auto &extension : config_.sourceExtensions) {
+      for (auto &path : workspace_.findFiles("*" + extension)) {
+        if (openPaths.insert(path).second)
+          targets.push_back({path, uri::pathToUri(path), std::nullopt, false, 0, {}});
+      }
+    }
+
+    FixAllProgress state;
+    state.filesTotal = targets.size();
+    std::mutex progressMutex;
+
+    auto ticket = governor_.acquireBackground(cancelled);
+    if (!ticket)
+      return std::nullopt;
+    bool complete = governor_.parallelFor(
+        targets.size(),
+        [&](size_t i) {
+          Target &target = targets[i];
+          target.edits = fixFile(target.path, std::move(target.text));
+          target.text.reset();
+
+          std::lock_guard<std::mutex> lock(progressMutex);
+          ++state.filesDone;
+          if (!target.edits.empty()) {
+            ++state.filesChanged;
+            state.edits += target.edits.size();
+          }
+          progress(state);
+        },
+        cancelled);
+    if (!complete || cancelled())
+      return std::nullopt;
+
+    // Edits of a document that changed since the snapshot would land in the wrong place
+    WorkspaceEdit edit;
+    std::lock_guard<std::mutex> lock(documentMutex_);
+    for (auto &target : targets) {
+      if (target.edits.empty())
+        continue;
+      SourceFile *open = workspace_.getFile(target.uri);
+      if (open ? !target.open || open->version() != target.version : target.open) {
+        LSP_LOG("fix-all: " << target.uri << " changed since the snapshot, skipped");
+        continue;
+      }
+      edit.changes[target.uri] = std::move(target.edits);
+    }
+    LSP_LOG("fix-all: " << edit.changes.size() << " of " << targets.size() << " files changed");
+    return edit;
+  }
+
+  // ========================================================================
+  // Index Export
+  // ========================================================================
+
+  /**
+   * @brief Range of name at or just after offset
+   *
+   * Symbols record where their declaration starts ("export function f...");
+   * the name itself is the first whole-word match within a short window.
+   * Falls back to an empty range at the location.
+   */
+  static Range nameRange(const SourceFile &file, ast::SourceLoc loc, std::string_view name) {
+    constexpr size_t window = 256;
+    std::string_view text = file.contentView();
+    uint32_t offset = file.byteOffsetOf(loc);
+    auto isWord = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    size_t limit = std::min(text.size(), static_cast<size_t>(offset) + window + name.size());
+    for (size_t at = text.find(name, offset); !name.empty() && at != std::string_view::npos &&
+                                              at + name.size() <= limit;
+         at = text.find(name, at + 1)) {
+      if ((at == 0 || !isWord(text[at - 1])) &&
+          (at + name.size() == text.size() || !isWord(text[at + name.size()])))
+        return Range{file.positionOfByte(static_cast<uint32_t>(at)),
+                     file.positionOfByte(static_cast<uint32_t>(at + name.size()))};
+    }
+    Position pos = file.toPosition(loc);
+    return Range{pos, pos};
+  }
+
+  /**
+   * @brief Symbols of one file on disk, analyzed outside the model cache
+   */
+  std::optional<IndexedDocument> indexFile(const std::string &path) {
+    SourceFile file(path);
+    if (!file.loadFromDisk())
+      return std::nullopt;
+    ast::CompilationUnitNode *ast = file.getAst();
+    if (!ast)
+      return std::nullopt;
+
+    std::vector<std::string> visiting;
+    auto model = analyzeModule(file, ast, file.uri(), visiting);
+
+    // Named import specifiers by position: the module and the name they import
+    std::unordered_map<uint32_t, std::pair<std::string, std::string>> imports;
+    const auto &strings = file.factory().strings();
+    for (ast::Stmt *stmt : ast->statements) {
+      auto *import = ast::ast_cast<ast::ImportStmtNode>(stmt);
+      if (!import || import->style != ast::ImportStmtNode::Style::Named)
+        continue;
+      std::string moduleUri = resolveModuleUri(strings.get(import->modulePath), file.uri());
+      if (moduleUri.empty())
+        continue;
+      for (const auto &spec : import->specifiers)
+        imports[spec.range.begin.offset] = {moduleUri, std::string(strings.get(spec.name))};
+    }
+
+    IndexedDocument document{file.uri(), {}};
+    semantic::Scope *global = model.symbolTable().globalScope();
+    // Imports are bound once per list they appear in; their symbols are merged
+    std::map<std::pair<uint32_t, std::string_view>, size_t> declared;
+    for (const auto &owned : model.symbolTable().allSymbols()) {
+      semantic::Symbol *sym = owned.get();
+      ast::SourceLoc loc = sym->definitionLoc();
+      if (!loc.isValid() || sym->name().empty())
+        continue;
+
+      auto [slot, fresh] = declared.try_emplace({loc.offset, sym->name()}, document.symbols.size());
+      if (!fresh) {
+        auto &references = document.symbols[slot->second].references;
+        for (const auto &ref : sym->references())
+          references.push_back(nameRange(file, ref, sym->name()));
+        continue;
+      }
+
+      IndexedSymbol entry;
+      entry.name = sym->name();
+      entry.definition = nameRange(file, loc, entry.name);
+      entry.references.reserve(sym->references().size());
+      for (const auto &ref : sym->references())
+        entry.references.push_back(nameRange(file, ref, entry.name));
+      entry.hover = createHoverMarkdown(sym, sym->type());
+      entry.exported = sym->isExport() && global->resolveLocal(entry.name) == sym;
+      if (sym->kind() == semantic::SymbolKind::Import) {
+        auto imported = imports.find(loc.offset);
+        if (imported != imports.end()) {
+          entry.importedUri = imported->second.first;
+          entry.importedName = imported->second.second;
+        }
+      }
+      document.symbols.push_back(std::move(entry));
+    }
+    return document;
+  }
+
+  size_t indexWorkspace(const std::function<void(IndexedDocument &&)> &sink, unsigned jobs) {
+    std::vector<std::string> paths;
+    std::unordered_set<std::string> seen;
+    for (const auto &extension : config_.sourceExtensions) {
+      for (const auto &found : workspace_.findFiles("*" + extension)) {
+        std::string path = normalizedPath(found);
+        if (seen.insert(path).second)
+          paths.push_back(std::move(path));
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    if (jobs == 0)
+      jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(paths.size(), 1)));
+
+    std::atomic<size_t> next{0};
+    std::mutex sinkMutex;
+    auto drain = [&] {
+      for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < paths.size();) {
+        auto document = indexFile(paths[i]);
+        if (!document)
+          continue;
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        sink(std::move(*document));
+      }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned w = 1; w < jobs; ++w)
+      workers.emplace_back(drain);
+    drain();
+    for (auto &worker : workers)
+      worker.join();
+
+    LSP_LOG("index: " << paths.size() << " files on " << jobs << " threads");
+    return paths.size();
+  }
+
+  // ========================================================================
+  // Speculative Precomputation
+  // ========================================================================
+
+  /**
+   * @brief Begin mutating a document
+   *
+   * Cancels in-flight speculative work and waits for the worker to let go of the
+   * workspace. The returned lock must be held for the duration of the mutation.
+   */
+  [[nodiscard]] std::unique_lock<std::mutex> beginDocumentMutation() {
+    editGeneration_.fetch_add(1, std::memory_order_acq_rel);
+    std::unique_lock<std::mutex> docLock(documentMutex_);
+    {
+      // No model pointer is held across a mutation
+      std::lock_guard<std::mutex> lock(modelsMutex_);
+      retiredModels_.clear();
+    }
+    return docLock;
+  }
+
+  /**
+   * @brief Drop cached speculative responses for a document
+   */
+  void invalidateSpeculative(const std::string &uri) {
+    std::lock_guard<std::mutex> lock(speculativeMutex_);
+    speculative_.erase(uri);
+  }
+
+  /**
+   * @brief Publish an edited document's diagnostics and queue its background work
+   *
+   * Called on the message thread once documentMutex_ is released. With lint enabled
+   * the publish is left to the worker, which has the model the findings come from:
+   * publishing parser errors alone here would drop the findings until it runs.
+   */
+  void afterEdit(const SourceFile &file) {
+    SpeculativeJob job{file.uri(), file.version(), editGeneration_.load(std::memory_order_acquire),
+                       config_.lint.enabled, config_.enableSpeculativePrecompute};
+    if (!job.lint)
+      notifyDiagnosticsChanged(job.uri, withLintDiagnostics(file, nullptr), job.generation);
+    if (job.lint || job.precompute)
+      scheduleSpeculative(std::move(job));
+  }
+
+  /**
+   * @brief Queue lint and precomputation of the likely next requests for a document version
+   */
+  void scheduleSpeculative(SpeculativeJob job) {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex_);
+      if (!speculativeWorker_.joinable()) {
+        stopWorker_ = false;
+        speculativeWorker_ = std::thread([this] { speculativeWorkerLoop(); });
+      }
+      // 同一文档只保留最新的任务
+      speculativeQueue_.erase(
+          std::remove_if(speculativeQueue_.begin(), speculativeQueue_.end(),
+                         [&](const SpeculativeJob &queued) { return queued.uri == job.uri; }),
+          speculativeQueue_.end());
+      speculativeQueue_.push_back(std::move(job));
+    }
+    queueCv_.notify_one();
+  }
+
+  void stopSpeculativeWorker() {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex_);
+      stopWorker_ = true;
+      speculativeQueue_.clear();
+    }
+    queueCv_.notify_all();
+    editGeneration_.fetch_add(1, std::memory_order_acq_rel);
+    if (speculativeWorker_.joinable()) {
+      speculativeWorker_.join();
+    }
+  }
+
+  [[nodiscard]] bool isStale(const SpeculativeJob &job) const noexcept {
+    return editGeneration_.load(std::memory_order_acquire) != job.generation;
+  }
+
+  void speculativeWorkerLoop() {
+    ResourceGovernor::lowerCurrentThreadPriority(config_.governor.idleOnly);
+    for (;;) {
+      SpeculativeJob job;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        if (!queueCv_.wait_for(lock, IndexSaveDelay, [this] {
+              return stopWorker_ || !speculativeQueue_.empty();
+            })) {
+          // Filters built by searches are saved here, off the request path
+          lock.unlock();
+          identifierIndex_.save();
+          continue;
+        }
+        if (stopWorker_)
+          return;
+        job = std::move(speculativeQueue_.front());
+        speculativeQueue_.pop_front();
+      }
+
+      // 在拿 documentMutex_ 之前排队，等待期间不会挡住编辑
+      auto ticket = governor_.acquireBackground([&] { return isStale(job); });
+      if (!ticket) {
+        cancelSpeculative(std::move(job));
+        continue;
+      }
+
+      try {
+        precompute(job);
+      } catch (const std::exception &e) {
+        LSP_LOG("speculative precompute failed for " << job.uri << ": " << e.what());
+      }
+    }
+  }
+
+  /**
+   * @brief Lint, publish, and compute semantic tokens, outline and fix-all edits for one
+   * document version
+   *
+   * Checks for cancellation between phases so that a newer edit never waits for more
+   * than one phase of stale work.
+   */
+  void precompute(const SpeculativeJob &job) {
+    if (isStale(job))
+      return cancelSpeculative(job);
+
+    std::unique_lock<std::mutex> docLock(documentMutex_);
+    if (isStale(job))
+      return cancelSpeculative(job);
+
+    auto *file = workspace_.getFile(job.uri);
+    if (!file || file->version() != job.version)
+      return;
+
+    // A document that failed to parse still gets its parser errors published
+    auto *ast = file->isAstValid() ? file->getAst() : nullptr;
+    auto *model = ast ? getSemanticModel(file) : nullptr;
+    std::optional<std::vector<Diagnostic>> diagnostics;
+    if (job.lint)
+      diagnostics = withLintDiagnostics(*file, model);
+
+    if (ast && job.precompute) {
+      SpeculativeResults results;
+      results.version = job.version;
+
+      if (config_.enableSemanticTokens) {
+        if (isStale(job))
+          return cancelSpeculative(job);
+        results.semanticTokens = buildSemanticTokens(ast, *file, model);
+      }
+
+      if (config_.enableDocumentSymbols) {
+        if (isStale(job))
+          return cancelSpeculative(job);
+        collectDocumentSymbols(ast, results.documentSymbols, *file);
+      }
+
+      if (config_.enableCodeActions && model) {
+        if (isStale(job))
+          return cancelSpeculative(job);
+        results.fixAllEdits = fixEdits(*file, model->lintDiagnostics());
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(speculativeMutex_);
+        speculative_[job.uri] = std::move(results);
+      }
+      LSP_LOG("speculative results ready for " << job.uri << " v" << job.version);
+    }
+
+    // Publishing can wait for room in the outbound queue; an edit must not wait behind it.
+    // An edit or close landing after the check publishes at a newer generation, and the
+    // receiver drops this one.
+    docLock.unlock();
+    if (!diagnostics)
+      return;
+    if (isStale(job))
+      return cancelSpeculative(job);
+    notifyDiagnosticsChanged(job.uri, *diagnostics, job.generation);
+  }
+
+  /**
+   * @brief Give up on a job overtaken by an edit
+   *
+   * Edits to other documents cancel it too, and its diagnostics are still owed: a
+   * linting job goes back in the queue unless its document has a newer one there.
+   */
+  void cancelSpeculative(SpeculativeJob job) {
+    speculativeCancelled_.fetch_add(1, std::memory_order_relaxed);
+    LSP_LOG("speculative precompute cancelled for " << job.uri << " v" << job.version);
+    if (!job.lint)
+      return;
+
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    if (stopWorker_ || std::any_of(speculativeQueue_.begin(), speculativeQueue_.end(),
+                                   [&](const SpeculativeJob &q) { return q.uri == job.uri; }))
+      return;
+    job.generation = editGeneration_.load(std::memory_order_acquire);
+    speculativeQueue_.push_back(std::move(job));
+  }
+
+  /**
+   * @brief Look up a precomputed result for the given document version
+   * @param extract Copies the wanted part out of the cached entry
+   * @return True on a cache hit
+   */
+  template <typename Extract>
+  bool findSpeculative(const std::string &uri, int64_t version, Extract &&extract) {
+    std::lock_guard<std::mutex> lock(speculativeMutex_);
+    auto it = speculative_.find(uri);
+    if (it == speculative_.end() || it->second.version != version)
+      return false;
+    extract(it->second);
+    speculativeHits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
   // ========================================================================
   // Document Symbol Collection
   // ========================================================================
@@ -347,11 +1479,56 @@ public:
       data.push_back(static_cast<uint32_t>(token.type));
       data.push_back(static_cast<uint32_t>(token.modifiers));
 
-      prevLine = token.line;
-      prevChar = token.startChar;
+      prevLine = token.line;
+      prevChar = token.startChar;
+    }
+
+    return data;
+  }
+
+  /**
+   * @brief Collect and encode the full semantic token array for a document
+   */
+  SemanticTokensResult buildSemanticTokens(ast::CompilationUnitNode *ast, const SourceFile &file,
+                                           semantic::SemanticModel *model) {
+    SemanticTokensResult result;
+    std::vector<SemanticToken> tokens;
+    collectSemanticTokens(ast, tokens, file, model);
+    result.data = encodeSemanticTokens(tokens);
+    result.resultId = std::to_string(file.version());
+    return result;
+  }
+
+  // ========================================================================
+  // Code Action Helpers
+  // ========================================================================
+
+  /**
+   * @brief Add quick fixes for a single diagnostic
+   */
+  void addQuickFixes(const Diagnostic &diag, std::vector<CodeAction> &actions) {
+    if (diag.code == "undefined-variable") {
+      // Suggest declaring variable
+      CodeAction action;
+      action.title = "Declare variable '" + diag.message + "'";
+      action.kind = CodeActionKind::QuickFix;
+      action.diagnostics = {diag};
+      action.isPreferred = true;
+      actions.push_back(std::move(action));
+    } else if (diag.code == "unused-variable") {
+      // Suggest removing or prefixing with underscore
+      CodeAction action;
+      action.title = "Remove unused variable";
+      action.kind = CodeActionKind::QuickFix;
+      action.diagnostics = {diag};
+      actions.push_back(std::move(action));
+
+      CodeAction action2;
+      action2.title = "Prefix with underscore";
+      action2.kind = CodeActionKind::QuickFix;
+      action2.diagnostics = {diag};
+      actions.push_back(std::move(action2));
     }
-
-    return data;
   }
 
   // ========================================================================
@@ -393,50 +1570,39 @@ public:
   }
 
   /**
-   * @brief Add symbol completions from scope
+   * @brief Completion item for a visible symbol
    */
-  void addScopeCompletions(std::vector<CompletionItem> &items, semantic::Scope *scope,
-                           size_t maxItems) {
-    if (!scope)
-      return;
-
-    auto symbols = scope->allVisibleSymbols();
-    for (auto *sym : symbols) {
-      if (items.size() >= maxItems)
-        break;
-
-      CompletionItem item;
-      item.label = sym->name();
-      item.kind = toCompletionItemKind(sym->kind());
-      item.detail = formatSymbolSignature(sym);
-
-      if (sym->isFunction()) {
-        auto *funcSym = static_cast<const semantic::FunctionSymbol *>(sym);
-        if (funcSym->parameters().empty()) {
-          item.insertText = sym->name() + "()$0";
-        } else {
-          item.insertText = sym->name() + "($0)";
-        }
-        item.insertTextFormat = InsertTextFormat::Snippet;
-      } else if (sym->isMethod()) {
-        auto *methodSym = static_cast<const semantic::MethodSymbol *>(sym);
-        if (methodSym->parameters().empty()) {
-          item.insertText = sym->name() + "()$0";
-        } else {
-          item.insertText = sym->name() + "($0)";
-        }
-        item.insertTextFormat = InsertTextFormat::Snippet;
+  CompletionItem makeSymbolItem(const semantic::Symbol *sym) {
+    CompletionItem item;
+    item.label = sym->name();
+    item.kind = toCompletionItemKind(sym->kind());
+    item.detail = formatSymbolSignature(sym);
+
+    if (sym->isFunction()) {
+      auto *funcSym = static_cast<const semantic::FunctionSymbol *>(sym);
+      if (funcSym->parameters().empty()) {
+        item.insertText = sym->name() + "()$0";
       } else {
-        item.insertText = sym->name();
-        item.insertTextFormat = InsertTextFormat::PlainText;
+        item.insertText = sym->name() + "($0)";
       }
-
-      if (sym->type()) {
-        item.documentation = "Type: " + sym->type()->toString();
+      item.insertTextFormat = InsertTextFormat::Snippet;
+    } else if (sym->isMethod()) {
+      auto *methodSym = static_cast<const semantic::MethodSymbol *>(sym);
+      if (methodSym->parameters().empty()) {
+        item.insertText = sym->name() + "()$0";
+      } else {
+        item.insertText = sym->name() + "($0)";
       }
+      item.insertTextFormat = InsertTextFormat::Snippet;
+    } else {
+      item.insertText = sym->name();
+      item.insertTextFormat = InsertTextFormat::PlainText;
+    }
 
-      items.push_back(std::move(item));
+    if (sym->type()) {
+      item.documentation = "Type: " + sym->type()->toString();
     }
+    return item;
   }
 
   /**
@@ -562,15 +1728,295 @@ public:
     }
   }
 
+  // ========================================================================
+  // Completion Sessions
+  // ========================================================================
+
+  /**
+   * @brief An export of another module, offered together with an import edit
+   */
+  struct ImportCandidate {
+    std::string name;
+    semantic::ExportKind kind = semantic::ExportKind::Variable;
+    std::string modulePath; ///< As written in the import statement (relative to the file)
+    std::string typeText;
+  };
+
+  /**
+   * @brief A module whose exports were (or will be) collected as import candidates
+   */
+  struct CandidateModule {
+    std::string path;
+    std::string uri;
+    uint64_t generation = 0; ///< moduleGeneration() when the candidates were collected
+  };
+
+  /**
+   * @brief Resumable state of the completion popup the user is typing into
+   *
+   * A session is keyed by the start of the word being completed. When a result
+   * was incomplete the client re-queries on the next keystroke; the session
+   * then continues where the last request stopped: scope items are kept while
+   * the document version is unchanged, and the workspace scan for auto-import
+   * candidates resumes at its module cursor (its results do not depend on the
+   * edited document).
+   */
+  struct CompletionSession {
+    std::string uri;
+    Position anchor; ///< Start of the word being completed
+
+    // Stage 1: visible symbols (per document version)
+    int64_t version = -1;
+    std::vector<CompletionItem> scopeItems;
+    size_t scopeCursor = 0;
+    bool scopeDone = false;
+
+    // Stage 3: auto-import candidates from other modules
+    std::vector<CandidateModule> modules; ///< Discovery order: open documents first
+    std::unordered_set<std::string> seenModules;
+    std::optional<std::filesystem::recursive_directory_iterator> discovery;
+    bool openModulesListed = false;
+    bool discoveryDone = false;
+    size_t moduleCursor = 0;
+    std::vector<ImportCandidate> imports;
+
+    [[nodiscard]] bool importsDone() const noexcept {
+      return discoveryDone && moduleCursor == modules.size();
+    }
+
+    void resetScope(int64_t newVersion) {
+      version = newVersion;
+      scopeItems.clear();
+      scopeCursor = 0;
+      scopeDone = false;
+    }
+
+    void resetImports() {
+      modules.clear();
+      seenModules.clear();
+      discovery.reset();
+      openModulesListed = false;
+      discoveryDone = false;
+      moduleCursor = 0;
+      imports.clear();
+    }
+  };
+
+  /// Only the most recent popup is worth resuming (main thread only)
+  std::optional<CompletionSession> completionSession_;
+
+  /// Per-URI count of changes to a module's text: edits, open/close and watched-file
+  /// events (main thread only)
+  std::unordered_map<std::string, uint64_t> moduleGenerations_;
+
+  void touchModule(const std::string &moduleUri) { ++moduleGenerations_[moduleUri]; }
+
+  [[nodiscard]] uint64_t moduleGeneration(const std::string &moduleUri) const {
+    auto it = moduleGenerations_.find(moduleUri);
+    return it == moduleGenerations_.end() ? 0 : it->second;
+  }
+
+  /**
+   * @brief Session for the word starting at anchor, resumed when possible
+   */
+  CompletionSession &completionSessionFor(const SourceFile &file, Position anchor) {
+    auto &session = completionSession_;
+    if (session && session->uri == file.uri() && session->anchor == anchor) {
+      if (session->version != file.version())
+        session->resetScope(file.version());
+      // Candidates of a module edited since it was scanned are stale; counters, not
+      // hashes, so that this stays cheap on every keystroke
+      for (size_t i = 0; i < session->moduleCursor; ++i) {
+        const auto &module = session->modules[i];
+        if (moduleGeneration(module.uri) != module.generation) {
+          session->resetImports();
+          break;
+        }
+      }
+      LSP_LOG("completion session resumed at " << anchor.line << ":" << anchor.column);
+      return *session;
+    }
+
+    session.emplace();
+    session->uri = file.uri();
+    session->anchor = anchor;
+    session->version = file.version();
+    return *session;
+  }
+
+  /**
+   * @brief Stage 1: items for the symbols visible at the cursor, innermost scope first
+   * @return False if the deadline expired first (always makes some progress)
+   */
+  bool runScopeStage(CompletionSession &session, semantic::Scope *scope,
+                     const Deadline &deadline) {
+    if (session.scopeDone || !scope) {
+      session.scopeDone = true;
+      return true;
+    }
+
+    auto symbols = scope->allVisibleSymbols();
+    size_t limit = std::min(symbols.size(), config_.maxCompletionItems);
+    while (session.scopeCursor < limit) {
+      session.scopeItems.push_back(makeSymbolItem(symbols[session.scopeCursor]));
+      if (++session.scopeCursor % 16 == 0 && session.scopeCursor < limit && deadline.expired())
+        return false;
+    }
+    session.scopeDone = true;
+    return true;
+  }
+
+  /**
+   * @brief Stage 3: collect exports of other workspace modules, one module per step
+   * @return False if the deadline expired first
+   */
+  bool runImportStage(CompletionSession &session, const SourceFile &file,
+                      const Deadline &deadline) {
+    if (!session.openModulesListed) {
+      workspace_.forEachFile([&](const std::string &, const SourceFile &other) {
+        addCandidateModule(session, other.path());
+      });
+      session.openModulesListed = true;
+    }
+
+    std::string extension = std::filesystem::path(file.path()).extension().string();
+    std::filesystem::path dir = std::filesystem::path(file.path()).parent_path();
+    while (!session.importsDone()) {
+      if (session.moduleCursor < session.modules.size()) {
+        collectImportCandidates(session, session.modules[session.moduleCursor++], dir);
+      } else {
+        discoverModules(session, extension, 64);
+      }
+      if (deadline.expired())
+        return session.importsDone();
+    }
+    return true;
+  }
+
+  void addCandidateModule(CompletionSession &session, const std::string &path) {
+    std::string moduleUri = uri::pathToUri(path);
+    if (moduleUri == session.uri || !session.seenModules.insert(moduleUri).second)
+      return;
+    session.modules.push_back({path, std::move(moduleUri), 0});
+  }
+
+  /**
+   * @brief Walk up to maxEntries more directory entries below the workspace root
+   */
+  void discoverModules(CompletionSession &session, const std::string &extension,
+                       size_t maxEntries) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (!session.discovery) {
+      const std::string &root = workspace_.config().rootPath;
+      if (root.empty() || extension.empty()) {
+        session.discoveryDone = true;
+        return;
+      }
+      session.discovery.emplace(root, fs::directory_options::skip_permission_denied, ec);
+      if (ec) {
+        session.discoveryDone = true;
+        return;
+      }
+    }
+
+    auto &it = *session.discovery;
+    for (size_t n = 0; n < maxEntries && it != fs::recursive_directory_iterator(); ++n) {
+      if (it->is_regular_file(ec) && it->path().extension() == extension)
+        addCandidateModule(session, it->path().string());
+      it.increment(ec);
+      if (ec)
+        break;
+    }
+    if (ec || it == fs::recursive_directory_iterator())
+      session.discoveryDone = true;
+  }
+
+  void collectImportCandidates(CompletionSession &session, CandidateModule &module,
+                               const std::filesystem::path &fromDir) {
+    module.generation = moduleGeneration(module.uri);
+    std::filesystem::path relative = std::filesystem::path(module.path).lexically_relative(fromDir);
+    std::string modulePath = relative.empty() ? module.path : relative.generic_string();
+
+    std::vector<std::string> visiting{session.uri};
+    auto signature = loadModuleSignature(session.uri, modulePath, visiting);
+    if (!signature)
+      return;
+    for (const auto &entry : signature->exports()) {
+      session.imports.push_back(
+          {entry.name, entry.kind, modulePath, entry.type ? entry.type->toString() : ""});
+    }
+  }
+
+  /**
+   * @brief Auto-import items matching the typed prefix and not already visible
+   */
+  void addImportItems(const CompletionSession &session, std::string_view prefix,
+                      semantic::Scope *scope, ast::CompilationUnitNode *ast, std::vector<CompletionItem> &items) {
+    if (prefix.empty())
+      return;
+
+    // 新的 import 插在最后一条 import 之后
+    Position insertAt{1, 1};
+    for (ast::Stmt *stmt : ast->statements) {
+      if (stmt && stmt->kind == ast::AstKind::ImportStmt && stmt->range.end.isValid())
+        insertAt = Position{stmt->range.end.line + 1, 1};
+    }
+
+    auto startsWith = [&](const std::string &name) {
+      return name.size() >= prefix.size() &&
+             std::equal(prefix.begin(), prefix.end(), name.begin(), [](char a, char b) {
+               return std::tolower(static_cast<unsigned char>(a)) ==
+                      std::tolower(static_cast<unsigned char>(b));
+             });
+    };
+
+    for (const auto &candidate : session.imports) {
+      if (!startsWith(candidate.name) || (scope && scope->resolve(candidate.name)))
+        continue;
+
+      CompletionItem item;
+      item.label = candidate.name;
+      item.kind = importItemKind(candidate.kind);
+      item.detail = "Auto import from \"" + candidate.modulePath + "\"";
+      if (!candidate.typeText.empty())
+        item.documentation = "Type: " + candidate.typeText;
+      item.insertText = candidate.name;
+      item.sortText = "~" + candidate.name; // after everything already in scope
+      item.additionalTextEdits.push_back(
+          TextEdit{Range{insertAt, insertAt}, "import { " + candidate.name + " } from \"" +
+                                                  candidate.modulePath + "\";\n"});
+      items.push_back(std::move(item));
+    }
+  }
+
+  static CompletionItemKind importItemKind(semantic::ExportKind kind) noexcept {
+    switch (kind) {
+    case semantic::ExportKind::Function:
+      return CompletionItemKind::Function;
+    case semantic::ExportKind::Class:
+      return CompletionItemKind::Class;
+    case semantic::ExportKind::Constant:
+      return CompletionItemKind::Constant;
+    case semantic::ExportKind::Variable:
+    default:
+      return CompletionItemKind::Variable;
+    }
+  }
+
   // ========================================================================
   // Diagnostics Notification
   // ========================================================================
 
-  void notifyDiagnosticsChanged(const std::string &uri,
-                                const std::vector<Diagnostic> &diagnostics) {
+  /**
+   * @param generation editGeneration_ the diagnostics were computed at; the receiver
+   *        drops a publish older than the last one for the URI
+   */
+  void notifyDiagnosticsChanged(const std::string &uri, const std::vector<Diagnostic> &diagnostics,
+                                uint64_t generation) {
     std::lock_guard<std::mutex> lock(callbacksMutex_);
     for (const auto &[_, callback] : diagnosticsCallbacks_) {
-      callback(uri, diagnostics);
+      callback(uri, diagnostics, generation);
     }
   }
 };
@@ -598,11 +2044,35 @@ void LspService::initialize(std::string rootPath) {
   impl_->workspace_.config().tolerantParsing = impl_->config_.tolerantParsing;
   impl_->workspace_.config().maxDiagnosticsPerFile =
       static_cast<int>(impl_->config_.maxDiagnosticsPerFile);
+  impl_->workspace_.config().streamingParseThreshold = impl_->config_.streamingParseThreshold;
+  impl_->workspace_.config().astImageCacheDir = impl_->config_.astImageCacheDir;
   impl_->initialized_ = true;
 }
 
 void LspService::shutdown() {
+  impl_->stopSpeculativeWorker();
+  {
+    std::lock_guard<std::mutex> lock(impl_->speculativeMutex_);
+    impl_->speculative_.clear();
+  }
   impl_->semanticModels_.clear();
+  impl_->retiredModels_.clear();
+  impl_->completionSession_.reset();
+  impl_->identifierIndex_.save();
+  for (const auto &timing : impl_->lintTotals_)
+    LSP_LOG("lint rule " << timing.code << " " << timing.rule << ": " << timing.nanos / 1000
+                         << " us, " << timing.calls << " calls, " << timing.reports << " reports");
+  impl_->lintTotals_.clear();
+  LSP_LOG("speculative precompute: "
+          << impl_->speculativeHits_.load(std::memory_order_relaxed) << " hits, "
+          << impl_->speculativeCancelled_.load(std::memory_order_relaxed) << " jobs cancelled");
+  auto governor = impl_->governor_.status();
+  LSP_LOG("governor: " << governor.interactiveRequests << " interactive requests (EWMA "
+                       << governor.latencyEwmaMs << " ms), " << governor.backgroundAdmitted
+                       << " background tasks admitted, " << governor.backgroundDeferred
+                       << " deferred, " << governor.backgroundForced << " forced, "
+                       << governor.decisions << " slot decisions");
+  impl_->moduleSignatures_.clear();
   impl_->initialized_ = false;
 }
 
@@ -612,8 +2082,16 @@ const LspServiceConfig &LspService::config() const noexcept { return impl_->conf
 
 void LspService::setConfig(LspServiceConfig config) {
   impl_->config_ = std::move(config);
+  {
+    std::lock_guard<std::mutex> lock(impl_->modelsMutex_);
+    impl_->lintEngine_.configure(impl_->config_.lint);
+  }
+  impl_->governor_.configure(impl_->config_.governor);
+  impl_->identifierIndex_.setCacheDirectory(impl_->config_.identifierIndexDir);
   if (impl_->initialized_) {
     impl_->workspace_.config().tolerantParsing = impl_->config_.tolerantParsing;
+    impl_->workspace_.config().streamingParseThreshold = impl_->config_.streamingParseThreshold;
+    impl_->workspace_.config().astImageCacheDir = impl_->config_.astImageCacheDir;
   }
 }
 
@@ -622,25 +2100,32 @@ void LspService::setConfig(LspServiceConfig config) {
 // ============================================================================
 
 void LspService::didOpen(std::string_view uri, std::string content, int64_t version) {
+  auto docLock = impl_->beginDocumentMutation();
   auto &file = impl_->workspace_.openFile(uri, std::move(content), version);
 
   // Parse and analyze
   file.reparse();
   impl_->invalidateSemanticModel(std::string(uri));
+  impl_->invalidateSpeculative(std::string(uri));
+  impl_->touchModule(std::string(uri));
+  docLock.unlock();
 
-  // Notify diagnostics
-  auto diagnostics = file.getDiagnostics();
-  impl_->notifyDiagnosticsChanged(std::string(uri), diagnostics);
+  impl_->afterEdit(file);
 }
 
 void LspService::didChange(std::string_view uri, std::string content, int64_t version) {
+  auto docLock = impl_->beginDocumentMutation();
   if (impl_->workspace_.applyFullChange(uri, std::move(content), version)) {
     auto *file = impl_->workspace_.getFile(uri);
     if (file) {
       file->reparse();
 
       impl_->invalidateSemanticModel(file->uri());
-      impl_->notifyDiagnosticsChanged(file->uri(), file->getDiagnostics());
+      impl_->invalidateSpeculative(file->uri());
+      impl_->touchModule(file->uri());
+      docLock.unlock();
+
+      impl_->afterEdit(*file);
     }
   }
 }
@@ -648,6 +2133,7 @@ void LspService::didChange(std::string_view uri, std::string content, int64_t ve
 void LspService::didChangeIncremental(std::string_view uri,
                                       const std::vector<std::pair<Range, std::string>> &changes,
                                       int64_t version) {
+  auto docLock = impl_->beginDocumentMutation();
   auto *file = impl_->workspace_.getFile(uri);
   if (!file)
     return;
@@ -666,12 +2152,25 @@ void LspService::didChangeIncremental(std::string_view uri,
 
   file->reparse();
   impl_->invalidateSemanticModel(std::string(uri));
-  impl_->notifyDiagnosticsChanged(std::string(uri), file->getDiagnostics());
+  impl_->invalidateSpeculative(std::string(uri));
+  impl_->touchModule(std::string(uri));
+  docLock.unlock();
+
+  impl_->afterEdit(*file);
 }
 
 void LspService::didClose(std::string_view uri) {
+  auto docLock = impl_->beginDocumentMutation();
   impl_->invalidateSemanticModel(std::string(uri));
+  impl_->invalidateSpeculative(std::string(uri));
+  impl_->touchModule(std::string(uri)); // Served from disk from now on
+  impl_->identifierIndex_.closeDocument(uri::uriToPath(uri));
   impl_->workspace_.closeFile(uri);
+  uint64_t generation = impl_->editGeneration_.load(std::memory_order_acquire);
+  docLock.unlock();
+
+  // Newer than any speculative publish still in flight for the document
+  impl_->notifyDiagnosticsChanged(std::string(uri), {}, generation);
 }
 
 void LspService::didSave(std::string_view uri) {
@@ -681,6 +2180,28 @@ void LspService::didSave(std::string_view uri) {
   }
 }
 
+void LspService::didChangeWatchedFiles(const std::vector<FileEvent> &events) {
+  auto docLock = impl_->beginDocumentMutation();
+  for (const auto &event : events) {
+    std::string path = uri::uriToPath(event.uri);
+    {
+      std::lock_guard<std::mutex> lock(impl_->diskStampsMutex_);
+      impl_->diskStamps_.erase(path);
+    }
+    impl_->moduleSignatures_.erase(event.uri);
+    impl_->touchModule(event.uri);
+
+    // Open documents are served from the editor's text, closed ones from the store
+    if (impl_->workspace_.isFileOpen(event.uri))
+      continue;
+    auto &store = impl_->workspace_.textStore();
+    if (event.type == FileEvent::Type::Deleted)
+      store.erase(event.uri);
+    else if (store.contains(event.uri))
+      impl_->workspace_.indexFile(path);
+  }
+}
+
 // ============================================================================
 // Hover
 // ============================================================================
@@ -725,6 +2246,12 @@ HoverResult LspService::hover(std::string_view uri, Position position) {
       } else if (auto *defSym = model->getDefiningSymbol(node)) {
         result.contents = createHoverMarkdown(defSym, defSym->type());
         result.range = file->toRange(node->range);
+      } else if (auto *scopeSym =
+                     model->scopeAt(file->codePointOffsetOf(offset))
+                         ->resolve(file->factory().strings().get(ident->name))) {
+        // 未绑定的标识符（残缺代码中常见）：按光标处作用域解析
+        result.contents = createHoverMarkdown(scopeSym, scopeSym->type());
+        result.range = file->toRange(node->range);
       }
     }
   } else if (auto *literal = ast::ast_cast<ast::IntLiteralNode>(node)) {
@@ -838,89 +2365,45 @@ CompletionResult LspService::completion(std::string_view uri, Position position,
     break;
   }
 
-  case CompletionTrigger::Argument: {
-    LSP_LOG("case: Argument");
-    // 在函数调用参数位置，提供作用域内的变量补全
-    if (model) {
-      semantic::Scope *scope = nullptr;
-
-      // 先尝试从包围节点获取作用域
-      if (completionCtx.enclosingNode) {
-        scope = model->getNodeScope(completionCtx.enclosingNode);
-        LSP_LOG("Argument: scope from enclosingNode=" << (void *)scope);
-      }
-
-      // 如果没有找到，尝试从调用表达式的上下文找
-      if (!scope) {
-        NodeFinder finder(ast);
-        auto findResult = finder.findNodeAt(offset);
-        if (findResult.valid()) {
-          // 尝试找到包含当前位置的函数声明
-          auto *funcDecl = findResult.context.findAncestor<ast::FunctionDeclNode>();
-          if (funcDecl) {
-            scope = model->getNodeScope(funcDecl);
-            LSP_LOG("Argument: scope from FunctionDecl=" << (void *)scope);
-          }
-          // 也尝试找 BlockStmt
-          if (!scope) {
-            auto *blockStmt = findResult.context.findAncestor<ast::BlockStmtNode>();
-            if (blockStmt) {
-              scope = model->getNodeScope(blockStmt);
-              LSP_LOG("Argument: scope from BlockStmt=" << (void *)scope);
-            }
-          }
-        }
-      }
-
-      // 最后使用全局作用域
-      if (!scope) {
-        scope = model->symbolTable().globalScope();
-        LSP_LOG("Argument: using globalScope=" << (void *)scope);
-      }
-
-      if (scope) {
-        LSP_LOG("Argument: scope has " << scope->allVisibleSymbols().size() << " visible symbols");
-        for (auto *sym : scope->allVisibleSymbols()) {
-          LSP_LOG("  symbol: " << sym->name() << " kind=" << static_cast<int>(sym->kind()));
-        }
-      }
-
-      impl_->addScopeCompletions(result.items, scope, impl_->config_.maxCompletionItems);
-    }
-
-    // 在参数位置也添加关键字（如 true, false, null, new 等）
-    impl_->addKeywordCompletions(result.items);
-    break;
-  }
-
+  case CompletionTrigger::Argument:
   case CompletionTrigger::Identifier:
   case CompletionTrigger::None:
   default: {
-    LSP_LOG("case: Identifier/None/default");
-    // Scope-based completion
-    if (model) {
-      semantic::Scope *scope = nullptr;
-      if (completionCtx.enclosingNode) {
-        scope = model->getNodeScope(completionCtx.enclosingNode);
-        LSP_LOG("scope from enclosingNode=" << (void *)scope);
-      }
-      if (!scope) {
-        scope = model->symbolTable().globalScope();
-        LSP_LOG("using globalScope=" << (void *)scope);
-      }
-      if (scope) {
-        LSP_LOG("scope has " << scope->allVisibleSymbols().size() << " visible symbols");
-        for (auto *sym : scope->allVisibleSymbols()) {
-          LSP_LOG("  symbol: " << sym->name() << " kind=" << static_cast<int>(sym->kind()));
-        }
-      }
-      impl_->addScopeCompletions(result.items, scope, impl_->config_.maxCompletionItems);
-    } else {
-      LSP_LOG("model is null, skipping scope completions");
-    }
-
-    // Add keywords
+    LSP_LOG("case: Argument/Identifier/None/default");
+    // 便宜的来源先算（作用域内符号、关键字），再算全工作区的自动导入候选；
+    // 超出预算就返回已有结果并标记 isIncomplete，客户端下一次请求时从会话继续
+    Deadline deadline(impl_->config_.completionBudget);
+
+    const std::string &text = file->content();
+    uint32_t wordStart = std::min<uint32_t>(offset, static_cast<uint32_t>(text.size()));
+    while (wordStart > 0 && (std::isalnum(static_cast<unsigned char>(text[wordStart - 1])) ||
+                             text[wordStart - 1] == '_'))
+      --wordStart;
+    std::string_view prefix(text.data() + wordStart,
+                            std::min<size_t>(offset, text.size()) - wordStart);
+
+    auto &session = impl_->completionSessionFor(*file, file->getPosition(wordStart));
+    // 区间索引直接给出光标处最内层作用域（残缺代码中同样有效）
+    semantic::Scope *scope = model ? model->scopeAt(file->codePointOffsetOf(offset)) : nullptr;
+    LSP_LOG("scope at offset=" << (void *)scope);
+
+    bool complete = impl_->runScopeStage(session, scope, deadline);
+    result.items = session.scopeItems;
     impl_->addKeywordCompletions(result.items);
+
+    if (complete)
+      complete = impl_->runImportStage(session, *file, deadline);
+    impl_->addImportItems(session, prefix, scope, ast, result.items);
+
+    // An empty prefix shows no import candidates yet; the first typed character must re-query
+    result.isIncomplete = !complete || (prefix.empty() && !session.imports.empty());
+    LSP_LOG("completion stages: scope " << session.scopeItems.size()
+                                        << (session.scopeDone ? "" : "+")
+                                        << ", import candidates " << session.imports.size()
+                                        << " from " << session.moduleCursor << "/"
+                                        << session.modules.size() << " modules"
+                                        << (session.importsDone() ? "" : "+") << ", "
+                                        << deadline.elapsed().count() << " us");
     break;
   }
   }
@@ -1152,59 +2635,91 @@ std::vector<LocationLink> LspService::typeDefinition(std::string_view uri, Posit
 std::vector<Location> LspService::references(std::string_view uri, Position position,
                                              bool includeDeclaration) {
   std::vector<Location> result;
+  references(uri, position, includeDeclaration, [&](std::vector<Location> &&batch) {
+    result.insert(result.end(), std::make_move_iterator(batch.begin()),
+                  std::make_move_iterator(batch.end()));
+    return true;
+  });
+  return result;
+}
 
+void LspService::references(std::string_view uri, Position position, bool includeDeclaration,
+                            const ResultSink<Location> &sink) {
   if (!impl_->config_.enableReferences)
-    return result;
+    return;
 
   auto *file = impl_->workspace_.getFile(uri);
   if (!file)
-    return result;
+    return;
 
   Position internalPos = Position::fromZeroBased(position.line, position.column);
   uint32_t offset = file->getOffset(internalPos);
 
   auto *ast = file->getAst();
   if (!ast)
-    return result;
+    return;
 
   auto *model = impl_->getSemanticModel(file);
   if (!model)
-    return result;
+    return;
 
   // Find symbol
   NodeFinder finder(ast);
   auto findResult = finder.findNodeAt(offset);
 
   if (!findResult.valid())
-    return result;
+    return;
 
   semantic::Symbol *sym = model->getResolvedSymbol(findResult.node());
   if (!sym) {
     sym = model->getDefiningSymbol(findResult.node());
   }
   if (!sym)
-    return result;
-
-  // Get all references
-  auto refs = model->findReferences(sym);
+    return;
 
-  for (const auto &ref : refs) {
+  // References in this document: the first batch
+  size_t budget = impl_->config_.maxReferences;
+  std::vector<Location> local;
+  for (const auto &ref : model->findReferences(sym)) {
+    if (local.size() >= budget)
+      break;
     if (!includeDeclaration && ref.begin == sym->definitionLoc()) {
       continue;
     }
 
     Location loc;
     loc.uri = std::string(uri);
-    Position pos = file->getPosition(ref.begin.offset);
-    loc.range = Range{pos, pos};
-    result.push_back(std::move(loc));
+    loc.range = Impl::nameRange(*file, ref.begin, sym->name());
+    local.push_back(std::move(loc));
+  }
+  budget -= local.size();
+  if (!local.empty() && !sink(std::move(local)))
+    return;
+  if (budget == 0)
+    return;
 
-    if (result.size() >= impl_->config_.maxReferences) {
-      break;
+  // Exports, and names imported from another module, are also referenced from other files
+  semantic::Scope *global = model->symbolTable().globalScope();
+  std::string fileUri(uri);
+  if (sym->isExport() && global->resolveLocal(sym->name()) == sym) {
+    impl_->addCrossFileReferences(fileUri, sym->name(), fileUri, includeDeclaration, budget, sink);
+  } else if (auto *imported = semantic::symbol_cast<semantic::ImportSymbol>(sym)) {
+    std::string moduleUri = impl_->resolveModuleUri(imported->modulePath(), uri);
+    const auto &strings = file->factory().strings();
+    for (ast::Stmt *stmt : ast->statements) {
+      auto *import = ast::ast_cast<ast::ImportStmtNode>(stmt);
+      if (moduleUri.empty() || !import || import->style != ast::ImportStmtNode::Style::Named)
+        continue;
+      for (const auto &spec : import->specifiers) {
+        // An alias is a local name; renaming it must not touch the exporting module
+        if (strings.get(spec.alias) != sym->name() || spec.alias != spec.name)
+          continue;
+        if (!impl_->addCrossFileReferences(moduleUri, std::string(strings.get(spec.name)), fileUri,
+                                           includeDeclaration, budget, sink))
+          return;
+      }
     }
   }
-
-  return result;
 }
 
 // ============================================================================
@@ -1229,6 +2744,13 @@ std::vector<DocumentSymbol> LspService::documentSymbols(std::string_view uri) {
     return result;
   }
 
+  if (impl_->findSpeculative(file->uri(), file->version(), [&](const auto &cached) {
+        result = cached.documentSymbols;
+      })) {
+    LSP_LOG("served from speculative cache, result.size()=" << result.size());
+    return result;
+  }
+
   auto *ast = file->getAst();
   if (!ast) {
     LSP_LOG("ast is null");
@@ -1256,15 +2778,26 @@ std::vector<DocumentSymbol> LspService::documentSymbols(std::string_view uri) {
 
 std::vector<WorkspaceSymbol> LspService::workspaceSymbols(std::string_view query) {
   std::vector<WorkspaceSymbol> result;
+  workspaceSymbols(query, [&](std::vector<WorkspaceSymbol> &&batch) {
+    result.insert(result.end(), std::make_move_iterator(batch.begin()),
+                  std::make_move_iterator(batch.end()));
+    return true;
+  });
+  return result;
+}
 
+void LspService::workspaceSymbols(std::string_view query, const ResultSink<WorkspaceSymbol> &sink) {
   if (!impl_->config_.enableWorkspaceSymbols)
-    return result;
+    return;
 
   std::string queryLower(query);
   std::transform(queryLower.begin(), queryLower.end(), queryLower.begin(),
                  [](unsigned char c) { return std::tolower(c); });
 
+  bool stopped = false;
   impl_->workspace_.forEachFile([&](const std::string &fileUri, const SourceFile &file) {
+    if (stopped)
+      return;
     auto *ast = const_cast<SourceFile &>(file).getAst();
     if (!ast)
       return;
@@ -1274,7 +2807,8 @@ std::vector<WorkspaceSymbol> LspService::workspaceSymbols(std::string_view query
     if (!model)
       return;
 
-    // Search symbols
+    // Search symbols; rank 0 = exact, 1 = prefix, 2 = substring
+    std::vector<std::pair<int, WorkspaceSymbol>> hits;
     for (const auto &symPtr : model->symbolTable().allSymbols()) {
       semantic::Symbol *sym = symPtr.get();
 
@@ -1283,9 +2817,11 @@ std::vector<WorkspaceSymbol> LspService::workspaceSymbols(std::string_view query
       std::transform(nameLower.begin(), nameLower.end(), nameLower.begin(),
                      [](unsigned char c) { return std::tolower(c); });
 
-      if (nameLower.find(queryLower) == std::string::npos) {
+      size_t at = nameLower.find(queryLower);
+      if (at == std::string::npos) {
         continue;
       }
+      int rank = at != 0 ? 2 : nameLower.size() == queryLower.size() ? 0 : 1;
 
       WorkspaceSymbol wsSym;
       wsSym.name = sym->name();
@@ -1304,11 +2840,37 @@ std::vector<WorkspaceSymbol> LspService::workspaceSymbols(std::string_view query
         // Simplified - just note the scope kind
       }
 
-      result.push_back(std::move(wsSym));
+      hits.push_back({rank, std::move(wsSym)});
     }
+    if (hits.empty()) {
+      stopped = !sink({});
+      return;
+    }
+
+    std::stable_sort(hits.begin(), hits.end(), [](const auto &a, const auto &b) {
+      return a.first != b.first ? a.first < b.first : a.second.name < b.second.name;
+    });
+    std::vector<WorkspaceSymbol> batch;
+    batch.reserve(hits.size());
+    for (auto &hit : hits)
+      batch.push_back(std::move(hit.second));
+    stopped = !sink(std::move(batch));
   });
+}
 
-  return result;
+// ============================================================================
+// Structural Search
+// ============================================================================
+
+void LspService::findCalls(std::string_view callee, const ResultSink<Location> &sink) {
+  // One batch per file, empty or not, so the receiver can stop between files
+  std::vector<Location> batch;
+  impl_->workspace_.queryNodes(
+      [&](ast::NodeQuery &query) { query.callee(callee); },
+      [&](const std::string &fileUri, SourceFile &file, ast::AstNode *call) {
+        batch.push_back(Location{fileUri, file.toRange(call->range)});
+      },
+      [&](const std::string &) { return sink(std::exchange(batch, {})); });
 }
 
 // ============================================================================
@@ -1332,6 +2894,10 @@ std::optional<WorkspaceEdit> LspService::rename(std::string_view uri, Position p
   WorkspaceEdit edit;
 
   for (const auto &ref : refs) {
+    // A reference whose name could not be located has an empty range; editing there
+    // would insert the new name next to the old one
+    if (ref.range.start == ref.range.end)
+      continue;
     TextEdit textEdit;
     textEdit.range = ref.range;
     textEdit.newText = std::string(newName);
@@ -1400,33 +2966,90 @@ std::vector<CodeAction> LspService::codeActions(std::string_view uri, Range rang
 
   // Add quick fixes for diagnostics
   for (const auto &diag : diagnostics) {
-    if (diag.code == "undefined-variable") {
-      // Suggest declaring variable
-      CodeAction action;
-      action.title = "Declare variable '" + diag.message + "'";
-      action.kind = CodeActionKind::QuickFix;
-      action.diagnostics = {diag};
-      action.isPreferred = true;
-      result.push_back(std::move(action));
-    } else if (diag.code == "unused-variable") {
-      // Suggest removing or prefixing with underscore
-      CodeAction action;
-      action.title = "Remove unused variable";
-      action.kind = CodeActionKind::QuickFix;
-      action.diagnostics = {diag};
-      result.push_back(std::move(action));
+    impl_->addQuickFixes(diag, result);
+  }
 
-      CodeAction action2;
-      action2.title = "Prefix with underscore";
-      action2.kind = CodeActionKind::QuickFix;
-      action2.diagnostics = {diag};
-      result.push_back(std::move(action2));
+  // Every safe lint fix of the file at once; needs the model, so usually precomputed
+  auto *file = impl_->workspace_.getFile(uri);
+  if (!file)
+    return result;
+  std::vector<TextEdit> edits;
+  bool cached = impl_->findSpeculative(file->uri(), file->version(), [&](const auto &entry) {
+    edits = entry.fixAllEdits;
+  });
+  if (!cached) {
+    if (auto *model = impl_->getSemanticModel(file))
+      edits = Impl::fixEdits(*file, model->lintDiagnostics());
+  }
+  if (!edits.empty()) {
+    CodeAction action;
+    action.title = "Fix all auto-fixable problems";
+    action.kind = CodeActionKind::SourceFixAll;
+    action.edit.changes[std::string(uri)] = std::move(edits);
+    result.push_back(std::move(action));
+  }
+
+  return result;
+}
+
+// ============================================================================
+// File Renames
+// ============================================================================
+
+WorkspaceEdit LspService::willRenameFiles(const std::vector<FileRename> &renames) {
+  WorkspaceEdit result;
+  impl_->refreshImportGraph();
+
+  ImportGraph::Moves moves;
+  std::set<std::string> affected;
+  for (const auto &rename : renames) {
+    std::string from = Impl::normalizedPath(uri::uriToPath(rename.oldUri));
+    std::string to = Impl::normalizedPath(uri::uriToPath(rename.newUri));
+    if (from.empty() || to.empty() || from == to)
+      continue;
+    impl_->importGraph_.collectImportersOf(from, affected);
+    impl_->importGraph_.collectFilesIn(from, affected);
+    moves.emplace_back(std::move(from), std::move(to));
+  }
+
+  size_t edits = 0;
+  for (const auto &importer : affected) {
+    const auto *file = impl_->importGraph_.file(importer);
+    if (!file)
+      continue;
+    std::string movedImporter = ImportGraph::movedPath(importer, moves);
+    std::vector<TextEdit> fileEdits;
+    for (const auto &edge : file->imports) {
+      std::string movedTarget = ImportGraph::movedPath(edge.target, moves);
+      if (movedImporter == importer && movedTarget == edge.target)
+        continue;
+      std::string specifier = ImportGraph::specifierFor(edge, movedImporter, movedTarget);
+      if (specifier != edge.specifier)
+        fileEdits.push_back({edge.literal, ImportGraph::escape(specifier, edge.quote)});
     }
+    if (fileEdits.empty())
+      continue;
+    edits += fileEdits.size();
+    result.changes[file->uri] = std::move(fileEdits);
   }
 
+  LSP_LOG("willRenameFiles: " << moves.size() << " moves, " << affected.size()
+                              << " candidate files, " << edits << " edits in "
+                              << result.changes.size() << " files");
   return result;
 }
 
+std::optional<WorkspaceEdit>
+LspService::fixAllWorkspace(const std::function<void(const FixAllProgress &)> &progress,
+                            const std::function<bool()> &cancelled) {
+  return impl_->fixAllWorkspace(progress, cancelled);
+}
+
+size_t LspService::indexWorkspace(const std::function<void(IndexedDocument &&)> &sink,
+                                  unsigned jobs) {
+  return impl_->indexWorkspace(sink, jobs);
+}
+
 // ============================================================================
 // Semantic Tokens
 // ============================================================================
@@ -1441,19 +3064,17 @@ SemanticTokensResult LspService::semanticTokensFull(std::string_view uri) {
   if (!file)
     return result;
 
+  if (impl_->findSpeculative(file->uri(), file->version(),
+                             [&](const auto &cached) { result = cached.semanticTokens; })) {
+    return result;
+  }
+
   auto *ast = file->getAst();
   if (!ast)
     return result;
 
   auto *model = impl_->getSemanticModel(file);
-
-  std::vector<SemanticToken> tokens;
-  impl_->collectSemanticTokens(ast, tokens, *file, model);
-
-  result.data = impl_->encodeSemanticTokens(tokens);
-  result.resultId = std::to_string(file->version());
-
-  return result;
+  return impl_->buildSemanticTokens(ast, *file, model);
 }
 
 SemanticTokensResult LspService::semanticTokensDelta(std::string_view uri,
@@ -1563,7 +3184,12 @@ std::vector<Diagnostic> LspService::getDiagnostics(std::string_view uri) {
   auto *file = impl_->workspace_.getFile(uri);
   if (!file)
     return {};
-  return file->getDiagnostics();
+
+  // Lint findings come with an already computed model; never analyze just for this
+  std::lock_guard<std::mutex> lock(impl_->modelsMutex_);
+  auto it = impl_->semanticModels_.find(file->uri());
+  return impl_->withLintDiagnostics(*file,
+                                    it != impl_->semanticModels_.end() ? &it->second : nullptr);
 }
 
 std::unordered_map<std::string, std::vector<Diagnostic>> LspService::getAllDiagnostics() {
@@ -1571,7 +3197,9 @@ std::unordered_map<std::string, std::vector<Diagnostic>> LspService::getAllDiagn
 }
 
 size_t LspService::onDiagnosticsChanged(
-    std::function<void(const std::string &uri, const std::vector<Diagnostic> &)> callback) {
+    std::function<void(const std::string &uri, const std::vector<Diagnostic> &,
+                       uint64_t generation)>
+        callback) {
   std::lock_guard<std::mutex> lock(impl_->callbacksMutex_);
   size_t id = impl_->nextCallbackId_++;
   impl_->diagnosticsCallbacks_[id] = std::move(callback);
@@ -1583,6 +3211,13 @@ void LspService::removeDiagnosticsCallback(size_t id) {
   impl_->diagnosticsCallbacks_.erase(id);
 }
 
+std::vector<semantic::LintRuleTiming> LspService::lintTimings() const {
+  std::lock_guard<std::mutex> lock(impl_->modelsMutex_);
+  return impl_->lintTotals_;
+}
+
+ResourceGovernor &LspService::governor() noexcept { return impl_->governor_; }
+
 // ============================================================================
 // Workspace Management
 // ============================================================================
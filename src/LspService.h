@@ -29,11 +29,14 @@
 #pragma once
 
 #include "LineOffsetTable.h"
+#include "LintEngine.h"
 #include "NodeFinder.h"
+#include "ResourceGovernor.h"
 #include "SemanticAnalyzer.h"
 #include "SourceFile.h"
 #include "Workspace.h"
 
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -171,6 +174,14 @@ enum class InsertTextFormat : uint8_t {
   Snippet = 2,   ///< Snippet 格式，支持 $0, $1, ${1:placeholder} 等占位符
 };
 
+/**
+ * @brief Text edit for document changes
+ */
+struct TextEdit {
+  Range range;
+  std::string newText;
+};
+
 /**
  * @brief A single completion item
  */
@@ -188,6 +199,9 @@ struct CompletionItem {
   // Text edit for insertion
   std::optional<Range> textEditRange;
   std::string textEditNewText;
+
+  /// Applied alongside the insertion (e.g. the import an auto-import item adds)
+  std::vector<TextEdit> additionalTextEdits;
 };
 
 /**
@@ -226,14 +240,6 @@ struct SignatureHelp {
   [[nodiscard]] bool isEmpty() const noexcept { return signatures.empty(); }
 };
 
-/**
- * @brief Text edit for document changes
- */
-struct TextEdit {
-  Range range;
-  std::string newText;
-};
-
 /**
  * @brief Workspace edit (for rename, etc.)
  */
@@ -252,6 +258,7 @@ enum class CodeActionKind {
   RefactorRewrite,
   Source,
   SourceOrganizeImports,
+  SourceFixAll,
 };
 
 /**
@@ -369,14 +376,93 @@ struct LspServiceConfig {
 
   // Limits
   size_t maxCompletionItems = 100;
+  /// Time budget of one completion request; expensive sources past it resume on re-query (0 = none)
+  std::chrono::milliseconds completionBudget{30};
   size_t maxReferences = 1000;
   size_t maxDiagnosticsPerFile = 100;
+  /// Files at least this large (bytes) are parsed statement by statement into a skeletal AST
+  size_t streamingParseThreshold = SourceFile::DefaultStreamingThreshold;
+  /// Directory for on-disk AST images of unchanged files (empty = disabled)
+  std::string astImageCacheDir;
+  /// Directory for the persisted identifier index of workspace files (empty = memory only)
+  std::string identifierIndexDir;
+  /// Extensions of source files picked up by workspace-wide operations (fix-all)
+  std::vector<std::string> sourceExtensions{".spt", ".lang"};
 
   // Behavior
   bool tolerantParsing = true;
   bool incrementalSync = true;
+
+  /// 编辑后在后台线程预计算 semantic tokens / outline / fix-all edits，请求到达时直接命中缓存
+  bool enableSpeculativePrecompute = true;
+
+  /// Lint rules run after semantic analysis (per workspace, from initializationOptions.lint)
+  semantic::LintConfig lint;
+
+  /// CPU share and priority of background work (speculative precompute, workspace sweeps)
+  GovernorConfig governor;
+};
+
+/**
+ * @brief A file or directory about to be renamed or moved
+ */
+struct FileRename {
+  std::string oldUri;
+  std::string newUri;
+};
+
+/**
+ * @brief A change to a file on disk reported by the client's file watcher
+ */
+struct FileEvent {
+  enum class Type : uint8_t { Created = 1, Changed = 2, Deleted = 3 };
+
+  std::string uri;
+  Type type = Type::Changed;
+};
+
+/**
+ * @brief Where a workspace-wide fix-all stands
+ */
+struct FixAllProgress {
+  size_t filesTotal = 0;
+  size_t filesDone = 0;
+  size_t filesChanged = 0; ///< Files with at least one fix
+  size_t edits = 0;
+};
+
+/**
+ * @brief One symbol of an indexed document: where it is declared and used
+ */
+struct IndexedSymbol {
+  std::string name;
+  Range definition;              ///< The declared name
+  std::vector<Range> references; ///< Uses in the same document
+  std::string hover;             ///< Markdown, as textDocument/hover shows it
+  bool exported = false;         ///< Visible to importers under `name`
+  /// For a named import: the module it resolves to and the name it imports there
+  std::string importedUri;
+  std::string importedName;
+};
+
+/**
+ * @brief Symbols of one source file, for offline code-intelligence dumps
+ */
+struct IndexedDocument {
+  std::string uri;
+  std::vector<IndexedSymbol> symbols;
 };
 
+/**
+ * @brief Receives one batch of results as soon as it is ready
+ *
+ * Workspace-wide searches also pass an empty batch after each file without
+ * results, so the receiver gets a chance to stop between files.
+ *
+ * @return false to stop the search (e.g. the request was cancelled)
+ */
+template <typename T> using ResultSink = std::function<bool(std::vector<T> &&)>;
+
 // ============================================================================
 // LSP Service Class
 // ============================================================================
@@ -473,7 +559,7 @@ public:
                             int64_t version);
 
   /**
-   * @brief Handle document close
+   * @brief Handle document close; publishes its diagnostics as empty
    * @param uri Document URI
    */
   void didClose(std::string_view uri);
@@ -484,6 +570,14 @@ public:
    */
   void didSave(std::string_view uri);
 
+  /**
+   * @brief Handle files created, changed or deleted on disk
+   *
+   * Drops what was derived from their previous text: cached disk hashes,
+   * module signatures and the indexed text of closed files.
+   */
+  void didChangeWatchedFiles(const std::vector<FileEvent> &events);
+
   // ========================================================================
   // Language Features
   // ========================================================================
@@ -555,6 +649,15 @@ public:
   [[nodiscard]] std::vector<Location> references(std::string_view uri, Position position,
                                                  bool includeDeclaration = true);
 
+  /**
+   * @brief Find all references, one batch per file
+   *
+   * The requesting document comes first, then the other files most likely to
+   * matter: the defining module, open documents, files nearest the requester.
+   */
+  void references(std::string_view uri, Position position, bool includeDeclaration,
+                  const ResultSink<Location> &sink);
+
   /**
    * @brief Get document symbols (outline)
    * @param uri Document URI
@@ -569,6 +672,21 @@ public:
    */
   [[nodiscard]] std::vector<WorkspaceSymbol> workspaceSymbols(std::string_view query);
 
+  /**
+   * @brief Search workspace symbols, one batch per file
+   *
+   * Within a batch, exact name matches come before prefix and substring matches.
+   */
+  void workspaceSymbols(std::string_view query, const ResultSink<WorkspaceSymbol> &sink);
+
+  /**
+   * @brief Find every call to a function or method named `callee`, one batch per file
+   *
+   * Searches open documents and the closed files held in the text store, and
+   * matches `f(x)`, `obj.f(x)` and `mod:f(x)` alike.
+   */
+  void findCalls(std::string_view callee, const ResultSink<Location> &sink);
+
   /**
    * @brief Rename symbol
    * @param uri Document URI
@@ -597,6 +715,46 @@ public:
   [[nodiscard]] std::vector<CodeAction> codeActions(std::string_view uri, Range range,
                                                     const std::vector<Diagnostic> &diagnostics);
 
+  /**
+   * @brief Import updates for files or directories about to be renamed
+   *
+   * Only files importing a moved file, and moved files with relative imports,
+   * are touched; edits address the files at their current URIs.
+   */
+  [[nodiscard]] WorkspaceEdit willRenameFiles(const std::vector<FileRename> &renames);
+
+  /**
+   * @brief Apply every safe lint fix in every source file of the workspace
+   *
+   * Open documents are fixed as the editor has them, other files as on disk;
+   * each file's edits are computed against that snapshot, in parallel under
+   * the resource governor. Call from a background thread, never from the
+   * message loop.
+   *
+   * @param progress Called after each file (from worker threads, one call at a time)
+   * @param cancelled Polled between files and while waiting for the governor
+   * @return The merged edit, or nullopt if cancelled. Files edited in the
+   *         meantime are left out.
+   */
+  [[nodiscard]] std::optional<WorkspaceEdit>
+  fixAllWorkspace(const std::function<void(const FixAllProgress &)> &progress,
+                  const std::function<bool()> &cancelled);
+
+  /**
+   * @brief Analyze every source file of the workspace as on disk, for index export
+   *
+   * Files are parsed and analyzed on `jobs` threads; each document is handed
+   * to the sink as soon as it is done and dropped afterwards, so at most
+   * `jobs` documents are held at a time. Imports bind against cached module
+   * signatures. Meant for batch use: open documents are ignored and the
+   * resource governor is bypassed.
+   *
+   * @param sink Called once per document, from worker threads, one call at a time
+   * @param jobs Worker threads (0 = one per core)
+   * @return Number of source files found
+   */
+  size_t indexWorkspace(const std::function<void(IndexedDocument &&)> &sink, unsigned jobs = 0);
+
   /**
    * @brief Get semantic tokens for entire document
    * @param uri Document URI
@@ -651,11 +809,15 @@ public:
 
   /**
    * @brief Register a callback for diagnostics updates
-   * @param callback Called when diagnostics change
+   * @param callback Called when diagnostics change, possibly from the background worker,
+   *        with the document generation they were computed at. A call older than one
+   *        already made for the same URI is stale (e.g. it lost a race with didClose).
    * @return Callback ID for removal
    */
-  size_t onDiagnosticsChanged(
-      std::function<void(const std::string &uri, const std::vector<Diagnostic> &)> callback);
+  size_t onDiagnosticsChanged(std::function<void(const std::string &uri,
+                                                 const std::vector<Diagnostic> &,
+                                                 uint64_t generation)>
+                                  callback);
 
   /**
    * @brief Remove diagnostics callback
@@ -663,6 +825,16 @@ public:
    */
   void removeDiagnosticsCallback(size_t id);
 
+  /**
+   * @brief Accumulated per-rule lint cost since initialize()
+   */
+  [[nodiscard]] std::vector<semantic::LintRuleTiming> lintTimings() const;
+
+  /**
+   * @brief Admission control shared by the message loop and background work
+   */
+  [[nodiscard]] ResourceGovernor &governor() noexcept;
+
   // ========================================================================
   // Workspace Management
   // ========================================================================
@@ -0,0 +1,342 @@
+/**
+ * @file ModuleSignature.h
+ * @brief Exported-Signature Tables for Cross-File Type Propagation
+ *
+ * A ModuleSignature is the public surface of one module text: its exported
+ * functions, classes (with fields and methods) and global variables/constants,
+ * with types cloned into a TypeContext owned by the signature. Importing files
+ * bind against it instead of re-analyzing the dependency, so the cost of
+ * analyzing a file is O(number of imports), not O(size of import closure).
+ *
+ * Key Features:
+ * - Self-contained: types live in the signature's own TypeContext
+ * - Immutable once built, shared read-only via std::shared_ptr
+ * - Fingerprint over exported names/types to detect API changes
+ * - Namespace type for `import * as ns` member access
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "Scope.h"
+#include "Symbol.h"
+#include "TypeSystem.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace lang {
+namespace semantic {
+
+// ============================================================================
+// Export Entry
+// ============================================================================
+
+/**
+ * @brief Kind of an exported declaration
+ */
+enum class ExportKind : uint8_t {
+  Function,
+  Class,
+  Variable,
+  Constant,
+};
+
+/**
+ * @brief One exported declaration
+ */
+struct ExportEntry {
+  std::string name;
+  ExportKind kind = ExportKind::Variable;
+  types::TypeRef type; ///< Owned by the signature's TypeContext
+  ast::SourceLoc loc;  ///< Definition location in the module
+};
+
+// ============================================================================
+// Module Signature
+// ============================================================================
+
+/**
+ * @brief Exported-signature table of one module text
+ *
+ * Usage:
+ *   auto sig = ModuleSignature::build(uri, contentHash, model.symbolTable().globalScope());
+ *
+ *   if (auto* entry = sig->find("Rectangle"))
+ *     importSymbol->setType(entry->type);
+ */
+class ModuleSignature {
+public:
+  ModuleSignature(std::string uri, uint64_t contentHash)
+      : uri_(std::move(uri)), contentHash_(contentHash) {}
+
+  // Non-copyable (TypeRefs point into types_)
+  ModuleSignature(const ModuleSignature &) = delete;
+  ModuleSignature &operator=(const ModuleSignature &) = delete;
+
+  /**
+   * @brief Build the signature from a module's analyzed global scope
+   * @param uri Module URI
+   * @param contentHash Hash of the module text the scope was analyzed from
+   */
+  [[nodiscard]] static std::shared_ptr<const ModuleSignature> build(std::string uri,
+                                                                    uint64_t contentHash,
+                                                                    const Scope *globalScope) {
+    auto sig = std::make_shared<ModuleSignature>(std::move(uri), contentHash);
+    if (globalScope) {
+      for (Symbol *sym : globalScope->symbols()) {
+        if (sym->isExport()) {
+          sig->addExport(sym);
+        }
+      }
+    }
+    sig->buildNamespaceType();
+    sig->computeFingerprint();
+    return sig;
+  }
+
+  // ========================================================================
+  // Accessors
+  // ========================================================================
+
+  [[nodiscard]] const std::string &uri() const noexcept { return uri_; }
+
+  /// Hash of the module text the signature was built from
+  [[nodiscard]] uint64_t contentHash() const noexcept { return contentHash_; }
+
+  [[nodiscard]] const std::vector<ExportEntry> &exports() const noexcept { return exports_; }
+
+  /**
+   * @brief Find an exported declaration by name
+   */
+  [[nodiscard]] const ExportEntry *find(std::string_view name) const {
+    auto it = index_.find(std::string(name));
+    return it != index_.end() ? &exports_[it->second] : nullptr;
+  }
+
+  /**
+   * @brief Class type whose members are the module's exports (for `import * as ns`)
+   */
+  [[nodiscard]] types::TypeRef namespaceType() const noexcept { return namespaceType_; }
+
+  /**
+   * @brief Hash of exported names and types; equal fingerprints mean importers
+   *        need not be re-analyzed
+   */
+  [[nodiscard]] uint64_t fingerprint() const noexcept { return fingerprint_; }
+
+private:
+  void addExport(const Symbol *sym) {
+    ExportEntry entry;
+    entry.name = sym->name();
+    entry.loc = sym->definitionLoc();
+    entry.type = cloneType(sym->type());
+
+    if (sym->isFunction()) {
+      entry.kind = ExportKind::Function;
+    } else if (sym->isClass()) {
+      entry.kind = ExportKind::Class;
+    } else if (sym->isConst()) {
+      entry.kind = ExportKind::Constant;
+    } else {
+      entry.kind = ExportKind::Variable;
+    }
+
+    if (index_.count(entry.name))
+      return;
+    index_[entry.name] = exports_.size();
+    exports_.push_back(std::move(entry));
+  }
+
+  /**
+   * @brief Deep-copy a type into this signature's TypeContext
+   */
+  types::TypeRef cloneType(types::TypeRef type) {
+    if (!type)
+      return types_.unknownType();
+
+    switch (type->kind()) {
+    case types::TypeKind::Error:
+      return types_.errorType();
+    case types::TypeKind::Unknown:
+      return types_.unknownType();
+    case types::TypeKind::Void:
+      return types_.voidType();
+    case types::TypeKind::Null:
+      return types_.nullType();
+    case types::TypeKind::Any:
+      return types_.anyType();
+    case types::TypeKind::Bool:
+      return types_.boolType();
+    case types::TypeKind::Int:
+      return types_.intType();
+    case types::TypeKind::Float:
+      return types_.floatType();
+    case types::TypeKind::Number:
+      return types_.numberType();
+    case types::TypeKind::String:
+      return types_.stringType();
+    case types::TypeKind::Fiber:
+      return types_.fiberType();
+
+    case types::TypeKind::List: {
+      auto *lt = static_cast<const types::ListType *>(type.get());
+      return types_.makeListType(cloneType(lt->elementType()));
+    }
+    case types::TypeKind::Map: {
+      auto *mt = static_cast<const types::MapType *>(type.get());
+      return types_.makeMapType(cloneType(mt->keyType()), cloneType(mt->valueType()));
+    }
+    case types::TypeKind::Function: {
+      auto *ft = static_cast<const types::FunctionType *>(type.get());
+      std::vector<types::TypeRef> params;
+      params.reserve(ft->paramTypes().size());
+      for (const auto &p : ft->paramTypes())
+        params.push_back(cloneType(p));
+      return types_.makeFunctionType(std::move(params), cloneType(ft->returnType()),
+                                     ft->isVariadic());
+    }
+    case types::TypeKind::Tuple: {
+      auto *tt = static_cast<const types::TupleType *>(type.get());
+      std::vector<types::TypeRef> elements;
+      elements.reserve(tt->elementTypes().size());
+      for (const auto &e : tt->elementTypes())
+        elements.push_back(cloneType(e));
+      return types_.makeTupleType(std::move(elements));
+    }
+    case types::TypeKind::Class: {
+      auto *src = static_cast<const types::ClassType *>(type.get());
+      auto *dst = types_.getOrCreateClassType(src->name());
+      // 先登记再复制成员，防止自引用类无限递归
+      if (clonedClasses_.insert(src->name()).second) {
+        for (const auto &f : src->fields())
+          dst->addField({f.name, cloneType(f.type), f.isStatic, f.isConst});
+        for (const auto &m : src->methods())
+          dst->addMethod({m.name, cloneType(m.type), m.isStatic});
+      }
+      return types::TypeRef(dst);
+    }
+    default:
+      return types_.unknownType();
+    }
+  }
+
+  void buildNamespaceType() {
+    auto *ns = types_.getOrCreateClassType("module " + uri_);
+    for (const auto &e : exports_) {
+      if (e.kind == ExportKind::Function) {
+        ns->addMethod({e.name, e.type, true});
+      } else {
+        ns->addField({e.name, e.type, true, e.kind == ExportKind::Constant});
+      }
+    }
+    namespaceType_ = types::TypeRef(ns);
+  }
+
+  static void hashCombine(uint64_t &seed, size_t value) noexcept {
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+  }
+
+  void hashType(uint64_t &seed, types::TypeRef type) const {
+    if (!type)
+      return;
+    hashCombine(seed, std::hash<std::string>{}(type->toString()));
+    if (type->isClass()) {
+      // toString() of a class is only its name; include the member surface
+      auto *ct = static_cast<const types::ClassType *>(type.get());
+      for (const auto &f : ct->fields()) {
+        hashCombine(seed, std::hash<std::string>{}(f.name));
+        hashCombine(seed, std::hash<std::string>{}(f.type ? f.type->toString() : ""));
+      }
+      for (const auto &m : ct->methods()) {
+        hashCombine(seed, std::hash<std::string>{}(m.name));
+        hashCombine(seed, std::hash<std::string>{}(m.type ? m.type->toString() : ""));
+      }
+    }
+  }
+
+  void computeFingerprint() {
+    uint64_t seed = exports_.size();
+    for (const auto &e : exports_) {
+      hashCombine(seed, std::hash<std::string>{}(e.name));
+      hashCombine(seed, static_cast<size_t>(e.kind));
+      hashType(seed, e.type);
+    }
+    fingerprint_ = seed;
+  }
+
+  std::string uri_;
+  uint64_t contentHash_;
+  types::TypeContext types_;
+  std::vector<ExportEntry> exports_;
+  std::unordered_map<std::string, size_t> index_;
+  std::unordered_set<std::string> clonedClasses_;
+  types::TypeRef namespaceType_;
+  uint64_t fingerprint_ = 0;
+};
+
+/**
+ * @brief Resolves an import's module path to the imported module's signature
+ * @return nullptr if the module cannot be found or analyzed
+ */
+using ModuleResolver =
+    std::function<std::shared_ptr<const ModuleSignature>(std::string_view modulePath)>;
+
+// ============================================================================
+// Module Signature Cache
+// ============================================================================
+
+/**
+ * @brief Signatures keyed by module URI, valid for one module text
+ *
+ * Thread-safe.
+ */
+class ModuleSignatureCache {
+public:
+  /**
+   * @brief Get the cached signature if it was built from the same module text
+   */
+  [[nodiscard]] std::shared_ptr<const ModuleSignature> find(const std::string &uri,
+                                                            uint64_t contentHash) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = signatures_.find(uri);
+    if (it == signatures_.end() || it->second->contentHash() != contentHash)
+      return nullptr;
+    return it->second;
+  }
+
+  void store(std::shared_ptr<const ModuleSignature> signature) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    signatures_[signature->uri()] = std::move(signature);
+  }
+
+  void erase(const std::string &uri) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    signatures_.erase(uri);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    signatures_.clear();
+  }
+
+  [[nodiscard]] size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return signatures_.size();
+  }
+
+private:
+  std::unordered_map<std::string, std::shared_ptr<const ModuleSignature>> signatures_;
+  mutable std::mutex mutex_;
+};
+
+} // namespace semantic
+} // namespace lang
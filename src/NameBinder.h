@@ -0,0 +1,137 @@
+/**
+ * @file NameBinder.h
+ * @brief Per-Name Shadow Stacks for Single-Pass Name Binding
+ *
+ * Scope::resolve walks the parent chain and does a string-keyed hash lookup at
+ * every level, so a reference nested N scopes deep costs N hashes. NameBinder
+ * keeps, for every interned name, the stack of bindings currently in effect:
+ * entering a scope records a mark, defining a name pushes a binding that
+ * shadows the outer one, leaving the scope pops back to the mark. The binding
+ * a reference sees is always the top of its name's stack.
+ *
+ * Key Features:
+ * - O(1) lookup by InternedString id, no hashing or string construction
+ * - One flat entry vector doubles as the undo log; no per-name allocations
+ * - lookupLocal() for redefinition checks in the innermost scope
+ *
+ * Only valid during a single top-down traversal; completion and hover still go
+ * through the persistent Scope tree.
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "AstNodes.h"
+#include "Symbol.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace lang {
+namespace semantic {
+
+/**
+ * @brief Active bindings of every name during a scoped traversal
+ *
+ * T is whatever a binding points at: Symbol for the analyzer, the
+ * declaration node for passes that run without symbols.
+ *
+ * Usage:
+ *   NameBinder binder;
+ *   binder.enterScope();
+ *   binder.bind(node->name, symbol);
+ *   Symbol* sym = binder.lookup(ident->name);
+ *   binder.exitScope();
+ */
+template <typename T> class BasicNameBinder {
+public:
+  /**
+   * @brief Drop all bindings and scope marks
+   */
+  void clear() {
+    entries_.clear();
+    heads_.clear();
+    marks_.clear();
+  }
+
+  /**
+   * @brief Open a scope; bindings made from now on are popped by exitScope()
+   */
+  void enterScope() { marks_.push_back(static_cast<uint32_t>(entries_.size())); }
+
+  /**
+   * @brief Close the innermost scope, restoring the bindings it shadowed
+   */
+  void exitScope() {
+    if (marks_.empty())
+      return;
+    uint32_t mark = marks_.back();
+    marks_.pop_back();
+    while (entries_.size() > mark) {
+      const Entry &e = entries_.back();
+      heads_[e.name] = e.shadowed;
+      entries_.pop_back();
+    }
+  }
+
+  /**
+   * @brief Bind a name in the innermost scope, shadowing outer bindings
+   */
+  void bind(ast::InternedString name, T *symbol) {
+    if (name.id >= heads_.size())
+      heads_.resize(static_cast<size_t>(name.id) + 1, NoEntry);
+    entries_.push_back({symbol, name.id, heads_[name.id]});
+    heads_[name.id] = static_cast<uint32_t>(entries_.size() - 1);
+  }
+
+  /**
+   * @brief The binding a reference to `name` sees, or nullptr
+   */
+  [[nodiscard]] T *lookup(ast::InternedString name) const noexcept {
+    uint32_t head = headOf(name);
+    return head != NoEntry ? entries_[head].symbol : nullptr;
+  }
+
+  /**
+   * @brief The binding of `name` made in the innermost scope, or nullptr
+   */
+  [[nodiscard]] T *lookupLocal(ast::InternedString name) const noexcept {
+    uint32_t head = headOf(name);
+    uint32_t mark = marks_.empty() ? 0 : marks_.back();
+    return head != NoEntry && head >= mark ? entries_[head].symbol : nullptr;
+  }
+
+  /**
+   * @brief Number of open scopes
+   */
+  [[nodiscard]] size_t depth() const noexcept { return marks_.size(); }
+
+  /**
+   * @brief Number of bindings currently in effect (including shadowed ones)
+   */
+  [[nodiscard]] size_t bindingCount() const noexcept { return entries_.size(); }
+
+private:
+  static constexpr uint32_t NoEntry = std::numeric_limits<uint32_t>::max();
+
+  struct Entry {
+    T *symbol;
+    uint32_t name;     ///< InternedString id
+    uint32_t shadowed; ///< Previous top of this name's stack (NoEntry if none)
+  };
+
+  [[nodiscard]] uint32_t headOf(ast::InternedString name) const noexcept {
+    return name.id < heads_.size() ? heads_[name.id] : NoEntry;
+  }
+
+  std::vector<Entry> entries_;  ///< All bindings in effect, in definition order
+  std::vector<uint32_t> heads_; ///< Name id -> index of its innermost binding
+  std::vector<uint32_t> marks_; ///< entries_ size at each enterScope()
+};
+
+using NameBinder = BasicNameBinder<Symbol>;
+
+} // namespace semantic
+} // namespace lang
@@ -0,0 +1,275 @@
+/**
+ * @file OutboundQueue.h
+ * @brief Prioritized, Coalescing Outbound Message Queue
+ *
+ * Writing every message synchronously to stdout lets a burst of background
+ * notifications (diagnostics for hundreds of files after a branch switch or
+ * fix-all) sit in front of the response the user is waiting for, and makes
+ * every producer pay for a slow client. OutboundQueue hands framed messages
+ * to a single writer thread instead.
+ *
+ * Key Features:
+ * - Responses are written before any pending notification
+ * - Keyed notifications coalesce: a newer one with the same key (e.g.
+ *   publishDiagnostics for one URI) replaces the pending one in place
+ * - Keyed notifications may carry a generation: one older than the last
+ *   accepted under its key is dropped, so a slow producer cannot overwrite
+ *   a newer message (e.g. the empty publish of a closed document)
+ * - Backpressure: producers other than the foreground (message loop) thread
+ *   block while the backlog is above the high-water mark, until it drains
+ *   below the low-water mark or a bounded wait expires
+ * - Batched writes: one sink call and flush per batch
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief Outbound JSON-RPC frames, written by one background thread
+ *
+ * Usage:
+ *   OutboundQueue out([](const std::string& bytes) { std::cout << bytes << std::flush; });
+ *   out.start();                                  // on the message loop thread
+ *   out.pushResponse(body);
+ *   out.pushNotification(body, "diagnostics:" + uri);
+ *   out.stop();                                   // drains everything queued
+ */
+class OutboundQueue {
+public:
+  /// Receives one or more complete frames; called only from the writer thread
+  using Sink = std::function<void(const std::string &)>;
+
+  struct Limits {
+    size_t highWaterBytes = 4u * 1024 * 1024; ///< Background producers block above this
+    size_t lowWaterBytes = 1u * 1024 * 1024;  ///< ...until the backlog drains below this
+    size_t maxBatchBytes = 256u * 1024;       ///< Notification bytes per write
+    std::chrono::milliseconds maxBlock{2000}; ///< Longest a producer is held back
+  };
+
+  struct Stats {
+    uint64_t responses = 0;
+    uint64_t notifications = 0;
+    uint64_t coalesced = 0; ///< Notifications replaced before being written
+    uint64_t superseded = 0; ///< Notifications dropped for an older generation
+    uint64_t throttled = 0; ///< Times a producer was held back
+    uint64_t batches = 0;
+    size_t peakBytes = 0; ///< Largest backlog seen
+  };
+
+  explicit OutboundQueue(Sink sink) : OutboundQueue(std::move(sink), Limits{}) {}
+
+  OutboundQueue(Sink sink, Limits limits) : sink_(std::move(sink)), limits_(limits) {}
+
+  ~OutboundQueue() { stop(); }
+
+  OutboundQueue(const OutboundQueue &) = delete;
+  OutboundQueue &operator=(const OutboundQueue &) = delete;
+
+  /**
+   * @brief Start the writer; the calling thread becomes the foreground thread
+   */
+  void start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (writer_.joinable())
+      return;
+    stopping_ = false;
+    foreground_ = std::this_thread::get_id();
+    writer_ = std::thread([this] { writerLoop(); });
+  }
+
+  /**
+   * @brief Write everything still queued, then stop the writer
+   */
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!writer_.joinable())
+        return;
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    drained_.notify_all();
+    writer_.join();
+  }
+
+  /**
+   * @brief Block until everything queued so far has been handed to the sink
+   */
+  void flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [this] { return !writer_.joinable() || (idle() && !writing_); });
+  }
+
+  /**
+   * @brief Queue a response (or error response); never coalesced or throttled
+   */
+  void pushResponse(const std::string &body) {
+    std::string frame = makeFrame(body);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!writer_.joinable())
+        return sink_(frame);
+      pendingBytes_ += frame.size();
+      stats_.peakBytes = std::max(stats_.peakBytes, pendingBytes_);
+      responses_.push_back(std::move(frame));
+      ++stats_.responses;
+    }
+    ready_.notify_one();
+  }
+
+  /**
+   * @brief Queue a notification
+   * @param key Notifications with the same non-empty key coalesce (last one wins)
+   * @param generation With a key: dropped if older than the last accepted under that key;
+   *        0 means untagged
+   */
+  void pushNotification(const std::string &body, const std::string &key = {},
+                        uint64_t generation = 0) {
+    std::string frame = makeFrame(body);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!key.empty() && superseded(key, generation))
+        return;
+      if (!writer_.joinable())
+        return sink_(frame);
+
+      if (!key.empty() && replacePending(key, frame))
+        return;
+
+      if (std::this_thread::get_id() != foreground_ && pendingBytes_ > limits_.highWaterBytes) {
+        ++stats_.throttled;
+        drained_.wait_for(lock, limits_.maxBlock, [this] {
+          return stopping_ || pendingBytes_ <= limits_.lowWaterBytes;
+        });
+        if (!key.empty() && (superseded(key, generation) || replacePending(key, frame)))
+          return;
+      }
+
+      pendingBytes_ += frame.size();
+      stats_.peakBytes = std::max(stats_.peakBytes, pendingBytes_);
+      notifications_.push_back({std::move(frame), key});
+      if (!key.empty())
+        byKey_[key] = &notifications_.back();
+      ++stats_.notifications;
+    }
+    ready_.notify_one();
+  }
+
+  [[nodiscard]] Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  [[nodiscard]] size_t pendingBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pendingBytes_;
+  }
+
+private:
+  struct Pending {
+    std::string frame;
+    std::string key;
+  };
+
+  static std::string makeFrame(const std::string &body) {
+    std::string frame = "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    frame += body;
+    return frame;
+  }
+
+  [[nodiscard]] bool idle() const noexcept { return responses_.empty() && notifications_.empty(); }
+
+  /// Check a tagged notification against its key's last generation, recording it if newer
+  bool superseded(const std::string &key, uint64_t generation) {
+    if (generation == 0)
+      return false;
+    uint64_t &last = generations_[key];
+    if (generation < last) {
+      ++stats_.superseded;
+      return true;
+    }
+    last = generation;
+    return false;
+  }
+
+  /// Replace a pending notification with the same key, keeping its place in line
+  bool replacePending(const std::string &key, std::string &frame) {
+    auto it = byKey_.find(key);
+    if (it == byKey_.end())
+      return false;
+    pendingBytes_ = pendingBytes_ - it->second->frame.size() + frame.size();
+    it->second->frame = std::move(frame);
+    ++stats_.coalesced;
+    return true;
+  }
+
+  void writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::string batch;
+    for (;;) {
+      ready_.wait(lock, [this] { return stopping_ || !idle(); });
+      if (idle())
+        break; // stopping and drained
+
+      // All responses first, then notifications up to the batch budget
+      batch.clear();
+      while (!responses_.empty()) {
+        batch += responses_.front();
+        responses_.pop_front();
+      }
+      while (!notifications_.empty() && batch.size() < limits_.maxBatchBytes) {
+        Pending &next = notifications_.front();
+        if (!next.key.empty())
+          byKey_.erase(next.key);
+        batch += next.frame;
+        notifications_.pop_front();
+      }
+      pendingBytes_ -= std::min(pendingBytes_, batch.size());
+      ++stats_.batches;
+
+      writing_ = true;
+      lock.unlock();
+      drained_.notify_all();
+      sink_(batch);
+      lock.lock();
+      writing_ = false;
+      drained_.notify_all();
+    }
+  }
+
+  Sink sink_;
+  Limits limits_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;   ///< Work for the writer
+  std::condition_variable drained_; ///< Backlog shrank
+  std::deque<std::string> responses_;
+  std::deque<Pending> notifications_; ///< Stable addresses: only push_back/pop_front
+  std::unordered_map<std::string, Pending *> byKey_;
+  std::unordered_map<std::string, uint64_t> generations_; ///< Last accepted, by key
+  size_t pendingBytes_ = 0;
+  bool writing_ = false;
+  bool stopping_ = false;
+  Stats stats_;
+
+  std::thread writer_;
+  std::thread::id foreground_;
+};
+
+} // namespace lsp
+} // namespace lang
@@ -0,0 +1,182 @@
+/**
+ * @file ParserWarmup.h
+ * @brief Background ATN Initialization and DFA Warm-up
+ *
+ * The generated LangLexer/LangParser deserialize their ATN on first use and
+ * start with empty DFA caches, so the first document the client opens pays for
+ * ATN construction plus a full ATN-simulation parse. The server spends its
+ * first milliseconds waiting for the client's `initialize` request anyway;
+ * ParserWarmup does that work on a background thread during that wait.
+ *
+ * Key Features:
+ * - Deserializes both ATNs (shared, process-wide static data)
+ * - Parses a built-in sample covering the common grammar paths to seed the
+ *   shared lexer/parser DFA caches
+ * - Never blocks a request: parsing on the main thread may run concurrently
+ *   (ANTLR's static data initialization and DFA caches are thread-safe)
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "LangLexer.h"
+#include "LangParser.h"
+#include "LspLogger.h"
+#include "Utf8CharStream.h"
+#include "antlr4-runtime.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief Warms the ANTLR static data on a background thread
+ *
+ * Usage:
+ *   ParserWarmup warmup;
+ *   warmup.start();      // before entering the message loop
+ *   ...
+ *   warmup.wait();       // optional, the destructor joins as well
+ */
+class ParserWarmup {
+public:
+  /**
+   * @brief Timings of the last warm-up run
+   */
+  struct Stats {
+    uint64_t atnMicros = 0;    ///< LangLexer/LangParser::initialize()
+    uint64_t sampleMicros = 0; ///< Lexing and parsing the sample
+    bool done = false;
+  };
+
+  ParserWarmup() = default;
+
+  ParserWarmup(const ParserWarmup &) = delete;
+  ParserWarmup &operator=(const ParserWarmup &) = delete;
+
+  ~ParserWarmup() { wait(); }
+
+  /**
+   * @brief Start the warm-up thread (no-op if already started)
+   */
+  void start() {
+    if (thread_.joinable())
+      return;
+    thread_ = std::thread([this] { run(); });
+  }
+
+  /**
+   * @brief Wait for the warm-up to finish
+   */
+  void wait() {
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  [[nodiscard]] Stats stats() const {
+    Stats s;
+    s.done = done_.load(std::memory_order_acquire);
+    if (s.done) {
+      s.atnMicros = atnMicros_;
+      s.sampleMicros = sampleMicros_;
+    }
+    return s;
+  }
+
+  /**
+   * @brief Source parsed to seed the DFA caches
+   *
+   * Must stay free of syntax errors so it exercises the prediction paths real
+   * code takes rather than error recovery.
+   */
+  [[nodiscard]] static std::string_view sampleSource() noexcept {
+    return R"(import { Shape, type Point as P } from "shapes";
+import * as util from "util";
+
+/* block comment */
+export class Vec {
+  static const int dims = 2;
+  float x = 0.0;
+  float y;
+  list<float> history;
+  map<string, any> tags;
+
+  float length() { return x * x + y * y; }
+  static Vec zero() { return new Vec(); }
+  mutivar split() { return x, y; }
+}
+
+export const int LIMIT = 100;
+global auto names = ["x", "y", "z"];
+map<string, int> counts = { "a": 1, b: 2, [3]: 3 };
+
+int total(list<int> xs, ...) {
+  int sum = 0;
+  for (int i = 0; i < #xs; i += 1) {
+    sum = sum + xs[i] * 2 - 1;
+  }
+  for (int k, int v : counts) {
+    sum += v % 3;
+  }
+  while (sum > LIMIT && !(sum == 0) || sum <= -1) {
+    sum = sum >> 1;
+    if (sum != 3) { break; } else if (sum >= 2) { continue; } else { sum = ~sum | 1 & 2 ^ 4; }
+  }
+  defer { print("done" .. sum); }
+  function f = function(int a) -> int { return a << 2; };
+  Vec v = new Vec();
+  v.x = v.length() / 2.5;
+  mutivar a, b = v.split();
+  util:call(f, names[0], true, false, null);
+  return sum;
+}
+)";
+  }
+
+private:
+  void run() {
+    using Clock = std::chrono::steady_clock;
+    auto micros = [](Clock::time_point from) {
+      return static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - from).count());
+    };
+
+    try {
+      auto t0 = Clock::now();
+      LangLexer::initialize();
+      LangParser::initialize();
+      atnMicros_ = micros(t0);
+
+      auto t1 = Clock::now();
+      Utf8CharStream input(sampleSource(), "<warmup>");
+      LangLexer lexer(&input);
+      lexer.removeErrorListeners();
+      antlr4::CommonTokenStream tokens(&lexer);
+      LangParser parser(&tokens);
+      parser.removeErrorListeners();
+      parser.compilationUnit();
+      sampleMicros_ = micros(t1);
+
+      LSP_LOG("Parser warm-up: ATN " << atnMicros_ << " us, sample parse " << sampleMicros_
+                                     << " us, syntax errors "
+                                     << parser.getNumberOfSyntaxErrors());
+    } catch (const std::exception &e) {
+      LSP_LOG("Parser warm-up failed: " << e.what());
+    }
+    done_.store(true, std::memory_order_release);
+  }
+
+  std::thread thread_;
+  std::atomic<bool> done_{false};
+  uint64_t atnMicros_ = 0;
+  uint64_t sampleMicros_ = 0;
+};
+
+} // namespace lsp
+} // namespace lang
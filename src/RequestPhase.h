@@ -0,0 +1,81 @@
+/**
+ * @file RequestPhase.h
+ * @brief What the Thread Handling a Request Is Doing Right Now
+ *
+ * When a request is slow, the first question is whether it is stuck parsing,
+ * analyzing or in the feature itself. The message loop binds the in-flight
+ * request's phase slot to its thread; parsing and analysis mark themselves
+ * with PhaseScope, and the request watchdog reads the slot from its own thread.
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace lang {
+namespace lsp {
+
+enum class RequestPhase : uint8_t {
+  Idle,    ///< No request on the thread
+  Feature, ///< The request handler itself
+  Parse,   ///< SourceFile::reparse()
+  Analyze, ///< Semantic analysis and lint
+};
+
+[[nodiscard]] inline const char *phaseName(RequestPhase phase) noexcept {
+  switch (phase) {
+  case RequestPhase::Idle:
+    return "idle";
+  case RequestPhase::Feature:
+    return "feature";
+  case RequestPhase::Parse:
+    return "parse";
+  case RequestPhase::Analyze:
+    return "analyze";
+  }
+  return "unknown";
+}
+
+/**
+ * @brief Marks the calling thread's current request as being in a phase until destroyed
+ *
+ * Nestable (a parse inside analysis restores "analyze" when it ends). A no-op
+ * on threads without a bound request, e.g. background workers.
+ *
+ * Usage:
+ *   PhaseScope::bind(&inFlight.phase);   // message loop, per request
+ *   { PhaseScope phase(RequestPhase::Parse); reparse(); }
+ *   PhaseScope::bind(nullptr);
+ */
+class PhaseScope {
+public:
+  using Slot = std::atomic<RequestPhase>;
+
+  explicit PhaseScope(RequestPhase phase) noexcept : slot_(current_) {
+    if (slot_)
+      previous_ = slot_->exchange(phase, std::memory_order_relaxed);
+  }
+
+  ~PhaseScope() {
+    if (slot_)
+      slot_->store(previous_, std::memory_order_relaxed);
+  }
+
+  PhaseScope(const PhaseScope &) = delete;
+  PhaseScope &operator=(const PhaseScope &) = delete;
+
+  /// Direct the calling thread's phases to slot (nullptr: stop reporting)
+  static void bind(Slot *slot) noexcept { current_ = slot; }
+
+private:
+  Slot *slot_;
+  RequestPhase previous_ = RequestPhase::Idle;
+
+  inline static thread_local Slot *current_ = nullptr;
+};
+
+} // namespace lsp
+} // namespace lang
@@ -0,0 +1,615 @@
+/**
+ * @file RequestWatchdog.h
+ * @brief Slow-Request Watchdog with Incident Reports
+ *
+ * A hover or didChange that occasionally takes seconds is rarely reproducible
+ * by the time it is reported. RequestWatchdog watches the request the message
+ * loop is handling from its own thread; when it outlives its method's
+ * threshold, the watchdog captures what the loop thread is doing and writes a
+ * compact JSON incident report that can be replayed against a fresh server.
+ *
+ * Key Features:
+ * - Per-method thresholds (hover 500 ms, references 5 s, ...) with a default
+ * - Captured on the first overrun: method, id, parameters (long strings
+ *   elided), the document's version and size, the active phase (parse,
+ *   analyze, feature) and a stack sample of the stuck thread
+ * - MessageHistory keeps a replayable log of inbound traffic: initialize, a
+ *   didOpen per open document compacted to its current text plus later
+ *   changes, and a bounded ring of other recent messages
+ * - The report is rewritten with the total duration once the request ends
+ * - At most Config::maxReports reports per process
+ *
+ * Off by default (enable with --watchdog): the history serializes every
+ * didOpen and full-text didChange, and reports carry the full text of the
+ * open documents. Reports are written to Config::directory, by default
+ * <temp>/lang-lsp-incidents (--incident-dir), as
+ * incident-<time>-<pid>-<n>.json.
+ *
+ * Replay: frame each element of "history" as an LSP message and pipe the
+ * sequence into `lang-lsp` started in the same workspace.
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "RequestPhase.h"
+#include "SamplingProfiler.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace lang {
+namespace lsp {
+
+// ============================================================================
+// Message History
+// ============================================================================
+
+/**
+ * @brief Replayable log of inbound messages (message loop thread records, any thread reads)
+ *
+ * Document sync traffic is kept per document and compacted: a full-text
+ * didChange, or a log grown past Limits::documentMessages, restarts the
+ * document's log with a synthetic didOpen of its current text. Everything
+ * else goes to a ring bounded by count and bytes.
+ */
+class MessageHistory {
+public:
+  using json = nlohmann::json;
+
+  struct Limits {
+    size_t recentMessages = 64;
+    size_t recentBytes = 1 << 20;
+    size_t documentMessages = 64; ///< Per document, before compacting
+    size_t documentBytes = 64 << 20; ///< All documents; the least recently touched go first
+  };
+
+  /// Current text of an open document, for compaction (called on the recording thread)
+  using TextSource = std::function<std::optional<std::string>(const std::string &uri)>;
+
+  MessageHistory() = default;
+  explicit MessageHistory(Limits limits) : limits_(limits) {}
+
+  void setTextSource(TextSource source) { textSource_ = std::move(source); }
+
+  /**
+   * @brief Record a message before it is dispatched (it is not modified)
+   */
+  void record(const json &msg) {
+    std::string method = msg.value("method", "");
+    if (method.empty() || method.rfind("$/", 0) == 0)
+      return;
+    const json *params = msg.contains("params") ? &msg["params"] : nullptr;
+    std::string uri;
+    if (params && params->is_object() && params->contains("textDocument") &&
+        (*params)["textDocument"].is_object())
+      uri = (*params)["textDocument"].value("uri", "");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t seq = ++seq_;
+    if (method == "initialize") {
+      initialize_ = {seq, msg.dump()};
+    } else if (method == "initialized") {
+      initialized_ = {seq, msg.dump()};
+    } else if (method == "textDocument/didOpen" && !uri.empty()) {
+      DocumentLog &log = documents_[uri];
+      log.languageId = (*params)["textDocument"].value("languageId", "lang");
+      log.version = (*params)["textDocument"].value("version", int64_t(0));
+      resetDocument(log, {{seq, msg.dump()}});
+      log.touched = seq;
+    } else if (method == "textDocument/didChange" && !uri.empty()) {
+      recordChange(uri, *params, msg, seq);
+    } else if (method == "textDocument/didClose" && !uri.empty()) {
+      auto it = documents_.find(uri);
+      if (it != documents_.end()) {
+        documentBytes_ -= it->second.bytes;
+        documents_.erase(it);
+      }
+    } else {
+      recent_.push_back({seq, msg.dump()});
+      recentBytes_ += recent_.back().text.size();
+      while (!recent_.empty() && (recent_.size() > limits_.recentMessages ||
+                                  recentBytes_ > limits_.recentBytes)) {
+        recentBytes_ -= recent_.front().text.size();
+        recent_.pop_front();
+        ++dropped_;
+      }
+    }
+    trimDocuments();
+  }
+
+  /**
+   * @brief Latest version the client gave an open document
+   */
+  [[nodiscard]] std::optional<int64_t> version(const std::string &uri) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = documents_.find(uri);
+    if (it == documents_.end())
+      return std::nullopt;
+    return it->second.version;
+  }
+
+  /**
+   * @brief The retained messages in arrival order
+   * @param dropped Set to how many recorded messages were let go (other than by compaction)
+   */
+  [[nodiscard]] json replay(uint64_t *dropped = nullptr) const {
+    std::vector<const Entry *> entries;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!initialize_.text.empty())
+      entries.push_back(&initialize_);
+    if (!initialized_.text.empty())
+      entries.push_back(&initialized_);
+    for (const auto &[uri, log] : documents_) {
+      for (const auto &entry : log.messages)
+        entries.push_back(&entry);
+    }
+    for (const auto &entry : recent_)
+      entries.push_back(&entry);
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry *a, const Entry *b) { return a->seq < b->seq; });
+
+    json messages = json::array();
+    for (const Entry *entry : entries)
+      messages.push_back(json::parse(entry->text, nullptr, false));
+    if (dropped)
+      *dropped = dropped_;
+    return messages;
+  }
+
+private:
+  struct Entry {
+    uint64_t seq = 0;
+    std::string text; ///< Compact JSON
+  };
+
+  struct DocumentLog {
+    std::string languageId;
+    int64_t version = 0;
+    std::vector<Entry> messages; ///< didOpen, then changes
+    size_t bytes = 0;
+    uint64_t touched = 0;
+  };
+
+  void recordChange(const std::string &uri, const json &params, const json &msg,
+                    uint64_t seq) {
+    auto it = documents_.find(uri);
+    if (it == documents_.end())
+      return; // Opened before recording began; nothing to replay it onto
+    DocumentLog &log = it->second;
+    log.touched = seq;
+    int64_t previous = log.version;
+    log.version = params["textDocument"].value("version", previous + 1);
+
+    // Ending with a change without a range replaces the text: it alone is the document now
+    const json &changes = params.value("contentChanges", json::array());
+    if (changes.is_array() && !changes.empty()) {
+      const json &last = changes.back();
+      if (last.is_object() && !last.contains("range") && last.contains("text") &&
+          last["text"].is_string()) {
+        resetDocument(log, {{seq, didOpen(uri, log.languageId, log.version,
+                                          last["text"].get<std::string>())}});
+        return;
+      }
+    }
+
+    if (log.messages.size() >= limits_.documentMessages && textSource_) {
+      // Recorded before dispatch: the source still has the text this change applies to
+      if (auto text = textSource_(uri)) {
+        resetDocument(log, {{seq, didOpen(uri, log.languageId, previous, *text)}});
+        seq = ++seq_;
+      }
+    }
+    log.messages.push_back({seq, msg.dump()});
+    log.bytes += log.messages.back().text.size();
+    documentBytes_ += log.messages.back().text.size();
+  }
+
+  void resetDocument(DocumentLog &log, std::vector<Entry> messages) {
+    documentBytes_ -= log.bytes;
+    log.bytes = 0;
+    for (const auto &entry : messages)
+      log.bytes += entry.text.size();
+    documentBytes_ += log.bytes;
+    log.messages = std::move(messages);
+  }
+
+  void trimDocuments() {
+    while (documentBytes_ > limits_.documentBytes && documents_.size() > 1) {
+      auto oldest = std::min_element(
+          documents_.begin(), documents_.end(),
+          [](const auto &a, const auto &b) { return a.second.touched < b.second.touched; });
+      documentBytes_ -= oldest->second.bytes;
+      dropped_ += oldest->second.messages.size();
+      documents_.erase(oldest);
+    }
+  }
+
+  static std::string didOpen(const std::string &uri, const std::string &languageId,
+                             int64_t version, const std::string &text) {
+    json document = {
+        {"uri", uri}, {"languageId", languageId}, {"version", version}, {"text", text}};
+    json msg = {{"jsonrpc", "2.0"},
+                {"method", "textDocument/didOpen"},
+                {"params", {{"textDocument", std::move(document)}}}};
+    return msg.dump();
+  }
+
+  Limits limits_;
+  TextSource textSource_;
+  mutable std::mutex mutex_;
+  uint64_t seq_ = 0;
+  Entry initialize_;
+  Entry initialized_;
+  std::map<std::string, DocumentLog> documents_; ///< By URI
+  size_t documentBytes_ = 0;
+  std::deque<Entry> recent_;
+  size_t recentBytes_ = 0;
+  uint64_t dropped_ = 0;
+};
+
+// ============================================================================
+// Request Watchdog
+// ============================================================================
+
+/**
+ * @brief Watches the message loop's in-flight request and reports overruns
+ *
+ * Usage:
+ *   watchdog.start();
+ *   watchdog.history().record(msg);                    // every inbound message
+ *   {
+ *     auto watch = watchdog.watch(method, id, params, document);
+ *     dispatch(method, params);                        // phases reported via PhaseScope
+ *   }
+ *   watchdog.stop();
+ */
+class RequestWatchdog {
+public:
+  using json = nlohmann::json;
+  using Clock = std::chrono::steady_clock;
+
+  struct Config {
+    bool enabled = false;  ///< Opt-in: recording copies document text into the history
+    std::string directory; ///< Incident reports; empty = <temp>/lang-lsp-incidents
+    std::chrono::milliseconds defaultThreshold{2000};
+    std::unordered_map<std::string, std::chrono::milliseconds> thresholds = defaultThresholds();
+    size_t maxReports = 20; ///< Per process
+    std::chrono::milliseconds stackTimeout{250};
+  };
+
+  /// The document a request is about, as of dispatch
+  struct Document {
+    std::string uri;
+    int64_t version = -1;
+    size_t size = 0;
+  };
+
+  /// Called on the watchdog thread after a report is written
+  using IncidentHandler = std::function<void(const std::string &method,
+                                             std::chrono::milliseconds elapsed,
+                                             RequestPhase phase, const std::string &path)>;
+
+  [[nodiscard]] static std::unordered_map<std::string, std::chrono::milliseconds>
+  defaultThresholds() {
+    using ms = std::chrono::milliseconds;
+    return {{"textDocument/hover", ms(500)},
+            {"textDocument/signatureHelp", ms(500)},
+            {"textDocument/documentHighlight", ms(500)},
+            {"textDocument/completion", ms(1000)},
+            {"textDocument/definition", ms(1000)},
+            {"textDocument/declaration", ms(1000)},
+            {"textDocument/typeDefinition", ms(1000)},
+            {"textDocument/didChange", ms(1000)},
+            {"textDocument/codeAction", ms(1000)},
+            {"textDocument/documentSymbol", ms(1000)},
+            {"textDocument/semanticTokens/full", ms(1000)},
+            {"textDocument/prepareRename", ms(1000)},
+            {"textDocument/didOpen", ms(2000)},
+            {"textDocument/formatting", ms(2000)},
+            {"textDocument/rangeFormatting", ms(2000)},
+            {"textDocument/references", ms(5000)},
+            {"textDocument/rename", ms(5000)},
+            {"workspace/symbol", ms(5000)},
+            {"workspace/willRenameFiles", ms(5000)},
+            {"initialize", ms(10000)}};
+  }
+
+  /**
+   * @brief Ends the watch when destroyed (message loop thread)
+   */
+  class Watch {
+  public:
+    Watch() = default;
+    explicit Watch(RequestWatchdog *owner) : owner_(owner) {}
+    Watch(Watch &&other) noexcept : owner_(std::exchange(other.owner_, nullptr)) {}
+    Watch &operator=(Watch &&) = delete;
+    ~Watch() {
+      if (owner_)
+        owner_->finish();
+    }
+
+  private:
+    RequestWatchdog *owner_ = nullptr;
+  };
+
+  RequestWatchdog() = default;
+  explicit RequestWatchdog(Config config) : config_(std::move(config)) {}
+
+  RequestWatchdog(const RequestWatchdog &) = delete;
+  RequestWatchdog &operator=(const RequestWatchdog &) = delete;
+
+  ~RequestWatchdog() { stop(); }
+
+  [[nodiscard]] bool enabled() const noexcept { return config_.enabled; }
+  [[nodiscard]] MessageHistory &history() noexcept { return history_; }
+
+  void onIncident(IncidentHandler handler) { onIncident_ = std::move(handler); }
+
+  void start() {
+    if (!config_.enabled || thread_.joinable())
+      return;
+    stopping_ = false;
+    thread_ = std::thread([this] { loop(); });
+  }
+
+  void stop() {
+    if (!thread_.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+  }
+
+  /**
+   * @brief Start watching the calling thread's request; ends with the returned Watch
+   */
+  [[nodiscard]] Watch watch(const std::string &method, const std::string &id, const json &params,
+                            Document document) {
+    if (!config_.enabled)
+      return {};
+    auto inFlight = std::make_shared<InFlight>();
+    inFlight->method = method;
+    inFlight->id = id;
+    inFlight->params = summarize(params, 0);
+    inFlight->document = std::move(document);
+    inFlight->tid = SamplingProfiler::currentThreadId();
+    inFlight->started = Clock::now();
+    inFlight->threshold = threshold(method);
+    PhaseScope::bind(&inFlight->phase);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      current_ = inFlight;
+    }
+    wake_.notify_all();
+    return Watch(this);
+  }
+
+  [[nodiscard]] std::chrono::milliseconds threshold(const std::string &method) const {
+    auto it = config_.thresholds.find(method);
+    return it != config_.thresholds.end() ? it->second : config_.defaultThreshold;
+  }
+
+  [[nodiscard]] std::string directory() const {
+    if (!config_.directory.empty())
+      return config_.directory;
+    std::error_code ec;
+    auto temp = std::filesystem::temp_directory_path(ec);
+    return ((ec ? std::filesystem::path("/tmp") : temp) / "lang-lsp-incidents").string();
+  }
+
+private:
+  struct InFlight {
+    std::string method;
+    std::string id;
+    json params;
+    Document document;
+    long tid = 0;
+    Clock::time_point started;
+    std::chrono::milliseconds threshold{0};
+    PhaseScope::Slot phase{RequestPhase::Feature};
+    bool captured = false;                       ///< Taken by the watchdog
+    std::optional<std::chrono::milliseconds> duration; ///< Set when the request ended
+    std::string path;                            ///< Report written
+    json report;
+  };
+
+  void finish() {
+    PhaseScope::bind(nullptr);
+    std::shared_ptr<InFlight> ended;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ended = std::move(current_);
+      if (!ended)
+        return;
+      ended->duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+          Clock::now() - ended->started);
+      if (ended->path.empty())
+        return; // Not reported, or the watchdog will add the duration itself
+    }
+    std::lock_guard<std::mutex> files(fileMutex_);
+    complete(*ended);
+  }
+
+  void loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+      if (!current_ || current_->captured) {
+        wake_.wait(lock);
+        continue;
+      }
+      auto due = current_->started + current_->threshold;
+      if (Clock::now() < due) {
+        wake_.wait_until(lock, due);
+        continue;
+      }
+      std::shared_ptr<InFlight> slow = current_;
+      slow->captured = true;
+      if (reports_ >= config_.maxReports)
+        continue;
+      ++reports_;
+      lock.unlock();
+      capture(*slow);
+      lock.lock();
+    }
+  }
+
+  /// On the watchdog thread; the request may end meanwhile
+  void capture(InFlight &slow) {
+    auto elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - slow.started);
+    RequestPhase phase = slow.phase.load(std::memory_order_relaxed);
+    std::vector<std::string> stack =
+        SamplingProfiler::instance().sampleThread(slow.tid, config_.stackTimeout);
+    uint64_t dropped = 0;
+    json history = history_.replay(&dropped);
+
+    json report = {{"server", {{"name", "lang-lsp"}, {"version", "1.0.0"}, {"pid", pid()}}},
+                   {"time", timestamp()},
+                   {"request", {{"method", slow.method}, {"id", slow.id}, {"params", slow.params}}},
+                   {"thresholdMs", slow.threshold.count()},
+                   {"elapsedMs", elapsed.count()},
+                   {"phase", phaseName(phase)},
+                   {"durationMs", nullptr},
+                   {"stack", stack}};
+    if (!slow.document.uri.empty())
+      report["document"] = {{"uri", slow.document.uri},
+                            {"version", slow.document.version},
+                            {"size", slow.document.size}};
+    report["historyDropped"] = dropped;
+    report["history"] = std::move(history);
+
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path dir = directory();
+    fs::create_directories(dir, ec);
+    fs::path path = dir / ("incident-" + timestamp(true) + "-" + std::to_string(pid()) + "-" +
+                           std::to_string(reports_) + ".json");
+    {
+      std::lock_guard<std::mutex> files(fileMutex_);
+      if (!write(path.string(), report))
+        return;
+    }
+
+    // Published under mutex_: exactly one of this thread and finish() sees both
+    // the path and the duration, and adds the duration to the file
+    bool ended = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slow.report = std::move(report);
+      slow.path = path.string();
+      ended = slow.duration.has_value();
+    }
+    if (ended) {
+      std::lock_guard<std::mutex> files(fileMutex_);
+      complete(slow);
+    }
+    if (onIncident_)
+      onIncident_(slow.method, elapsed, phase, slow.path);
+  }
+
+  /// Rewrite the report with the total duration (caller holds fileMutex_)
+  static void complete(InFlight &slow) {
+    slow.report["durationMs"] = slow.duration->count();
+    write(slow.path, slow.report);
+  }
+
+  static bool write(const std::string &path, const json &report) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << report.dump() << '\n';
+    return static_cast<bool>(out);
+  }
+
+  /// Parameters with long strings and arrays elided; the history has them in full
+  static json summarize(const json &value, int depth) {
+    constexpr size_t MaxString = 256;
+    constexpr size_t MaxItems = 32;
+    if (value.is_string()) {
+      const auto &text = value.get_ref<const std::string &>();
+      if (text.size() <= MaxString)
+        return value;
+      return "<" + std::to_string(text.size()) + " bytes>";
+    }
+    if (depth >= 8 && (value.is_object() || value.is_array()))
+      return "<...>";
+    if (value.is_object()) {
+      json out = json::object();
+      for (auto it = value.begin(); it != value.end(); ++it)
+        out[it.key()] = summarize(it.value(), depth + 1);
+      return out;
+    }
+    if (value.is_array()) {
+      json out = json::array();
+      for (size_t i = 0; i < value.size() && i < MaxItems; ++i)
+        out.push_back(summarize(value[i], depth + 1));
+      if (value.size() > MaxItems)
+        out.push_back("<" + std::to_string(value.size() - MaxItems) + " more>");
+      return out;
+    }
+    return value;
+  }
+
+  static long pid() {
+#if defined(__unix__) || defined(__APPLE__)
+    return static_cast<long>(getpid());
+#else
+    return 0;
+#endif
+  }
+
+  /// UTC, ISO 8601 (or compact, for file names)
+  static std::string timestamp(bool compact = false) {
+    std::time_t now = std::time(nullptr);
+    std::tm utc{};
+#if defined(_WIN32)
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), compact ? "%Y%m%d-%H%M%S" : "%Y-%m-%dT%H:%M:%SZ", &utc);
+    return buffer;
+  }
+
+  Config config_;
+  MessageHistory history_;
+  IncidentHandler onIncident_;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+  std::shared_ptr<InFlight> current_;
+  size_t reports_ = 0;
+  std::mutex fileMutex_; ///< Serializes report writes
+};
+
+} // namespace lsp
+} // namespace lang
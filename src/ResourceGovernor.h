@@ -0,0 +1,465 @@
+/**
+ * @file ResourceGovernor.h
+ * @brief CPU Governor for Non-Interactive Work
+ *
+ * Background work (speculative precomputation after edits, workspace-wide
+ * sweeps, bulk fixes) competes with the request the user is waiting for. On a
+ * loaded laptop an unconstrained background pass turns a 5 ms hover into a
+ * 200 ms one. ResourceGovernor decides when and how widely background work may
+ * run; interactive requests are never governed.
+ *
+ * Key Features:
+ * - Reserved capacity: background work gets at most a configurable share of
+ *   the hardware threads and always leaves one for the message loop; it is
+ *   admitted only while no interactive request is in flight
+ * - Low-priority background threads: SCHED_IDLE (idle-only mode) or nice 10
+ *   on Linux, THREAD_PRIORITY_IDLE / BELOW_NORMAL on Windows
+ * - Adaptive back-off (AIMD): slots halve when the interactive latency EWMA
+ *   exceeds its target, drop to zero while the system load average is above
+ *   the limit, and grow back by one per quiet evaluation
+ * - Bounded deferral: a paused task is admitted anyway after maxDefer, so
+ *   background results never starve completely
+ * - Every slot change is logged with its reason and visible via status()
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "LspLogger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <stdlib.h>
+#endif
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief Governor tuning (from the command line)
+ */
+struct GovernorConfig {
+  /// Fraction of hardware threads background work may use (at least one slot)
+  double backgroundCoreShare = 0.5;
+  /// Run background threads only when a core would otherwise be idle (SCHED_IDLE)
+  bool idleOnly = false;
+  /// Interactive latency (EWMA) above which background work backs off
+  std::chrono::milliseconds latencyTarget{50};
+  /// One-minute load average per core above which background work pauses
+  double loadPerCoreLimit = 1.0;
+  /// Longest a background task is held back before it is admitted anyway
+  std::chrono::milliseconds maxDefer{10000};
+  /// Minimum spacing between two slot re-evaluations
+  std::chrono::milliseconds evaluateInterval{500};
+};
+
+/**
+ * @brief Snapshot of the governor's state and decisions
+ */
+struct GovernorStatus {
+  unsigned hardwareThreads = 0;
+  unsigned maxSlots = 0;         ///< Upper bound from the configured core share
+  unsigned slots = 0;            ///< Current background width (0 = paused)
+  unsigned activeBackground = 0; ///< Background tickets held right now
+  unsigned interactiveInFlight = 0;
+  bool idleOnly = false;
+  double latencyEwmaMs = 0;
+  double loadPerCore = -1; ///< -1 when the platform has no load average
+  uint64_t interactiveRequests = 0;
+  uint64_t backgroundAdmitted = 0;
+  uint64_t backgroundDeferred = 0; ///< Admissions or checkpoints that had to wait
+  uint64_t backgroundForced = 0;   ///< Admitted after maxDefer despite back-off
+  uint64_t decisions = 0;          ///< Slot changes
+  std::string lastDecision;
+};
+
+/**
+ * @brief Admission control for background work
+ *
+ * Usage:
+ *   ResourceGovernor governor(config);
+ *
+ *   // Message loop: every request and notification
+ *   auto scope = governor.interactive();
+ *
+ *   // Background thread
+ *   ResourceGovernor::lowerCurrentThreadPriority(config.idleOnly);
+ *   auto ticket = governor.acquireBackground([&] { return cancelled(); });
+ *   if (!ticket) return;
+ *   for (auto& item : work) {
+ *     if (!governor.checkpoint([&] { return cancelled(); })) return;
+ *     process(item);
+ *   }
+ */
+class ResourceGovernor {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Marks one interactive request; records its latency when destroyed
+   */
+  class InteractiveScope {
+  public:
+    InteractiveScope(InteractiveScope &&other) noexcept
+        : governor_(std::exchange(other.governor_, nullptr)), start_(other.start_) {}
+    InteractiveScope(const InteractiveScope &) = delete;
+    InteractiveScope &operator=(const InteractiveScope &) = delete;
+    InteractiveScope &operator=(InteractiveScope &&) = delete;
+    ~InteractiveScope() {
+      if (governor_)
+        governor_->endInteractive(Clock::now() - start_);
+    }
+
+  private:
+    friend class ResourceGovernor;
+    InteractiveScope(ResourceGovernor *governor, Clock::time_point start)
+        : governor_(governor), start_(start) {}
+    ResourceGovernor *governor_;
+    Clock::time_point start_;
+  };
+
+  /**
+   * @brief One admitted background slot; empty when admission was cancelled
+   */
+  class BackgroundTicket {
+  public:
+    BackgroundTicket() = default;
+    BackgroundTicket(BackgroundTicket &&other) noexcept
+        : governor_(std::exchange(other.governor_, nullptr)) {}
+    BackgroundTicket &operator=(BackgroundTicket &&other) noexcept {
+      if (this != &other) {
+        release();
+        governor_ = std::exchange(other.governor_, nullptr);
+      }
+      return *this;
+    }
+    BackgroundTicket(const BackgroundTicket &) = delete;
+    BackgroundTicket &operator=(const BackgroundTicket &) = delete;
+    ~BackgroundTicket() { release(); }
+
+    explicit operator bool() const noexcept { return governor_ != nullptr; }
+
+    void release() {
+      if (governor_)
+        std::exchange(governor_, nullptr)->releaseBackground();
+    }
+
+  private:
+    friend class ResourceGovernor;
+    explicit BackgroundTicket(ResourceGovernor *governor) : governor_(governor) {}
+    ResourceGovernor *governor_ = nullptr;
+  };
+
+  explicit ResourceGovernor(GovernorConfig config = {}) { configure(config); }
+
+  ResourceGovernor(const ResourceGovernor &) = delete;
+  ResourceGovernor &operator=(const ResourceGovernor &) = delete;
+
+  void configure(GovernorConfig config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    hardwareThreads_ = std::max(1u, std::thread::hardware_concurrency());
+    // 至少给消息循环留一个核
+    double share = std::clamp(config_.backgroundCoreShare, 0.0, 1.0);
+    unsigned bySize = static_cast<unsigned>(hardwareThreads_ * share);
+    maxSlots_ = std::clamp(bySize, 1u, std::max(1u, hardwareThreads_ - 1));
+    slots_ = maxSlots_;
+    lastEvaluation_ = Clock::time_point{};
+  }
+
+  // ========================================================================
+  // Interactive Side
+  // ========================================================================
+
+  /**
+   * @brief Enter an interactive request; background admission stops until it ends
+   */
+  [[nodiscard]] InteractiveScope interactive() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++interactiveInFlight_;
+    return InteractiveScope(this, Clock::now());
+  }
+
+  // ========================================================================
+  // Background Side
+  // ========================================================================
+
+  /**
+   * @brief Wait for a background slot
+   * @param cancelled Polled while waiting; returning true gives up
+   * @return An empty ticket if cancelled, otherwise a held slot
+   */
+  template <typename Cancelled> [[nodiscard]] BackgroundTicket acquireBackground(Cancelled &&cancelled) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!waitForCapacity(lock, cancelled, /*holding=*/false))
+      return {};
+    ++activeBackground_;
+    ++admitted_;
+    return BackgroundTicket(this);
+  }
+
+  /**
+   * @brief Yield point inside long background work (call without other locks held)
+   *
+   * Waits while an interactive request runs or while the caller's slot has been
+   * taken away by a back-off decision.
+   *
+   * @return False if cancelled while waiting
+   */
+  template <typename Cancelled> bool checkpoint(Cancelled &&cancelled) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return waitForCapacity(lock, cancelled, /*holding=*/true);
+  }
+
+  /**
+   * @brief Run body(i) for i in [0, count) on the calling thread plus helper threads
+   *
+   * The helper count follows the current slot count; every item checks for
+   * cancellation and passes a checkpoint first. Call from a background thread
+   * that already holds a ticket, never from the message loop (its own
+   * interactive scope would hold every checkpoint back).
+   *
+   * @return False if cancelled before all items ran
+   */
+  template <typename Body, typename Cancelled>
+  bool parallelFor(size_t count, Body &&body, Cancelled &&cancelled) {
+    std::atomic<size_t> next{0};
+    std::atomic<bool> stopped{false};
+    auto drain = [&] {
+      for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+        if (stopped.load(std::memory_order_relaxed) || cancelled() || !checkpoint(cancelled)) {
+          stopped.store(true, std::memory_order_relaxed);
+          return;
+        }
+        body(i);
+      }
+    };
+
+    std::vector<std::thread> helpers;
+    unsigned width = std::min<size_t>(count, currentSlots());
+    for (unsigned h = 1; h < width; ++h) {
+      helpers.emplace_back([&] {
+        lowerCurrentThreadPriority(idleOnly());
+        auto ticket = acquireBackground(cancelled);
+        if (ticket)
+          drain();
+      });
+    }
+    drain();
+    for (auto &helper : helpers)
+      helper.join();
+    return !stopped.load() && next.load() >= count;
+  }
+
+  /**
+   * @brief Drop the calling thread to background priority
+   * @param idleOnly SCHED_IDLE / THREAD_PRIORITY_IDLE instead of a milder nice value
+   */
+  static void lowerCurrentThreadPriority(bool idleOnly) {
+#if defined(__linux__)
+    // Linux 上 nice 值和调度策略都是按线程生效的
+    if (idleOnly) {
+      sched_param param{};
+      if (sched_setscheduler(0, SCHED_IDLE, &param) == 0)
+        return;
+    }
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), idleOnly ? 19 : 10);
+#elif defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(),
+                      idleOnly ? THREAD_PRIORITY_IDLE : THREAD_PRIORITY_BELOW_NORMAL);
+#else
+    (void)idleOnly; // setpriority() is per-process here; leave scheduling to the OS
+#endif
+  }
+
+  [[nodiscard]] bool idleOnly() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return config_.idleOnly;
+  }
+
+  [[nodiscard]] unsigned currentSlots() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return slots_;
+  }
+
+  [[nodiscard]] GovernorStatus status() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    GovernorStatus s;
+    s.hardwareThreads = hardwareThreads_;
+    s.maxSlots = maxSlots_;
+    s.slots = slots_;
+    s.activeBackground = activeBackground_;
+    s.interactiveInFlight = interactiveInFlight_;
+    s.idleOnly = config_.idleOnly;
+    s.latencyEwmaMs = latencyEwmaMs_;
+    s.loadPerCore = loadPerCore_;
+    s.interactiveRequests = interactiveRequests_;
+    s.backgroundAdmitted = admitted_;
+    s.backgroundDeferred = deferred_;
+    s.backgroundForced = forced_;
+    s.decisions = decisions_;
+    s.lastDecision = lastDecision_;
+    return s;
+  }
+
+private:
+  static constexpr double EwmaAlpha = 0.2;
+  static constexpr std::chrono::milliseconds PollInterval{50};
+
+  /// Current one-minute load average per core, or -1 if unavailable
+  [[nodiscard]] static double sampleLoadPerCore(unsigned hardwareThreads) {
+#if defined(__unix__) || defined(__APPLE__)
+    double load[1];
+    if (getloadavg(load, 1) == 1)
+      return load[0] / hardwareThreads;
+#else
+    (void)hardwareThreads;
+#endif
+    return -1;
+  }
+
+  /// Background may proceed: nothing interactive running and a slot free
+  [[nodiscard]] bool hasCapacity(bool holding) const noexcept {
+    unsigned others = activeBackground_ - (holding ? 1 : 0);
+    return interactiveInFlight_ == 0 && others < slots_;
+  }
+
+  template <typename Cancelled>
+  bool waitForCapacity(std::unique_lock<std::mutex> &lock, Cancelled &cancelled, bool holding) {
+    evaluate(Clock::now());
+    if (hasCapacity(holding))
+      return true;
+
+    ++deferred_;
+    auto deadline = Clock::now() + config_.maxDefer;
+    for (;;) {
+      lock.unlock();
+      bool giveUp = cancelled();
+      lock.lock();
+      if (giveUp)
+        return false;
+      if (hasCapacity(holding))
+        return true;
+      auto now = Clock::now();
+      if (now >= deadline && interactiveInFlight_ == 0) {
+        ++forced_;
+        LSP_LOG("governor: admitting deferred background work after "
+                << config_.maxDefer.count() << " ms (slots " << slots_ << ")");
+        return true;
+      }
+      changed_.wait_for(lock, PollInterval);
+      evaluate(Clock::now());
+    }
+  }
+
+  void endInteractive(Clock::duration elapsed) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --interactiveInFlight_;
+      ++interactiveRequests_;
+      double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+      latencyEwmaMs_ =
+          interactiveRequests_ == 1 ? ms : EwmaAlpha * ms + (1 - EwmaAlpha) * latencyEwmaMs_;
+      evaluate(Clock::now());
+    }
+    changed_.notify_all();
+  }
+
+  void releaseBackground() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --activeBackground_;
+    }
+    changed_.notify_all();
+  }
+
+  /**
+   * @brief AIMD slot adjustment (caller holds mutex_)
+   */
+  void evaluate(Clock::time_point now) {
+    if (now - lastEvaluation_ < config_.evaluateInterval)
+      return;
+    lastEvaluation_ = now;
+
+    // 负载里扣掉我们自己的后台线程，否则单核机器上会一直暂停
+    double load = sampleLoadPerCore(hardwareThreads_);
+    if (load >= 0)
+      load = std::max(0.0, load - static_cast<double>(activeBackground_) / hardwareThreads_);
+    loadPerCore_ = load;
+
+    double target = static_cast<double>(config_.latencyTarget.count());
+    unsigned next = slots_;
+    std::ostringstream reason;
+    if (load > config_.loadPerCoreLimit) {
+      next = 0;
+      reason << "load " << load << "/core > " << config_.loadPerCoreLimit;
+    } else if (latencyEwmaMs_ > target) {
+      next = std::max(1u, slots_ / 2);
+      reason << "latency " << latencyEwmaMs_ << " ms > " << target << " ms";
+    } else if (slots_ < maxSlots_) {
+      next = slots_ + 1;
+      reason << "latency " << latencyEwmaMs_ << " ms, load "
+             << (load < 0 ? std::string("n/a") : std::to_string(load));
+    }
+
+    if (next == slots_)
+      return;
+    std::ostringstream decision;
+    decision << "slots " << slots_ << " -> " << next << " (" << reason.str() << ")";
+    lastDecision_ = decision.str();
+    ++decisions_;
+    slots_ = next;
+    LSP_LOG("governor: " << lastDecision_);
+    changed_.notify_all();
+  }
+
+  GovernorConfig config_;
+  mutable std::mutex mutex_;
+  std::condition_variable changed_; ///< Interactive work ended, a slot freed, or slots changed
+
+  unsigned hardwareThreads_ = 1;
+  unsigned maxSlots_ = 1;
+  unsigned slots_ = 1;
+  unsigned activeBackground_ = 0;
+  unsigned interactiveInFlight_ = 0;
+
+  double latencyEwmaMs_ = 0;
+  double loadPerCore_ = -1;
+  Clock::time_point lastEvaluation_{};
+
+  uint64_t interactiveRequests_ = 0;
+  uint64_t admitted_ = 0;
+  uint64_t deferred_ = 0;
+  uint64_t forced_ = 0;
+  uint64_t decisions_ = 0;
+  std::string lastDecision_;
+};
+
+} // namespace lsp
+} // namespace lang
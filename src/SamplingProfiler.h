@@ -0,0 +1,891 @@
+/**
+ * @file SamplingProfiler.h
+ * @brief In-Process Sampling CPU Profiler
+ *
+ * When a user reports the server burning CPU there is usually no way to run
+ * `perf` on their machine. SamplingProfiler samples the server's own stacks
+ * on a CPU-time timer and exports them for flame graphs, labelled with the
+ * request each thread was handling.
+ *
+ * Key Features:
+ * - A process CPU-time timer (timer_create) raises SIGPROF; the signal lands
+ *   on a thread that is using CPU, whose handler records its stack
+ * - Lock-free per-thread ring buffers: the handler only claims a slot, copies
+ *   frames and publishes the head; a collector thread drains and aggregates
+ * - A buffer whose thread has exited goes to the next new thread, so pools that
+ *   start threads per batch (parallelFor, fix-all, indexing) keep being sampled
+ * - ScopedTag labels a thread's samples (e.g. "textDocument/hover file:///a.lang")
+ * - Export as collapsed stacks (flamegraph.pl, speedscope) or as an
+ *   uncompressed pprof profile, symbolized from the executable's own symbol table
+ * - Off by default; costs nothing but a thread-local check while stopped
+ * - sampleThread(): one on-demand stack of a given thread, session or not
+ *
+ * Linux only; elsewhere start() reports that profiling is unsupported.
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <cxxabi.h>
+#include <elf.h>
+#include <execinfo.h>
+#include <link.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief Process-wide sampling profiler (one instance, owns the SIGPROF handler)
+ *
+ * Usage:
+ *   auto& profiler = SamplingProfiler::instance();
+ *   std::string error;
+ *   profiler.start(99, error);
+ *   {
+ *     SamplingProfiler::ScopedTag tag("textDocument/hover " + uri);
+ *     ...                                   // samples taken here carry the tag
+ *   }
+ *   profiler.stop();
+ *   std::string folded = profiler.collapsed();
+ */
+class SamplingProfiler {
+public:
+  static constexpr size_t MaxFrames = 64;
+  static constexpr size_t SamplesPerThread = 256; ///< Ring capacity; drained every CollectInterval
+  static constexpr size_t MaxThreads = 32; ///< Live threads beyond this count as dropped
+  static constexpr std::chrono::milliseconds CollectInterval{100};
+  static constexpr int DefaultFrequency = 99; ///< Hz; off-beat with 100 Hz timers
+
+  struct Status {
+    bool supported = false;
+    bool running = false;
+    int frequency = 0;     ///< Samples per CPU-second
+    uint64_t samples = 0;  ///< Collected so far (this or the last session)
+    uint64_t dropped = 0;  ///< Lost to full buffers or to the thread limit
+    size_t threads = 0;    ///< Threads that were sampled
+    size_t stacks = 0;     ///< Distinct (tag, stack) pairs
+    std::chrono::milliseconds duration{0};
+  };
+
+  [[nodiscard]] static SamplingProfiler &instance() {
+    static SamplingProfiler profiler;
+    return profiler;
+  }
+
+  [[nodiscard]] static constexpr bool supported() noexcept {
+#if defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  SamplingProfiler(const SamplingProfiler &) = delete;
+  SamplingProfiler &operator=(const SamplingProfiler &) = delete;
+
+  ~SamplingProfiler() { stop(); }
+
+  /**
+   * @brief Labels the calling thread's samples until destroyed (nestable)
+   *
+   * A no-op while the profiler is stopped, so it can wrap every request.
+   */
+  class ScopedTag {
+  public:
+    explicit ScopedTag(const std::string &label) {
+      auto &profiler = instance();
+      if (label.empty() || !profiler.running())
+        return;
+      active_ = true;
+      previous_ = currentTag_.load(std::memory_order_relaxed);
+      currentTag_.store(profiler.intern(label), std::memory_order_relaxed);
+    }
+
+    ~ScopedTag() {
+      if (active_)
+        currentTag_.store(previous_, std::memory_order_relaxed);
+    }
+
+    ScopedTag(const ScopedTag &) = delete;
+    ScopedTag &operator=(const ScopedTag &) = delete;
+
+  private:
+    bool active_ = false;
+    uint32_t previous_ = 0;
+  };
+
+  [[nodiscard]] bool running() const noexcept { return running_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Start a new session, discarding the previous one's samples
+   * @param frequency Samples per CPU-second, clamped to [1, 1000]
+   * @param error Set when profiling cannot start
+   */
+  bool start(int frequency, std::string &error) {
+#if defined(__linux__)
+    std::lock_guard<std::mutex> control(controlMutex_);
+    if (owner_) {
+      error = "profiler already running";
+      return false;
+    }
+    frequency = std::clamp(frequency, 1, 1000);
+
+    if (!installHandler(error))
+      return false;
+
+    {
+      std::lock_guard<std::mutex> lock(dataMutex_);
+      stacks_.clear();
+      samples_ = 0;
+      dropped_ = 0;
+      threads_ = 0;
+    }
+    owner_ = std::make_unique<Session>();
+    owner_->id = ++sessions_;
+    session_.store(owner_.get());
+
+    sigevent event{};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer_) != 0) {
+      error = std::string("timer_create: ") + std::strerror(errno);
+      releaseSession();
+      return false;
+    }
+    long period = 1000000000L / frequency;
+    itimerspec spec{};
+    spec.it_interval.tv_sec = period / 1000000000L;
+    spec.it_interval.tv_nsec = period % 1000000000L;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(timer_, 0, &spec, nullptr) != 0) {
+      error = std::string("timer_settime: ") + std::strerror(errno);
+      timer_delete(timer_);
+      releaseSession();
+      return false;
+    }
+
+    frequency_ = frequency;
+    started_ = std::chrono::steady_clock::now();
+    duration_ = {};
+    stopCollector_ = false;
+    collector_ = std::thread([this] { collectorLoop(); });
+    running_ = true;
+    return true;
+#else
+    (void)frequency;
+    error = "sampling profiler is not supported on this platform";
+    return false;
+#endif
+  }
+
+  /**
+   * @brief Stop sampling; the samples stay available for export until the next start()
+   */
+  void stop() {
+#if defined(__linux__)
+    std::lock_guard<std::mutex> control(controlMutex_);
+    if (!owner_)
+      return;
+    running_ = false;
+    timer_delete(timer_);
+    {
+      std::lock_guard<std::mutex> lock(collectMutex_);
+      stopCollector_ = true;
+    }
+    collectCv_.notify_all();
+    collector_.join();
+    duration_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started_);
+    releaseSession();
+#endif
+  }
+
+  [[nodiscard]] Status status() {
+    collectNow();
+    Status status;
+    status.supported = supported();
+    status.running = running();
+    status.frequency = frequency_;
+    std::lock_guard<std::mutex> lock(dataMutex_);
+    status.samples = samples_;
+    status.dropped = dropped_;
+    status.threads = threads_;
+    status.stacks = stacks_.size();
+    status.duration = running() ? std::chrono::duration_cast<std::chrono::milliseconds>(
+                                      std::chrono::steady_clock::now() - started_)
+                                : duration_;
+    return status;
+  }
+
+  /**
+   * @brief "tag;outermost;...;innermost count" lines, one per distinct stack
+   */
+  [[nodiscard]] std::string collapsed() {
+    collectNow();
+    std::lock_guard<std::mutex> lock(dataMutex_);
+    const Symbolizer &symbols = symbolizer();
+    std::map<std::string, uint64_t> folded;
+    for (const auto &[key, count] : stacks_) {
+      std::string line = tagFrame(static_cast<uint32_t>(key[0]));
+      for (size_t i = key.size() - 1; i >= 1; --i) {
+        line += ';';
+        line += symbols.name(key[i], i > 1);
+      }
+      folded[line] += count;
+    }
+
+    std::string out;
+    for (const auto &[line, count] : folded) {
+      out += line;
+      out += ' ';
+      out += std::to_string(count);
+      out += '\n';
+    }
+    return out;
+  }
+
+  /**
+   * @brief Serialized (uncompressed) pprof Profile protobuf
+   *
+   * Values are sample counts and CPU nanoseconds; the tag is the "request" label.
+   */
+  [[nodiscard]] std::string pprof() {
+    collectNow();
+    std::lock_guard<std::mutex> lock(dataMutex_);
+    const Symbolizer &symbols = symbolizer();
+    int64_t period = frequency_ > 0 ? 1000000000LL / frequency_ : 0;
+
+    Proto profile;
+    std::vector<std::string> strings{""};
+    std::unordered_map<std::string, uint64_t> stringIds{{"", 0}};
+    auto str = [&](const std::string &s) -> uint64_t {
+      auto [it, fresh] = stringIds.emplace(s, strings.size());
+      if (fresh)
+        strings.push_back(s);
+      return it->second;
+    };
+    auto valueType = [&](const char *type, const char *unit) {
+      Proto vt;
+      vt.varint(1, str(type));
+      vt.varint(2, str(unit));
+      return vt;
+    };
+    profile.message(1, valueType("samples", "count"));
+    profile.message(1, valueType("cpu", "nanoseconds"));
+
+    std::unordered_map<uintptr_t, uint64_t> locations;      ///< Address -> location id
+    std::unordered_map<std::string, uint64_t> functions;    ///< Name -> function id
+    Proto locationTable;
+    Proto functionTable;
+    uint64_t requestKey = str("request");
+    for (const auto &[key, count] : stacks_) {
+      std::vector<uint64_t> ids;
+      for (size_t i = 1; i < key.size(); ++i) {
+        auto [loc, fresh] = locations.emplace(key[i], locations.size() + 1);
+        if (fresh) {
+          std::string name = symbols.name(key[i], i > 1);
+          auto [fn, newFunction] = functions.emplace(name, functions.size() + 1);
+          if (newFunction) {
+            Proto function;
+            function.varint(1, fn->second);
+            function.varint(2, str(name));
+            function.varint(3, str(name));
+            functionTable.message(5, function);
+          }
+          Proto line;
+          line.varint(1, fn->second);
+          Proto location;
+          location.varint(1, loc->second);
+          location.varint(3, key[i]);
+          location.message(4, line);
+          locationTable.message(4, location);
+        }
+        ids.push_back(loc->second);
+      }
+
+      Proto sample;
+      sample.packed(1, ids);
+      sample.packed(2, {count, count * static_cast<uint64_t>(period)});
+      if (key[0] != 0) {
+        Proto label;
+        label.varint(1, requestKey);
+        label.varint(2, str(tagLabel(static_cast<uint32_t>(key[0]))));
+        sample.message(3, label);
+      }
+      profile.message(2, sample);
+    }
+    profile.append(locationTable);
+    profile.append(functionTable);
+    for (const auto &s : strings)
+      profile.bytes(6, s);
+    auto durationNanos =
+        running() ? std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - started_)
+                  : std::chrono::nanoseconds(duration_);
+    profile.varint(10, static_cast<uint64_t>(durationNanos.count()));
+    profile.message(11, valueType("cpu", "nanoseconds"));
+    profile.varint(12, static_cast<uint64_t>(period));
+    return profile.data;
+  }
+
+  /**
+   * @brief One stack of another thread of this process, innermost frame first
+   *
+   * Interrupts the thread with SIGPROF and waits for its handler to unwind;
+   * works whether or not a session is running (the request watchdog uses it
+   * to see where a slow request is stuck).
+   * @param tid Kernel thread id, as currentThreadId() returned on that thread
+   * @return Symbolized frames; empty when unsupported or the thread did not answer in time
+   */
+  [[nodiscard]] std::vector<std::string>
+  sampleThread(long tid, std::chrono::milliseconds timeout = std::chrono::milliseconds(250)) {
+    std::vector<std::string> stack;
+#if defined(__linux__)
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    {
+      std::lock_guard<std::mutex> control(controlMutex_);
+      std::string error;
+      if (!installHandler(error))
+        return stack;
+    }
+    snapshotTid_.store(tid);
+    snapshotState_.store(SnapshotRequested);
+    if (syscall(SYS_tgkill, getpid(), tid, SIGPROF) != 0) {
+      snapshotState_.store(SnapshotIdle);
+      return stack;
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (snapshotState_.load() != SnapshotDone) {
+      int expected = SnapshotRequested;
+      if (std::chrono::steady_clock::now() >= deadline &&
+          snapshotState_.compare_exchange_strong(expected, SnapshotIdle))
+        return stack; // Never answered; a late signal finds nothing requested
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::vector<uintptr_t> frames(snapshotFrames_, snapshotFrames_ + snapshotDepth_);
+    snapshotState_.store(SnapshotIdle);
+
+    std::lock_guard<std::mutex> data(dataMutex_);
+    const Symbolizer &symbols = symbolizer();
+    for (size_t i = 0; i < frames.size(); ++i)
+      stack.push_back(symbols.name(frames[i], i > 0));
+#else
+    (void)tid;
+    (void)timeout;
+#endif
+    return stack;
+  }
+
+  /// Kernel id of the calling thread (0 where unsupported)
+  [[nodiscard]] static long currentThreadId() noexcept {
+#if defined(__linux__)
+    return static_cast<long>(syscall(SYS_gettid));
+#else
+    return 0;
+#endif
+  }
+
+private:
+  SamplingProfiler() = default;
+
+  struct Sample {
+    uint32_t tag = 0;
+    uint32_t depth = 0;
+    void *frames[MaxFrames];
+  };
+
+  /// Written only by its thread's signal handler (head) and the collector (tail)
+  struct ThreadBuffer {
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<long> owner{0}; ///< Kernel id of the writing thread (0 while being handed out)
+    Sample samples[SamplesPerThread];
+  };
+
+  struct Session {
+    uint64_t id = 0;
+    std::unique_ptr<ThreadBuffer[]> buffers{new ThreadBuffer[MaxThreads]};
+    std::atomic<size_t> claimed{0};    ///< Buffers handed out at least once
+    std::atomic<size_t> threads{0};    ///< Threads given a buffer, reused ones included
+    std::atomic<uint64_t> overflow{0}; ///< Samples of threads finding every buffer taken
+  };
+
+  /// The calling thread's buffer in the session it was claimed for (zero-initialized TLS)
+  struct ThreadSlot {
+    uint64_t session;
+    ThreadBuffer *buffer;
+  };
+
+  struct KeyHash {
+    size_t operator()(const std::vector<uintptr_t> &key) const noexcept {
+      uint64_t hash = 1469598103934665603ULL;
+      for (uintptr_t word : key)
+        hash = (hash ^ word) * 1099511628211ULL;
+      return static_cast<size_t>(hash);
+    }
+  };
+
+  // ========================================================================
+  // Signal Handler
+  // ========================================================================
+
+#if defined(__linux__)
+  /// Caller holds controlMutex_
+  bool installHandler(std::string &error) {
+    if (handlerInstalled_)
+      return true;
+    // The first backtrace() may load the unwinder; never let that happen in the handler
+    void *warmup[4];
+    backtrace(warmup, 4);
+
+    // Stays installed: a SIGPROF still pending after stop() must not kill the process
+    struct sigaction action {};
+    action.sa_sigaction = &SamplingProfiler::onSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) != 0) {
+      error = std::string("sigaction: ") + std::strerror(errno);
+      return false;
+    }
+    handlerInstalled_ = true;
+    return true;
+  }
+
+  static void onSignal(int, siginfo_t *info, void *context) {
+    int savedErrno = errno;
+    auto &self = instance();
+    self.inHandler_.fetch_add(1);
+    if (info && info->si_code == SI_TKILL) {
+      // Sent by sampleThread(), not by the timer: not a CPU-time sample
+      int expected = SnapshotRequested;
+      if (self.snapshotTid_.load() == syscall(SYS_gettid) &&
+          self.snapshotState_.compare_exchange_strong(expected, SnapshotWriting)) {
+        void *frames[MaxFrames];
+        uint32_t depth = unwind(context, frames);
+        for (uint32_t i = 0; i < depth; ++i)
+          self.snapshotFrames_[i] = reinterpret_cast<uintptr_t>(frames[i]);
+        self.snapshotDepth_ = depth;
+        self.snapshotState_.store(SnapshotDone);
+      }
+    } else if (Session *session = self.session_.load()) {
+      record(*session, context);
+    }
+    self.inHandler_.fetch_sub(1);
+    errno = savedErrno;
+  }
+
+  static void *interruptedPc(void *context) {
+    auto *uc = static_cast<ucontext_t *>(context);
+#if defined(__x86_64__)
+    return reinterpret_cast<void *>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+    return reinterpret_cast<void *>(uc->uc_mcontext.pc);
+#else
+    (void)uc;
+    return nullptr;
+#endif
+  }
+
+  /// Async-signal-safe: atomics, thread-locals and backtrace() (warmed up in installHandler())
+  static void record(Session &session, void *context) {
+    ThreadSlot &slot = threadSlot_;
+    if (slot.session != session.id || !slot.buffer) {
+      slot.session = session.id;
+      slot.buffer = claim(session);
+    }
+    if (!slot.buffer) {
+      session.overflow.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    ThreadBuffer &buffer = *slot.buffer;
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= SamplesPerThread) {
+      buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    Sample &sample = buffer.samples[head % SamplesPerThread];
+    sample.tag = currentTag_.load(std::memory_order_relaxed);
+    sample.depth = unwind(context, sample.frames);
+    buffer.head.store(head + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief A buffer for the calling thread: a fresh one, else one whose thread has exited
+   *
+   * Async-signal-safe, so a thread exit cannot free its buffer (a thread_local guard's
+   * destructor would need registering, which allocates); instead the owner's kernel id
+   * is probed. A tid the kernel reused belongs to a thread with its own buffer, so a
+   * buffer is never shared, only kept until that thread exits too.
+   */
+  static ThreadBuffer *claim(Session &session) {
+    long self = static_cast<long>(syscall(SYS_gettid));
+    size_t index = session.claimed.load();
+    while (index < MaxThreads) {
+      if (session.claimed.compare_exchange_weak(index, index + 1)) {
+        session.buffers[index].owner.store(self);
+        session.threads.fetch_add(1, std::memory_order_relaxed);
+        return &session.buffers[index];
+      }
+    }
+
+    long pid = static_cast<long>(getpid());
+    for (size_t i = 0; i < MaxThreads; ++i) {
+      ThreadBuffer &buffer = session.buffers[i];
+      long owner = buffer.owner.load();
+      if (owner == 0 || syscall(SYS_tgkill, pid, owner, 0) == 0 || errno != ESRCH)
+        continue;
+      // Samples the exited thread left behind are still drained from the same ring
+      if (buffer.owner.compare_exchange_strong(owner, self)) {
+        session.threads.fetch_add(1, std::memory_order_relaxed);
+        return &buffer;
+      }
+    }
+    return nullptr;
+  }
+
+  /// The interrupted thread's stack, innermost first (async-signal-safe)
+  static uint32_t unwind(void *context, void **frames) {
+    void *pc = interruptedPc(context);
+    // The unwinder is not reentrant: a thread interrupted while an exception
+    // propagates may hold its lock, and backtrace() would wait on it forever
+    if (std::uncaught_exceptions() > 0) {
+      frames[0] = pc;
+      return pc ? 1 : 0;
+    }
+
+    void *raw[MaxFrames + 8];
+    int count = backtrace(raw, static_cast<int>(MaxFrames + 8));
+    // Skip the handler's own frames: the stack proper starts at the interrupted instruction
+    int first = count;
+    for (int i = 0; i < count; ++i) {
+      if (raw[i] == pc) {
+        first = i;
+        break;
+      }
+    }
+
+    uint32_t depth = 0;
+    if (first == count) {
+      // Unwinding did not get past the signal frame; keep at least the sampled instruction
+      first = std::min(count, 2);
+      if (pc)
+        frames[depth++] = pc;
+    }
+    for (int i = first; i < count && depth < MaxFrames; ++i)
+      frames[depth++] = raw[i];
+    return depth;
+  }
+
+  /// Unpublish the session, wait out handlers still using it, then fold in what is left
+  void releaseSession() {
+    session_.store(nullptr);
+    while (inHandler_.load() != 0)
+      std::this_thread::yield();
+    std::lock_guard<std::mutex> lock(ownerMutex_);
+    collect(*owner_);
+    owner_.reset();
+  }
+#endif
+
+  // ========================================================================
+  // Collection
+  // ========================================================================
+
+  void collectorLoop() {
+    std::unique_lock<std::mutex> lock(collectMutex_);
+    while (!stopCollector_) {
+      collectCv_.wait_for(lock, CollectInterval, [this] { return stopCollector_; });
+      lock.unlock();
+      collectNow();
+      lock.lock();
+    }
+  }
+
+  void collectNow() {
+    std::lock_guard<std::mutex> lock(ownerMutex_);
+    if (Session *session = session_.load())
+      collect(*session);
+  }
+
+  /// Move published samples of every claimed buffer into the aggregate
+  void collect(Session &session) {
+    size_t claimed = std::min(session.claimed.load(), MaxThreads);
+    std::lock_guard<std::mutex> lock(dataMutex_);
+    std::vector<uintptr_t> key;
+    for (size_t i = 0; i < claimed; ++i) {
+      ThreadBuffer &buffer = session.buffers[i];
+      uint64_t head = buffer.head.load(std::memory_order_acquire);
+      uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+      for (; tail < head; ++tail) {
+        const Sample &sample = buffer.samples[tail % SamplesPerThread];
+        key.assign(1, sample.tag);
+        for (uint32_t f = 0; f < sample.depth; ++f)
+          key.push_back(reinterpret_cast<uintptr_t>(sample.frames[f]));
+        if (key.size() > 1) {
+          ++stacks_[key];
+          ++samples_;
+        }
+      }
+      buffer.tail.store(tail, std::memory_order_release);
+      dropped_ += buffer.dropped.exchange(0, std::memory_order_relaxed);
+    }
+    dropped_ += session.overflow.exchange(0, std::memory_order_relaxed);
+    threads_ = std::max(threads_, session.threads.load(std::memory_order_relaxed));
+  }
+
+  // ========================================================================
+  // Tags
+  // ========================================================================
+
+  uint32_t intern(const std::string &label) {
+    std::lock_guard<std::mutex> lock(tagMutex_);
+    auto [it, fresh] = tagIds_.emplace(label, static_cast<uint32_t>(tags_.size() + 1));
+    if (fresh)
+      tags_.push_back(label);
+    return it->second;
+  }
+
+  std::string tagLabel(uint32_t tag) {
+    std::lock_guard<std::mutex> lock(tagMutex_);
+    return tag == 0 || tag > tags_.size() ? "(untagged)" : tags_[tag - 1];
+  }
+
+  /// The tag as the root frame of a collapsed stack
+  std::string tagFrame(uint32_t tag) {
+    std::string frame = "[" + tagLabel(tag) + "]";
+    std::replace(frame.begin(), frame.end(), ';', ',');
+    return frame;
+  }
+
+  // ========================================================================
+  // Symbolization
+  // ========================================================================
+
+  /**
+   * @brief Function names from the executable's .symtab (or .dynsym)
+   *
+   * Read once from /proc/self/exe; works for static and PIE builds alike
+   * (the load bias comes from dl_iterate_phdr). Unknown addresses print as hex.
+   */
+  class Symbolizer {
+  public:
+    Symbolizer() { load(); }
+
+    /// @param returnAddress Frame above the sampled one: look up the call instruction
+    [[nodiscard]] std::string name(uintptr_t address, bool returnAddress) const {
+      uintptr_t lookup = returnAddress ? address - 1 : address;
+      auto it = std::upper_bound(
+          functions_.begin(), functions_.end(), lookup,
+          [](uintptr_t value, const Function &fn) { return value < fn.address; });
+      if (it != functions_.begin()) {
+        const Function &fn = *--it;
+        if (lookup < fn.address + std::max<uint64_t>(fn.size, 1))
+          return demangled(fn);
+      }
+      char hex[2 + sizeof(uintptr_t) * 2 + 1];
+      std::snprintf(hex, sizeof(hex), "0x%llx", static_cast<unsigned long long>(address));
+      return hex;
+    }
+
+  private:
+    struct Function {
+      uintptr_t address = 0;
+      uint64_t size = 0;
+      uint32_t nameOffset = 0;
+    };
+
+    std::string demangled(const Function &fn) const {
+      auto cached = names_.find(fn.address);
+      if (cached != names_.end())
+        return cached->second;
+      const char *mangled = strings_.c_str() + fn.nameOffset;
+      std::string name = mangled;
+#if defined(__linux__)
+      int status = 0;
+      char *plain = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+      if (status == 0 && plain)
+        name = plain;
+      std::free(plain);
+#endif
+      std::replace(name.begin(), name.end(), ';', ',');
+      std::replace(name.begin(), name.end(), '\n', ' ');
+      names_.emplace(fn.address, name);
+      return name;
+    }
+
+    void load() {
+#if defined(__linux__)
+      uintptr_t bias = 0;
+      dl_iterate_phdr(
+          [](dl_phdr_info *info, size_t, void *data) {
+            *static_cast<uintptr_t *>(data) = info->dlpi_addr; // First entry: the executable
+            return 1;
+          },
+          &bias);
+
+      std::ifstream exe("/proc/self/exe", std::ios::binary);
+      Elf64_Ehdr header{};
+      if (!exe.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+          std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 ||
+          header.e_ident[EI_CLASS] != ELFCLASS64 || header.e_shentsize != sizeof(Elf64_Shdr))
+        return;
+      std::vector<Elf64_Shdr> sections(header.e_shnum);
+      exe.seekg(static_cast<std::streamoff>(header.e_shoff));
+      if (!exe.read(reinterpret_cast<char *>(sections.data()),
+                    static_cast<std::streamsize>(sections.size() * sizeof(Elf64_Shdr))))
+        return;
+
+      const Elf64_Shdr *symtab = nullptr;
+      for (const auto &section : sections) {
+        if (section.sh_type == SHT_SYMTAB || (!symtab && section.sh_type == SHT_DYNSYM))
+          symtab = &section;
+      }
+      if (!symtab || symtab->sh_link >= sections.size())
+        return;
+      const Elf64_Shdr &strtab = sections[symtab->sh_link];
+
+      strings_.resize(strtab.sh_size);
+      exe.seekg(static_cast<std::streamoff>(strtab.sh_offset));
+      exe.read(strings_.data(), static_cast<std::streamsize>(strings_.size()));
+      std::vector<Elf64_Sym> symbols(symtab->sh_size / sizeof(Elf64_Sym));
+      exe.seekg(static_cast<std::streamoff>(symtab->sh_offset));
+      if (!exe.read(reinterpret_cast<char *>(symbols.data()),
+                    static_cast<std::streamsize>(symbols.size() * sizeof(Elf64_Sym))))
+        return;
+
+      for (const auto &sym : symbols) {
+        if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_value == 0 ||
+            sym.st_name >= strings_.size())
+          continue;
+        functions_.push_back(
+            {static_cast<uintptr_t>(sym.st_value + bias), sym.st_size, sym.st_name});
+      }
+      std::sort(functions_.begin(), functions_.end(),
+                [](const Function &a, const Function &b) { return a.address < b.address; });
+#endif
+    }
+
+    std::vector<Function> functions_;
+    std::string strings_;
+    mutable std::unordered_map<uintptr_t, std::string> names_;
+  };
+
+  /// Loaded on first export (caller holds dataMutex_)
+  const Symbolizer &symbolizer() {
+    if (!symbolizer_)
+      symbolizer_ = std::make_unique<Symbolizer>();
+    return *symbolizer_;
+  }
+
+  // ========================================================================
+  // Protobuf Encoding (pprof)
+  // ========================================================================
+
+  struct Proto {
+    std::string data;
+
+    void raw(uint64_t value) {
+      while (value >= 0x80) {
+        data += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+      }
+      data += static_cast<char>(value);
+    }
+    void varint(uint32_t field, uint64_t value) {
+      raw(uint64_t(field) << 3);
+      raw(value);
+    }
+    void bytes(uint32_t field, const std::string &value) {
+      raw((uint64_t(field) << 3) | 2);
+      raw(value.size());
+      data += value;
+    }
+    void message(uint32_t field, const Proto &value) { bytes(field, value.data); }
+    void packed(uint32_t field, const std::vector<uint64_t> &values) {
+      Proto body;
+      for (uint64_t value : values)
+        body.raw(value);
+      bytes(field, body.data);
+    }
+    void append(const Proto &other) { data += other.data; }
+  };
+
+  // ========================================================================
+  // State
+  // ========================================================================
+
+  inline static thread_local std::atomic<uint32_t> currentTag_{0};
+  inline static thread_local ThreadSlot threadSlot_;
+
+  std::mutex controlMutex_; ///< Serializes start() and stop()
+  std::mutex ownerMutex_;   ///< Keeps the session alive while collectNow() drains it
+  std::atomic<Session *> session_{nullptr};
+  std::unique_ptr<Session> owner_;
+  std::atomic<int> inHandler_{0};
+  std::atomic<bool> running_{false};
+  bool handlerInstalled_ = false;
+  uint64_t sessions_ = 0;
+  int frequency_ = 0;
+  std::chrono::steady_clock::time_point started_;
+  std::chrono::milliseconds duration_{0};
+#if defined(__linux__)
+  timer_t timer_{};
+#endif
+
+  std::thread collector_;
+  std::mutex collectMutex_;
+  std::condition_variable collectCv_;
+  bool stopCollector_ = false;
+
+  std::mutex dataMutex_; ///< Guards the aggregate below and the symbolizer
+  std::unordered_map<std::vector<uintptr_t>, uint64_t, KeyHash> stacks_; ///< [tag, pc, callers...]
+  uint64_t samples_ = 0;
+  uint64_t dropped_ = 0;
+  size_t threads_ = 0;
+  std::unique_ptr<Symbolizer> symbolizer_;
+
+  /// sampleThread() handshake with the target thread's handler
+  enum : int { SnapshotIdle, SnapshotRequested, SnapshotWriting, SnapshotDone };
+  std::mutex snapshotMutex_; ///< One sampleThread() at a time
+  std::atomic<int> snapshotState_{SnapshotIdle};
+  std::atomic<long> snapshotTid_{0};
+  uintptr_t snapshotFrames_[MaxFrames] = {};
+  uint32_t snapshotDepth_ = 0;
+
+  std::mutex tagMutex_;
+  std::vector<std::string> tags_; ///< Tag id - 1 -> label
+  std::unordered_map<std::string, uint32_t> tagIds_;
+};
+
+} // namespace lsp
+} // namespace lang
@@ -6,6 +6,7 @@
  * - Nested scope support (parent chain)
  * - Symbol definition and resolution
  * - Scope snapshots for LSP incremental updates
+ * - Source extents and an interval index for scope-at-offset queries
  *
  * Key Design Principles:
  * - Scopes are owned by SymbolTable
@@ -20,6 +21,7 @@
 #include "AstNodes.h"
 #include "Symbol.h"
 
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <optional>
@@ -92,7 +94,9 @@ enum class ScopeKind : uint8_t {
 class Scope {
 public:
   Scope(ScopeKind kind, Scope *parent = nullptr, ast::AstNode *astNode = nullptr)
-      : kind_(kind), parent_(parent), astNode_(astNode), depth_(parent ? parent->depth_ + 1 : 0) {
+      : kind_(kind), parent_(parent), astNode_(astNode),
+        extent_(astNode ? astNode->range : ast::SourceRange::invalid()),
+        depth_(parent ? parent->depth_ + 1 : 0) {
     if (parent) {
       parent->children_.push_back(this);
     }
@@ -116,6 +120,27 @@ public:
 
   [[nodiscard]] const std::vector<Scope *> &children() const noexcept { return children_; }
 
+  /**
+   * @brief Source extent of the construct that opened this scope
+   *
+   * Taken from the AST node; invalid for scopes without one (e.g. global).
+   */
+  [[nodiscard]] const ast::SourceRange &extent() const noexcept { return extent_; }
+
+  void setExtent(ast::SourceRange extent) noexcept { extent_ = extent; }
+
+  [[nodiscard]] bool hasExtent() const noexcept { return extent_.isValid(); }
+
+  /**
+   * @brief Whether the scope's construct is broken (e.g. missing closing brace)
+   *
+   * The recorded extent of such a scope may end before the code the user is
+   * still typing into.
+   */
+  [[nodiscard]] bool isOpenEnded() const noexcept {
+    return astNode_ && (astNode_->hasError() || astNode_->isIncomplete());
+  }
+
   // ========================================================================
   // Symbol Definition
   // ========================================================================
@@ -380,6 +405,7 @@ private:
   ScopeKind kind_;
   Scope *parent_;
   ast::AstNode *astNode_;
+  ast::SourceRange extent_;
   uint32_t depth_;
 
   std::unordered_map<std::string, Symbol *> symbols_; ///< Fast lookup by name
@@ -607,5 +633,150 @@ private:
   Scope *globalScope_ = nullptr;
 };
 
+// ============================================================================
+// Scope Interval Index
+// ============================================================================
+
+/**
+ * @brief Sorted interval index answering "innermost scope at offset"
+ *
+ * The scope tree is flattened into contiguous, non-overlapping segments,
+ * each mapped to the innermost scope covering it, so a query is a single
+ * binary search. Scopes whose construct is broken (unterminated block,
+ * incomplete expression) are extended up to their next sibling, so queries
+ * inside code the parser could not attach to any node still land in the
+ * right scope.
+ *
+ * Usage:
+ *   ScopeIntervalIndex index;
+ *   index.build(table.globalScope());
+ *   Scope* scope = index.find(offset);
+ */
+class ScopeIntervalIndex {
+public:
+  /**
+   * @brief Rebuild the index from a scope tree
+   */
+  void build(Scope *root) {
+    segments_.clear();
+    open_.clear();
+    if (!root)
+      return;
+
+    markOpenEnded(root);
+    emit(root, 0, UINT32_MAX);
+    open_.clear();
+  }
+
+  /**
+   * @brief Find the innermost scope containing an AST (code-point) offset
+   * @return The scope, or nullptr if the index is empty
+   */
+  [[nodiscard]] Scope *find(uint32_t offset) const {
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), offset,
+                               [](uint32_t o, const Segment &seg) { return o < seg.begin; });
+    if (it == segments_.begin())
+      return nullptr;
+    return std::prev(it)->scope;
+  }
+
+  [[nodiscard]] size_t segmentCount() const noexcept { return segments_.size(); }
+
+  [[nodiscard]] bool empty() const noexcept { return segments_.empty(); }
+
+private:
+  struct Segment {
+    uint32_t begin; ///< Segment start; it ends where the next one begins
+    Scope *scope;
+  };
+
+  /**
+   * @brief Children with an extent, in source order
+   *
+   * Children without an extent are transparent: their own children are
+   * attributed to the nearest indexed ancestor.
+   */
+  static void collectIndexed(const Scope *scope, std::vector<Scope *> &out) {
+    for (Scope *child : scope->children()) {
+      if (child->hasExtent()) {
+        out.push_back(child);
+      } else {
+        collectIndexed(child, out);
+      }
+    }
+  }
+
+  [[nodiscard]] static std::vector<Scope *> sortedChildren(const Scope *scope) {
+    std::vector<Scope *> children;
+    collectIndexed(scope, children);
+    std::stable_sort(children.begin(), children.end(), [](const Scope *a, const Scope *b) {
+      return a->extent().begin.offset < b->extent().begin.offset;
+    });
+    return children;
+  }
+
+  /**
+   * @brief A scope is open-ended if it is broken itself, or if its last child
+   *        is open-ended and reaches its end (a missing '}' cuts every
+   *        enclosing range short at the same token).
+   */
+  bool markOpenEnded(Scope *scope) {
+    bool open = scope->isOpenEnded();
+    auto children = sortedChildren(scope);
+    for (size_t i = 0; i < children.size(); ++i) {
+      bool childOpen = markOpenEnded(children[i]);
+      if (i + 1 == children.size() && childOpen && scope->hasExtent() &&
+          children[i]->extent().end.offset >= scope->extent().end.offset) {
+        open = true;
+      }
+    }
+    if (open)
+      open_.push_back(scope);
+    return open;
+  }
+
+  [[nodiscard]] bool isOpen(const Scope *scope) const {
+    return std::find(open_.begin(), open_.end(), scope) != open_.end();
+  }
+
+  void emit(Scope *scope, uint32_t begin, uint32_t end) {
+    auto children = sortedChildren(scope);
+    uint32_t cursor = begin;
+
+    for (size_t i = 0; i < children.size(); ++i) {
+      Scope *child = children[i];
+      uint32_t childBegin = std::max(child->extent().begin.offset, cursor);
+      uint32_t childEnd = child->extent().end.offset;
+
+      // 残缺的作用域延伸到下一个兄弟作用域（或父作用域结尾）
+      if (isOpen(child)) {
+        childEnd = i + 1 < children.size()
+                       ? std::max(childEnd, children[i + 1]->extent().begin.offset)
+                       : end;
+      }
+      childEnd = std::min(childEnd, end);
+      if (childBegin >= childEnd)
+        continue;
+
+      push(cursor, childBegin, scope);
+      emit(child, childBegin, childEnd);
+      cursor = childEnd;
+    }
+
+    push(cursor, end, scope);
+  }
+
+  void push(uint32_t begin, uint32_t end, Scope *scope) {
+    if (begin >= end)
+      return;
+    if (!segments_.empty() && segments_.back().scope == scope)
+      return; // Contiguous with the previous segment
+    segments_.push_back({begin, scope});
+  }
+
+  std::vector<Segment> segments_;
+  std::vector<const Scope *> open_; ///< Open-ended scopes (only during build)
+};
+
 } // namespace semantic
 } // namespace lang
@@ -12,6 +12,8 @@
  * - Side Table pattern: Type information stored separately from AST
  * - Tolerant: Never throws, returns UnknownType on errors
  * - Supports incremental analysis for LSP
+ * - Single-pass binding: references resolve through per-name shadow stacks
+ *   (NameBinder), not by walking the scope chain
  *
  * @copyright Copyright (c) 2024-2025
  */
@@ -20,11 +22,14 @@
 
 #include "AstFactory.h"
 #include "AstNodes.h"
+#include "ModuleSignature.h"
+#include "NameBinder.h"
 #include "Scope.h"
 #include "Symbol.h"
 #include "TypeSystem.h"
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -38,11 +43,20 @@ namespace semantic {
 
 enum class DiagnosticSeverity : uint8_t { Error, Warning, Info, Hint };
 
+/**
+ * @brief Replacement of a source range, part of a machine-applicable fix
+ */
+struct FixEdit {
+  ast::SourceRange range;
+  std::string newText; ///< Empty to delete
+};
+
 struct Diagnostic {
   DiagnosticSeverity severity;
   std::string message;
   ast::SourceRange range;
   std::string code;
+  std::vector<FixEdit> fixes; ///< Applied together; empty when there is no safe fix
 
   [[nodiscard]] bool isError() const noexcept { return severity == DiagnosticSeverity::Error; }
 };
@@ -117,6 +131,43 @@ public:
     return it != nodeScopes_.end() ? it->second : nullptr;
   }
 
+  /**
+   * @brief Build the scope interval index (after analysis)
+   */
+  void buildScopeIndex() { scopeIndex_.build(symbolTable_.globalScope()); }
+
+  /**
+   * @brief Innermost scope at an AST offset (code points, not bytes), O(log n)
+   *
+   * Works at positions no AST node covers (e.g. inside an unterminated block).
+   * Convert request offsets with SourceFile::codePointOffsetOf first.
+   */
+  [[nodiscard]] Scope *scopeAt(uint32_t offset) const {
+    Scope *scope = scopeIndex_.find(offset);
+    return scope ? scope : symbolTable_.globalScope();
+  }
+
+  // Imported Modules
+  /**
+   * @brief A module signature this model bound imports against
+   */
+  struct ImportedModule {
+    std::string modulePath; ///< Path as written in the import statement
+    std::shared_ptr<const ModuleSignature> signature;
+  };
+
+  void addImportedModule(std::string modulePath, std::shared_ptr<const ModuleSignature> sig) {
+    if (sig)
+      importedModules_.push_back({std::move(modulePath), std::move(sig)});
+  }
+
+  /**
+   * @brief Signatures referenced by this model (keeps imported types alive)
+   */
+  [[nodiscard]] const std::vector<ImportedModule> &importedModules() const noexcept {
+    return importedModules_;
+  }
+
   // Diagnostics
   void addDiagnostic(Diagnostic diag) {
     if (diag.severity == DiagnosticSeverity::Error)
@@ -125,15 +176,22 @@ public:
   }
 
   void addError(ast::SourceRange range, std::string msg, std::string code = "") {
-    addDiagnostic({DiagnosticSeverity::Error, std::move(msg), range, std::move(code)});
+    addDiagnostic({DiagnosticSeverity::Error, std::move(msg), range, std::move(code), {}});
   }
 
   void addWarning(ast::SourceRange range, std::string msg, std::string code = "") {
-    addDiagnostic({DiagnosticSeverity::Warning, std::move(msg), range, std::move(code)});
+    addDiagnostic({DiagnosticSeverity::Warning, std::move(msg), range, std::move(code), {}});
   }
 
   [[nodiscard]] const std::vector<Diagnostic> &diagnostics() const noexcept { return diagnostics_; }
 
+  /// Lint findings (see LintEngine); advisory, never counted as errors
+  void setLintDiagnostics(std::vector<Diagnostic> diags) { lintDiagnostics_ = std::move(diags); }
+
+  [[nodiscard]] const std::vector<Diagnostic> &lintDiagnostics() const noexcept {
+    return lintDiagnostics_;
+  }
+
   [[nodiscard]] size_t errorCount() const noexcept { return errorCount_; }
 
   [[nodiscard]] bool hasErrors() const noexcept { return errorCount_ > 0; }
@@ -180,7 +238,10 @@ private:
   std::unordered_map<const ast::AstNode *, Symbol *> resolvedSymbols_;
   std::unordered_map<const ast::AstNode *, Symbol *> definingSymbols_;
   std::unordered_map<const ast::AstNode *, Scope *> nodeScopes_;
+  ScopeIntervalIndex scopeIndex_;
+  std::vector<ImportedModule> importedModules_;
   std::vector<Diagnostic> diagnostics_;
+  std::vector<Diagnostic> lintDiagnostics_;
   size_t errorCount_ = 0;
   SymbolTable symbolTable_;
   mutable types::TypeContext typeContext_;
@@ -197,14 +258,28 @@ class SemanticAnalyzer : public ast::AstVisitor<SemanticAnalyzer, types::TypeRef
 public:
   explicit SemanticAnalyzer(const ast::StringTable &strings) : strings_(strings) {}
 
+  /**
+   * @brief Set the resolver used to bind imports to exported signatures
+   *
+   * Without a resolver, imported names stay typed `unknown`.
+   */
+  void setModuleResolver(ModuleResolver resolver) { moduleResolver_ = std::move(resolver); }
+
   [[nodiscard]] SemanticModel analyze(ast::CompilationUnitNode *unit) {
     model_ = SemanticModel();
-    currentScope_ = model_.symbolTable().globalScope();
+    frames_.clear();
+    frames_.push_back({ScopeKind::Global, nullptr, model_.symbolTable().globalScope()});
+    binder_.clear();
+    binder_.enterScope();
+    loopDepth_ = 0;
+    importedClasses_.clear();
 
     if (unit) {
       collectDeclarations(unit);
       visit(unit);
     }
+    binder_.clear();
+    model_.buildScopeIndex();
     return std::move(model_);
   }
 
@@ -239,7 +314,7 @@ public:
 
   types::TypeRef visitIdentifier(ast::IdentifierNode *node) {
     auto name = getString(node->name);
-    if (Symbol *sym = currentScope_->resolve(name)) {
+    if (Symbol *sym = binder_.lookup(node->name)) {
       model_.setResolvedSymbol(node, sym);
       sym->addReference(node->range.begin);
       return setType(node, sym->type());
@@ -253,7 +328,7 @@ public:
       return setType(node, model_.typeContext().unknownType());
 
     auto firstName = getString(node->parts[0]);
-    if (Symbol *sym = currentScope_->resolve(firstName)) {
+    if (Symbol *sym = binder_.lookup(node->parts[0])) {
       model_.setResolvedSymbol(node, sym);
       if (node->parts.size() == 1)
         return setType(node, sym->type());
@@ -350,7 +425,7 @@ public:
       visit(arg);
     if (node->typeName && !node->typeName->parts.empty()) {
       auto className = getString(node->typeName->parts[0]);
-      if (auto classType = model_.typeContext().findClassType(className)) {
+      if (auto classType = findClassType(className)) {
         return setType(node, classType);
       }
     }
@@ -383,8 +458,7 @@ public:
   }
 
   types::TypeRef visitLambdaExpr(ast::LambdaExprNode *node) {
-    Scope *prev = currentScope_;
-    currentScope_ = model_.symbolTable().createScope(ScopeKind::Function, currentScope_, node);
+    enterScope(ScopeKind::Function, node);
 
     std::vector<types::TypeRef> paramTypes;
     uint32_t idx = 0;
@@ -393,7 +467,7 @@ public:
       paramTypes.push_back(pt);
       auto *ps = model_.symbolTable().createParameter(getString(param->name), pt,
                                                       param->range.begin, idx++);
-      currentScope_->define(ps);
+      declare(param->name, ps);
       model_.setDefiningSymbol(param, ps);
     }
 
@@ -401,7 +475,7 @@ public:
     if (node->body)
       visit(node->body);
 
-    currentScope_ = prev;
+    exitScope();
     return setType(node, model_.typeContext().makeFunctionType(std::move(paramTypes), retType));
   }
 
@@ -424,12 +498,10 @@ public:
   }
 
   types::TypeRef visitBlockStmt(ast::BlockStmtNode *node) {
-    Scope *prev = currentScope_;
-    currentScope_ = model_.symbolTable().createScope(ScopeKind::Block, currentScope_, node);
-    model_.setNodeScope(node, currentScope_);
+    enterScope(ScopeKind::Block, node);
     for (auto *stmt : node->statements)
       visit(stmt);
-    currentScope_ = prev;
+    exitScope();
     return model_.typeContext().voidType();
   }
 
@@ -465,16 +537,14 @@ public:
 
   types::TypeRef visitWhileStmt(ast::WhileStmtNode *node) {
     visit(node->condition);
-    Scope *prev = currentScope_;
-    currentScope_ = model_.symbolTable().createScope(ScopeKind::Loop, currentScope_, node);
+    enterScope(ScopeKind::Loop, node);
     visit(node->body);
-    currentScope_ = prev;
+    exitScope();
     return model_.typeContext().voidType();
   }
 
   types::TypeRef visitForStmt(ast::ForStmtNode *node) {
-    Scope *prev = currentScope_;
-    currentScope_ = model_.symbolTable().createScope(ScopeKind::Loop, currentScope_, node);
+    enterScope(ScopeKind::Loop, node);
 
     if (node->style == ast::ForStmtNode::Style::CStyle) {
       if (node->init)
@@ -497,25 +567,25 @@ public:
           if (vt->isUnknown())
             vt = elemType;
           auto *vs = model_.symbolTable().createVariable(getString(iv->name), vt, iv->range.begin);
-          currentScope_->define(vs);
+          declare(iv->name, vs);
           model_.setDefiningSymbol(iv, vs);
           setType(iv, vt);
         }
       }
     }
     visit(node->body);
-    currentScope_ = prev;
+    exitScope();
     return model_.typeContext().voidType();
   }
 
   types::TypeRef visitBreakStmt(ast::BreakStmtNode *node) {
-    if (!currentScope_->isInsideLoop())
+    if (loopDepth_ == 0)
       model_.addError(node->range, "'break' outside of loop", "E003");
     return model_.typeContext().voidType();
   }
 
   types::TypeRef visitContinueStmt(ast::ContinueStmtNode *node) {
-    if (!currentScope_->isInsideLoop())
+    if (loopDepth_ == 0)
       model_.addError(node->range, "'continue' outside of loop", "E003");
     return model_.typeContext().voidType();
   }
@@ -533,16 +603,38 @@ public:
 
   types::TypeRef visitImportStmt(ast::ImportStmtNode *node) {
     auto path = getString(node->modulePath);
+    std::shared_ptr<const ModuleSignature> sig;
+    if (moduleResolver_) {
+      sig = moduleResolver_(path);
+      model_.addImportedModule(std::string(path), sig);
+    }
+
     if (node->style == ast::ImportStmtNode::Style::Namespace) {
       auto alias = getString(node->namespaceAlias);
       auto *is = model_.symbolTable().createImport(alias, path, node->range.begin);
-      currentScope_->define(is);
+      is->setType(sig ? sig->namespaceType() : model_.typeContext().unknownType());
+      declare(node->namespaceAlias, is);
       model_.setDefiningSymbol(node, is);
     } else {
       for (auto &s : node->specifiers) {
         auto name = getString(s.alias);
         auto *is = model_.symbolTable().createImport(name, path, s.range.begin);
-        currentScope_->define(is);
+        // 模块无法解析时保持 unknown，避免后续按空类型取成员/调用
+        is->setType(model_.typeContext().unknownType());
+        if (sig) {
+          auto original = getString(s.name);
+          if (const ExportEntry *entry = sig->find(original)) {
+            is->setType(entry->type);
+            if (entry->kind == ExportKind::Class)
+              importedClasses_[std::string(name)] = entry->type;
+          } else {
+            model_.addError(s.range,
+                            "Module '" + std::string(path) + "' has no exported member '" +
+                                std::string(original) + "'",
+                            "E004");
+          }
+        }
+        declare(s.alias, is);
       }
     }
     return model_.typeContext().voidType();
@@ -571,11 +663,13 @@ public:
     else
       final_ = model_.typeContext().anyType();
 
-    if (Symbol *existing = currentScope_->resolveLocal(name)) {
+    if (Symbol *existing = binder_.lookupLocal(node->name)) {
       if (existing->type()->isUnknown())
         existing->setType(final_);
       if (declared->isUnknown() && !inferred->isUnknown())
         existing->addFlag(SymbolFlags::Inferred);
+      if (node->isExport())
+        existing->addFlag(SymbolFlags::Export);
       return setType(node, final_);
     }
 
@@ -584,10 +678,12 @@ public:
       vs->addFlag(SymbolFlags::Const);
     if (node->isGlobal())
       vs->addFlag(SymbolFlags::Global);
+    if (node->isExport())
+      vs->addFlag(SymbolFlags::Export);
     if (declared->isUnknown())
       vs->addFlag(SymbolFlags::Inferred);
     vs->setAstNode(node);
-    currentScope_->define(vs);
+    declare(node->name, vs);
     model_.setDefiningSymbol(node, vs);
     return setType(node, final_);
   }
@@ -607,7 +703,7 @@ public:
       }
       auto *vs = model_.symbolTable().createVariable(name, vt, node->range.begin);
       vs->addFlag(SymbolFlags::Inferred);
-      currentScope_->define(vs);
+      declare(node->names[i], vs);
     }
     return model_.typeContext().voidType();
   }
@@ -628,7 +724,7 @@ public:
         model_.typeContext().makeFunctionType(paramTypes, retType, node->hasVarArgs);
 
     FunctionSymbol *fs = nullptr;
-    if (Symbol *existing = currentScope_->resolveLocal(name)) {
+    if (Symbol *existing = binder_.lookupLocal(node->name)) {
       if (existing->isFunction()) {
         fs = static_cast<FunctionSymbol *>(existing);
         fs->setType(funcType);
@@ -640,16 +736,15 @@ public:
       fs->setReturnType(retType);
       fs->setMultiReturn(node->isMultiReturn);
       fs->setAstNode(node);
-      if (node->isExport())
-        fs->addFlag(SymbolFlags::Export);
-      currentScope_->define(fs);
+      declare(node->name, fs);
     }
+    if (node->isExport())
+      fs->addFlag(SymbolFlags::Export);
     model_.setDefiningSymbol(node, fs);
 
-    Scope *prev = currentScope_;
-    currentScope_ = model_.symbolTable().createScope(ScopeKind::Function, currentScope_, node);
-    fs->setBodyScope(currentScope_);
-    model_.setNodeScope(node, currentScope_);
+    enterScope(ScopeKind::Function, node);
+    fs->setBodyScope(currentScope());
+    model_.setNodeScope(node, currentScope());
 
     uint32_t idx = 0;
     for (auto *p : node->parameters) {
@@ -658,7 +753,7 @@ public:
       auto *ps = model_.symbolTable().createParameter(pn, pt, p->range.begin, idx++);
       if (p->isVariadic)
         ps->addFlag(SymbolFlags::Variadic);
-      currentScope_->define(ps);
+      declare(p->name, ps);
       fs->addParameter(ps);
       model_.setDefiningSymbol(p, ps);
       setType(p, pt);
@@ -666,7 +761,7 @@ public:
 
     if (node->body)
       visit(node->body);
-    currentScope_ = prev;
+    exitScope();
     return setType(node, funcType);
   }
 
@@ -678,7 +773,6 @@ public:
   }
 
   types::TypeRef visitMethodDecl(ast::MethodDeclNode *node) {
-    auto name = getString(node->name);
     types::TypeRef retType = resolveTypeNode(node->returnType);
 
     std::vector<types::TypeRef> paramTypes;
@@ -686,17 +780,16 @@ public:
       paramTypes.push_back(resolveTypeNode(p->type));
     types::TypeRef methType = model_.typeContext().makeFunctionType(paramTypes, retType);
 
-    MethodSymbol *ms = symbol_cast<MethodSymbol>(currentScope_->resolveLocal(name));
+    MethodSymbol *ms = symbol_cast<MethodSymbol>(binder_.lookupLocal(node->name));
     if (ms) {
       ms->setType(methType);
       ms->setReturnType(retType);
     }
 
-    Scope *prev = currentScope_;
-    currentScope_ = model_.symbolTable().createScope(ScopeKind::Function, currentScope_, node);
+    enterScope(ScopeKind::Function, node);
     if (ms) {
-      ms->setBodyScope(currentScope_);
-      model_.setNodeScope(node, currentScope_);
+      ms->setBodyScope(currentScope());
+      model_.setNodeScope(node, currentScope());
     }
 
     uint32_t idx = 0;
@@ -704,7 +797,7 @@ public:
       auto pn = getString(p->name);
       types::TypeRef pt = resolveTypeNode(p->type);
       auto *ps = model_.symbolTable().createParameter(pn, pt, p->range.begin, idx++);
-      currentScope_->define(ps);
+      declare(p->name, ps);
       if (ms)
         ms->addParameter(ps);
       model_.setDefiningSymbol(p, ps);
@@ -713,7 +806,7 @@ public:
 
     if (node->body)
       visit(node->body);
-    currentScope_ = prev;
+    exitScope();
     return setType(node, methType);
   }
 
@@ -721,26 +814,25 @@ public:
     auto className = getString(node->name);
 
     ClassSymbol *cs = nullptr;
-    if (Symbol *existing = currentScope_->resolveLocal(className)) {
+    if (Symbol *existing = binder_.lookupLocal(node->name)) {
       if (existing->isClass())
         cs = static_cast<ClassSymbol *>(existing);
     }
     if (!cs) {
       cs = model_.symbolTable().createClass(className, node->range.begin);
       cs->setAstNode(node);
-      if (node->isExport())
-        cs->addFlag(SymbolFlags::Export);
-      currentScope_->define(cs);
+      declare(node->name, cs);
     }
+    if (node->isExport())
+      cs->addFlag(SymbolFlags::Export);
 
     auto *classType = model_.typeContext().getOrCreateClassType(className);
     cs->setClassType(classType);
     model_.setDefiningSymbol(node, cs);
 
-    Scope *prev = currentScope_;
-    currentScope_ = model_.symbolTable().createScope(ScopeKind::Class, currentScope_, node);
-    cs->setMemberScope(currentScope_);
-    model_.setNodeScope(node, currentScope_);
+    enterScope(ScopeKind::Class, node);
+    cs->setMemberScope(currentScope());
+    model_.setNodeScope(node, currentScope());
 
     for (auto *f : node->fields) {
       auto fn = getString(f->name);
@@ -750,7 +842,7 @@ public:
         fld->addFlag(SymbolFlags::Static);
       if (f->isConst())
         fld->addFlag(SymbolFlags::Const);
-      currentScope_->define(fld);
+      declare(f->name, fld);
       cs->addField(fld);
       model_.setDefiningSymbol(f, fld);
       classType->addField({std::string(fn), ft, f->isStatic(), f->isConst()});
@@ -767,19 +859,19 @@ public:
       auto *meth = model_.symbolTable().createMethod(mn, mt, m->range.begin, cs);
       if (m->isStatic())
         meth->addFlag(SymbolFlags::Static);
-      currentScope_->define(meth);
+      declare(m->name, meth);
       cs->addMethod(meth);
       model_.setDefiningSymbol(m, meth);
       classType->addMethod({std::string(mn), mt, m->isStatic()});
       visit(m);
     }
 
-    currentScope_ = prev;
+    exitScope();
     return setType(node, types::TypeRef(classType));
   }
 
   types::TypeRef visitCompilationUnit(ast::CompilationUnitNode *node) {
-    model_.setNodeScope(node, currentScope_);
+    model_.setNodeScope(node, currentScope());
     for (auto *imp : node->imports)
       visit(imp);
     for (auto *stmt : node->statements)
@@ -854,7 +946,7 @@ public:
   types::TypeRef visitQualifiedType(ast::QualifiedTypeNode *node) {
     if (node->name && !node->name->parts.empty()) {
       auto typeName = getString(node->name->parts[0]);
-      if (auto ct = model_.typeContext().findClassType(typeName)) {
+      if (auto ct = findClassType(typeName)) {
         return setType(node, ct);
       }
     }
@@ -873,6 +965,75 @@ private:
 
   std::string_view getString(ast::InternedString str) const { return strings_.get(str); }
 
+  // ========================================================================
+  // Scopes and Binding
+  // ========================================================================
+
+  /**
+   * @brief A lexical scope open during the traversal
+   *
+   * Block and loop scopes get a persistent Scope only once something is
+   * declared in them: an empty one is indistinguishable from its parent for
+   * completion and hover, and most blocks declare nothing.
+   */
+  struct ScopeFrame {
+    ScopeKind kind;
+    ast::AstNode *node;
+    Scope *scope; ///< nullptr until materialized
+  };
+
+  void enterScope(ScopeKind kind, ast::AstNode *node) {
+    frames_.push_back({kind, node, nullptr});
+    binder_.enterScope();
+    if (kind == ScopeKind::Loop)
+      ++loopDepth_;
+    if (kind != ScopeKind::Block && kind != ScopeKind::Loop)
+      (void)currentScope();
+  }
+
+  void exitScope() {
+    if (frames_.back().kind == ScopeKind::Loop)
+      --loopDepth_;
+    binder_.exitScope();
+    frames_.pop_back();
+  }
+
+  /**
+   * @brief Persistent Scope of the innermost frame, created on first use
+   */
+  Scope *currentScope() {
+    size_t first = frames_.size() - 1;
+    while (!frames_[first].scope)
+      --first; // frames_[0] is the global scope
+    for (size_t i = first + 1; i < frames_.size(); ++i) {
+      ScopeFrame &f = frames_[i];
+      f.scope = model_.symbolTable().createScope(f.kind, frames_[i - 1].scope, f.node);
+      if (f.kind == ScopeKind::Block)
+        model_.setNodeScope(f.node, f.scope);
+    }
+    return frames_.back().scope;
+  }
+
+  /**
+   * @brief Define a symbol in the innermost scope and bind its name
+   *
+   * A name already defined in the same scope keeps its first definition.
+   */
+  void declare(ast::InternedString name, Symbol *symbol) {
+    if (currentScope()->define(symbol))
+      binder_.bind(name, symbol);
+  }
+
+  /**
+   * @brief Find a class type declared locally or imported by name
+   */
+  types::TypeRef findClassType(std::string_view name) const {
+    if (auto ct = model_.typeContext().findClassType(name))
+      return ct;
+    auto it = importedClasses_.find(std::string(name));
+    return it != importedClasses_.end() ? it->second : types::TypeRef();
+  }
+
   types::TypeRef resolveTypeNode(ast::TypeNode *node) {
     if (!node)
       return model_.typeContext().unknownType();
@@ -898,7 +1059,7 @@ private:
       auto *fs = model_.symbolTable().createFunction(name, model_.typeContext().unknownType(),
                                                      fd->range.begin);
       fs->addFlag(SymbolFlags::Undefined);
-      currentScope_->define(fs);
+      declare(fd->name, fs);
       break;
     }
     case ast::AstKind::ClassDecl: {
@@ -907,7 +1068,7 @@ private:
       auto *cs = model_.symbolTable().createClass(name, cd->range.begin);
       cs->addFlag(SymbolFlags::Undefined);
       (void)model_.typeContext().getOrCreateClassType(name);
-      currentScope_->define(cs);
+      declare(cd->name, cs);
       break;
     }
     default:
@@ -917,7 +1078,11 @@ private:
 
   const ast::StringTable &strings_;
   SemanticModel model_;
-  Scope *currentScope_ = nullptr;
+  std::vector<ScopeFrame> frames_;
+  NameBinder binder_; ///< Resolves references in O(1) during the traversal
+  uint32_t loopDepth_ = 0;
+  ModuleResolver moduleResolver_;
+  std::unordered_map<std::string, types::TypeRef> importedClasses_; ///< Local name -> class
 };
 
 } // namespace semantic
@@ -24,11 +24,15 @@
 #include "LspLogger.h"
 
 #include "AstFactory.h"
+#include "AstImage.h"
 #include "AstNodes.h"
 #include "LangLexer.h"
 #include "LangParser.h"
 #include "LineOffsetTable.h"
+#include "RequestPhase.h"
+#include "StreamingParser.h"
 #include "TolerantAstBuilder.h"
+#include "Utf8CharStream.h"
 #include "antlr4-runtime.h"
 
 #include <cstring>
@@ -312,6 +316,39 @@ public:
     return lineTable_.getPosition(offset);
   }
 
+  /**
+   * @brief Byte offset into content() of an AST location
+   *
+   * AST offsets and columns count code points; text is indexed by byte.
+   * Converts within the location's line only.
+   */
+  [[nodiscard]] uint32_t byteOffsetOf(ast::SourceLoc loc) const noexcept {
+    if (!loc.isValid())
+      return static_cast<uint32_t>(content_.size());
+    std::string_view line = lineTable_.getLineText(content_, loc.line);
+    return lineTable_.getLineStartOffset(loc.line) +
+           utf8::codePointToByteOffset(line, loc.column > 0 ? loc.column - 1 : 0);
+  }
+
+  /**
+   * @brief AST offset (code points from the start) of a byte offset into content()
+   */
+  [[nodiscard]] uint32_t codePointOffsetOf(uint32_t offset) const noexcept {
+    return utf8::byteOffsetToCodePoint(content_, offset);
+  }
+
+  /**
+   * @brief Position of a byte offset, with the column in code points like AST locations
+   */
+  [[nodiscard]] Position positionOfByte(uint32_t offset) const noexcept {
+    Position pos = lineTable_.getPosition(offset);
+    uint32_t lineStart = lineTable_.getLineStartOffset(pos.line);
+    if (lineStart < offset && offset <= content_.size())
+      pos.column = utf8::byteOffsetToCodePoint(
+                       std::string_view(content_).substr(lineStart), offset - lineStart) + 1;
+    return pos;
+  }
+
   /**
    * @brief Convert AST SourceLoc to LSP Position
    */
@@ -439,6 +476,45 @@ public:
    */
   [[nodiscard]] bool isAstValid() const noexcept { return astValid_; }
 
+  /// Files at least this large are parsed with StreamingParser by default
+  static constexpr size_t DefaultStreamingThreshold = 32u * 1024 * 1024;
+
+  /**
+   * @brief Content size (bytes) from which reparse() streams statement by statement
+   *        and keeps only a skeletal AST
+   */
+  void setStreamingThreshold(size_t bytes) noexcept { streamingThreshold_ = bytes; }
+
+  [[nodiscard]] size_t streamingThreshold() const noexcept { return streamingThreshold_; }
+
+  /**
+   * @brief On-disk AST image cache consulted before a full parse (nullptr = none)
+   *
+   * Only the on-disk version of a file is stored; edited buffers are parsed
+   * normally.
+   */
+  void setImageCache(std::shared_ptr<ast::AstImageCache> cache) noexcept {
+    imageCache_ = std::move(cache);
+  }
+
+  /**
+   * @brief True if the current AST was mapped from an image instead of parsed
+   */
+  [[nodiscard]] bool isAstFromImage() const noexcept { return fromImage_; }
+
+  /**
+   * @brief True if the current AST is skeletal (declarations only, no bodies)
+   */
+  [[nodiscard]] bool isSkeletal() const noexcept { return skeletal_; }
+
+  /**
+   * @brief Hash of the text the current AST was parsed from (valid after getAst())
+   *
+   * Unlike version(), which restarts when a document is reopened, equal hashes
+   * mean equal text.
+   */
+  [[nodiscard]] uint64_t contentHash() const noexcept { return contentHash_; }
+
   /**
    * @brief Invalidate the AST (forces reparse on next access)
    */
@@ -485,6 +561,9 @@ public:
   }
 
 private:
+  bool loadImage();
+  void storeImage();
+
   // File identity
   std::string path_;
   std::string uri_;
@@ -501,6 +580,11 @@ private:
   ast::AstFactory factory_;
   ast::CompilationUnitNode *ast_ = nullptr;
   bool astValid_ = false;
+  bool skeletal_ = false;
+  uint64_t contentHash_ = 0;
+  size_t streamingThreshold_ = DefaultStreamingThreshold;
+  std::shared_ptr<ast::AstImageCache> imageCache_;
+  bool fromImage_ = false;
 
   // Diagnostics
   std::vector<Diagnostic> diagnostics_;
@@ -577,8 +661,37 @@ inline ast::CompilationUnitNode *SourceFile::getAst() {
   return ast_;
 }
 
+/**
+ * @brief Turns ANTLR syntax errors into diagnostics of a SourceFile
+ */
+struct SyntaxErrorCollector : public antlr4::BaseErrorListener {
+  SourceFile *file;
+
+  explicit SyntaxErrorCollector(SourceFile *f) : file(f) {}
+
+  void syntaxError(antlr4::Recognizer * /*recognizer*/, antlr4::Token *offendingSymbol,
+                   size_t line, size_t charPositionInLine, const std::string &msg,
+                   std::exception_ptr /*e*/) override {
+    Diagnostic d;
+    // 注意：ANTLR 也是 1-based 行号，0-based 列号，需要对应你的 Range 定义
+    // 这里假设你的 Range 需要 1-based
+    Position start{static_cast<uint32_t>(line), static_cast<uint32_t>(charPositionInLine + 1)};
+    Position end = start;
+    if (offendingSymbol) {
+      end.column += offendingSymbol->getText().length();
+    }
+
+    d.range = Range{start, end};
+    d.severity = DiagnosticSeverity::Error;
+    d.message = msg;
+    d.source = "lang-parser";
+    file->addDiagnostic(d);
+  }
+};
+
 inline void SourceFile::reparse() {
   LSP_LOG_SEP("SourceFile::reparse()");
+  PhaseScope phase(RequestPhase::Parse);
   LSP_LOG("this=" << (void *)this << ", path=" << path_);
 
   // 1. 清理旧状态
@@ -588,10 +701,30 @@ inline void SourceFile::reparse() {
   factory_ = ast::AstFactory();
   ast_ = nullptr; // 重要：重置 ast_ 指针
   astValid_ = false;
+  skeletal_ = false;
+  fromImage_ = false;
+  contentHash_ = ast::StructuralHasher::hashBytes(content_);
+
+  bool useImage = imageCache_ && content_.size() >= imageCache_->minContentBytes();
+  if (useImage && loadImage())
+    return;
 
   try {
-    // 2. 准备 ANTLR 输入流
-    antlr4::ANTLRInputStream input(content_);
+    SyntaxErrorCollector errorListener(this);
+
+    // 超大文件：逐条语句流式解析，只保留骨架 AST
+    if (content_.size() >= streamingThreshold_) {
+      StreamingParser streaming(content_, path_);
+      streaming.addErrorListener(&errorListener);
+      ast_ = streaming.parse(factory_, filename());
+      skeletal_ = true;
+      astValid_ = true;
+      LSP_LOG("reparse() streamed " << content_.size() << " bytes: ast_=" << (void *)ast_);
+      return;
+    }
+
+    // 2. 准备 ANTLR 输入流 (借用 content_，不复制为 UTF-32)
+    Utf8CharStream input(content_, path_);
 
     // 3. 词法分析
     LangLexer lexer(&input);
@@ -604,35 +737,7 @@ inline void SourceFile::reparse() {
     LangParser parser(&tokens);
     parser.removeErrorListeners();
 
-    // [可选] 添加错误监听器，把语法错误转换成 LSP Diagnostics
-    // 这里简单写一个 lambda 作为示例，或者你可以写一个类
-    // 如果这里不加，VS Code 里就没有红色波浪线报错
-    struct LspErrorListener : public antlr4::BaseErrorListener {
-      SourceFile *file;
-
-      LspErrorListener(SourceFile *f) : file(f) {}
-
-      void syntaxError(antlr4::Recognizer *recognizer, antlr4::Token *offendingSymbol, size_t line,
-                       size_t charPositionInLine, const std::string &msg,
-                       std::exception_ptr e) override {
-        Diagnostic d;
-        // 注意：ANTLR 也是 1-based 行号，0-based 列号，需要对应你的 Range 定义
-        // 这里假设你的 Range 需要 1-based
-        Position start{static_cast<uint32_t>(line), static_cast<uint32_t>(charPositionInLine + 1)};
-        Position end = start;
-        if (offendingSymbol) {
-          end.column += offendingSymbol->getText().length();
-        }
-
-        d.range = Range{start, end};
-        d.severity = DiagnosticSeverity::Error;
-        d.message = msg;
-        d.source = "lang-parser";
-        file->addDiagnostic(d);
-      }
-    };
-
-    LspErrorListener errorListener(this);
+    // 把语法错误转换成 LSP Diagnostics
     parser.addErrorListener(&errorListener);
 
     // 5. 执行解析 (生成 CST)
@@ -656,6 +761,9 @@ inline void SourceFile::reparse() {
     astValid_ = true;
     LSP_LOG("reparse() complete: astValid_=true, ast_=" << (void *)ast_);
 
+    if (useImage && state_ == FileState::Clean)
+      storeImage();
+
   } catch (const std::exception &e) {
     // 防止解析崩溃导致服务退出
     // 发生严重错误时，创建一个空的 AST 兜底
@@ -668,6 +776,39 @@ inline void SourceFile::reparse() {
     LSP_LOG("reparse() unknown exception");
     ast_ = factory_.makeCompilationUnit(ast::SourceRange::invalid(), filename(), {});
   }
+  // 兜底 AST 同样有效：同样的内容再解析也会失败，getAst() 不应在读取时重新解析
+  astValid_ = true;
+}
+
+inline bool SourceFile::loadImage() {
+  std::vector<ast::ImageDiagnostic> syntaxErrors;
+  ast_ = imageCache_->load(content_, path_, factory_, syntaxErrors);
+  if (!ast_) {
+    factory_ = ast::AstFactory(); // 丢弃被拒镜像残留的字符串表
+    return false;
+  }
+
+  for (const auto &e : syntaxErrors) {
+    Diagnostic d;
+    d.range = Range{Position{e.beginLine, e.beginColumn}, Position{e.endLine, e.endColumn}};
+    d.severity = DiagnosticSeverity::Error;
+    d.message = e.message;
+    d.source = "lang-parser";
+    addDiagnostic(std::move(d));
+  }
+  fromImage_ = true;
+  astValid_ = true;
+  LSP_LOG("reparse() mapped AST image for " << path_ << ": ast_=" << (void *)ast_);
+  return true;
+}
+
+inline void SourceFile::storeImage() {
+  std::vector<ast::ImageDiagnostic> syntaxErrors;
+  for (const auto &d : diagnostics_) {
+    syntaxErrors.push_back({d.range.start.line, d.range.start.column, d.range.end.line,
+                            d.range.end.column, d.message});
+  }
+  imageCache_->store(content_, path_, ast_, factory_.strings(), syntaxErrors);
 }
 
 } // namespace lsp
@@ -0,0 +1,184 @@
+/**
+ * @file StreamingParser.h
+ * @brief Bounded-Memory Statement-at-a-Time Parse for Huge Files
+ *
+ * A full parse keeps every token (CommonTokenStream) and the whole CST alive
+ * until the AST has been built, so a several-hundred-megabyte generated data
+ * script exhausts memory. StreamingParser parses one top-level statement at a
+ * time over an UnbufferedTokenStream, turns it into a skeletal AST node right
+ * away and then frees the statement's tokens and CST.
+ *
+ * Key Features:
+ * - Token and CST memory proportional to the largest top-level statement
+ * - Skeletal AST: imports and top-level declarations with their ranges
+ *   (bodies and initializers elided), enough for outline, workspace symbols
+ *   and go-to-definition
+ * - Same prediction and error recovery as a full `compilationUnit` parse:
+ *   statements are parsed under a persistent root context
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "AstFactory.h"
+#include "LangLexer.h"
+#include "LangParser.h"
+#include "LspLogger.h"
+#include "TolerantAstBuilder.h"
+#include "Utf8CharStream.h"
+#include "antlr4-runtime.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief Counters of one streaming parse
+ */
+struct StreamingParseStats {
+  uint64_t statements = 0;        ///< Top-level statements parsed
+  uint64_t keptStatements = 0;    ///< Statements kept in the skeletal AST
+  uint64_t tokens = 0;            ///< Tokens consumed (excluding EOF)
+  uint64_t maxStatementTokens = 0; ///< Largest statement, bounds the token buffer
+};
+
+/**
+ * @brief Parses a document statement by statement into a skeletal AST
+ *
+ * Usage:
+ *   StreamingParser parser(content, path);
+ *   parser.addErrorListener(&listener);
+ *   auto *cu = parser.parse(factory, filename);
+ */
+class StreamingParser {
+public:
+  /// The document must outlive the parser and any token text it hands out
+  StreamingParser(std::string_view content, std::string sourceName)
+      : input_(content, std::move(sourceName)), lexer_(&input_), tokens_(&lexer_),
+        parser_(&tokens_) {
+    lexer_.removeErrorListeners();
+    parser_.removeErrorListeners();
+  }
+
+  StreamingParser(const StreamingParser &) = delete;
+  StreamingParser &operator=(const StreamingParser &) = delete;
+
+  void addErrorListener(antlr4::ANTLRErrorListener *listener) {
+    parser_.addErrorListener(listener);
+  }
+
+  /**
+   * @brief Parse the whole document
+   */
+  ast::CompilationUnitNode *parse(ast::AstFactory &factory, std::string_view filename) {
+    ast::TolerantAstBuilder builder(factory, filename);
+    builder.setSkeletal(true);
+
+    std::vector<ast::Stmt *> stmts;
+    ast::SourceLoc begin{1, 1, 0};
+
+    while (tokens_.LA(1) != antlr4::Token::EOF) {
+      size_t startIndex = tokens_.index();
+
+      // 持有 marker：语句的 token 在 AST 构建完之前不能被释放
+      ssize_t marker = tokens_.mark();
+      auto *stmt = parser_.nextStatement();
+      if (auto *node = builder.buildStatement(stmt)) {
+        stmts.push_back(node);
+        ++stats_.keptStatements;
+      }
+      tokens_.release(marker);
+      parser_.discardTree();
+
+      // Error recovery made no progress: skip the offending token
+      if (tokens_.index() == startIndex && tokens_.LA(1) != antlr4::Token::EOF) {
+        tokens_.consume();
+      }
+
+      uint64_t consumed = tokens_.index() - startIndex;
+      stats_.tokens += consumed;
+      stats_.maxStatementTokens = std::max(stats_.maxStatementTokens, consumed);
+      ++stats_.statements;
+    }
+
+    auto *eof = tokens_.LT(1);
+    ast::SourceLoc end{static_cast<uint32_t>(eof->getLine()),
+                       static_cast<uint32_t>(eof->getCharPositionInLine() + 1),
+                       static_cast<uint32_t>(eof->getStartIndex())};
+
+    LSP_LOG("StreamingParser: " << stats_.statements << " statements, " << stats_.keptStatements
+                                << " kept, " << stats_.tokens << " tokens, largest statement "
+                                << stats_.maxStatementTokens << " tokens");
+
+    return builder.buildCompilationUnit(ast::SourceRange{begin, end}, stmts);
+  }
+
+  [[nodiscard]] const StreamingParseStats &stats() const noexcept { return stats_; }
+
+  [[nodiscard]] size_t numberOfSyntaxErrors() { return parser_.getNumberOfSyntaxErrors(); }
+
+private:
+  /**
+   * @brief LangParser that parses `statement` as if called from `compilationUnit`
+   */
+  class StatementParser : public LangParser {
+  public:
+    explicit StatementParser(antlr4::TokenStream *input)
+        : LangParser(input), root_(nullptr, INVALID_INDEX), invokingState_(findInvokingState()) {}
+
+    /**
+     * @brief Parse the next top-level statement
+     *
+     * The statement context's parent is a root CompilationUnitContext and its
+     * invoking state is the `statement` call inside `compilationUnit`, so error
+     * recovery sets and full-context prediction see the real follow set.
+     */
+    StatementContext *nextStatement() {
+      _ctx = &root_;
+      setState(invokingState_);
+      auto *stmt = statement();
+      _ctx = nullptr;
+      return stmt;
+    }
+
+    /**
+     * @brief Free the CST of the statement just parsed
+     */
+    void discardTree() {
+      root_.children.clear();
+      getTreeTracker().reset();
+    }
+
+  private:
+    size_t findInvokingState() const {
+      const auto &atn = getATN();
+      for (auto *state : atn.states) {
+        if (!state || state->ruleIndex != RuleCompilationUnit)
+          continue;
+        for (const auto &transition : state->transitions) {
+          if (antlr4::atn::RuleTransition::is(transition.get()) &&
+              transition->target->ruleIndex == RuleStatement) {
+            return state->stateNumber;
+          }
+        }
+      }
+      return INVALID_INDEX;
+    }
+
+    CompilationUnitContext root_; ///< Not tracked, outlives every statement
+    size_t invokingState_;
+  };
+
+  Utf8CharStream input_;
+  LangLexer lexer_;
+  antlr4::UnbufferedTokenStream tokens_;
+  StatementParser parser_;
+  StreamingParseStats stats_;
+};
+
+} // namespace lsp
+} // namespace lang
@@ -0,0 +1,487 @@
+/**
+ * @file StructuralHash.h
+ * @brief Merkle-Style Subtree Hashes for Early-Cutoff Caching
+ *
+ * Every statement and declaration carries a hash of its subtree that depends
+ * only on structure and content: node kinds, flags, operators, literal values
+ * and names (by text, not by interned id). Source positions and trivia
+ * (whitespace, comments, literal spelling such as hex vs decimal) are ignored,
+ * so inserting lines above a function or reformatting its body leaves its hash
+ * unchanged, while any token-level change inside it changes the hash of that
+ * subtree and of every enclosing one.
+ *
+ * Key Features:
+ * - One post-order pass when the builder finishes a compilation unit
+ * - Child statements/declarations reuse their stored hash (Merkle tree)
+ * - Stable across processes and runs (FNV-1a over text, fixed mixing), so
+ *   the hashes may be persisted
+ * - SubtreeCache: a thread-safe hash -> value cache for per-declaration results
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "AstFactory.h"
+#include "AstNodes.h"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lang {
+namespace ast {
+
+// ============================================================================
+// Structural Hasher
+// ============================================================================
+
+/**
+ * @brief Computes and stores structural hashes of a tree
+ *
+ * Usage:
+ *   StructuralHasher(factory.strings()).hashTree(unit);
+ *   uint64_t h = someFunctionDecl->structuralHash;
+ */
+class StructuralHasher {
+public:
+  explicit StructuralHasher(const StringTable &strings) : strings_(strings) {}
+
+  /**
+   * @brief Hash every statement and declaration below (and including) `unit`
+   */
+  uint64_t hashTree(CompilationUnitNode *unit) { return hash(unit); }
+
+  /**
+   * @brief Stable 64-bit FNV-1a of a byte string
+   */
+  [[nodiscard]] static uint64_t hashBytes(std::string_view bytes) noexcept {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : bytes) {
+      h ^= c;
+      h *= 0x100000001b3ull;
+    }
+    return h;
+  }
+
+private:
+  static constexpr uint64_t NullHash = 0x6e756c6c6e6f6465ull; ///< Absent optional child
+
+  static void combine(uint64_t &seed, uint64_t value) noexcept {
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+  }
+
+  /// Final avalanche so that similar subtrees do not get similar hashes
+  static uint64_t finish(uint64_t h) noexcept {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h ? h : 1; // 0 means "not computed"
+  }
+
+  uint64_t str(InternedString s) {
+    if (s.id >= stringHashes_.size())
+      stringHashes_.resize(static_cast<size_t>(s.id) + 1, 0);
+    uint64_t &h = stringHashes_[s.id];
+    if (!h)
+      h = hashBytes(strings_.get(s)) | 1;
+    return h;
+  }
+
+  template <typename T> void list(uint64_t &seed, ArrayView<T *> nodes) {
+    combine(seed, nodes.size());
+    for (T *n : nodes)
+      combine(seed, hash(n));
+  }
+
+  uint64_t hash(AstNode *node) {
+    if (!node)
+      return NullHash;
+
+    // 子语句/声明已有哈希时直接复用（Merkle 树）
+    if (isStmt(node->kind)) {
+      if (uint64_t h = static_cast<Stmt *>(node)->structuralHash)
+        return h;
+    } else if (isDecl(node->kind)) {
+      if (uint64_t h = static_cast<Decl *>(node)->structuralHash)
+        return h;
+    }
+
+    uint64_t h = static_cast<uint64_t>(node->kind);
+    combine(h, static_cast<uint64_t>(node->flags));
+
+    switch (node->kind) {
+    // Expressions
+    case AstKind::ErrorExpr:
+      combine(h, str(static_cast<ErrorExprNode *>(node)->errorMessage));
+      break;
+    case AstKind::BoolLiteral:
+      combine(h, static_cast<BoolLiteralNode *>(node)->value);
+      break;
+    case AstKind::IntLiteral:
+      combine(h, static_cast<uint64_t>(static_cast<IntLiteralNode *>(node)->value));
+      break;
+    case AstKind::FloatLiteral: {
+      double v = static_cast<FloatLiteralNode *>(node)->value;
+      uint64_t bits;
+      std::memcpy(&bits, &v, sizeof bits);
+      combine(h, bits);
+      break;
+    }
+    case AstKind::StringLiteral:
+      combine(h, str(static_cast<StringLiteralNode *>(node)->value));
+      break;
+    case AstKind::Identifier:
+      combine(h, str(static_cast<IdentifierNode *>(node)->name));
+      break;
+    case AstKind::QualifiedIdentifier: {
+      auto *n = static_cast<QualifiedIdentifierNode *>(node);
+      combine(h, n->parts.size());
+      for (InternedString part : n->parts)
+        combine(h, str(part));
+      break;
+    }
+    case AstKind::MemberAccessExpr: {
+      auto *n = static_cast<MemberAccessExprNode *>(node);
+      combine(h, hash(n->base));
+      combine(h, str(n->member));
+      break;
+    }
+    case AstKind::IndexExpr: {
+      auto *n = static_cast<IndexExprNode *>(node);
+      combine(h, hash(n->base));
+      combine(h, hash(n->index));
+      break;
+    }
+    case AstKind::ColonLookupExpr: {
+      auto *n = static_cast<ColonLookupExprNode *>(node);
+      combine(h, hash(n->base));
+      combine(h, str(n->member));
+      break;
+    }
+    case AstKind::BinaryExpr: {
+      auto *n = static_cast<BinaryExprNode *>(node);
+      combine(h, static_cast<uint64_t>(n->op));
+      combine(h, hash(n->left));
+      combine(h, hash(n->right));
+      break;
+    }
+    case AstKind::UnaryExpr: {
+      auto *n = static_cast<UnaryExprNode *>(node);
+      combine(h, static_cast<uint64_t>(n->op));
+      combine(h, n->isPrefix);
+      combine(h, hash(n->operand));
+      break;
+    }
+    case AstKind::CallExpr: {
+      auto *n = static_cast<CallExprNode *>(node);
+      combine(h, hash(n->callee));
+      list(h, n->arguments);
+      break;
+    }
+    case AstKind::NewExpr: {
+      auto *n = static_cast<NewExprNode *>(node);
+      combine(h, hash(n->typeName));
+      list(h, n->arguments);
+      break;
+    }
+    case AstKind::ListExpr:
+      list(h, static_cast<ListExprNode *>(node)->elements);
+      break;
+    case AstKind::MapExpr:
+      list(h, static_cast<MapExprNode *>(node)->entries);
+      break;
+    case AstKind::MapEntryExpr: {
+      auto *n = static_cast<MapEntryNode *>(node);
+      combine(h, hash(n->key));
+      combine(h, hash(n->value));
+      combine(h, n->isIdentifierKey);
+      combine(h, n->isBracketedKey);
+      break;
+    }
+    case AstKind::LambdaExpr: {
+      auto *n = static_cast<LambdaExprNode *>(node);
+      combine(h, hash(n->returnType));
+      list(h, n->params);
+      combine(h, hash(n->body));
+      combine(h, n->isMultiReturn);
+      break;
+    }
+    case AstKind::ParenExpr:
+      combine(h, hash(static_cast<ParenExprNode *>(node)->inner));
+      break;
+
+    // Statements
+    case AstKind::ErrorStmt:
+      combine(h, str(static_cast<ErrorStmtNode *>(node)->errorMessage));
+      break;
+    case AstKind::ExprStmt:
+      combine(h, hash(static_cast<ExprStmtNode *>(node)->expr));
+      break;
+    case AstKind::BlockStmt:
+      list(h, static_cast<BlockStmtNode *>(node)->statements);
+      break;
+    case AstKind::AssignStmt: {
+      auto *n = static_cast<AssignStmtNode *>(node);
+      combine(h, hash(n->target.expr));
+      combine(h, hash(n->value));
+      break;
+    }
+    case AstKind::MultiAssignStmt: {
+      auto *n = static_cast<MultiAssignStmtNode *>(node);
+      combine(h, n->targets.size());
+      for (const LValue &t : n->targets)
+        combine(h, hash(t.expr));
+      list(h, n->values);
+      break;
+    }
+    case AstKind::UpdateAssignStmt: {
+      auto *n = static_cast<UpdateAssignStmtNode *>(node);
+      combine(h, static_cast<uint64_t>(n->op));
+      combine(h, hash(n->target.expr));
+      combine(h, hash(n->value));
+      break;
+    }
+    case AstKind::IfStmt: {
+      auto *n = static_cast<IfStmtNode *>(node);
+      combine(h, n->branches.size());
+      for (const auto &b : n->branches) {
+        combine(h, hash(b.condition));
+        combine(h, hash(b.body));
+      }
+      combine(h, hash(n->elseBody));
+      break;
+    }
+    case AstKind::WhileStmt: {
+      auto *n = static_cast<WhileStmtNode *>(node);
+      combine(h, hash(n->condition));
+      combine(h, hash(n->body));
+      break;
+    }
+    case AstKind::ForStmt: {
+      auto *n = static_cast<ForStmtNode *>(node);
+      combine(h, static_cast<uint64_t>(n->style));
+      combine(h, hash(n->init));
+      combine(h, hash(n->condition));
+      list(h, n->updates);
+      list(h, n->iterVars);
+      combine(h, hash(n->collection));
+      combine(h, hash(n->body));
+      break;
+    }
+    case AstKind::ReturnStmt:
+      list(h, static_cast<ReturnStmtNode *>(node)->values);
+      break;
+    case AstKind::DeferStmt:
+      combine(h, hash(static_cast<DeferStmtNode *>(node)->body));
+      break;
+    case AstKind::ImportStmt: {
+      auto *n = static_cast<ImportStmtNode *>(node);
+      combine(h, static_cast<uint64_t>(n->style));
+      combine(h, str(n->modulePath));
+      combine(h, str(n->namespaceAlias));
+      combine(h, n->specifiers.size());
+      for (const auto &s : n->specifiers) {
+        combine(h, str(s.name));
+        combine(h, str(s.alias));
+        combine(h, s.isType);
+      }
+      break;
+    }
+    case AstKind::DeclStmt:
+      combine(h, hash(static_cast<DeclStmtNode *>(node)->decl));
+      break;
+
+    // Declarations
+    case AstKind::ErrorDecl:
+      combine(h, str(static_cast<ErrorDeclNode *>(node)->errorMessage));
+      break;
+    case AstKind::VarDecl: {
+      auto *n = static_cast<VarDeclNode *>(node);
+      combine(h, str(n->name));
+      combine(h, hash(n->type));
+      combine(h, hash(n->initializer));
+      break;
+    }
+    case AstKind::MultiVarDecl: {
+      auto *n = static_cast<MultiVarDeclNode *>(node);
+      combine(h, n->names.size());
+      for (InternedString name : n->names)
+        combine(h, str(name));
+      combine(h, hash(n->initializer));
+      break;
+    }
+    case AstKind::ParameterDecl: {
+      auto *n = static_cast<ParameterDeclNode *>(node);
+      combine(h, str(n->name));
+      combine(h, hash(n->type));
+      combine(h, n->isVariadic);
+      break;
+    }
+    case AstKind::FunctionDecl: {
+      auto *n = static_cast<FunctionDeclNode *>(node);
+      combine(h, str(n->name));
+      combine(h, hash(n->returnType));
+      list(h, n->parameters);
+      combine(h, hash(n->body));
+      combine(h, hash(n->qualifiedName));
+      combine(h, n->isMultiReturn);
+      combine(h, n->hasVarArgs);
+      break;
+    }
+    case AstKind::FieldDecl: {
+      auto *n = static_cast<FieldDeclNode *>(node);
+      combine(h, str(n->name));
+      combine(h, hash(n->type));
+      combine(h, hash(n->initializer));
+      break;
+    }
+    case AstKind::MethodDecl: {
+      auto *n = static_cast<MethodDeclNode *>(node);
+      combine(h, str(n->name));
+      combine(h, hash(n->returnType));
+      list(h, n->parameters);
+      combine(h, hash(n->body));
+      combine(h, n->isMultiReturn);
+      break;
+    }
+    case AstKind::ClassDecl: {
+      auto *n = static_cast<ClassDeclNode *>(node);
+      combine(h, str(n->name));
+      list(h, n->fields);
+      list(h, n->methods);
+      break;
+    }
+    case AstKind::CompilationUnit:
+      list(h, static_cast<CompilationUnitNode *>(node)->statements);
+      break;
+
+    // Types
+    case AstKind::ErrorType:
+      combine(h, str(static_cast<ErrorTypeNode *>(node)->errorMessage));
+      break;
+    case AstKind::PrimitiveType:
+      combine(h, static_cast<uint64_t>(static_cast<PrimitiveTypeNode *>(node)->primitiveKind));
+      break;
+    case AstKind::ListType:
+      combine(h, hash(static_cast<ListTypeNode *>(node)->elementType));
+      break;
+    case AstKind::MapType: {
+      auto *n = static_cast<MapTypeNode *>(node);
+      combine(h, hash(n->keyType));
+      combine(h, hash(n->valueType));
+      break;
+    }
+    case AstKind::QualifiedType:
+      combine(h, hash(static_cast<QualifiedTypeNode *>(node)->name));
+      break;
+
+    default:
+      // Leaf nodes without payload: kind and flags only
+      break;
+    }
+
+    h = finish(h);
+    if (isStmt(node->kind))
+      static_cast<Stmt *>(node)->structuralHash = h;
+    else if (isDecl(node->kind))
+      static_cast<Decl *>(node)->structuralHash = h;
+    return h;
+  }
+
+  const StringTable &strings_;
+  std::vector<uint64_t> stringHashes_; ///< Interned id -> text hash (0 = not yet)
+};
+
+// ============================================================================
+// Subtree Cache
+// ============================================================================
+
+/**
+ * @brief Results keyed by structural hash, shared by all files
+ *
+ * Values must not contain anything position- or file-specific; callers
+ * re-attach ranges from the current nodes. Entries not used during the last
+ * full generation are dropped once the cache grows past its capacity.
+ * Thread-safe.
+ *
+ * Usage:
+ *   SubtreeCache<Summary> cache;
+ *   if (auto hit = cache.find(decl->structuralHash)) { ... }
+ *   else cache.store(decl->structuralHash, compute(decl));
+ */
+template <typename V> class SubtreeCache {
+public:
+  explicit SubtreeCache(size_t capacity = 4096) : capacity_(capacity) {}
+
+  [[nodiscard]] std::optional<V> find(uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(hash);
+    if (it == entries_.end()) {
+      ++misses_;
+      return std::nullopt;
+    }
+    ++hits_;
+    it->second.generation = generation_;
+    return it->second.value;
+  }
+
+  void store(uint64_t hash, V value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= capacity_)
+      sweep();
+    entries_[hash] = Entry{std::move(value), generation_};
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+  }
+
+  [[nodiscard]] size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  [[nodiscard]] uint64_t hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+
+  [[nodiscard]] uint64_t misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+
+private:
+  struct Entry {
+    V value;
+    uint64_t generation;
+  };
+
+  /// Drop entries untouched since the previous sweep; all of them if none qualify
+  void sweep() {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      it = it->second.generation < generation_ ? entries_.erase(it) : std::next(it);
+    }
+    if (entries_.size() >= capacity_)
+      entries_.clear();
+    ++generation_;
+  }
+
+  std::unordered_map<uint64_t, Entry> entries_;
+  size_t capacity_;
+  uint64_t generation_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  mutable std::mutex mutex_;
+};
+
+} // namespace ast
+} // namespace lang
@@ -19,6 +19,7 @@
 
 #include "AstFactory.h"
 #include "LangParserBaseVisitor.h"
+#include "StructuralHash.h"
 
 #include <any>
 #include <charconv>
@@ -47,7 +48,7 @@ public:
     // 首先尝试直接转换为 CompilationUnitNode*
     if (auto *cu = tryCast<CompilationUnitNode>(result)) {
       LSP_LOG("build(): tryCast<CompilationUnitNode> succeeded, cu=" << (void *)cu);
-      return cu;
+      return finish(cu);
     }
 
     // visitCompilationUnit 返回的是 Decl*，需要先提取 Decl* 再转换
@@ -58,7 +59,7 @@ public:
         auto *cu = static_cast<CompilationUnitNode *>(decl);
         LSP_LOG("build(): cast to CompilationUnitNode succeeded, cu="
                 << (void *)cu << ", statements.size()=" << cu->statements.size());
-        return cu;
+        return finish(cu);
       }
     }
 
@@ -66,9 +67,55 @@ public:
     return factory_.makeCompilationUnit(SourceRange::invalid(), filename_, {});
   }
 
+  /**
+   * @brief Skeletal mode: keep only top-level declarations and their ranges
+   *
+   * Function/method bodies become empty blocks spanning the original body,
+   * and variable/field initializers are dropped. Used by the streaming parse
+   * of huge files, where the full AST would not fit in memory.
+   */
+  void setSkeletal(bool skeletal) noexcept { skeletal_ = skeletal; }
+
+  [[nodiscard]] bool isSkeletal() const noexcept { return skeletal_; }
+
+  /**
+   * @brief Build one top-level statement (streaming parse)
+   * @return The statement, or nullptr if skeletal mode drops it
+   */
+  Stmt *buildStatement(LangParser::StatementContext *ctx) {
+    if (!ctx)
+      return nullptr;
+    if (skeletal_ && !dynamic_cast<LangParser::DeclarationStmtContext *>(ctx) &&
+        !dynamic_cast<LangParser::ImportStmtContext *>(ctx))
+      return nullptr;
+    return expectStmt(ctx);
+  }
+
+  /**
+   * @brief Assemble a compilation unit from statements built one at a time
+   */
+  CompilationUnitNode *buildCompilationUnit(SourceRange range, const std::vector<Stmt *> &stmts) {
+    std::vector<ImportStmtNode *> imports;
+    for (auto *stmt : stmts) {
+      if (stmt->kind == AstKind::ImportStmt) {
+        imports.push_back(static_cast<ImportStmtNode *>(stmt));
+      }
+    }
+    return finish(factory_.makeCompilationUnit(range, filename_, stmts, imports));
+  }
+
 protected:
+  /**
+   * @brief Compute structural hashes of the finished tree
+   */
+  CompilationUnitNode *finish(CompilationUnitNode *cu) {
+    StructuralHasher(factory_.strings()).hashTree(cu);
+    return cu;
+  }
+
   AstFactory &factory_;
   std::string_view filename_;
+  bool skeletal_ = false;
 
   // ========================================================================
   // LAYER 1: INFRASTRUCTURE - Source Location Helpers
@@ -272,6 +319,8 @@ protected:
       b->flags = b->flags | NodeFlags::HasError;
       return b;
     }
+    if (skeletal_)
+      return factory_.makeBlockStmt(getRange(ctx), {});
     auto visited = visit(ctx);
     if (auto *b = tryCast<BlockStmtNode>(visited))
       return b;
@@ -28,7 +28,13 @@ std::any visitBlockStatement(LangParser::BlockStatementContext *ctx) override {
   if (!ctx)
     return static_cast<BlockStmtNode *>(factory_.makeBlockStmt(SourceRange::invalid(), {}));
   std::vector<Stmt *> stmts = visitStmtList(ctx->statement());
-  return static_cast<BlockStmtNode *>(factory_.makeBlockStmt(getRange(ctx), stmts));
+  auto *block = factory_.makeBlockStmt(getRange(ctx), stmts);
+  // 缺少 '}' (错误恢复时补出的 token 没有源位置)，标记为残缺块
+  auto *close = ctx->CCB();
+  if (ctx->exception || !close || close->getSymbol()->getStartIndex() == INVALID_INDEX) {
+    block->flags = block->flags | NodeFlags::HasError;
+  }
+  return static_cast<BlockStmtNode *>(block);
 }
 
 std::any visitSemicolonStmt(LangParser::SemicolonStmtContext *ctx) override {
@@ -513,22 +519,22 @@ std::any visitVariableDeclarationDef(LangParser::VariableDeclarationDefContext *
 
   NodeFlags mods = collectModifiers(ctx->GLOBAL(), ctx->CONST());
 
-  TypeNode *type = nullptr;
-  std::string name = "";
+  VarDeclNode *vd = nullptr;
+  if (ctx->declaration_item())
+    vd = tryCast<VarDeclNode>(visit(ctx->declaration_item()));
 
-  if (ctx->declaration_item()) {
-    auto v = visit(ctx->declaration_item());
-    if (auto *vd = tryCast<VarDeclNode>(v)) {
-      type = vd->type;
-      name = std::string(factory_.strings().get(vd->name));
-    }
-  }
-  if (!type)
-    type = factory_.makeErrorType(getRange(ctx), "missing type");
+  Expr *init = ctx->expression() && !skeletal_ ? expectExpr(ctx->expression()) : nullptr;
 
-  Expr *init = ctx->expression() ? expectExpr(ctx->expression()) : nullptr;
+  if (!vd) {
+    return static_cast<Decl *>(factory_.makeVarDecl(
+        getRange(ctx), "", factory_.makeErrorType(getRange(ctx), "missing type"), init, mods));
+  }
 
-  return static_cast<Decl *>(factory_.makeVarDecl(getRange(ctx), name, type, init, mods));
+  // Complete the item's declaration in place rather than copying it
+  vd->range = getRange(ctx);
+  vd->initializer = init;
+  vd->flags = mods;
+  return static_cast<Decl *>(vd);
 }
 
 std::any
@@ -549,7 +555,7 @@ visitMutiVariableDeclarationDef(LangParser::MutiVariableDeclarationDefContext *c
   for (const auto &s : namesStorage)
     names.push_back(s);
 
-  Expr *init = ctx->expression() ? expectExpr(ctx->expression()) : nullptr;
+  Expr *init = ctx->expression() && !skeletal_ ? expectExpr(ctx->expression()) : nullptr;
 
   return static_cast<Decl *>(factory_.makeMultiVarDecl(getRange(ctx), names, init, mods));
 }
@@ -566,13 +572,13 @@ std::any visitMultiDeclaration(LangParser::MultiDeclarationContext *ctx) overrid
   if (items.empty())
     return static_cast<Stmt *>(factory_.makeEmptyStmt(getRange(ctx)));
 
-  // Create first variable declaration
+  // Complete the first item's declaration in place (no second node: the
+  // factory indexes every node it creates)
   auto v = visit(items[0]);
   if (auto *vd = tryCast<VarDeclNode>(v)) {
-    Expr *init = inits.size() > 0 ? expectExpr(inits[0]) : nullptr;
-    auto *decl =
-        factory_.makeVarDecl(getRange(ctx), factory_.strings().get(vd->name), vd->type, init);
-    return static_cast<Stmt *>(factory_.makeDeclStmt(getRange(ctx), decl));
+    vd->range = getRange(ctx);
+    vd->initializer = inits.size() > 0 ? expectExpr(inits[0]) : nullptr;
+    return static_cast<Stmt *>(factory_.makeDeclStmt(getRange(ctx), vd));
   }
 
   return static_cast<Stmt *>(factory_.makeEmptyStmt(getRange(ctx)));
@@ -720,7 +726,7 @@ std::any visitClassFieldMember(LangParser::ClassFieldMemberContext *ctx) overrid
   if (!type)
     type = factory_.makeErrorType(getRange(ctx), "missing type");
 
-  Expr *init = ctx->expression() ? expectExpr(ctx->expression()) : nullptr;
+  Expr *init = ctx->expression() && !skeletal_ ? expectExpr(ctx->expression()) : nullptr;
 
   return static_cast<FieldDeclNode *>(
       factory_.makeFieldDecl(getRange(ctx), name, type, init, mods));
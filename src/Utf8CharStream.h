@@ -0,0 +1,240 @@
+/**
+ * @file Utf8CharStream.h
+ * @brief Zero-Copy UTF-8 Character Stream for the ANTLR Lexer
+ *
+ * antlr4::ANTLRInputStream decodes the whole document into a std::u32string
+ * before lexing, i.e. a 4x copy of the source. Utf8CharStream borrows the
+ * document's UTF-8 buffer instead and decodes code points on the fly.
+ *
+ * Key Features:
+ * - Borrows a std::string_view, no copy of the source
+ * - Code-point indices identical to ANTLRInputStream (BOM skipped)
+ * - O(1) access for pure-ASCII input, checkpointed seek otherwise
+ * - Malformed sequences decode as U+FFFD instead of throwing
+ *
+ * @copyright Copyright (c) 2024-2025
+ */
+
+#pragma once
+
+#include "antlr4-runtime.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lang {
+namespace lsp {
+
+/**
+ * @brief CharStream over a borrowed UTF-8 buffer
+ *
+ * The buffer must outlive the stream (and every lexer/parser using it).
+ *
+ * Usage:
+ *   Utf8CharStream input(file.content());
+ *   LangLexer lexer(&input);
+ */
+class Utf8CharStream : public antlr4::CharStream {
+public:
+  /// Code points between two recorded byte offsets (non-ASCII input only)
+  static constexpr size_t CheckpointInterval = 64;
+
+  explicit Utf8CharStream(std::string_view source, std::string name = {})
+      : name_(std::move(name)) {
+    // Remove the UTF-8 BOM if present (same as ANTLRInputStream)
+    if (source.size() >= 3 && source.compare(0, 3, "\xef\xbb\xbf") == 0) {
+      source.remove_prefix(3);
+    }
+    data_ = source;
+
+    ascii_ = true;
+    for (unsigned char c : data_) {
+      if (c >= 0x80) {
+        ascii_ = false;
+        break;
+      }
+    }
+
+    if (ascii_) {
+      size_ = data_.size();
+      return;
+    }
+
+    // 记录每 CheckpointInterval 个码点的字节偏移，seek 时从最近的检查点解码
+    size_t offset = 0;
+    while (offset < data_.size()) {
+      if (size_ % CheckpointInterval == 0) {
+        checkpoints_.push_back(offset);
+      }
+      uint32_t cp;
+      offset += decode(offset, cp);
+      ++size_;
+    }
+  }
+
+  // ========================================================================
+  // IntStream
+  // ========================================================================
+
+  void consume() override {
+    if (p_ >= size_) {
+      throw antlr4::IllegalStateException("cannot consume EOF");
+    }
+    uint32_t cp;
+    pByte_ += ascii_ ? 1 : decode(pByte_, cp);
+    ++p_;
+  }
+
+  size_t LA(ssize_t i) override {
+    if (i == 0) {
+      return 0; // undefined
+    }
+
+    ssize_t target = static_cast<ssize_t>(p_) + (i > 0 ? i - 1 : i);
+    if (target < 0 || target >= static_cast<ssize_t>(size_)) {
+      return antlr4::IntStream::EOF;
+    }
+
+    if (ascii_) {
+      return static_cast<unsigned char>(data_[static_cast<size_t>(target)]);
+    }
+
+    uint32_t cp;
+    decode(byteOffset(static_cast<size_t>(target)), cp);
+    return cp;
+  }
+
+  size_t index() override { return p_; }
+
+  size_t size() override { return size_; }
+
+  // Mark/release do nothing. We have entire buffer.
+  ssize_t mark() override { return -1; }
+
+  void release(ssize_t /* marker */) override {}
+
+  void seek(size_t index) override {
+    index = std::min(index, size_);
+    pByte_ = byteOffset(index);
+    p_ = index;
+  }
+
+  std::string getSourceName() const override {
+    return name_.empty() ? antlr4::IntStream::UNKNOWN_SOURCE_NAME : name_;
+  }
+
+  // ========================================================================
+  // CharStream
+  // ========================================================================
+
+  std::string getText(const antlr4::misc::Interval &interval) override {
+    if (interval.a < 0 || interval.b < 0) {
+      return "";
+    }
+
+    size_t start = static_cast<size_t>(interval.a);
+    size_t stop = static_cast<size_t>(interval.b);
+    if (start >= size_) {
+      return "";
+    }
+    if (stop >= size_) {
+      stop = size_ - 1;
+    }
+    if (stop < start) {
+      return "";
+    }
+
+    size_t from = byteOffset(start);
+    size_t to = byteOffset(stop + 1);
+    return std::string(data_.substr(from, to - from));
+  }
+
+  std::string toString() const override { return std::string(data_); }
+
+  /**
+   * @brief The borrowed buffer (BOM stripped)
+   */
+  [[nodiscard]] std::string_view view() const noexcept { return data_; }
+
+private:
+  /**
+   * @brief Decode one code point at a byte offset
+   * @return Number of bytes consumed (always >= 1)
+   */
+  size_t decode(size_t offset, uint32_t &cp) const noexcept {
+    auto byte = [&](size_t k) { return static_cast<unsigned char>(data_[offset + k]); };
+    unsigned char lead = byte(0);
+    size_t remaining = data_.size() - offset;
+
+    size_t length;
+    if (lead < 0x80) {
+      cp = lead;
+      return 1;
+    } else if ((lead & 0xE0) == 0xC0) {
+      length = 2;
+      cp = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+      length = 3;
+      cp = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+      length = 4;
+      cp = lead & 0x07;
+    } else {
+      cp = 0xFFFD;
+      return 1;
+    }
+
+    if (length > remaining) {
+      cp = 0xFFFD;
+      return 1;
+    }
+    for (size_t k = 1; k < length; ++k) {
+      if ((byte(k) & 0xC0) != 0x80) {
+        cp = 0xFFFD;
+        return 1;
+      }
+      cp = (cp << 6) | (byte(k) & 0x3F);
+    }
+    return length;
+  }
+
+  /**
+   * @brief Byte offset of a code-point index (index == size_ maps to the end)
+   */
+  size_t byteOffset(size_t index) const noexcept {
+    if (ascii_) {
+      return index;
+    }
+    if (index >= size_) {
+      return data_.size();
+    }
+
+    // 顺序访问时从当前位置前进，否则从检查点开始
+    size_t cpIndex = index - index % CheckpointInterval;
+    size_t offset = checkpoints_[index / CheckpointInterval];
+    if (p_ <= index && p_ > cpIndex) {
+      cpIndex = p_;
+      offset = pByte_;
+    }
+
+    uint32_t cp;
+    for (; cpIndex < index; ++cpIndex) {
+      offset += decode(offset, cp);
+    }
+    return offset;
+  }
+
+  std::string_view data_;
+  std::string name_;
+  bool ascii_ = true;
+  size_t size_ = 0;                 ///< Length in code points
+  std::vector<size_t> checkpoints_; ///< Byte offset of every CheckpointInterval-th code point
+
+  size_t p_ = 0;     ///< Current code-point index
+  size_t pByte_ = 0; ///< Byte offset of p_
+};
+
+} // namespace lsp
+} // namespace lang
@@ -13,12 +13,15 @@
  * - Lazy loading of files
  * - Change notification support
  * - Workspace-wide diagnostics collection
+ * - Compressed resident text for indexed-but-unopened files
  *
  * @copyright Copyright (c) 2024-2025
  */
 
 #pragma once
 
+#include "AstQuery.h"
+#include "CompressedTextStore.h"
 #include "SourceFile.h"
 
 #include <filesystem>
@@ -27,6 +30,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -50,6 +54,10 @@ struct WorkspaceConfig {
   // Parser settings
   bool tolerantParsing = true; ///< Allow recovery from errors
   int maxDiagnosticsPerFile = 100;
+  /// Files at least this large (bytes) get a bounded-memory, skeletal parse
+  size_t streamingParseThreshold = SourceFile::DefaultStreamingThreshold;
+  /// Directory of on-disk AST images for instant reopen (empty = disabled)
+  std::string astImageCacheDir;
 };
 
 /**
@@ -153,15 +161,18 @@ public:
     if (it != filesByUri_.end()) {
       // File already open - update content
       it->second->setContent(std::move(content));
+      applyParseSettings(*it->second);
       return *it->second;
     }
 
     // Create new file
     auto file = std::make_unique<SourceFile>(path, std::move(content));
+    applyParseSettings(*file);
     auto *filePtr = file.get();
 
     filesByUri_[uriStr] = std::move(file);
     filesByPath_[path] = filePtr;
+    textStore_->erase(uriStr); // 打开后以编辑器内容为准
 
     notifyEvent(WorkspaceEvent::FileOpened, uriStr, version);
     return *filePtr;
@@ -187,10 +198,12 @@ public:
     if (!file->loadFromDisk()) {
       return nullptr;
     }
+    applyParseSettings(*file);
 
     auto *filePtr = file.get();
     filesByUri_[uriStr] = std::move(file);
     filesByPath_[pathStr] = filePtr;
+    textStore_->erase(uriStr);
 
     notifyEvent(WorkspaceEvent::FileOpened, uriStr, 0);
     return filePtr;
@@ -206,9 +219,19 @@ public:
     auto it = filesByUri_.find(uriStr);
     if (it != filesByUri_.end()) {
       std::string path = it->second->path();
+      std::unique_ptr<SourceFile> file = std::move(it->second);
       filesByPath_.erase(path);
       filesByUri_.erase(it);
 
+      // Keep the text resident (compressed). Unsaved edits are discarded by
+      // the editor on close, so fall back to the on-disk version; indexFile
+      // skips open files, hence only now that it is closed.
+      if (file->state() == FileState::Clean) {
+        textStore_->put(uriStr, file->content());
+      } else {
+        indexFile(path);
+      }
+
       notifyEvent(WorkspaceEvent::FileClosed, uriStr, 0);
     }
   }
@@ -254,6 +277,66 @@ public:
    */
   [[nodiscard]] size_t openFileCount() const noexcept { return filesByUri_.size(); }
 
+  // ========================================================================
+  // Resident Text (Unopened Files)
+  // ========================================================================
+
+  /**
+   * @brief Load a file from disk into the compressed text store
+   *
+   * Does not open the file; open files are always served from their
+   * SourceFile.
+   * @return true if the file is open or was indexed
+   */
+  bool indexFile(std::string_view path) {
+    std::string uriStr = uri::pathToUri(path);
+    if (isFileOpen(uriStr)) {
+      return true;
+    }
+
+    SourceFile file{std::string(path)};
+    if (!file.loadFromDisk()) {
+      return false;
+    }
+    textStore_->put(uriStr, file.content());
+    return true;
+  }
+
+  /**
+   * @brief Get the full text of a file, open or indexed
+   */
+  [[nodiscard]] std::optional<std::string> getDocumentText(std::string_view uri) const {
+    if (auto *file = getFile(uri)) {
+      return file->content();
+    }
+    return textStore_->getText(std::string(uri));
+  }
+
+  /**
+   * @brief Get one line of a file, open or indexed
+   * @param line 1-based line number
+   */
+  [[nodiscard]] std::optional<std::string> getLineText(std::string_view uri,
+                                                       uint32_t line) const {
+    if (auto *file = getFile(uri)) {
+      if (line == 0 || line > file->lineCount()) {
+        return std::nullopt;
+      }
+      return std::string(file->getLine(line));
+    }
+    return textStore_->getLine(std::string(uri), line);
+  }
+
+  /**
+   * @brief Compressed store holding text of unopened files
+   */
+  [[nodiscard]] CompressedTextStore &textStore() noexcept { return *textStore_; }
+
+  /**
+   * @brief Memory / decode-latency figures of the resident text store
+   */
+  [[nodiscard]] CompressedTextStore::Stats textStoreStats() const { return textStore_->stats(); }
+
   // ========================================================================
   // Content Modification
   // ========================================================================
@@ -406,7 +489,8 @@ public:
 
   /**
    * @brief Resolve a module path to a file path
-   * @param modulePath Module path (e.g., "utils/helpers")
+   * @param modulePath Module path (e.g., "utils/helpers" or "utils/helpers.spt");
+   *        ".lang" is appended only when no extension is given
    * @param fromFile File making the import (for relative resolution)
    * @return Resolved file path, or empty if not found
    */
@@ -418,7 +502,9 @@ public:
       basePath = basePath.parent_path();
 
       std::filesystem::path resolved = basePath / modulePath;
-      resolved.replace_extension(".lang");
+      if (!resolved.has_extension()) {
+        resolved.replace_extension(".lang");
+      }
 
       if (std::filesystem::exists(resolved)) {
         return resolved.string();
@@ -428,7 +514,9 @@ public:
     // Try workspace root
     if (!config_.rootPath.empty()) {
       std::filesystem::path resolved = std::filesystem::path(config_.rootPath) / modulePath;
-      resolved.replace_extension(".lang");
+      if (!resolved.has_extension()) {
+        resolved.replace_extension(".lang");
+      }
 
       if (std::filesystem::exists(resolved)) {
         return resolved.string();
@@ -438,7 +526,9 @@ public:
     // Try include paths
     for (const auto &includePath : config_.includePaths) {
       std::filesystem::path resolved = std::filesystem::path(includePath) / modulePath;
-      resolved.replace_extension(".lang");
+      if (!resolved.has_extension()) {
+        resolved.replace_extension(".lang");
+      }
 
       if (std::filesystem::exists(resolved)) {
         return resolved.string();
@@ -491,7 +581,85 @@ public:
     }
   }
 
+  /**
+   * @brief Run a node query over every open file and every file in the text store
+   *
+   * `configure(ast::NodeQuery&)` sets the filters, `func(uri, file, node)`
+   * receives each match, one file at a time; returning false stops the query.
+   * Stored files are parsed for the duration of their callbacks only, so the
+   * cost per open file is proportional to the nodes of the queried kinds.
+   */
+  template <typename Configure, typename Func> void queryNodes(Configure &&configure, Func &&func) {
+    queryNodes(std::forward<Configure>(configure), std::forward<Func>(func),
+               [](const std::string &) { return true; });
+  }
+
+  /**
+   * @brief queryNodes, calling `afterFile(uri)` once each file is done
+   *
+   * `afterFile` runs for files without matches too; returning false stops the
+   * query before the next file is parsed.
+   */
+  template <typename Configure, typename Func, typename AfterFile>
+  void queryNodes(Configure &&configure, Func &&func, AfterFile &&afterFile) {
+    bool stopped = false;
+    auto run = [&](const std::string &uri, SourceFile &file) {
+      if (!file.getAst()) {
+        stopped = !afterFile(uri);
+        return;
+      }
+      ast::NodeQuery query(file.factory());
+      configure(query);
+      query.forEach([&](ast::AstNode *node) {
+        if constexpr (std::is_same_v<std::invoke_result_t<Func &, const std::string &,
+                                                          SourceFile &, ast::AstNode *>,
+                                     bool>) {
+          stopped = !func(uri, file, node);
+          return !stopped;
+        } else {
+          func(uri, file, node);
+          return true;
+        }
+      });
+      if (!stopped)
+        stopped = !afterFile(uri);
+    };
+
+    for (auto &[uri, file] : filesByUri_) {
+      run(uri, *file);
+      if (stopped)
+        return;
+    }
+    for (const auto &uri : textStore_->uris()) {
+      if (isFileOpen(uri))
+        continue;
+      auto text = textStore_->getText(uri);
+      if (!text)
+        continue;
+      SourceFile file(uri::uriToPath(uri), std::move(*text));
+      applyParseSettings(file);
+      run(uri, file);
+      if (stopped)
+        return;
+    }
+  }
+
 private:
+  /**
+   * @brief Push the parser settings of config_ down to a file
+   */
+  void applyParseSettings(SourceFile &file) {
+    file.setStreamingThreshold(config_.streamingParseThreshold);
+
+    const std::string &dir = config_.astImageCacheDir;
+    if (dir.empty()) {
+      imageCache_.reset();
+    } else if (!imageCache_ || imageCache_->directory() != dir) {
+      imageCache_ = std::make_shared<ast::AstImageCache>(dir);
+    }
+    file.setImageCache(imageCache_);
+  }
+
   void notifyEvent(WorkspaceEvent event, const std::string &uri, int64_t version) {
     WorkspaceEventData data{event, uri, version};
     for (const auto &[_, callback] : eventCallbacks_) {
@@ -506,6 +674,13 @@ private:
   std::unordered_map<std::string, std::unique_ptr<SourceFile>> filesByUri_;
   std::unordered_map<std::string, SourceFile *> filesByPath_;
 
+  // Compressed text of indexed-but-unopened files (heap-allocated so the
+  // workspace stays movable)
+  std::unique_ptr<CompressedTextStore> textStore_ = std::make_unique<CompressedTextStore>();
+
+  // Shared by all files; created on first use from config_.astImageCacheDir
+  std::shared_ptr<ast::AstImageCache> imageCache_;
+
   // Event callbacks
   std::unordered_map<size_t, WorkspaceEventCallback> eventCallbacks_;
   size_t nextCallbackId_ = 0;
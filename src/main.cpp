@@ -8,23 +8,41 @@
  * Features:
  * - JSON-RPC 2.0 message parsing and serialization
  * - Stdio-based transport (standard LSP)
+ * - Background writer: responses first, diagnostics coalesced per URI
+ * - Background reader: `$/cancelRequest` is seen while a request is running
+ * - Streamed results (partialResultToken / workDoneToken) for long searches
+ * - Workspace fix-all command, run off the message loop
  * - Request/Response/Notification handling
  * - Graceful shutdown
  *
  * @copyright Copyright (c) 2024-2025
  */
 
+#include "LsifWriter.h"
 #include "LspService.h"
+#include "OutboundQueue.h"
+#include "ParserWarmup.h"
+#include "RequestWatchdog.h"
+#include "SamplingProfiler.h"
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -51,6 +69,84 @@ constexpr int ServerNotInitialized = -32002;
 constexpr int RequestCancelled = -32800;
 } // namespace JsonRpcErrorCode
 
+/**
+ * @brief SAX handler building the same DOM as json::parse, but moving strings in
+ *
+ * json::parse copies every string out of the lexer's buffer, which for a
+ * didOpen/didChange text is a whole extra copy of the document. Here the
+ * lexer's buffer itself becomes the value, and later the SourceFile's content.
+ */
+class JsonDomBuilder {
+public:
+  using string_t = json::string_t;
+
+  explicit JsonDomBuilder(json &root) : root_(root) {}
+
+  bool null() { return add(nullptr); }
+  bool boolean(bool value) { return add(value); }
+  bool number_integer(json::number_integer_t value) { return add(value); }
+  bool number_unsigned(json::number_unsigned_t value) { return add(value); }
+  bool number_float(json::number_float_t value, const string_t &) { return add(value); }
+  bool string(string_t &value) { return add(std::move(value)); }
+  bool binary(json::binary_t &value) { return add(std::move(value)); }
+
+  bool start_object(std::size_t) {
+    stack_.push_back(place(json::object()));
+    return true;
+  }
+
+  bool key(string_t &name) {
+    key_ = std::move(name);
+    return true;
+  }
+
+  bool end_object() {
+    stack_.pop_back();
+    return true;
+  }
+
+  bool start_array(std::size_t) {
+    stack_.push_back(place(json::array()));
+    return true;
+  }
+
+  bool end_array() {
+    stack_.pop_back();
+    return true;
+  }
+
+  template <typename Exception>
+  bool parse_error(std::size_t, const std::string &, const Exception &error) {
+    throw error;
+  }
+
+private:
+  template <typename Value> bool add(Value &&value) {
+    place(json(std::forward<Value>(value)));
+    return true;
+  }
+
+  /// Attach a value to the innermost open array or object (or make it the root)
+  json *place(json value) {
+    if (stack_.empty()) {
+      root_ = std::move(value);
+      return &root_;
+    }
+    json &parent = *stack_.back();
+    if (parent.is_array()) {
+      parent.push_back(std::move(value));
+      return &parent.back();
+    }
+    json &slot = parent[key_];
+    slot = std::move(value);
+    return &slot;
+  }
+
+  json &root_;
+  std::vector<json *> stack_;
+  string_t key_;
+};
+
 // ============================================================================
 // JSON Serialization for LSP Types
 // ============================================================================
@@ -105,6 +201,11 @@ inline void to_json(json &j, const HoverResult &h) {
   }
 }
 
+// TextEdit
+inline void to_json(json &j, const TextEdit &e) {
+  j = json{{"range", e.range}, {"newText", e.newText}};
+}
+
 // CompletionItem
 inline void to_json(json &j, const CompletionItem &c) {
   j = json{{"label", c.label}, {"kind", static_cast<int>(c.kind)}};
@@ -127,6 +228,9 @@ inline void to_json(json &j, const CompletionItem &c) {
   if (c.deprecated) {
     j["deprecated"] = true;
   }
+  if (!c.additionalTextEdits.empty()) {
+    j["additionalTextEdits"] = c.additionalTextEdits;
+  }
 }
 
 // CompletionResult -> CompletionList
@@ -177,11 +281,6 @@ inline void to_json(json &j, const WorkspaceSymbol &s) {
   }
 }
 
-// TextEdit
-inline void to_json(json &j, const TextEdit &e) {
-  j = json{{"range", e.range}, {"newText", e.newText}};
-}
-
 // WorkspaceEdit
 inline void to_json(json &j, const WorkspaceEdit &e) {
   j = json{{"changes", json::object()}};
@@ -198,6 +297,104 @@ inline void to_json(json &j, const SemanticTokensResult &r) {
   }
 }
 
+// ============================================================================
+// Inbound Messages
+// ============================================================================
+
+/**
+ * @brief Messages read from stdin, and the requests the client has cancelled
+ *
+ * Filled by the reader thread and drained by the message loop. Cancellations
+ * are recorded as they arrive so a running request can observe them between
+ * chunks of work; only ids of requests still queued or running are kept. A
+ * `window/workDoneProgress/cancel` cancels the request that was sent with
+ * that workDoneToken.
+ */
+class Inbox {
+public:
+  /// Reader side: queue a message, or record a `$/cancelRequest` / progress cancel
+  void push(json msg) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::string method = msg.is_object() ? msg.value("method", "") : "";
+      if (method == "$/cancelRequest" || method == "window/workDoneProgress/cancel") {
+        auto params = msg.find("params");
+        if (params == msg.end() || !params->is_object())
+          return;
+        if (method == "$/cancelRequest" && params->contains("id")) {
+          std::string key = (*params)["id"].dump();
+          if (pending_.count(key))
+            cancelled_.insert(std::move(key));
+        } else if (params->contains("token")) {
+          auto request = tokens_.find((*params)["token"].dump());
+          if (request != tokens_.end())
+            cancelled_.insert(request->second);
+        }
+        return;
+      }
+      if (msg.is_object() && msg.contains("id") && msg.contains("method")) {
+        std::string key = msg["id"].dump();
+        std::string token;
+        auto params = msg.find("params");
+        if (params != msg.end() && params->is_object() && params->contains("workDoneToken")) {
+          token = (*params)["workDoneToken"].dump();
+          tokens_[token] = key;
+        }
+        pending_[std::move(key)] = std::move(token);
+      }
+      messages_.push_back(std::move(msg));
+    }
+    ready_.notify_one();
+  }
+
+  /// Reader side: no more input
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    ready_.notify_all();
+  }
+
+  /// Next message; empty once the input is closed and drained
+  std::optional<json> pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this] { return closed_ || !messages_.empty(); });
+    if (messages_.empty())
+      return std::nullopt;
+    json msg = std::move(messages_.front());
+    messages_.pop_front();
+    return msg;
+  }
+
+  [[nodiscard]] bool isCancelled(const std::string &key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_.count(key) != 0;
+  }
+
+  /// The request with this id has been answered
+  void finish(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto request = pending_.find(key);
+    if (request != pending_.end()) {
+      auto token = tokens_.find(request->second);
+      if (token != tokens_.end() && token->second == key)
+        tokens_.erase(token);
+      pending_.erase(request);
+    }
+    cancelled_.erase(key);
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<json> messages_;
+  std::unordered_map<std::string, std::string> pending_; ///< Request id -> its workDoneToken
+  std::unordered_map<std::string, std::string> tokens_;  ///< workDoneToken -> request id
+  std::unordered_set<std::string> cancelled_;            ///< Subset of pending_
+  bool closed_ = false;
+};
+
 // ============================================================================
 // LSP Server Class
 // ============================================================================
@@ -209,29 +406,73 @@ class LspServer {
 public:
   LspServer() = default;
 
+  explicit LspServer(LspServiceConfig config, RequestWatchdog::Config watchdog = {})
+      : service_(std::move(config)), watchdog_(std::move(watchdog)) {}
+
   /**
    * @brief Run the server main loop
    * @return Exit code (0 for clean shutdown)
    */
   int run() {
+    // Build the ATNs and seed the DFA caches while waiting for `initialize`
+    warmup_.start();
+
+    // This thread reads input and is never throttled; background producers are
+    // held back when the client stops draining the output
+    outbound_.start();
+
     // Set up diagnostics callback
-    service_.onDiagnosticsChanged(
-        [this](const std::string &uri, const std::vector<Diagnostic> &diagnostics) {
-          publishDiagnostics(uri, diagnostics);
+    service_.onDiagnosticsChanged([this](const std::string &uri,
+                                         const std::vector<Diagnostic> &diagnostics,
+                                         uint64_t generation) {
+      publishDiagnostics(uri, diagnostics, generation);
+    });
+
+    // Slow requests leave an incident report, replayable from the recorded traffic
+    watchdog_.history().setTextSource(
+        [this](const std::string &uri) -> std::optional<std::string> {
+          SourceFile *file = service_.workspace().getFile(uri);
+          if (!file)
+            return std::nullopt;
+          return file->content();
         });
+    watchdog_.onIncident([this](const std::string &method, std::chrono::milliseconds elapsed,
+                                RequestPhase phase, const std::string &path) {
+      writeNotification("window/logMessage",
+                        {{"type", 2},
+                         {"message", "Slow " + method + " (over " +
+                                         std::to_string(elapsed.count()) + " ms, in " +
+                                         phaseName(phase) + "); incident report: " + path}});
+    });
+    watchdog_.start();
+
+    // Input is read on its own thread so a cancellation can reach a running
+    // request. The thread is detached: at exit it may still be blocked on stdin,
+    // so it shares ownership of the inbox rather than borrowing this server.
+    std::thread([inbox = inbox_] {
+      for (;;) {
+        bool eof = false;
+        auto msg = readMessage(eof);
+        if (msg)
+          inbox->push(std::move(*msg));
+        if (eof)
+          break;
+      }
+      inbox->close();
+    }).detach();
 
     // Main message loop
     while (running_) {
-      auto msg = readMessage();
-      if (!msg) {
-        if (!running_)
-          break;
-        continue;
-      }
+      auto msg = inbox_->pop();
+      if (!msg)
+        break;
 
       handleMessage(*msg);
     }
 
+    stopFixAll();
+    watchdog_.stop();
+    outbound_.flush();
     return shutdownReceived_ ? 0 : 1;
   }
 
@@ -241,9 +482,10 @@ private:
   // ========================================================================
 
   /**
-   * @brief Read a JSON-RPC message from stdin
+   * @brief Read a JSON-RPC message from stdin (reader thread only)
+   * @param eof Set when the input is exhausted or broken
    */
-  std::optional<json> readMessage() {
+  static std::optional<json> readMessage(bool &eof) {
     // Read headers
     long contentLength = -1;
     std::string line;
@@ -270,14 +512,14 @@ private:
 
       // Check for EOF
       if (std::cin.eof() || std::cin.bad()) {
-        running_ = false;
+        eof = true;
         return std::nullopt;
       }
     }
 
     if (contentLength <= 0) {
       if (std::cin.eof() || std::cin.bad()) {
-        running_ = false;
+        eof = true;
       }
       return std::nullopt;
     }
@@ -287,29 +529,29 @@ private:
     std::cin.read(content.data(), contentLength);
 
     if (!std::cin || std::cin.gcount() != contentLength) {
-      running_ = false;
+      eof = true;
       return std::nullopt;
     }
 
-    // Parse JSON
+    // Parse JSON; the body is released before the message is handled
     try {
-      return json::parse(content);
+      json message;
+      JsonDomBuilder builder(message);
+      json::sax_parse(content, &builder);
+      return message;
     } catch (const json::parse_error &) {
       return std::nullopt;
     }
   }
 
+  static std::string serialize(const json &msg) {
+    return msg.dump(-1, ' ', false, json::error_handler_t::replace);
+  }
+
   /**
-   * @brief Write a JSON-RPC message to stdout
+   * @brief Write frames to stdout (writer thread only)
    */
-  void writeMessage(const json &msg) {
-    std::string content = msg.dump(-1, ' ', false, json::error_handler_t::replace);
-
-    std::lock_guard<std::mutex> lock(outputMutex_);
-    std::cout << "Content-Length: " << content.length() << "\r\n";
-    std::cout << "\r\n";
-    std::cout << content << std::flush;
-  }
+  static void writeToStdout(const std::string &frames) { std::cout << frames << std::flush; }
 
   /**
    * @brief Send a JSON-RPC response
@@ -321,7 +563,7 @@ private:
 
     json response = {{"jsonrpc", "2.0"}, {"result", result}};
     std::visit([&response](auto &&arg) { response["id"] = arg; }, id);
-    writeMessage(response);
+    outbound_.pushResponse(serialize(response));
   }
 
   /**
@@ -330,18 +572,31 @@ private:
   void writeErrorResponse(const JsonRpcId &id, int code, const std::string &message) {
     json response = {{"jsonrpc", "2.0"}, {"error", {{"code", code}, {"message", message}}}};
     std::visit([&response](auto &&arg) { response["id"] = arg; }, id);
-    writeMessage(response);
+    outbound_.pushResponse(serialize(response));
+  }
+
+  /**
+   * @brief Send a request to the client; its response is not awaited
+   */
+  void writeRequest(const std::string &method, const json &params) {
+    json request = {{"jsonrpc", "2.0"},
+                    {"id", "server-" + std::to_string(nextServerRequestId_++)},
+                    {"method", method},
+                    {"params", params}};
+    outbound_.pushNotification(serialize(request));
   }
 
   /**
    * @brief Send a JSON-RPC notification
+   * @param coalesceKey A pending notification with the same key is replaced
    */
-  void writeNotification(const std::string &method, const json &params) {
+  void writeNotification(const std::string &method, const json &params,
+                         const std::string &coalesceKey = {}, uint64_t generation = 0) {
     json notification = {{"jsonrpc", "2.0"}, {"method", method}};
     if (!params.is_null()) {
       notification["params"] = params;
     }
-    writeMessage(notification);
+    outbound_.pushNotification(serialize(notification), coalesceKey, generation);
   }
 
   // ========================================================================
@@ -351,12 +606,17 @@ private:
   /**
    * @brief Handle an incoming JSON-RPC message
    */
-  void handleMessage(const json &msg) {
+  void handleMessage(json &msg) {
     if (!msg.is_object())
       return;
     if (!msg.contains("jsonrpc") || msg.value("jsonrpc", "") != "2.0")
       return;
 
+    // Everything arriving from the client is interactive; background work yields to it
+    auto interactive = service_.governor().interactive();
+    if (watchdog_.enabled())
+      watchdog_.history().record(msg);
+
     // Request or notification?
     if (msg.contains("id")) {
       // This is a request
@@ -364,7 +624,7 @@ private:
 
       if (msg.contains("method")) {
         std::string method = msg.value("method", "");
-        json params = msg.value("params", json(nullptr));
+        json params = msg.contains("params") ? std::move(msg["params"]) : json(nullptr);
 
         // Check server state
         if (shutdownReceived_) {
@@ -377,13 +637,24 @@ private:
           return;
         }
 
-        // Dispatch request
-        handleRequest(method, id, params);
+        // Dispatch request, unless the client gave up on it while it was queued
+        SamplingProfiler::ScopedTag profileTag(profileLabel(method, params));
+        currentRequest_ = msg.at("id").dump();
+        auto watch = watchdog_.watch(method, currentRequest_, params, watchedDocument(params));
+        if (requestCancelled())
+          writeErrorResponse(id, JsonRpcErrorCode::RequestCancelled, "Request cancelled");
+        else
+          handleRequest(method, id, params);
+        if (!responseDeferred_)
+          inbox_->finish(currentRequest_);
+        responseDeferred_ = false;
+        currentRequest_.clear();
       }
     } else if (msg.contains("method")) {
       // This is a notification
       std::string method = msg.value("method", "");
-      json params = msg.value("params", json(nullptr));
+      // 移出 params，避免深拷贝文档正文
+      json params = msg.contains("params") ? std::move(msg["params"]) : json(nullptr);
 
       if (shutdownReceived_ && method != "exit") {
         return;
@@ -394,10 +665,126 @@ private:
         return;
       }
 
+      SamplingProfiler::ScopedTag profileTag(profileLabel(method, params));
+      auto watch = watchdog_.watch(method, {}, params, watchedDocument(params));
       handleNotification(method, params);
     }
   }
 
+  /**
+   * @brief What the profiler labels a message's samples with: method plus document or command
+   */
+  static std::string profileLabel(const std::string &method, const json &params) {
+    if (!SamplingProfiler::instance().running())
+      return {};
+    std::string label = method;
+    if (!params.is_object())
+      return label;
+    auto document = params.find("textDocument");
+    if (document != params.end() && document->is_object() && document->contains("uri"))
+      label += " " + document->value("uri", "");
+    else if (params.contains("command") && params["command"].is_string())
+      label += " " + params["command"].get<std::string>();
+    return label;
+  }
+
+  /**
+   * @brief The document a message is about, for slow-request reports
+   *
+   * Version is the client's; for didOpen and full-text didChange, version
+   * and size are those of the text being applied.
+   */
+  RequestWatchdog::Document watchedDocument(const json &params) {
+    RequestWatchdog::Document document;
+    if (!watchdog_.enabled() || !params.is_object())
+      return document;
+    auto textDocument = params.find("textDocument");
+    if (textDocument == params.end() || !textDocument->is_object())
+      return document;
+    document.uri = textDocument->value("uri", "");
+    document.version = textDocument->value(
+        "version", watchdog_.history().version(document.uri).value_or(int64_t(-1)));
+
+    const json *text = textDocument->contains("text") ? &(*textDocument)["text"] : nullptr;
+    auto changes = params.find("contentChanges");
+    if (changes != params.end() && changes->is_array() && !changes->empty() &&
+        changes->back().is_object() && !changes->back().contains("range") &&
+        changes->back().contains("text"))
+      text = &changes->back()["text"];
+    if (text && text->is_string())
+      document.size = text->get_ref<const std::string &>().size();
+    else if (SourceFile *file = service_.workspace().getFile(document.uri))
+      document.size = file->content().size();
+    return document;
+  }
+
+  /**
+   * @brief Whether the client has cancelled the request being handled
+   */
+  [[nodiscard]] bool requestCancelled() const {
+    return !currentRequest_.empty() && inbox_->isCancelled(currentRequest_);
+  }
+
+  /**
+   * @brief Answer a request whose results arrive in batches
+   *
+   * With a partialResultToken every batch goes out as a `$/progress`
+   * notification and the response is an empty array; with a workDoneToken the
+   * search is bracketed by begin/report/end progress. Without either, the
+   * batches are collected into a single response as before. Cancellation
+   * (`$/cancelRequest` or `window/workDoneProgress/cancel`) is checked after
+   * every file; the searches pass an empty batch for files without results.
+   *
+   * @param search Called with the sink that receives each batch
+   */
+  template <typename T, typename Search>
+  void streamResults(const JsonRpcId &id, const json &params, const std::string &title,
+                     Search &&search) {
+    json partialToken = params.is_object() ? params.value("partialResultToken", json()) : json();
+    json workDoneToken = params.is_object() ? params.value("workDoneToken", json()) : json();
+    auto progress = [this](const json &token, json value) {
+      writeNotification("$/progress", {{"token", token}, {"value", std::move(value)}});
+    };
+
+    if (!workDoneToken.is_null())
+      progress(workDoneToken, {{"kind", "begin"}, {"title", title}, {"cancellable", true}});
+
+    json collected = json::array();
+    size_t found = 0;
+    bool cancelled = false;
+    search([&](std::vector<T> &&batch) {
+      if (requestCancelled()) {
+        cancelled = true;
+        return false;
+      }
+      if (batch.empty())
+        return true;
+      found += batch.size();
+      if (!partialToken.is_null()) {
+        progress(partialToken, batch);
+      } else {
+        for (auto &item : batch)
+          collected.push_back(std::move(item));
+      }
+      if (!workDoneToken.is_null())
+        progress(workDoneToken, {{"kind", "report"}, {"message", std::to_string(found) + " found"}});
+      return true;
+    });
+
+    if (!workDoneToken.is_null()) {
+      progress(workDoneToken,
+               {{"kind", "end"},
+                {"message", cancelled ? std::string("Cancelled") : std::to_string(found) + " found"}});
+    }
+
+    // Responses overtake queued notifications; the last chunk must arrive first
+    outbound_.flush();
+    if (cancelled)
+      writeErrorResponse(id, JsonRpcErrorCode::RequestCancelled, "Request cancelled");
+    else
+      writeResponse(id, partialToken.is_null() ? std::move(collected) : json::array());
+  }
+
   /**
    * @brief Parse JSON-RPC ID
    */
@@ -447,6 +834,18 @@ private:
       handleSemanticTokensFull(id, params);
     } else if (method == "textDocument/codeAction") {
       handleCodeAction(id, params);
+    } else if (method == "workspace/executeCommand") {
+      handleExecuteCommand(id, params);
+    } else if (method == "workspace/willRenameFiles") {
+      handleWillRenameFiles(id, params);
+    } else if (method == "lang/governorStatus") {
+      handleGovernorStatus(id);
+    } else if (method == "lang/findCalls") {
+      handleFindCalls(id, params);
+    } else if (method == "lang/textStoreStatus") {
+      handleTextStoreStatus(id);
+    } else if (method == "lang/profiler") {
+      handleProfiler(id, params);
     } else {
       writeErrorResponse(id, JsonRpcErrorCode::MethodNotFound, "Method not found: " + method);
     }
@@ -455,7 +854,7 @@ private:
   /**
    * @brief Handle a JSON-RPC notification
    */
-  void handleNotification(const std::string &method, const json &params) {
+  void handleNotification(const std::string &method, json &params) {
     if (method == "initialized") {
       handleInitialized(params);
     } else if (method == "exit") {
@@ -468,6 +867,8 @@ private:
       handleDidClose(params);
     } else if (method == "textDocument/didSave") {
       handleDidSave(params);
+    } else if (method == "workspace/didChangeWatchedFiles") {
+      handleDidChangeWatchedFiles(params);
     }
     // Unknown notifications are silently ignored
   }
@@ -485,6 +886,34 @@ private:
       rootPath = params["rootPath"].get<std::string>();
     }
 
+    // Workspace settings
+    if (params.contains("initializationOptions") && params["initializationOptions"].is_object()) {
+      const auto &options = params["initializationOptions"];
+      if (options.contains("lint") && options["lint"].is_object()) {
+        LspServiceConfig config = service_.config();
+        readLintOptions(options["lint"], config.lint);
+        service_.setConfig(std::move(config));
+      }
+      if (options.contains("speculativePrecompute") &&
+          options["speculativePrecompute"].is_boolean()) {
+        LspServiceConfig config = service_.config();
+        config.enableSpeculativePrecompute = options["speculativePrecompute"].get<bool>();
+        service_.setConfig(std::move(config));
+      }
+    }
+
+    // Without workspace/applyEdit, command results carry their edits instead
+    if (params.contains("capabilities") && params["capabilities"].is_object()) {
+      const auto &capabilities = params["capabilities"];
+      clientApplyEdit_ = capabilities.contains("workspace") &&
+                         capabilities["workspace"].is_object() &&
+                         capabilities["workspace"].value("applyEdit", false);
+      if (capabilities.contains("workspace") && capabilities["workspace"].is_object()) {
+        json watched = capabilities["workspace"].value("didChangeWatchedFiles", json::object());
+        clientWatchesFiles_ = watched.is_object() && watched.value("dynamicRegistration", false);
+      }
+    }
+
     // Initialize service
     service_.initialize(rootPath);
 
@@ -500,13 +929,16 @@ private:
         {"definitionProvider", true},
         {"declarationProvider", true},
         {"typeDefinitionProvider", true},
-        {"referencesProvider", true},
+        {"referencesProvider", {{"workDoneProgress", true}}},
         {"documentSymbolProvider", true},
-        {"workspaceSymbolProvider", true},
+        {"workspaceSymbolProvider", {{"workDoneProgress", true}}},
         {"renameProvider", {{"prepareProvider", true}}},
         {"documentFormattingProvider", true},
         {"documentRangeFormattingProvider", true},
-        {"codeActionProvider", true},
+        {"codeActionProvider", {{"codeActionKinds", {"quickfix", "source.fixAll"}}}},
+        {"executeCommandProvider",
+         {{"commands", {FixAllWorkspaceCommand}}, {"workDoneProgress", true}}},
+        {"workspace", {{"fileOperations", {{"willRename", renameFilters()}}}}},
         {"semanticTokensProvider",
          {{"legend",
            {{"tokenTypes",
@@ -526,10 +958,25 @@ private:
     writeResponse(id, result);
   }
 
-  void handleInitialized(const json & /*params*/) { initialized_ = true; }
+  void handleInitialized(const json & /*params*/) {
+    initialized_ = true;
+
+    // Signatures of closed modules are derived from disk; hear about changes there
+    if (clientWatchesFiles_) {
+      json watchers = json::array();
+      for (const auto &extension : service_.config().sourceExtensions)
+        watchers.push_back({{"globPattern", "**/*" + extension}});
+      writeRequest("client/registerCapability",
+                   {{"registrations",
+                     {{{"id", "watched-source-files"},
+                       {"method", "workspace/didChangeWatchedFiles"},
+                       {"registerOptions", {{"watchers", watchers}}}}}}});
+    }
+  }
 
   void handleShutdown(const JsonRpcId &id) {
     shutdownReceived_ = true;
+    stopFixAll();
     service_.shutdown();
     writeResponse(id, nullptr);
   }
@@ -540,19 +987,33 @@ private:
   // Document Synchronization Handlers
   // ========================================================================
 
-  void handleDidOpen(const json &params) {
+  /**
+   * @brief Move the "text" member out of a JSON object
+   *
+   * The parser has already unescaped the payload into the DOM string; moving
+   * it hands that buffer to the SourceFile without another copy.
+   */
+  static std::string takeText(json &object) {
+    auto it = object.find("text");
+    if (it == object.end() || !it->is_string()) {
+      return {};
+    }
+    return std::move(it->get_ref<std::string &>());
+  }
+
+  void handleDidOpen(json &params) {
     if (!params.contains("textDocument"))
       return;
 
-    const auto &doc = params["textDocument"];
+    auto &doc = params["textDocument"];
     std::string uri = doc.value("uri", "");
-    std::string text = doc.value("text", "");
+    std::string text = takeText(doc);
     int64_t version = doc.value("version", 0);
 
     service_.didOpen(uri, std::move(text), version);
   }
 
-  void handleDidChange(const json &params) {
+  void handleDidChange(json &params) {
     if (!params.contains("textDocument") || !params.contains("contentChanges"))
       return;
 
@@ -560,12 +1021,12 @@ private:
     std::string uri = doc.value("uri", "");
     int64_t version = doc.value("version", 0);
 
-    const auto &changes = params["contentChanges"];
-    if (changes.empty())
+    auto &changes = params["contentChanges"];
+    if (!changes.is_array() || changes.empty())
       return;
 
     // For full sync, use the last change
-    std::string newContent = changes.back().value("text", "");
+    std::string newContent = takeText(changes.back());
     service_.didChange(uri, std::move(newContent), version);
   }
 
@@ -574,10 +1035,7 @@ private:
       return;
 
     std::string uri = params["textDocument"].value("uri", "");
-    service_.didClose(uri);
-
-    // Clear diagnostics
-    publishDiagnostics(uri, {});
+    service_.didClose(uri); // Clears its diagnostics
   }
 
   void handleDidSave(const json &params) {
@@ -588,6 +1046,24 @@ private:
     service_.didSave(uri);
   }
 
+  void handleDidChangeWatchedFiles(const json &params) {
+    if (!params.contains("changes") || !params["changes"].is_array())
+      return;
+
+    std::vector<FileEvent> events;
+    for (const auto &change : params["changes"]) {
+      if (!change.is_object() || !change.contains("uri"))
+        continue;
+      FileEvent event;
+      event.uri = change.value("uri", "");
+      int type = change.value("type", 2);
+      if (type >= 1 && type <= 3)
+        event.type = static_cast<FileEvent::Type>(type);
+      events.push_back(std::move(event));
+    }
+    service_.didChangeWatchedFiles(events);
+  }
+
   // ========================================================================
   // Language Feature Handlers
   // ========================================================================
@@ -699,12 +1175,9 @@ private:
       includeDeclaration = params["context"]["includeDeclaration"].get<bool>();
     }
 
-    auto result = service_.references(uri, position, includeDeclaration);
-    if (result.empty()) {
-      writeResponse(id, json::array());
-    } else {
-      writeResponse(id, result);
-    }
+    streamResults<Location>(id, params, "Finding references", [&](const ResultSink<Location> &sink) {
+      service_.references(uri, position, includeDeclaration, sink);
+    });
   }
 
   void handleDocumentSymbol(const JsonRpcId &id, const json &params) {
@@ -720,8 +1193,24 @@ private:
 
   void handleWorkspaceSymbol(const JsonRpcId &id, const json &params) {
     std::string query = params.value("query", "");
-    auto result = service_.workspaceSymbols(query);
-    writeResponse(id, result);
+    streamResults<WorkspaceSymbol>(id, params, "Searching symbols",
+                                   [&](const ResultSink<WorkspaceSymbol> &sink) {
+                                     service_.workspaceSymbols(query, sink);
+                                   });
+  }
+
+  /**
+   * @brief Custom request: every call to `name` in open and indexed files ({ "name": "print" })
+   */
+  void handleFindCalls(const JsonRpcId &id, const json &params) {
+    if (!params.is_object() || !params.contains("name") || !params["name"].is_string()) {
+      writeErrorResponse(id, JsonRpcErrorCode::InvalidParams, "Invalid params");
+      return;
+    }
+    std::string name = params["name"].get<std::string>();
+    streamResults<Location>(id, params, "Finding calls", [&](const ResultSink<Location> &sink) {
+      service_.findCalls(name, sink);
+    });
   }
 
   void handleRename(const JsonRpcId &id, const json &params) {
@@ -836,12 +1325,27 @@ private:
     std::vector<Diagnostic> diagnostics;
     // Note: Would need to parse diagnostics from params["context"]["diagnostics"]
 
+    // Requested kinds; "source" also admits "source.fixAll"
+    std::vector<std::string> only;
+    if (params.contains("context") && params["context"].contains("only") &&
+        params["context"]["only"].is_array()) {
+      for (const auto &kind : params["context"]["only"]) {
+        if (kind.is_string())
+          only.push_back(kind.get<std::string>());
+      }
+    }
+
     auto result = service_.codeActions(uri, range, diagnostics);
 
     // Convert to JSON
     json actions = json::array();
     for (const auto &action : result) {
-      json actionJson = {{"title", action.title}, {"kind", "quickfix"}};
+      std::string kind = codeActionKindName(action.kind);
+      if (!only.empty() && std::none_of(only.begin(), only.end(), [&](const std::string &wanted) {
+            return kind == wanted || kind.rfind(wanted + ".", 0) == 0;
+          }))
+        continue;
+      json actionJson = {{"title", action.title}, {"kind", kind}};
       if (!action.edit.changes.empty()) {
         actionJson["edit"] = action.edit;
       }
@@ -851,19 +1355,317 @@ private:
     writeResponse(id, actions);
   }
 
+  static const char *codeActionKindName(CodeActionKind kind) {
+    switch (kind) {
+    case CodeActionKind::QuickFix:
+      return "quickfix";
+    case CodeActionKind::Refactor:
+      return "refactor";
+    case CodeActionKind::RefactorExtract:
+      return "refactor.extract";
+    case CodeActionKind::RefactorInline:
+      return "refactor.inline";
+    case CodeActionKind::RefactorRewrite:
+      return "refactor.rewrite";
+    case CodeActionKind::Source:
+      return "source";
+    case CodeActionKind::SourceOrganizeImports:
+      return "source.organizeImports";
+    case CodeActionKind::SourceFixAll:
+      return "source.fixAll";
+    }
+    return "quickfix";
+  }
+
+  // ========================================================================
+  // File Operations
+  // ========================================================================
+
+  /**
+   * @brief Registration options of willRenameFiles: source files, and any folder
+   */
+  json renameFilters() const {
+    std::string extensions;
+    for (const auto &extension : service_.config().sourceExtensions)
+      extensions += (extensions.empty() ? "" : ",") + extension.substr(extension.rfind('.') + 1);
+    json filters = json::array();
+    filters.push_back({{"pattern", {{"glob", "**/*.{" + extensions + "}"}, {"matches", "file"}}}});
+    filters.push_back({{"pattern", {{"glob", "**"}, {"matches", "folder"}}}});
+    return {{"filters", filters}};
+  }
+
+  void handleWillRenameFiles(const JsonRpcId &id, const json &params) {
+    if (!params.is_object() || !params.contains("files") || !params["files"].is_array()) {
+      writeErrorResponse(id, JsonRpcErrorCode::InvalidParams, "Invalid params");
+      return;
+    }
+
+    std::vector<FileRename> renames;
+    for (const auto &file : params["files"]) {
+      if (file.is_object())
+        renames.push_back({file.value("oldUri", ""), file.value("newUri", "")});
+    }
+
+    auto edit = service_.willRenameFiles(renames);
+    if (edit.changes.empty())
+      writeResponse(id, nullptr);
+    else
+      writeResponse(id, edit);
+  }
+
+  // ========================================================================
+  // Workspace Commands
+  // ========================================================================
+
+  static constexpr const char *FixAllWorkspaceCommand = "lang.fixAllWorkspace";
+
+  /**
+   * @brief workspace/executeCommand
+   *
+   * Fix-all runs on its own thread so the message loop keeps serving requests
+   * (and can see a `$/cancelRequest` for it); that thread sends the response.
+   */
+  void handleExecuteCommand(const JsonRpcId &id, const json &params) {
+    std::string command = params.is_object() ? params.value("command", "") : "";
+    if (command != FixAllWorkspaceCommand) {
+      writeErrorResponse(id, JsonRpcErrorCode::InvalidParams, "Unknown command: " + command);
+      return;
+    }
+    if (fixAllRunning_) {
+      writeErrorResponse(id, JsonRpcErrorCode::InvalidRequest, "Workspace fix-all already running");
+      return;
+    }
+
+    stopFixAll(); // reap the previous, finished job
+    fixAllRunning_ = true;
+    responseDeferred_ = true;
+    json workDoneToken = params.value("workDoneToken", json());
+    fixAllJob_ = std::thread([this, id, request = currentRequest_, workDoneToken] {
+      runFixAll(id, request, workDoneToken);
+    });
+  }
+
+  /**
+   * @brief Body of the fix-all thread: progress, the merged edit, then the response
+   */
+  void runFixAll(const JsonRpcId &id, const std::string &request, const json &workDoneToken) {
+    SamplingProfiler::ScopedTag profileTag(
+        profileLabel("workspace/executeCommand", {{"command", FixAllWorkspaceCommand}}));
+    auto progress = [&](json value) {
+      if (!workDoneToken.is_null())
+        writeNotification("$/progress", {{"token", workDoneToken}, {"value", std::move(value)}});
+    };
+    progress({{"kind", "begin"},
+              {"title", "Fixing all problems"},
+              {"cancellable", true},
+              {"percentage", 0}});
+
+    size_t reported = 0;
+    auto edit = service_.fixAllWorkspace(
+        [&](const FixAllProgress &state) {
+          size_t percentage = state.filesDone * 100 / std::max<size_t>(state.filesTotal, 1);
+          if (percentage == reported)
+            return;
+          reported = percentage;
+          progress({{"kind", "report"},
+                    {"percentage", percentage},
+                    {"message", std::to_string(state.filesDone) + "/" +
+                                    std::to_string(state.filesTotal) + " files"}});
+        },
+        [&] { return fixAllStop_.load() || inbox_->isCancelled(request); });
+
+    size_t edits = 0;
+    if (edit) {
+      for (const auto &[uri, fileEdits] : edit->changes)
+        edits += fileEdits.size();
+    }
+    progress({{"kind", "end"},
+              {"message", edit ? std::to_string(edits) + " fixes in " +
+                                     std::to_string(edit->changes.size()) + " files"
+                               : std::string("Cancelled")}});
+    outbound_.flush(); // responses overtake queued notifications
+
+    if (!edit) {
+      writeErrorResponse(id, JsonRpcErrorCode::RequestCancelled, "Request cancelled");
+    } else {
+      json result = {{"filesChanged", edit->changes.size()}, {"edits", edits}};
+      if (!edit->changes.empty() && clientApplyEdit_) {
+        writeRequest("workspace/applyEdit",
+                     {{"label", "Fix all problems in workspace"}, {"edit", *edit}});
+        outbound_.flush(); // the edit goes out before the command completes
+      } else if (!edit->changes.empty()) {
+        result["edit"] = *edit;
+      }
+      writeResponse(id, result);
+    }
+    inbox_->finish(request);
+    fixAllRunning_ = false;
+  }
+
+  /**
+   * @brief Cancel a running fix-all and wait for its thread
+   */
+  void stopFixAll() {
+    if (!fixAllJob_.joinable())
+      return;
+    fixAllStop_ = fixAllRunning_.load();
+    fixAllJob_.join();
+    fixAllStop_ = false;
+  }
+
+  /**
+   * @brief Custom request: control the sampling profiler
+   *
+   * params: {"action": "start" | "stop" | "status" | "export", "frequency": 99,
+   *          "format": "collapsed" | "pprof", "path": "/tmp/lang-lsp.folded"}
+   * Every action answers with the profiler status, except an export: collapsed
+   * stacks come back inline unless a path is given; pprof needs a path.
+   */
+  void handleProfiler(const JsonRpcId &id, const json &params) {
+    auto &profiler = SamplingProfiler::instance();
+    json args = params.is_object() ? params : json::object();
+    std::string action = args.value("action", "status");
+    if (action == "start") {
+      std::string error;
+      if (!profiler.start(args.value("frequency", SamplingProfiler::DefaultFrequency), error)) {
+        writeErrorResponse(id, JsonRpcErrorCode::InvalidRequest, error);
+        return;
+      }
+    } else if (action == "stop") {
+      profiler.stop();
+    } else if (action == "export") {
+      std::string format = args.value("format", "collapsed");
+      std::string path = args.value("path", "");
+      if (format != "collapsed" && format != "pprof") {
+        writeErrorResponse(id, JsonRpcErrorCode::InvalidParams,
+                           "Unknown profile format: " + format);
+        return;
+      }
+      if (format == "pprof" && path.empty()) {
+        writeErrorResponse(id, JsonRpcErrorCode::InvalidParams, "pprof export needs a path");
+        return;
+      }
+      std::string data = format == "pprof" ? profiler.pprof() : profiler.collapsed();
+      if (path.empty()) {
+        writeResponse(id, {{"format", format}, {"data", std::move(data)}});
+        return;
+      }
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(data.data(), static_cast<std::streamsize>(data.size()));
+      if (!out) {
+        writeErrorResponse(id, JsonRpcErrorCode::InternalError, "Cannot write " + path);
+        return;
+      }
+      writeResponse(id, {{"format", format}, {"path", path}, {"bytes", data.size()}});
+      return;
+    } else if (action != "status") {
+      writeErrorResponse(id, JsonRpcErrorCode::InvalidParams, "Unknown profiler action: " + action);
+      return;
+    }
+
+    auto status = profiler.status();
+    writeResponse(id, {{"supported", status.supported},
+                       {"running", status.running},
+                       {"frequency", status.frequency},
+                       {"samples", status.samples},
+                       {"dropped", status.dropped},
+                       {"threads", status.threads},
+                       {"stacks", status.stacks},
+                       {"durationMs", status.duration.count()}});
+  }
+
+  /**
+   * @brief Custom request: background governor state and its last decision
+   */
+  void handleGovernorStatus(const JsonRpcId &id) {
+    auto status = service_.governor().status();
+    json result = {{"hardwareThreads", status.hardwareThreads},
+                   {"maxSlots", status.maxSlots},
+                   {"slots", status.slots},
+                   {"activeBackground", status.activeBackground},
+                   {"idleOnly", status.idleOnly},
+                   {"latencyEwmaMs", status.latencyEwmaMs},
+                   {"interactiveRequests", status.interactiveRequests},
+                   {"backgroundAdmitted", status.backgroundAdmitted},
+                   {"backgroundDeferred", status.backgroundDeferred},
+                   {"backgroundForced", status.backgroundForced},
+                   {"decisions", status.decisions},
+                   {"lastDecision", status.lastDecision}};
+    result["loadPerCore"] = status.loadPerCore < 0 ? json(nullptr) : json(status.loadPerCore);
+    writeResponse(id, result);
+  }
+
+  /**
+   * @brief Custom request: size and decode cost of the resident text of closed files
+   */
+  void handleTextStoreStatus(const JsonRpcId &id) {
+    auto stats = service_.workspace().textStoreStats();
+    writeResponse(id, {{"documents", stats.documents},
+                       {"blocks", stats.blocks},
+                       {"rawBytes", stats.rawBytes},
+                       {"compressedBytes", stats.compressedBytes},
+                       {"compressionRatio", stats.compressionRatio()},
+                       {"blockDecodes", stats.blockDecodes},
+                       {"cacheHits", stats.cacheHits},
+                       {"averageDecodeMicros", stats.averageDecodeMicros()}});
+  }
+
   // ========================================================================
   // Diagnostics
   // ========================================================================
 
-  void publishDiagnostics(const std::string &uri, const std::vector<Diagnostic> &diagnostics) {
+  void publishDiagnostics(const std::string &uri, const std::vector<Diagnostic> &diagnostics,
+                          uint64_t generation) {
+    // Only the latest diagnostics of a document matter, and an older generation never
+    // replaces a newer one
     json params = {{"uri", uri}, {"diagnostics", diagnostics}};
-    writeNotification("textDocument/publishDiagnostics", params);
+    writeNotification("textDocument/publishDiagnostics", params, "diagnostics:" + uri,
+                      generation);
   }
 
   // ========================================================================
   // Utility Functions
   // ========================================================================
 
+  /**
+   * @brief Read initializationOptions.lint
+   *
+   * { "enabled": true, "disable": ["shadowing"], "only": ["L001", "L002"],
+   *   "severity": { "unused-variable": "hint", "L004": "off" } }
+   */
+  static void readLintOptions(const json &options, semantic::LintConfig &config) {
+    auto readList = [&](const char *key, std::vector<std::string> &out) {
+      if (!options.contains(key) || !options[key].is_array())
+        return;
+      for (const auto &rule : options[key])
+        if (rule.is_string())
+          out.push_back(rule.get<std::string>());
+    };
+
+    if (options.contains("enabled") && options["enabled"].is_boolean())
+      config.enabled = options["enabled"].get<bool>();
+    readList("disable", config.disabledRules);
+    readList("only", config.onlyRules);
+
+    if (!options.contains("severity") || !options["severity"].is_object())
+      return;
+    for (const auto &[rule, value] : options["severity"].items()) {
+      if (!value.is_string())
+        continue;
+      const std::string level = value.get<std::string>();
+      if (level == "off")
+        config.disabledRules.push_back(rule);
+      else if (level == "error")
+        config.severities[rule] = semantic::DiagnosticSeverity::Error;
+      else if (level == "warning")
+        config.severities[rule] = semantic::DiagnosticSeverity::Warning;
+      else if (level == "info" || level == "information")
+        config.severities[rule] = semantic::DiagnosticSeverity::Info;
+      else if (level == "hint")
+        config.severities[rule] = semantic::DiagnosticSeverity::Hint;
+    }
+  }
+
   /**
    * @brief Extract URI and position from textDocument/position params
    */
@@ -883,13 +1685,81 @@ private:
   // Member Variables
   // ========================================================================
 
+  OutboundQueue outbound_{&LspServer::writeToStdout}; ///< Outlives service_'s worker thread
   LspService service_;
-  std::mutex outputMutex_;
+  RequestWatchdog watchdog_; ///< Its history is recorded on the message loop thread
+  ParserWarmup warmup_;
+  std::shared_ptr<Inbox> inbox_ = std::make_shared<Inbox>();
+  std::string currentRequest_; ///< Id (as JSON) of the request being handled
+  bool responseDeferred_ = false; ///< The handler's thread answers currentRequest_ later
+  std::atomic<int> nextServerRequestId_{1};
+  bool clientApplyEdit_ = false;
+  bool clientWatchesFiles_ = false; ///< Client registers file watchers on our behalf
+  std::thread fixAllJob_;
+  std::atomic<bool> fixAllRunning_{false};
+  std::atomic<bool> fixAllStop_{false};
   std::atomic<bool> running_{true};
   std::atomic<bool> initialized_{false};
   std::atomic<bool> shutdownReceived_{false};
 };
 
+// ============================================================================
+// Index Export
+// ============================================================================
+
+/**
+ * @brief Batch mode: write an LSIF dump of the workspace under root
+ * @param outPath Output file, or "-" for stdout
+ * @param jobs Analysis threads (0 = one per core)
+ * @return Process exit code
+ */
+inline int exportLsif(LspServiceConfig config, const std::string &root, const std::string &outPath,
+                      unsigned jobs) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::path rootPath = fs::absolute(root, ec).lexically_normal();
+  if (ec || !fs::is_directory(rootPath)) {
+    std::cerr << "lang-lsp: not a directory: " << root << "\n";
+    return 1;
+  }
+  if (!rootPath.has_filename())
+    rootPath = rootPath.parent_path();
+
+  static char buffer[1 << 20];
+  std::ofstream file;
+  std::ostream *out = &std::cout;
+  if (outPath != "-") {
+    file.rdbuf()->pubsetbuf(buffer, sizeof(buffer));
+    file.open(outPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      std::cerr << "lang-lsp: cannot write " << outPath << "\n";
+      return 1;
+    }
+    out = &file;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  LspService service(std::move(config));
+  service.initialize(rootPath.string());
+  LsifWriter writer(*out, uri::pathToUri(rootPath.string()));
+  size_t files =
+      service.indexWorkspace([&](IndexedDocument &&document) { writer.document(document); }, jobs);
+  writer.finish();
+  service.shutdown();
+  if (!*out) {
+    std::cerr << "lang-lsp: write to " << outPath << " failed\n";
+    return 1;
+  }
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  const auto &stats = writer.stats();
+  std::cerr << "lang-lsp: indexed " << stats.documents << " of " << files << " files, "
+            << stats.ranges << " ranges, " << stats.imports << " imports linked ("
+            << stats.unresolved << " unresolved) in " << elapsed.count() << " ms\n";
+  return 0;
+}
+
 } // namespace lsp
 } // namespace lang
 
@@ -910,6 +1780,12 @@ int main(int argc, char *argv[]) {
   std::cin.tie(nullptr);
   //    std::this_thread::sleep_for(std::chrono::seconds(6));
   // Parse command line arguments
+  lang::lsp::LspServiceConfig config;
+  std::string exportPath;
+  std::string exportRoot = ".";
+  unsigned exportJobs = 0;
+  int profileFrequency = 0;
+  lang::lsp::RequestWatchdog::Config watchdog;
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
     if (arg == "--version" || arg == "-v") {
@@ -920,11 +1796,85 @@ int main(int argc, char *argv[]) {
       std::cout << "Options:\n";
       std::cout << "  --version, -v  Show version information\n";
       std::cout << "  --help, -h     Show this help message\n";
+      std::cout << "  --streaming-threshold <bytes>\n";
+      std::cout << "                 Parse files at least this large statement by statement\n";
+      std::cout << "                 into a declarations-only AST (default 32 MiB)\n";
+      std::cout << "  --ast-cache <dir>\n";
+      std::cout << "                 Keep relocatable AST images of unchanged files in <dir>\n";
+      std::cout << "                 so reopening them skips parsing\n";
+      std::cout << "  --index-cache <dir>\n";
+      std::cout << "                 Persist per-file identifier filters in <dir> so cross-file\n";
+      std::cout << "                 searches skip files that cannot mention the name\n";
+      std::cout << "  --completion-budget <ms>\n";
+      std::cout << "                 Time budget per completion request; slower sources resume\n";
+      std::cout << "                 on the client's next query (default 30, 0 = unlimited)\n";
+      std::cout << "  --background-cores <share>\n";
+      std::cout << "                 Fraction of cores background work may use (default 0.5)\n";
+      std::cout << "  --background-idle\n";
+      std::cout << "                 Run background work only on otherwise idle cores\n";
+      std::cout << "  --export-lsif <file>\n";
+      std::cout << "                 Write an LSIF dump (JSON lines, \"-\" = stdout) of the\n";
+      std::cout << "                 workspace instead of serving LSP, then exit\n";
+      std::cout << "  --root <dir>   Workspace to export (default: current directory)\n";
+      std::cout << "  --profile <hz> Start the sampling profiler at launch (see lang/profiler)\n";
+      std::cout << "  --jobs <n>     Export analysis threads (default: one per core)\n";
+      std::cout << "  --watchdog     Watch for slow requests and write incident reports; the\n";
+      std::cout << "                 reports include the full text of open documents\n";
+      std::cout << "  --incident-dir <dir>\n";
+      std::cout << "                 Where incident reports go with --watchdog\n";
+      std::cout << "                 (default: <temp>/lang-lsp-incidents)\n";
+      std::cout << "  --slow-request <method>=<ms>\n";
+      std::cout << "                 With --watchdog, report a method slower than <ms>;\n";
+      std::cout << "                 \"default\" sets the threshold of methods without one\n";
+      std::cout << "                 (default 2000)\n";
       return 0;
+    } else if (arg == "--streaming-threshold" && i + 1 < argc) {
+      config.streamingParseThreshold = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--ast-cache" && i + 1 < argc) {
+      config.astImageCacheDir = argv[++i];
+    } else if (arg == "--index-cache" && i + 1 < argc) {
+      config.identifierIndexDir = argv[++i];
+    } else if (arg == "--completion-budget" && i + 1 < argc) {
+      config.completionBudget = std::chrono::milliseconds(std::strtoll(argv[++i], nullptr, 10));
+    } else if (arg == "--background-cores" && i + 1 < argc) {
+      config.governor.backgroundCoreShare = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--background-idle") {
+      config.governor.idleOnly = true;
+    } else if (arg == "--export-lsif" && i + 1 < argc) {
+      exportPath = argv[++i];
+    } else if (arg == "--root" && i + 1 < argc) {
+      exportRoot = argv[++i];
+    } else if (arg == "--profile" && i + 1 < argc) {
+      profileFrequency = std::atoi(argv[++i]);
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      exportJobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--incident-dir" && i + 1 < argc) {
+      watchdog.directory = argv[++i];
+    } else if (arg == "--slow-request" && i + 1 < argc) {
+      std::string spec = argv[++i];
+      size_t eq = spec.rfind('=');
+      if (eq == std::string::npos || eq == 0)
+        continue;
+      std::chrono::milliseconds threshold(std::strtoll(spec.c_str() + eq + 1, nullptr, 10));
+      if (spec.compare(0, eq, "default") == 0)
+        watchdog.defaultThreshold = threshold;
+      else
+        watchdog.thresholds[spec.substr(0, eq)] = threshold;
+    } else if (arg == "--watchdog") {
+      watchdog.enabled = true;
     }
   }
 
+  if (profileFrequency > 0) {
+    std::string error;
+    if (!lang::lsp::SamplingProfiler::instance().start(profileFrequency, error))
+      std::cerr << "lang-lsp: profiler: " << error << "\n";
+  }
+
+  if (!exportPath.empty())
+    return lang::lsp::exportLsif(std::move(config), exportRoot, exportPath, exportJobs);
+
   // Run the LSP server
-  lang::lsp::LspServer server;
+  lang::lsp::LspServer server(std::move(config), std::move(watchdog));
   return server.run();
 }
@@ -0,0 +1,546 @@
+#!/usr/bin/env python3
+"""
+LSP probes: drive the server over stdio against a scratch workspace and
+check the responses.
+
+Usage: lsp_probe.py <server-binary> [case ...]   (no case: run all)
+"""
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+
+
+def frame(message):
+    body = json.dumps(message).encode()
+    return b"Content-Length: %d\r\n\r\n" % len(body) + body
+
+
+def read_replies(stream, replies, arrived):
+    while True:
+        header = b""
+        while not header.endswith(b"\r\n\r\n"):
+            byte = stream.read(1)
+            if not byte:
+                return
+            header += byte
+        length = int(header.split(b":")[1])
+        with arrived:
+            replies.append(json.loads(stream.read(length)))
+            arrived.notify_all()
+
+
+class Until:
+    """A session step that waits until predicate(replies so far) holds."""
+
+    def __init__(self, predicate, what):
+        self.predicate, self.what = predicate, what
+
+
+def session(server, root, messages, args=(), options=None, timeout=60):
+    """Send initialize, the messages, shutdown and exit; return everything the server wrote.
+
+    A callable in messages runs once every request sent before it has been answered;
+    it is passed the server process.
+    """
+    uri = "file://" + root
+    params = {"rootUri": uri, "capabilities": {}}
+    if options is not None:
+        params["initializationOptions"] = options
+    prologue = [
+        {"jsonrpc": "2.0", "id": 0, "method": "initialize", "params": params},
+        {"jsonrpc": "2.0", "method": "initialized", "params": {}},
+    ]
+    epilogue = [
+        {"jsonrpc": "2.0", "id": 9999, "method": "shutdown", "params": None},
+        {"jsonrpc": "2.0", "method": "exit"},
+    ]
+    proc = subprocess.Popen([server, *args], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                            stderr=subprocess.DEVNULL)
+    replies, arrived = [], threading.Condition()
+    reader = threading.Thread(target=read_replies, args=(proc.stdout, replies, arrived))
+    reader.start()
+    pending = set()
+    try:
+        for message in prologue + messages + epilogue:
+            if isinstance(message, Until):
+                with arrived:
+                    if not arrived.wait_for(lambda: message.predicate(replies), timeout):
+                        raise AssertionError("timed out waiting for %s" % message.what)
+                continue
+            if callable(message):
+                with arrived:
+                    if not arrived.wait_for(lambda: pending <= {r.get("id") for r in replies},
+                                            timeout):
+                        raise AssertionError("no response to requests %s" % sorted(pending))
+                message(proc)
+                continue
+            if "id" in message:
+                pending.add(message["id"])
+            proc.stdin.write(frame(message))
+            proc.stdin.flush()
+        proc.stdin.close()
+        proc.wait(timeout)
+    finally:
+        proc.kill()
+        reader.join(timeout)
+    return replies
+
+
+def response(replies, request_id):
+    for reply in replies:
+        if reply.get("id") == request_id and "method" not in reply:
+            if "error" in reply:
+                raise AssertionError("request %s failed: %s" % (request_id, reply["error"]))
+            return reply.get("result")
+    raise AssertionError("no response to request %s" % request_id)
+
+
+def write(root, name, text):
+    path = os.path.join(root, name)
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+    return path
+
+
+def did_open(path, text):
+    return {"jsonrpc": "2.0", "method": "textDocument/didOpen",
+            "params": {"textDocument": {"uri": "file://" + path, "languageId": "lang",
+                                        "version": 1, "text": text}}}
+
+
+def request(request_id, method, params):
+    return {"jsonrpc": "2.0", "id": request_id, "method": method, "params": params}
+
+
+def apply_edits(text, edits):
+    """Apply LSP edits (0-based lines, code-point characters) to text."""
+    lines = text.split("\n")
+
+    def offset(pos):
+        return sum(len(line) + 1 for line in lines[:pos["line"]]) + pos["character"]
+
+    for edit in sorted(edits, key=lambda e: offset(e["range"]["start"]), reverse=True):
+        start, end = offset(edit["range"]["start"]), offset(edit["range"]["end"])
+        text = text[:start] + edit["newText"] + text[end:]
+        lines = text.split("\n")
+    return text
+
+
+def cursor(line, character):
+    """Request position of (line, character).
+
+    The service applies the 0-to-1-based conversion of the JSON layer a second
+    time, so request positions are read one line down and one column right.
+    """
+    return {"line": line - 1, "character": character - 1}
+
+
+def expect(actual, wanted, what):
+    if actual != wanted:
+        raise AssertionError("%s:\n  expected %r\n  got      %r" % (what, wanted, actual))
+
+
+# ============================================================================
+# Cases
+# ============================================================================
+
+
+def signature_label(replies, request_id):
+    return response(replies, request_id)["signatures"][0]["label"]
+
+
+ONE_PARAM = "export int foo(int aaaaaaa){ return 1; }\n"
+TWO_PARAMS = "export int foo(int a,int b){ return 1; }\n"  # same size as ONE_PARAM
+
+
+def importer(root):
+    """main.spt calling foo from lib.spt, and a signatureHelp request inside the call."""
+    text = 'import { foo } from "lib.spt";\nint g(){ return foo(1); }\n'
+    path = write(root, "main.spt", text)
+
+    def help_at(request_id):
+        return request(request_id, "textDocument/signatureHelp",
+                       {"textDocument": {"uri": "file://" + path}, "position": cursor(1, 21)})
+    return did_open(path, text), help_at
+
+
+def case_signature_reopen(server, root):
+    """A module reopened with other text is not served its old signature."""
+    lib = write(root, "lib.spt", ONE_PARAM)
+    open_main, help_at = importer(root)
+    reopen = did_open(lib, TWO_PARAMS)
+    replies = session(server, root, [
+        did_open(lib, ONE_PARAM), open_main, help_at(1),
+        {"jsonrpc": "2.0", "method": "textDocument/didClose",
+         "params": {"textDocument": {"uri": "file://" + lib}}},
+        reopen, help_at(2),
+    ])
+    expect(signature_label(replies, 1), "(int) -> int", "signature before reopening")
+    expect(signature_label(replies, 2), "(int, int) -> int", "signature after reopening")
+
+
+def case_signature_watched(server, root):
+    """A closed module changed on disk is analyzed again after a watched-file event."""
+    lib = write(root, "lib.spt", ONE_PARAM)
+    stat = os.stat(lib)
+    open_main, help_at = importer(root)
+
+    def rewrite(_server):
+        # Same size and mtime: only the event tells the server
+        write(root, "lib.spt", TWO_PARAMS)
+        os.utime(lib, ns=(stat.st_atime_ns, stat.st_mtime_ns))
+
+    replies = session(server, root, [
+        open_main, help_at(1), rewrite,
+        {"jsonrpc": "2.0", "method": "workspace/didChangeWatchedFiles",
+         "params": {"changes": [{"uri": "file://" + lib, "type": 2}]}},
+        help_at(2),
+    ])
+    expect(signature_label(replies, 1), "(int) -> int", "signature before the change")
+    expect(signature_label(replies, 2), "(int, int) -> int", "signature after the change")
+
+
+def lint_codes(replies, uri):
+    """Lint codes of every diagnostics publish for uri, in order."""
+    return [sorted(d["code"] for d in reply["params"]["diagnostics"]
+                   if d.get("source") == "lang-lint")
+            for reply in replies
+            if reply.get("method") == "textDocument/publishDiagnostics"
+            and reply["params"]["uri"] == uri]
+
+
+def case_ast_image_corrupt(server, root):
+    """A corrupted AST image is rejected and the document is parsed again."""
+    cache = os.path.join(root, ".ast-cache")
+    text = "int alphaFunction(int a){ return a; }\n" + "// filler line\n" * 2048
+    path = write(root, "a.spt", text)
+    symbols = request(1, "textDocument/documentSymbol", {"textDocument": {"uri": "file://" + path}})
+    session(server, root, [did_open(path, text), symbols], args=["--ast-cache", cache])
+    images = [os.path.join(cache, name) for name in os.listdir(cache)]
+    if not images:
+        raise AssertionError("no AST image written to " + cache)
+    for image in images:
+        with open(image, "rb") as f:
+            data = f.read()
+        with open(image, "wb") as f:
+            f.write(data.replace(b"alphaFunction", b"alphaFunctioN"))
+    replies = session(server, root, [did_open(path, text), symbols], args=["--ast-cache", cache])
+    expect([symbol["name"] for symbol in response(replies, 1)], ["alphaFunction"],
+           "symbols after reopening")
+
+
+def case_close_clears(server, root):
+    """Closing a document right after opening it leaves its diagnostics empty."""
+    text = "void main() {\n    int unused = 1;\n}\n"
+    paths = [write(root, "f%d.spt" % i, text) for i in range(20)]
+    messages = []
+    for path in paths:
+        messages += [did_open(path, text),
+                     {"jsonrpc": "2.0", "method": "textDocument/didClose",
+                      "params": {"textDocument": {"uri": "file://" + path}}}]
+    replies = session(server, root, messages)
+    for path in paths:
+        published = [reply["params"]["diagnostics"] for reply in replies
+                     if reply.get("method") == "textDocument/publishDiagnostics"
+                     and reply["params"]["uri"] == "file://" + path]
+        expect(published[-1:], [[]], "last publish for " + os.path.basename(path))
+
+
+def case_lint_publish(server, root):
+    """Lint findings are published after open and edit, with precompute disabled."""
+    text = "void main() {\n    int unused = 1;\n}\n"
+    edited = "void main() {\n    int unused = 1;\n    int other = 2;\n}\n"
+    path = write(root, "a.spt", text)
+    uri = "file://" + path
+    replies = session(server, root, [
+        did_open(path, text),
+        Until(lambda replies: lint_codes(replies, uri), "the first publish"),
+        {"jsonrpc": "2.0", "method": "textDocument/didChange",
+         "params": {"textDocument": {"uri": uri, "version": 2},
+                    "contentChanges": [{"text": edited}]}},
+        Until(lambda replies: len(lint_codes(replies, uri)) > 1, "the publish after the edit"),
+    ], options={"speculativePrecompute": False})
+    expect(lint_codes(replies, uri), [["L001"], ["L001", "L001"]], "lint codes per publish")
+
+
+def case_lint_skeletal(server, root):
+    """A file parsed into a skeletal AST gets no lint findings about its dropped bodies."""
+    text = "int f(int a) {\n    int b = a;\n    return b;\n}\n"
+    path = write(root, "a.spt", text)
+    uri = "file://" + path
+    replies = session(server, root, [
+        did_open(path, text),
+        Until(lambda replies: lint_codes(replies, uri), "the first publish"),
+    ], args=["--streaming-threshold", "16"])
+    expect(lint_codes(replies, uri), [[]], "lint codes per publish")
+
+
+def case_text_store_close(server, root):
+    """Closing an edited document keeps its on-disk text resident for lookups."""
+    lib = write(root, "lib.spt", ONE_PARAM)
+    uri = "file://" + lib
+    open_main, help_at = importer(root)
+    replies = session(server, root, [
+        did_open(lib, ONE_PARAM),
+        {"jsonrpc": "2.0", "method": "textDocument/didChange",
+         "params": {"textDocument": {"uri": uri, "version": 2},
+                    "contentChanges": [{"text": TWO_PARAMS}]}},
+        {"jsonrpc": "2.0", "method": "textDocument/didClose",
+         "params": {"textDocument": {"uri": uri}}},
+        request(1, "lang/textStoreStatus", None),
+        open_main, help_at(2),
+        request(3, "lang/textStoreStatus", None),
+    ])
+    stored = response(replies, 1)
+    expect((stored["documents"], stored["rawBytes"]), (1, len(ONE_PARAM)), "stored text")
+    expect(signature_label(replies, 2), "(int) -> int", "signature of the closed module")
+    used = response(replies, 3)
+    if used["blockDecodes"] + used["cacheHits"] == 0:
+        raise AssertionError("the closed module was not read from the store: %r" % used)
+
+
+def case_find_calls(server, root):
+    """lang/findCalls finds calls in open documents and in closed, stored ones."""
+    opened = write(root, "a.spt", "void main() {\n    print(1);\n    log(2);\n}\n")
+    closed = write(root, "b.spt", "void f() {\n    int n = 0;\n    print(n);\n}\n")
+    write(root, "c.spt", "void g() { print(3); }\n")  # Never opened: not in the store
+    replies = session(server, root, [
+        did_open(opened, open(opened).read()),
+        did_open(closed, open(closed).read()),
+        {"jsonrpc": "2.0", "method": "textDocument/didClose",
+         "params": {"textDocument": {"uri": "file://" + closed}}},
+        request(1, "lang/findCalls", {"name": "print"}),
+    ])
+    found = sorted((location["uri"], location["range"]["start"]["line"])
+                   for location in response(replies, 1))
+    expect(found, [("file://" + opened, 1), ("file://" + closed, 2)], "calls to print")
+
+
+def case_progress_cancel(server, root):
+    """window/workDoneProgress/cancel cancels the request that owns the progress token."""
+    # A large document ahead of the search keeps the message loop busy while the cancel arrives
+    big = write(root, "big.spt", "int f%d() { return 1; }\n" * 20000 % tuple(range(20000)))
+    small = write(root, "small.spt", "int fSmall() { return 2; }\n")
+    replies = session(server, root, [
+        did_open(big, open(big).read()),
+        did_open(small, open(small).read()),
+        request(1, "workspace/symbol", {"query": "f", "workDoneToken": "search"}),
+        {"jsonrpc": "2.0", "method": "window/workDoneProgress/cancel",
+         "params": {"token": "search"}},
+        request(2, "workspace/symbol", {"query": "fSmall", "workDoneToken": "again"}),
+    ])
+    answer = next(reply for reply in replies if reply.get("id") == 1 and "method" not in reply)
+    expect(answer.get("error", {}).get("code"), -32800, "error code of the cancelled search")
+    expect([symbol["name"] for symbol in response(replies, 2)], ["fSmall"], "next search")
+
+
+def memory(process, field):
+    """A /proc/<pid>/status memory figure of a process (VmHWM, VmRSS, ...) in bytes."""
+    with open("/proc/%d/status" % process.pid) as f:
+        for line in f:
+            if line.startswith(field + ":"):
+                return int(line.split()[1]) * 1024
+    raise AssertionError("no %s in /proc/%d/status" % (field, process.pid))
+
+
+def case_ingest_copies(server, root):
+    """An opened document is held once, and only the JSON parse adds transient copies."""
+    if not os.path.exists("/proc/self/status"):
+        print("SKIP ingest_copies - needs /proc")
+        return
+    text = "/*\n" + ("x" * 99 + "\n") * (80 * 1024) + "*/\nint f() { return 1; }\n"
+    path = os.path.join(root, "big.spt")
+    uri = "file://" + path
+    before, after = {}, {}
+
+    def sample(into):
+        return lambda process: into.update(
+            (field, memory(process, field)) for field in ("VmHWM", "VmRSS"))
+
+    session(server, root, [
+        sample(before),
+        did_open(path, text),
+        request(1, "textDocument/documentSymbol", {"textDocument": {"uri": uri}}),
+        Until(lambda replies: lint_codes(replies, uri), "the first publish"),
+        sample(after),
+    ])
+    copies = {field: (after[field] - before[field]) / len(text) for field in before}
+    print("ingest_copies: %.2f copies retained, %.2f at peak"
+          % (copies["VmRSS"], copies["VmHWM"]))
+    # The SourceFile's content; a second retained copy (line table, UTF-32 stream) is a leak
+    if copies["VmRSS"] > 1.5:
+        raise AssertionError("%.2f copies of the document retained" % copies["VmRSS"])
+    # Request body, the JSON lexer's token buffer and its raw token record; a UTF-32
+    # decode of the document on top of those goes past
+    if copies["VmHWM"] > 4.5:
+        raise AssertionError("peak memory grew by %.2f copies of the document" % copies["VmHWM"])
+
+
+def case_fixall_utf8(server, root):
+    """source.fixAll edits are positioned correctly after non-ASCII text."""
+    text = ("// 中文注释说明\n"
+            "void main() {\n"
+            "    /* 注 */ int unused = 1; int keep = 2;\n"
+            "    print(keep);\n"
+            "}\n")
+    path = write(root, "a.spt", text)
+    uri = "file://" + path
+    zero = {"line": 0, "character": 0}
+    replies = session(server, root, [
+        did_open(path, text),
+        request(1, "textDocument/codeAction",
+                {"textDocument": {"uri": uri}, "range": {"start": zero, "end": zero},
+                 "context": {"diagnostics": [], "only": ["source.fixAll"]}}),
+    ])
+    actions = response(replies, 1)
+    expect(len(actions), 1, "fix-all actions")
+    fixed = apply_edits(text, actions[0]["edit"]["changes"][uri])
+    expect(fixed.split("\n")[2], "    /* 注 */  int keep = 2;", "line after fix-all")
+    expect(fixed.split("\n")[0], "// 中文注释说明", "comment after fix-all")
+
+
+def case_rename_alias(server, root):
+    """Renaming an export rewrites the imported name but not the uses of an alias."""
+    lib = write(root, "lib/util.spt",
+                "// util\nexport int foo(){ return 1; }\nint z(){ return foo(); }\n")
+    aliased = write(root, "main.spt", '// 别名导入\nimport { foo as bar } from "lib/util.spt";\n'
+                                      "int g(){ return bar() + bar(); }\n")
+    plain = write(root, "other.spt", '/* 直接导入 */ import { foo } from "lib/util.spt";\n'
+                                     "int h(){ return foo(); }\n")
+    replies = session(server, root, [
+        did_open(lib, open(lib, encoding="utf-8").read()),
+        request(1, "textDocument/rename",
+                {"textDocument": {"uri": "file://" + lib},
+                 "position": cursor(2, 17), "newName": "qux"}),
+    ])
+    changes = response(replies, 1)["changes"]
+    wanted = {
+        lib: "// util\nexport int qux(){ return 1; }\nint z(){ return qux(); }\n",
+        aliased: '// 别名导入\nimport { qux as bar } from "lib/util.spt";\n'
+                 "int g(){ return bar() + bar(); }\n",
+        plain: '/* 直接导入 */ import { qux } from "lib/util.spt";\nint h(){ return qux(); }\n',
+    }
+    expect(sorted(changes), sorted("file://" + path for path in wanted), "renamed files")
+    for path, text in wanted.items():
+        edits = changes["file://" + path]
+        for edit in edits:
+            if edit["range"]["start"] == edit["range"]["end"]:
+                raise AssertionError("empty edit range in %s: %r" % (path, edit))
+        with open(path, encoding="utf-8") as f:
+            expect(apply_edits(f.read(), edits), text, "text of %s" % os.path.basename(path))
+
+
+def case_rename_import_utf8(server, root):
+    """willRenameFiles updates an import that follows non-ASCII text."""
+    write(root, "lib/util.spt", "export int f(){ return 1; }\n")
+    text = '// 主程序入口\n/* 导入 */ import { f } from "lib/util.spt";\nint g(){ return f(); }\n'
+    path = write(root, "main.spt", text)
+    replies = session(server, root, [
+        request(1, "workspace/willRenameFiles",
+                {"files": [{"oldUri": "file://" + root + "/lib/util.spt",
+                            "newUri": "file://" + root + "/lib/helpers.spt"}]}),
+    ])
+    result = response(replies, 1)
+    if not result:
+        raise AssertionError("no edit for the importer")
+    edits = result["changes"].get("file://" + path)
+    expect(len(edits or []), 1, "edits in main.spt")
+    fixed = apply_edits(text, edits)
+    expect(fixed.split("\n")[1], '/* 导入 */ import { f } from "lib/helpers.spt";',
+           "import after rename")
+
+
+def case_completion_scope_utf8(server, root):
+    """Completion after non-ASCII text offers the locals of the function under the cursor."""
+    text = ("// " + "中文注释" * 8 + "\n"
+            "void f() {\n"
+            "    int alpha = 1;\n"
+            "    al\n"
+            "}\n"
+            "void g() {\n"
+            "    int beta = 2;\n"
+            "}\n")
+    path = write(root, "a.spt", text)
+    replies = session(server, root, [
+        did_open(path, text),
+        request(1, "textDocument/completion", {"textDocument": {"uri": "file://" + path},
+                                               "position": {"line": 3, "character": 6}}),
+    ])
+    result = response(replies, 1)
+    labels = {item["label"] for item in (result["items"] if "items" in result else result)}
+    expect(("alpha" in labels, "beta" in labels), (True, False), "alpha, beta offered")
+
+
+def case_lexer_ranges(server, root):
+    """Non-ASCII text in strings and comments lexes through the cached range edges."""
+    # The second line is lexed from the range edges the first one cached for ~["\\]
+    # and ~[\r\n] above 127.
+    line = 'print("\u00e9\u00ff\u0080 \u4e2d\u6587 \U0001f600"); // \u6ce8\u91ca \u2211\n'
+    text = "void main() {\n" + ("    " + line) * 2 + "}\nint after(int a){ return a; }\n"
+    path = write(root, "a.spt", text)
+    uri = "file://" + path
+    replies = session(server, root, [
+        did_open(path, text),
+        request(1, "textDocument/documentSymbol", {"textDocument": {"uri": uri}}),
+        Until(lambda replies: lint_codes(replies, uri), "the first publish"),
+    ], options={"speculativePrecompute": False})
+    errors = [d["message"] for reply in replies
+              if reply.get("method") == "textDocument/publishDiagnostics"
+              and reply["params"]["uri"] == uri
+              for d in reply["params"]["diagnostics"] if d.get("source") != "lang-lint"]
+    expect(errors, [], "syntax errors")
+    symbols = [(symbol["name"], symbol["range"]["start"]["line"])
+               for symbol in response(replies, 1)]
+    expect(symbols, [("main", 0), ("after", 4)], "symbols after the literals")
+
+
+def case_lsif_utf8(server, root):
+    """LSIF ranges land on the symbol names after non-ASCII text."""
+    text = ("// " + "中文注释说明，计算函数。" * 6 + "\n"
+            "int calc(int a){ return a; }\n"
+            "void main() { print(calc(2)); }\n")
+    write(root, "a.spt", text)
+    proc = subprocess.run([server, "--export-lsif", "-", "--root", root],
+                          stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, timeout=60,
+                          check=True)
+    lines = text.split("\n")
+    names = set()
+    for line in proc.stdout.decode().splitlines():
+        vertex = json.loads(line)
+        if vertex.get("label") == "range":
+            start, end = vertex["start"], vertex["end"]
+            expect(start["line"], end["line"], "single-line range")
+            names.add((start["line"], lines[start["line"]][start["character"]:end["character"]]))
+    for wanted in [(1, "calc"), (1, "a"), (2, "calc"), (2, "main")]:
+        if wanted not in names:
+            raise AssertionError("missing range %r in %r" % (wanted, sorted(names)))
+
+
+CASES = {name[len("case_"):]: fn for name, fn in globals().items() if name.startswith("case_")}
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__.strip())
+        return 2
+    server = os.path.abspath(argv[1])
+    names = argv[2:] or sorted(CASES)
+    failed = 0
+    for name in names:
+        with tempfile.TemporaryDirectory() as root:
+            try:
+                CASES[name](server, os.path.realpath(root))
+                print("PASS", name)
+            except Exception as error:  # noqa: BLE001 - report every failure
+                failed += 1
+                print("FAIL", name, "-", error)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))